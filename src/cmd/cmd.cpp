@@ -36,6 +36,8 @@
 #include "simplesslerrorhandler.h"
 #include "syncengine.h"
 #include "common/syncjournaldb.h"
+#include "common/syncmetrics.h"
+#include "common/synctrace.h"
 #include "config.h"
 #include "csync_exclude.h"
 
@@ -78,6 +80,8 @@ struct CmdOptions
     bool ignoreHiddenFiles;
     QString exclude;
     QString unsyncedfolders;
+    QString traceFile;
+    QString metricsFile;
     int restartTimes;
     int downlimit;
     int uplimit;
@@ -194,6 +198,8 @@ void help()
     std::cout << "  --version, -v          Display version and exit" << std::endl;
     std::cout << "  --logdebug             More verbose logging" << std::endl;
     std::cout << "  --path                 Path to a folder on a remote server" << std::endl;
+    std::cout << "  --trace file           Write a sync trace, see " APPLICATION_EXECUTABLE "trace" << std::endl;
+    std::cout << "  --metrics-file file    Write the sync performance counters as JSON when done" << std::endl;
     std::cout << "" << std::endl;
     exit(0);
 }
@@ -272,6 +278,10 @@ void parseOptions(const QStringList &app_args, CmdOptions *options)
             Logger::instance()->setLogDebug(true);
         } else if (option == "--path" && !it.peekNext().startsWith("-")) {
             options->remotePath = it.next();
+        } else if (option == "--trace" && !it.peekNext().startsWith("-")) {
+            options->traceFile = it.next();
+        } else if (option == "--metrics-file" && !it.peekNext().startsWith("-")) {
+            options->metricsFile = it.next();
         }
         else {
             help();
@@ -336,6 +346,12 @@ int main(int argc, char **argv)
         qSetMessagePattern("%{time MM-dd hh:mm:ss:zzz} [ %{type} %{category} ]%{if-debug}\t[ %{function} ]%{endif}:\t%{message}");
     }
 
+    if (!options.traceFile.isEmpty()) {
+        SyncTrace::start(options.traceFile);
+    } else {
+        SyncTrace::startFromEnvironment();
+    }
+
     AccountPtr account = Account::create();
 
     if (!account) {
@@ -545,5 +561,9 @@ restart_sync:
         qWarning() << "Another sync is needed, but not done because restart count is exceeded" << restartCount;
     }
 
+    if (!options.metricsFile.isEmpty()) {
+        SyncMetrics::instance()->writeToFile(options.metricsFile);
+    }
+    SyncTrace::stop();
     return resultCode;
 }
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include <iostream>
+#include <QCoreApplication>
+#include <QFile>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QPair>
+
+#include "common/synctrace.h"
+#include "config.h"
+
+using namespace OCC;
+
+namespace {
+
+struct OpenSpan
+{
+    QString name;
+    quint64 timestamp;
+};
+
+using SpanKey = QPair<int, quint64>;
+
+void help()
+{
+    const char *binaryName = APPLICATION_EXECUTABLE "trace";
+
+    std::cout << binaryName << " - converts sync traces written by " APPLICATION_EXECUTABLE "cmd --trace" << std::endl;
+    std::cout << "" << std::endl;
+    std::cout << "Usage: " << binaryName << " [OPTION] <trace_file> [output_file]" << std::endl;
+    std::cout << "" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --chrome               Write the Chrome trace event format (default)" << std::endl;
+    std::cout << "  --folded               Write folded stacks for flamegraph.pl" << std::endl;
+    std::cout << "" << std::endl;
+    exit(0);
+}
+
+QString valueName(SyncTrace::Category category, SyncTrace::Phase phase)
+{
+    if (category == SyncTrace::Http && phase == SyncTrace::End)
+        return QStringLiteral("status");
+    if (category == SyncTrace::Propagation)
+        return QStringLiteral("size");
+    return QString();
+}
+
+bool writeChrome(SyncTraceReader &reader, QFile &out)
+{
+    // End records don't repeat the name of their span
+    QHash<SpanKey, QString> names;
+
+    out.write("{\"traceEvents\":[\n");
+    bool first = true;
+    SyncTraceReader::Event event;
+    while (reader.next(&event)) {
+        const SpanKey key(event.category, event.span);
+        QJsonObject json;
+        json.insert(QStringLiteral("cat"), SyncTraceReader::categoryName(event.category));
+        json.insert(QStringLiteral("ts"), double(event.timestamp));
+        json.insert(QStringLiteral("pid"), 1);
+        json.insert(QStringLiteral("tid"), event.thread);
+
+        QString name = event.name;
+        switch (event.phase) {
+        case SyncTrace::Begin:
+            names.insert(key, name);
+            json.insert(QStringLiteral("ph"), QStringLiteral("b"));
+            json.insert(QStringLiteral("id"), QString::number(event.span, 16));
+            break;
+        case SyncTrace::End:
+            name = names.take(key);
+            json.insert(QStringLiteral("ph"), QStringLiteral("e"));
+            json.insert(QStringLiteral("id"), QString::number(event.span, 16));
+            break;
+        default:
+            json.insert(QStringLiteral("ph"), QStringLiteral("X"));
+            json.insert(QStringLiteral("dur"), double(event.value));
+            break;
+        }
+        json.insert(QStringLiteral("name"), name.isEmpty() ? QStringLiteral("/") : name);
+
+        const auto argName = valueName(event.category, event.phase);
+        if (!argName.isEmpty())
+            json.insert(QStringLiteral("args"), QJsonObject{ { argName, double(event.value) } });
+
+        if (!first)
+            out.write(",\n");
+        first = false;
+        out.write(QJsonDocument(json).toJson(QJsonDocument::Compact));
+    }
+    out.write("\n],\"displayTimeUnit\":\"ms\"}\n");
+    return reader.errorString().isEmpty();
+}
+
+QString parentPath(const QString &path)
+{
+    const int slash = path.lastIndexOf(QLatin1Char('/'));
+    return slash < 0 ? QString() : path.left(slash);
+}
+
+bool writeFolded(SyncTraceReader &reader, QFile &out)
+{
+    QHash<SpanKey, OpenSpan> open;
+    QMap<QString, qint64> stacks;
+    // Discovery jobs run while their sub directories are discovered, so
+    // only the time not spent in the sub directories is their own
+    QHash<QString, qint64> discovery;
+    QHash<QString, qint64> discoveryChildren;
+
+    auto pathStack = [](const QString &category, const QString &path) {
+        return path.isEmpty() ? category : category + QLatin1Char(';') + QString(path).replace(QLatin1Char('/'), QLatin1Char(';'));
+    };
+
+    SyncTraceReader::Event event;
+    while (reader.next(&event)) {
+        const SpanKey key(event.category, event.span);
+        if (event.phase == SyncTrace::Begin) {
+            open.insert(key, { event.name, event.timestamp });
+            continue;
+        }
+
+        QString name = event.name;
+        qint64 duration = event.value;
+        if (event.phase == SyncTrace::End) {
+            if (!open.contains(key))
+                continue;
+            const auto span = open.take(key);
+            name = span.name;
+            duration = qint64(event.timestamp - span.timestamp);
+        }
+
+        const auto category = SyncTraceReader::categoryName(event.category);
+        switch (event.category) {
+        case SyncTrace::Discovery:
+            discovery[name] += duration;
+            if (!name.isEmpty())
+                discoveryChildren[parentPath(name)] += duration;
+            break;
+        case SyncTrace::Propagation:
+            stacks[pathStack(category, name)] += duration;
+            break;
+        case SyncTrace::Http:
+            // Group by verb, the urls are too diverse
+            stacks[category + QLatin1Char(';') + name.section(QLatin1Char(' '), 0, 0)] += duration;
+            break;
+        default:
+            stacks[category + QLatin1Char(';') + name] += duration;
+            break;
+        }
+    }
+
+    for (auto it = discovery.cbegin(); it != discovery.cend(); ++it) {
+        const auto self = qMax<qint64>(0, it.value() - discoveryChildren.value(it.key()));
+        stacks[pathStack(SyncTraceReader::categoryName(SyncTrace::Discovery), it.key())] += self;
+    }
+
+    for (auto it = stacks.cbegin(); it != stacks.cend(); ++it) {
+        if (it.value() > 0)
+            out.write(it.key().toUtf8() + ' ' + QByteArray::number(it.value()) + '\n');
+    }
+    return reader.errorString().isEmpty();
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    bool folded = false;
+    QStringList files;
+    const auto args = app.arguments().mid(1);
+    for (const auto &arg : args) {
+        if (arg == QLatin1String("--chrome")) {
+            folded = false;
+        } else if (arg == QLatin1String("--folded")) {
+            folded = true;
+        } else if (arg.startsWith(QLatin1Char('-'))) {
+            help();
+        } else {
+            files.append(arg);
+        }
+    }
+    if (files.isEmpty() || files.size() > 2)
+        help();
+
+    SyncTraceReader reader;
+    if (!reader.open(files.at(0))) {
+        std::cerr << "Could not read " << qPrintable(files.at(0)) << ": " << qPrintable(reader.errorString()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    QFile out;
+    bool opened = false;
+    if (files.size() == 2) {
+        out.setFileName(files.at(1));
+        opened = out.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    } else {
+        opened = out.open(stdout, QIODevice::WriteOnly);
+    }
+    if (!opened) {
+        std::cerr << "Could not write " << qPrintable(out.fileName()) << ": " << qPrintable(out.errorString()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!(folded ? writeFolded(reader, out) : writeChrome(reader, out))) {
+        std::cerr << "Trace is damaged: " << qPrintable(reader.errorString()) << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -19,11 +19,14 @@
 #include "filesystembase.h"
 #include "common/checksums.h"
 #include "asserts.h"
+#include "syncmetrics.h"
 
 #include <QLoggingCategory>
 #include <qtconcurrentrun.h>
 #include <QCryptographicHash>
 
+#include <chrono>
+
 #ifdef ZLIB_FOUND
 #include <zlib.h>
 #endif
@@ -280,13 +283,8 @@ QByteArray ComputeChecksum::computeNowOnFile(const QString &filePath, const QByt
     return computeNow(&file, checksumType);
 }
 
-QByteArray ComputeChecksum::computeNow(QIODevice *device, const QByteArray &checksumType)
+static QByteArray computeChecksumNow(QIODevice *device, const QByteArray &checksumType)
 {
-    if (!checksumComputationEnabled()) {
-        qCWarning(lcChecksums) << "Checksum computation disabled by environment variable";
-        return QByteArray();
-    }
-
     if (checksumType == checkSumMD5C) {
         return calcMd5(device);
     } else if (checksumType == checkSumSHA1C) {
@@ -311,6 +309,24 @@ QByteArray ComputeChecksum::computeNow(QIODevice *device, const QByteArray &chec
     return QByteArray();
 }
 
+QByteArray ComputeChecksum::computeNow(QIODevice *device, const QByteArray &checksumType)
+{
+    if (!checksumComputationEnabled()) {
+        qCWarning(lcChecksums) << "Checksum computation disabled by environment variable";
+        return QByteArray();
+    }
+
+    static auto throughput = SyncMetrics::instance()->rate(QStringLiteral("checksum.bytes"));
+    const auto start = std::chrono::steady_clock::now();
+    const auto startPos = device->pos();
+    const auto checksum = computeChecksumNow(device, checksumType);
+    if (!checksum.isEmpty()) {
+        throughput->add(device->pos() - startPos,
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+    return checksum;
+}
+
 void ComputeChecksum::slotCalculationDone()
 {
     QByteArray checksum = _watcher.future().result();
@@ -18,11 +18,13 @@
 
 #include <QCryptographicHash>
 #include <QFile>
+#include <QFileInfo>
 #include <QLoggingCategory>
 #include <QStringList>
 #include <QElapsedTimer>
 #include <QUrl>
 #include <QDir>
+#include <QThread>
 #include <sqlite3.h>
 #include <cstring>
 
@@ -32,6 +34,8 @@
 #include "common/asserts.h"
 #include "common/checksums.h"
 #include "common/preparedsqlquerymanager.h"
+#include "common/syncmetrics.h"
+#include "common/synctrace.h"
 
 #include "common/c_jhash.h"
 
@@ -46,12 +50,39 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcDb, "nextcloud.sync.database", QtInfoMsg)
 
+static SyncMetrics::Histogram *journalQueryLatency()
+{
+    static auto histogram = SyncMetrics::instance()->histogram(QStringLiteral("journal.query_us"));
+    return histogram;
+}
+
+static SyncMetrics::Histogram *journalCommitLatency()
+{
+    static auto histogram = SyncMetrics::instance()->histogram(QStringLiteral("journal.commit_us"));
+    return histogram;
+}
+
 #define GET_FILE_RECORD_QUERY \
         "SELECT path, inode, modtime, type, md5, fileid, remotePerm, filesize," \
         "  ignoredChildrenRemote, contentchecksumtype.name || ':' || contentChecksum, e2eMangledName, isE2eEncrypted " \
         " FROM metadata" \
         "  LEFT JOIN checksumtype as contentchecksumtype ON metadata.contentChecksumTypeId == contentchecksumtype.id"
 
+// Queries shared by SyncJournalDb and SyncJournalReader
+#define GET_FILE_RECORD_BY_PHASH_QUERY GET_FILE_RECORD_QUERY " WHERE phash=?1"
+#define GET_FILE_RECORD_BY_INODE_QUERY GET_FILE_RECORD_QUERY " WHERE inode=?1"
+#define GET_ALL_FILES_QUERY GET_FILE_RECORD_QUERY " ORDER BY path||'/' ASC"
+#define GET_FILES_BELOW_PATH_QUERY \
+    GET_FILE_RECORD_QUERY " WHERE " IS_PREFIX_PATH_OF("?1", "path") \
+                          " OR " IS_PREFIX_PATH_OF("?1", "e2eMangledName") \
+                          /* We want to ensure that the contents of a directory are sorted */ \
+                          /* directly behind the directory itself. Without this ORDER BY */ \
+                          /* an ordering like foo, foo-2, foo/file would be returned. */ \
+                          /* With the trailing /, we get foo-2, foo, foo/file. This property */ \
+                          /* is used in fill_tree_from_db(). */ \
+                          " ORDER BY path||'/' ASC"
+#define LIST_FILES_IN_PATH_QUERY GET_FILE_RECORD_QUERY " WHERE parent = ?1 ORDER BY path||'/' ASC"
+
 static void fillFileRecordFromGetQuery(SyncJournalFileRecord &rec, SqlQuery &query)
 {
     rec._path = query.baValue(0);
@@ -68,6 +99,111 @@ static void fillFileRecordFromGetQuery(SyncJournalFileRecord &rec, SqlQuery &que
     rec._isE2eEncrypted = query.intValue(11) > 0;
 }
 
+// Runs the prepared and bound query and passes each row to rowCallback
+static bool forEachFileRecord(SqlQuery &query, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
+{
+    if (!query.exec()) {
+        return false;
+    }
+
+    forever {
+        auto next = query.next();
+        if (!next.ok)
+            return false;
+        if (!next.hasData)
+            break;
+
+        SyncJournalFileRecord rec;
+        fillFileRecordFromGetQuery(rec, query);
+        rowCallback(rec);
+    }
+    return true;
+}
+
+static bool getFilesBelowPathImpl(PreparedSqlQueryManager &queryManager, SqlDatabase &db,
+    const QByteArray &path, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
+{
+    if (path.isEmpty()) {
+        // Since the path column doesn't store the starting /, the getFilesBelowPathQuery
+        // can't be used for the root path "". It would scan for (path > '/' and path < '0')
+        // and find nothing. So, unfortunately, we have to use a different query for
+        // retrieving the whole tree.
+
+        const auto query = queryManager.get(PreparedSqlQueryManager::GetAllFilesQuery, QByteArrayLiteral(GET_ALL_FILES_QUERY), db);
+        if (!query) {
+            return false;
+        }
+        return forEachFileRecord(*query, rowCallback);
+    } else {
+        // This query is used to skip discovery and fill the tree from the
+        // database instead
+        const auto query = queryManager.get(PreparedSqlQueryManager::GetFilesBelowPathQuery, QByteArrayLiteral(GET_FILES_BELOW_PATH_QUERY), db);
+        if (!query) {
+            return false;
+        }
+        query->bindValue(1, path);
+        return forEachFileRecord(*query, rowCallback);
+    }
+}
+
+static bool listFilesInPathImpl(PreparedSqlQueryManager &queryManager, SqlDatabase &db,
+    const QByteArray &path, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
+{
+    const auto query = queryManager.get(PreparedSqlQueryManager::ListFilesInPathQuery, QByteArrayLiteral(LIST_FILES_IN_PATH_QUERY), db);
+    if (!query) {
+        return false;
+    }
+    query->bindValue(1, SyncJournalDb::getPHash(path));
+
+    return forEachFileRecord(*query, [&](const SyncJournalFileRecord &rec) {
+        if (!rec._path.startsWith(path) || rec._path.indexOf("/", path.size() + 1) > 0) {
+            qWarning(lcDb) << "hash collision" << path << rec.path();
+            return;
+        }
+        rowCallback(rec);
+    });
+}
+
+// The phash of the parent directory of a path, the value of the parent column
+static qint64 getParentPHash(const QByteArray &path)
+{
+    const int slash = path.lastIndexOf('/');
+    return SyncJournalDb::getPHash(slash == -1 ? QByteArray() : path.left(slash));
+}
+
+// SQL function returning the phash of the parent directory of a path
+static void registerParentHashFunction(SqlDatabase &db)
+{
+    sqlite3_create_function(db.sqliteDb(), "parent_hash", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr,
+                                [] (sqlite3_context *ctx,int, sqlite3_value **argv) {
+                                    auto text = reinterpret_cast<const char*>(sqlite3_value_text(argv[0]));
+                                    const char *end = std::strrchr(text, '/');
+                                    if (!end) end = text;
+                                    sqlite3_result_int64(ctx, c_jhash64(reinterpret_cast<const uint8_t*>(text),
+                                                                        end - text, 0));
+                                }, nullptr, nullptr);
+}
+
+// Runs the pragma to completion and returns the first value it reports
+static qint64 runPragma(SqlDatabase &db, const QByteArray &sql)
+{
+    SqlQuery query(db);
+    if (query.prepare(sql, true) != SQLITE_OK || !query.exec()) {
+        qCWarning(lcDb) << "Failed to run" << sql << query.error();
+        return 0;
+    }
+    qint64 value = 0;
+    auto next = query.next();
+    if (next.ok && next.hasData)
+        value = static_cast<qint64>(query.int64Value(0));
+    // Some pragmas, like incremental_vacuum, do their work step by step
+    while (next.ok && next.hasData)
+        next = query.next();
+    if (!next.ok)
+        qCWarning(lcDb) << "Failed to run" << sql << query.error();
+    return value;
+}
+
 static QByteArray defaultJournalMode(const QString &dbPath)
 {
 #if defined(Q_OS_WIN)
@@ -102,6 +238,15 @@ SyncJournalDb::SyncJournalDb(const QString &dbFilePath, QObject *parent)
     if (_journalMode.isEmpty()) {
         _journalMode = defaultJournalMode(_dbFile);
     }
+
+    static QByteArray envLockingMode = qgetenv("OWNCLOUD_SQLITE_LOCKING_MODE");
+    _lockingMode = envLockingMode;
+    if (_lockingMode.isEmpty()) {
+        _lockingMode = "EXCLUSIVE";
+    }
+
+    static const qint64 envWalSizeLimit = qgetenv("OWNCLOUD_SQLITE_WAL_SIZE_LIMIT").toLongLong();
+    _walSizeLimit = envWalSizeLimit > 0 ? envWalSizeLimit : 64 * 1024 * 1024;
 }
 
 QString SyncJournalDb::makeDbName(const QString &localPath,
@@ -214,11 +359,69 @@ void SyncJournalDb::walCheckpoint()
 {
     QElapsedTimer t;
     t.start();
-    SqlQuery pragma1(_db);
-    pragma1.prepare("PRAGMA wal_checkpoint(FULL);");
-    if (pragma1.exec()) {
-        qCDebug(lcDb) << "took" << t.elapsed() << "msec";
+    runPragma(_db, "PRAGMA wal_checkpoint(FULL);");
+    qCDebug(lcDb) << "took" << t.elapsed() << "msec";
+}
+
+SyncJournalDb::DatabaseStats SyncJournalDb::databaseStats()
+{
+    QMutexLocker locker(&_mutex);
+
+    DatabaseStats stats;
+    if (!checkConnect())
+        return stats;
+
+    stats.pageSize = runPragma(_db, "PRAGMA page_size;");
+    stats.pageCount = runPragma(_db, "PRAGMA page_count;");
+    stats.freePages = runPragma(_db, "PRAGMA freelist_count;");
+    stats.incrementalVacuum = runPragma(_db, "PRAGMA auto_vacuum;") == 2;
+    stats.walSize = QFileInfo(_dbFile + QStringLiteral("-wal")).size();
+    return stats;
+}
+
+SyncJournalDb::DatabaseStats SyncJournalDb::performMaintenance()
+{
+    QMutexLocker locker(&_mutex);
+
+    if (!checkConnect())
+        return {};
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Checkpoints only cover committed changes and VACUUM can't run in a transaction
+    commitTransaction();
+
+    runPragma(_db, "PRAGMA optimize;");
+
+    auto stats = databaseStats();
+    if (!stats.incrementalVacuum) {
+        // Journals created before incremental vacuum was enabled in checkConnect()
+        // need one full VACUUM to switch, afterwards the free pages are
+        // reclaimed incrementally.
+        qCInfo(lcDb) << "Enabling incremental vacuum for" << _dbFile << "with" << stats.pageCount << "pages";
+        SqlQuery vacuum(_db);
+        if (vacuum.prepare("VACUUM;", true) != SQLITE_OK || !vacuum.exec())
+            qCWarning(lcDb) << "VACUUM failed:" << vacuum.error();
+    } else if (stats.freePages > 0) {
+        runPragma(_db, "PRAGMA incremental_vacuum;");
+    }
+
+    // A passive checkpoint doesn't wait for readers. When the log grew beyond
+    // its limit, wait for them so it can be truncated.
+    stats = databaseStats();
+    if (stats.walSize > _walSizeLimit) {
+        runPragma(_db, "PRAGMA wal_checkpoint(TRUNCATE);");
+    } else {
+        runPragma(_db, "PRAGMA wal_checkpoint(PASSIVE);");
     }
+
+    stats = databaseStats();
+    qCInfo(lcDb) << "Maintenance of" << _dbFile << "took" << timer.elapsed() << "msec:"
+                 << stats.pageCount << "pages of" << stats.pageSize << "bytes,"
+                 << stats.freePages << "free (" << qRound(stats.fragmentation() * 100) << "% ),"
+                 << "WAL" << stats.walSize << "bytes";
+    return stats;
 }
 
 void SyncJournalDb::startTransaction()
@@ -229,6 +432,7 @@ void SyncJournalDb::startTransaction()
             return;
         }
         _transaction = 1;
+        _committedChanges = sqlite3_total_changes(_db.sqliteDb());
     } else {
         qCDebug(lcDb) << "Database Transaction is running, not starting another one!";
     }
@@ -302,11 +506,7 @@ bool SyncJournalDb::checkConnect()
         qCInfo(lcDb) << "sqlite3 version" << pragma1.stringValue(0);
     }
 
-    // Set locking mode to avoid issues with WAL on Windows
-    static QByteArray locking_mode_env = qgetenv("OWNCLOUD_SQLITE_LOCKING_MODE");
-    if (locking_mode_env.isEmpty())
-        locking_mode_env = "EXCLUSIVE";
-    pragma1.prepare("PRAGMA locking_mode=" + locking_mode_env + ";");
+    pragma1.prepare("PRAGMA locking_mode=" + _lockingMode + ";");
     if (!pragma1.exec()) {
         return sqlFail(QStringLiteral("Set PRAGMA locking_mode"), pragma1);
     } else {
@@ -314,6 +514,14 @@ bool SyncJournalDb::checkConnect()
         qCInfo(lcDb) << "sqlite3 locking_mode=" << pragma1.stringValue(0);
     }
 
+    // Only takes effect for new databases, performMaintenance() converts old ones.
+    // Must come before the journal_mode, switching to WAL writes the header.
+    pragma1.prepare("PRAGMA auto_vacuum = INCREMENTAL;");
+    if (!pragma1.exec()) {
+        return sqlFail(QStringLiteral("Set PRAGMA auto_vacuum"), pragma1);
+    }
+    pragma1.next();
+
     pragma1.prepare("PRAGMA journal_mode=" + _journalMode + ";");
     if (!pragma1.exec()) {
         return sqlFail(QStringLiteral("Set PRAGMA journal_mode"), pragma1);
@@ -344,19 +552,19 @@ bool SyncJournalDb::checkConnect()
         qCInfo(lcDb) << "sqlite3 synchronous=" << synchronousMode;
     }
 
+    // Lets sqlite shrink the write-ahead log to the limit after checkpoints
+    pragma1.prepare("PRAGMA journal_size_limit = " + QByteArray::number(_walSizeLimit) + ";");
+    if (!pragma1.exec()) {
+        return sqlFail(QStringLiteral("Set PRAGMA journal_size_limit"), pragma1);
+    }
+    pragma1.next();
+
     pragma1.prepare("PRAGMA case_sensitive_like = ON;");
     if (!pragma1.exec()) {
         return sqlFail(QStringLiteral("Set PRAGMA case_sensitivity"), pragma1);
     }
 
-    sqlite3_create_function(_db.sqliteDb(), "parent_hash", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr,
-                                [] (sqlite3_context *ctx,int, sqlite3_value **argv) {
-                                    auto text = reinterpret_cast<const char*>(sqlite3_value_text(argv[0]));
-                                    const char *end = std::strrchr(text, '/');
-                                    if (!end) end = text;
-                                    sqlite3_result_int64(ctx, c_jhash64(reinterpret_cast<const uint8_t*>(text),
-                                                                        end - text, 0));
-                                }, nullptr, nullptr);
+    registerParentHashFunction(_db);
 
     /* Because insert is so slow, we do everything in a transaction, and only need one call to commit */
     startTransaction();
@@ -380,6 +588,9 @@ bool SyncJournalDb::checkConnect()
                         // ignoredChildrenRemote
                         // contentChecksum
                         // contentChecksumTypeId
+                        // e2eMangledName
+                        // isE2eEncrypted
+                        // parent
                         "PRIMARY KEY(phash)"
                         ");");
 
@@ -631,6 +842,14 @@ void SyncJournalDb::close()
     qCInfo(lcDb) << "Closing DB" << _dbFile;
 
     commitTransaction();
+    _committedChanges = -1;
+
+    {
+        // Leased readers get dropped when they're returned
+        QMutexLocker readerLocker(&_readerMutex);
+        _idleReaders.clear();
+        ++_readerGeneration;
+    }
 
     _db.close();
     clearEtagStorageFilter();
@@ -712,13 +931,45 @@ bool SyncJournalDb::updateMetadataTableStructure()
         commitInternal(QStringLiteral("update database structure: add path index"));
     }
 
+    if (!columns.contains("parent")) {
+        // Schema v2: children are found by the phash of their parent instead of
+        // an index over parent_hash(path)
+        SqlQuery query(_db);
+        query.prepare("ALTER TABLE metadata ADD COLUMN parent INTEGER(8);");
+        if (!query.exec()) {
+            sqlFail(QStringLiteral("updateMetadataTableStructure: add parent column"), query);
+            re = false;
+        }
+        query.prepare("UPDATE metadata SET parent = parent_hash(path);");
+        if (!query.exec()) {
+            sqlFail(QStringLiteral("updateMetadataTableStructure: migrate to parent column"), query);
+            re = false;
+        }
+        commitInternal(QStringLiteral("update database structure: add parent col"));
+    } else {
+        // Clients older than schema v2 leave the column empty in the rows they
+        // write, the children queries wouldn't find those rows
+        SqlQuery query(_db);
+        query.prepare("UPDATE metadata SET parent = parent_hash(path) WHERE parent IS NULL;");
+        if (!query.exec()) {
+            sqlFail(QStringLiteral("updateMetadataTableStructure: fill empty parent column"), query);
+            re = false;
+        }
+        commitInternal(QStringLiteral("update database structure: fill empty parent col"));
+    }
+
     if (true) {
         SqlQuery query(_db);
-        query.prepare("CREATE INDEX IF NOT EXISTS metadata_parent ON metadata(parent_hash(path));");
+        query.prepare("CREATE INDEX IF NOT EXISTS metadata_parent_id ON metadata(parent);");
         if (!query.exec()) {
             sqlFail(QStringLiteral("updateMetadataTableStructure: create index parent"), query);
             re = false;
         }
+        query.prepare("DROP INDEX IF EXISTS metadata_parent;");
+        if (!query.exec()) {
+            sqlFail(QStringLiteral("updateMetadataTableStructure: drop index parent_hash"), query);
+            re = false;
+        }
         commitInternal(QStringLiteral("update database structure: add parent index"));
     }
 
@@ -900,6 +1151,8 @@ qint64 SyncJournalDb::getPHash(const QByteArray &file)
 
 Result<void, QString> SyncJournalDb::setFileRecord(const SyncJournalFileRecord &_record)
 {
+    SyncTrace::Scope trace(SyncTrace::Journal, "setFileRecord");
+    SyncMetrics::ScopedTimer timer(journalQueryLatency());
     SyncJournalFileRecord record = _record;
     QMutexLocker locker(&_mutex);
 
@@ -937,8 +1190,8 @@ Result<void, QString> SyncJournalDb::setFileRecord(const SyncJournalFileRecord &
         int contentChecksumTypeId = mapChecksumType(checksumType);
 
         const auto query = _queryManager.get(PreparedSqlQueryManager::SetFileRecordQuery, QByteArrayLiteral("INSERT OR REPLACE INTO metadata "
-                                                                                                            "(phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5, fileid, remotePerm, filesize, ignoredChildrenRemote, contentChecksum, contentChecksumTypeId, e2eMangledName, isE2eEncrypted) "
-                                                                                                            "VALUES (?1 , ?2, ?3 , ?4 , ?5 , ?6 , ?7,  ?8 , ?9 , ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17, ?18);"),
+                                                                                                            "(phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5, fileid, remotePerm, filesize, ignoredChildrenRemote, contentChecksum, contentChecksumTypeId, e2eMangledName, isE2eEncrypted, parent) "
+                                                                                                            "VALUES (?1 , ?2, ?3 , ?4 , ?5 , ?6 , ?7,  ?8 , ?9 , ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17, ?18, ?19);"),
             _db);
         if (!query) {
             return query->error();
@@ -962,6 +1215,7 @@ Result<void, QString> SyncJournalDb::setFileRecord(const SyncJournalFileRecord &
         query->bindValue(16, contentChecksumTypeId);
         query->bindValue(17, record._e2eMangledName);
         query->bindValue(18, record._isE2eEncrypted);
+        query->bindValue(19, getParentPHash(record._path));
 
         if (!query->exec()) {
             return query->error();
@@ -1094,6 +1348,13 @@ bool SyncJournalDb::deleteFileRecord(const QString &filename, bool recursively)
 
 bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec)
 {
+    SyncTrace::Scope trace(SyncTrace::Journal, "getFileRecord");
+    SyncMetrics::ScopedTimer timer(journalQueryLatency());
+    if (auto reader = leaseReader()) {
+        if (reader->getFileRecord(filename, rec))
+            return true;
+    }
+
     QMutexLocker locker(&_mutex);
 
     // Reset the output var in case the caller is reusing it.
@@ -1108,7 +1369,7 @@ bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRec
         return false;
 
     if (!filename.isEmpty()) {
-        const auto query = _queryManager.get(PreparedSqlQueryManager::GetFileRecordQuery, QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE phash=?1"), _db);
+        const auto query = _queryManager.get(PreparedSqlQueryManager::GetFileRecordQuery, QByteArrayLiteral(GET_FILE_RECORD_BY_PHASH_QUERY), _db);
         if (!query) {
             return false;
         }
@@ -1134,6 +1395,32 @@ bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRec
     return true;
 }
 
+void SyncJournalDb::enableReadOnlyConnections()
+{
+    QMutexLocker locker(&_mutex);
+    if (_db.isOpen()) {
+        qCWarning(lcDb) << "Read-only connections must be enabled before opening" << _dbFile;
+        return;
+    }
+
+#if defined(Q_OS_WIN)
+    // Avoid issues with WAL on Windows, keep the exclusive lock
+#else
+    // With WAL the NORMAL locking mode allows read-only connections
+    if (qEnvironmentVariableIsEmpty("OWNCLOUD_SQLITE_LOCKING_MODE")
+        && _journalMode.compare("WAL", Qt::CaseInsensitive) == 0) {
+        _lockingMode = "NORMAL";
+    }
+#endif
+}
+
+bool SyncJournalDb::allowsReadOnlyConnections()
+{
+    QMutexLocker locker(&_mutex);
+    return _journalMode.compare("WAL", Qt::CaseInsensitive) == 0
+        && _lockingMode.compare("NORMAL", Qt::CaseInsensitive) == 0;
+}
+
 bool SyncJournalDb::getFileRecordByE2eMangledName(const QString &mangledName, SyncJournalFileRecord *rec)
 {
     QMutexLocker locker(&_mutex);
@@ -1180,6 +1467,13 @@ bool SyncJournalDb::getFileRecordByE2eMangledName(const QString &mangledName, Sy
 
 bool SyncJournalDb::getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec)
 {
+    SyncTrace::Scope trace(SyncTrace::Journal, "getFileRecordByInode");
+    SyncMetrics::ScopedTimer timer(journalQueryLatency());
+    if (auto reader = leaseReader()) {
+        if (reader->getFileRecordByInode(inode, rec))
+            return true;
+    }
+
     QMutexLocker locker(&_mutex);
 
     // Reset the output var in case the caller is reusing it.
@@ -1192,7 +1486,7 @@ bool SyncJournalDb::getFileRecordByInode(quint64 inode, SyncJournalFileRecord *r
 
     if (!checkConnect())
         return false;
-    const auto query = _queryManager.get(PreparedSqlQueryManager::GetFileRecordQueryByInode, QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE inode=?1"), _db);
+    const auto query = _queryManager.get(PreparedSqlQueryManager::GetFileRecordQueryByInode, QByteArrayLiteral(GET_FILE_RECORD_BY_INODE_QUERY), _db);
     if (!query)
         return false;
 
@@ -1245,82 +1539,26 @@ bool SyncJournalDb::getFileRecordsByFileId(const QByteArray &fileId, const std::
     return true;
 }
 
-bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback)
+bool SyncJournalDb::getFileRecordsByNumericFileId(qint64 numericFileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
 {
     QMutexLocker locker(&_mutex);
 
-    if (_metadataTableIsEmpty)
+    if (numericFileId <= 0 || _metadataTableIsEmpty)
         return true; // no error, yet nothing found
 
     if (!checkConnect())
         return false;
 
-    auto _exec = [&rowCallback](SqlQuery &query) {
-        if (!query.exec()) {
-            return false;
-        }
-
-        forever {
-            auto next = query.next();
-            if (!next.ok)
-                return false;
-            if (!next.hasData)
-                break;
-
-            SyncJournalFileRecord rec;
-            fillFileRecordFromGetQuery(rec, query);
-            rowCallback(rec);
-        }
-        return true;
-    };
-
-    if(path.isEmpty()) {
-        // Since the path column doesn't store the starting /, the getFilesBelowPathQuery
-        // can't be used for the root path "". It would scan for (path > '/' and path < '0')
-        // and find nothing. So, unfortunately, we have to use a different query for
-        // retrieving the whole tree.
-
-        const auto query = _queryManager.get(PreparedSqlQueryManager::GetAllFilesQuery, QByteArrayLiteral(GET_FILE_RECORD_QUERY " ORDER BY path||'/' ASC"), _db);
-        if (!query) {
-            return false;
-        }
-        return _exec(*query);
-    } else {
-        // This query is used to skip discovery and fill the tree from the
-        // database instead
-        const auto query = _queryManager.get(PreparedSqlQueryManager::GetFilesBelowPathQuery, QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE " IS_PREFIX_PATH_OF("?1", "path")
-                                                                                                                " OR " IS_PREFIX_PATH_OF("?1", "e2eMangledName")
-                                                                                                                // We want to ensure that the contents of a directory are sorted
-                                                                                                                // directly behind the directory itself. Without this ORDER BY
-                                                                                                                // an ordering like foo, foo-2, foo/file would be returned.
-                                                                                                                // With the trailing /, we get foo-2, foo, foo/file. This property
-                                                                                                                // is used in fill_tree_from_db().
-                                                                                                                " ORDER BY path||'/' ASC"),
-            _db);
-        if (!query) {
-            return false;
-        }
-        query->bindValue(1, path);
-        return _exec(*query);
-    }
-}
-
-bool SyncJournalDb::listFilesInPath(const QByteArray& path,
-                                    const std::function<void (const SyncJournalFileRecord &)>& rowCallback)
-{
-    QMutexLocker locker(&_mutex);
-
-    if (_metadataTableIsEmpty)
-        return true;
-
-    if (!checkConnect())
-        return false;
-
-    const auto query = _queryManager.get(PreparedSqlQueryManager::ListFilesInPathQuery, QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE parent_hash(path) = ?1 ORDER BY path||'/' ASC"), _db);
+    // The fileid column contains the oc:id: the numeric id padded to at least
+    // eight digits followed by the instance id. With case_sensitive_like the
+    // prefix match can use the metadata_file_id index.
+    const auto prefix = QByteArray::number(numericFileId).rightJustified(8, '0');
+    const auto query = _queryManager.get(PreparedSqlQueryManager::GetFileRecordQueryByNumericFileId, QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE fileid LIKE ?1"), _db);
     if (!query) {
         return false;
     }
-    query->bindValue(1, getPHash(path));
+
+    query->bindValue(1, QByteArray(prefix + '%'));
 
     if (!query->exec())
         return false;
@@ -1334,16 +1572,68 @@ bool SyncJournalDb::listFilesInPath(const QByteArray& path,
 
         SyncJournalFileRecord rec;
         fillFileRecordFromGetQuery(rec, *query);
-        if (!rec._path.startsWith(path) || rec._path.indexOf("/", path.size() + 1) > 0) {
-            qWarning(lcDb) << "hash collision" << path << rec.path();
+        // The prefix alone also matches longer ids, like 1234567890 for 123456789
+        if (rec.numericFileId() != prefix)
             continue;
-        }
         rowCallback(rec);
     }
 
     return true;
 }
 
+bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback)
+{
+    SyncTrace::Scope trace(SyncTrace::Journal, "getFilesBelowPath");
+    SyncMetrics::ScopedTimer timer(journalQueryLatency());
+    if (auto reader = leaseReader()) {
+        // Only fall back if nothing was reported yet
+        bool gotRows = false;
+        const bool ok = reader->getFilesBelowPath(path, [&](const SyncJournalFileRecord &rec) {
+            gotRows = true;
+            rowCallback(rec);
+        });
+        if (ok || gotRows)
+            return ok;
+    }
+
+    QMutexLocker locker(&_mutex);
+
+    if (_metadataTableIsEmpty)
+        return true; // no error, yet nothing found
+
+    if (!checkConnect())
+        return false;
+
+    return getFilesBelowPathImpl(_queryManager, _db, path, rowCallback);
+}
+
+bool SyncJournalDb::listFilesInPath(const QByteArray& path,
+                                    const std::function<void (const SyncJournalFileRecord &)>& rowCallback)
+{
+    SyncTrace::Scope trace(SyncTrace::Journal, "listFilesInPath");
+    SyncMetrics::ScopedTimer timer(journalQueryLatency());
+    if (auto reader = leaseReader()) {
+        // Only fall back if nothing was reported yet
+        bool gotRows = false;
+        const bool ok = reader->listFilesInPath(path, [&](const SyncJournalFileRecord &rec) {
+            gotRows = true;
+            rowCallback(rec);
+        });
+        if (ok || gotRows)
+            return ok;
+    }
+
+    QMutexLocker locker(&_mutex);
+
+    if (_metadataTableIsEmpty)
+        return true;
+
+    if (!checkConnect())
+        return false;
+
+    return listFilesInPathImpl(_queryManager, _db, path, rowCallback);
+}
+
 int SyncJournalDb::getFileRecordCount()
 {
     QMutexLocker locker(&_mutex);
@@ -2457,6 +2747,8 @@ bool SyncJournalDb::isOpen()
 
 void SyncJournalDb::commitInternal(const QString &context, bool startTrans)
 {
+    SyncTrace::Scope trace(SyncTrace::Journal, "commit");
+    SyncMetrics::ScopedTimer timer(journalCommitLatency());
     qCDebug(lcDb) << "Transaction commit" << context << (startTrans ? "and starting new transaction" : "");
     commitTransaction();
 
@@ -2465,11 +2757,197 @@ void SyncJournalDb::commitInternal(const QString &context, bool startTrans)
     }
 }
 
+class SyncJournalDb::ReaderLease
+{
+public:
+    ReaderLease() = default;
+    ReaderLease(SyncJournalDb *db, std::unique_ptr<SyncJournalReader> reader, int generation)
+        : _db(db)
+        , _reader(std::move(reader))
+        , _generation(generation)
+    {
+    }
+    ReaderLease(ReaderLease &&other) = default;
+    ~ReaderLease()
+    {
+        if (_reader)
+            _db->returnReader(std::move(_reader), _generation);
+    }
+
+    explicit operator bool() const { return _reader != nullptr; }
+    SyncJournalReader *operator->() const { return _reader.get(); }
+
+private:
+    Q_DISABLE_COPY(ReaderLease)
+
+    SyncJournalDb *_db = nullptr;
+    std::unique_ptr<SyncJournalReader> _reader;
+    int _generation = 0;
+};
+
+SyncJournalDb::ReaderLease SyncJournalDb::leaseReader()
+{
+    // The maximum number of read-only connections per journal
+    static const int maxReaders = qBound(1, QThread::idealThreadCount(), 4);
+
+    {
+        QMutexLocker locker(&_mutex);
+        // Readers only see committed data. Anything written in the open transaction
+        // must be read through the main connection. Without one, writes autocommit.
+        if (!_db.isOpen() || _metadataTableIsEmpty || !allowsReadOnlyConnections()
+            || (_transaction == 1 && sqlite3_total_changes(_db.sqliteDb()) != _committedChanges)) {
+            return {};
+        }
+    }
+
+    QMutexLocker readerLocker(&_readerMutex);
+    std::unique_ptr<SyncJournalReader> reader;
+    if (!_idleReaders.empty()) {
+        reader = std::move(_idleReaders.back());
+        _idleReaders.pop_back();
+    } else if (_leasedReaders < maxReaders) {
+        reader.reset(new SyncJournalReader(_dbFile));
+    } else {
+        return {};
+    }
+    ++_leasedReaders;
+    return ReaderLease(this, std::move(reader), _readerGeneration);
+}
+
+void SyncJournalDb::returnReader(std::unique_ptr<SyncJournalReader> reader, int generation)
+{
+    QMutexLocker readerLocker(&_readerMutex);
+    --_leasedReaders;
+    if (generation == _readerGeneration)
+        _idleReaders.push_back(std::move(reader));
+}
+
 SyncJournalDb::~SyncJournalDb()
 {
     close();
 }
 
+SyncJournalReader::SyncJournalReader(const QString &dbFilePath)
+    : _dbFile(dbFilePath)
+{
+}
+
+SyncJournalReader::~SyncJournalReader() = default;
+
+bool SyncJournalReader::checkConnect()
+{
+    if (_db.isOpen()) {
+        if (!QFile::exists(_dbFile)) {
+            qCWarning(lcDb) << "Read-only database open, but file" << _dbFile << "does not exist";
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // Never create the database, that's up to SyncJournalDb
+    if (!QFile::exists(_dbFile)) {
+        return false;
+    }
+
+    if (!_db.openReadOnly(_dbFile)) {
+        qCWarning(lcDb) << "Error opening the db read-only:" << _db.error();
+        return false;
+    }
+    registerParentHashFunction(_db);
+    return true;
+}
+
+bool SyncJournalReader::getFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec)
+{
+    // Reset the output var in case the caller is reusing it.
+    Q_ASSERT(rec);
+    rec->_path.clear();
+    Q_ASSERT(!rec->isValid());
+
+    if (filename.isEmpty())
+        return true;
+
+    if (!checkConnect())
+        return false;
+
+    const auto query = _queryManager.get(PreparedSqlQueryManager::GetFileRecordQuery, QByteArrayLiteral(GET_FILE_RECORD_BY_PHASH_QUERY), _db);
+    if (!query) {
+        return false;
+    }
+
+    query->bindValue(1, SyncJournalDb::getPHash(filename));
+
+    if (!query->exec()) {
+        close();
+        return false;
+    }
+
+    auto next = query->next();
+    if (!next.ok) {
+        qCWarning(lcDb) << "Read-only lookup failed for" << filename << "Error:" << query->error();
+        close();
+        return false;
+    }
+    if (next.hasData) {
+        fillFileRecordFromGetQuery(*rec, *query);
+    }
+    return true;
+}
+
+bool SyncJournalReader::getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec)
+{
+    // Reset the output var in case the caller is reusing it.
+    Q_ASSERT(rec);
+    rec->_path.clear();
+    Q_ASSERT(!rec->isValid());
+
+    if (!inode)
+        return true;
+
+    if (!checkConnect())
+        return false;
+
+    const auto query = _queryManager.get(PreparedSqlQueryManager::GetFileRecordQueryByInode, QByteArrayLiteral(GET_FILE_RECORD_BY_INODE_QUERY), _db);
+    if (!query)
+        return false;
+
+    query->bindValue(1, inode);
+
+    if (!query->exec()) {
+        close();
+        return false;
+    }
+
+    auto next = query->next();
+    if (!next.ok) {
+        close();
+        return false;
+    }
+    if (next.hasData)
+        fillFileRecordFromGetQuery(*rec, *query);
+    return true;
+}
+
+bool SyncJournalReader::getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
+{
+    if (!checkConnect())
+        return false;
+    return getFilesBelowPathImpl(_queryManager, _db, path, rowCallback);
+}
+
+bool SyncJournalReader::listFilesInPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
+{
+    if (!checkConnect())
+        return false;
+    return listFilesInPathImpl(_queryManager, _db, path, rowCallback);
+}
+
+void SyncJournalReader::close()
+{
+    _db.close();
+}
+
 
 bool operator==(const SyncJournalDb::DownloadInfo &lhs,
     const SyncJournalDb::DownloadInfo &rhs)
@@ -25,6 +25,8 @@
 #include <QMutex>
 #include <QVariant>
 #include <functional>
+#include <memory>
+#include <vector>
 
 #include "common/utility.h"
 #include "common/ownsql.h"
@@ -36,10 +38,57 @@
 namespace OCC {
 class SyncJournalFileRecord;
 
+/**
+ * @brief Read-only connection to a sync journal
+ *
+ * Lets a worker thread look up records without waiting for the mutex of
+ * the SyncJournalDb that owns the journal. Unlike SyncJournalDb this class
+ * is not thread safe: it must not be used by several threads at the same
+ * time. It may be used by different threads one after the other, as the
+ * pool of SyncJournalDb does when it leases it out, since the connection
+ * is opened in SQLite's multi-thread mode.
+ *
+ * Readers see the last committed state of the journal and only work while
+ * SyncJournalDb::allowsReadOnlyConnections() is true. SyncJournalDb itself
+ * keeps a pool of them for its reads.
+ * @ingroup libsync
+ */
+class OCSYNC_EXPORT SyncJournalReader
+{
+public:
+    explicit SyncJournalReader(const QString &dbFilePath);
+    ~SyncJournalReader();
+
+    QString databaseFilePath() const { return _dbFile; }
+
+    // Like the SyncJournalDb functions of the same name; open the connection on demand
+    bool getFileRecord(const QString &filename, SyncJournalFileRecord *rec) { return getFileRecord(filename.toUtf8(), rec); }
+    bool getFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec);
+    bool getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec);
+    bool getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
+    bool listFilesInPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
+
+    void close();
+
+private:
+    bool checkConnect();
+
+    SqlDatabase _db;
+    QString _dbFile;
+    PreparedSqlQueryManager _queryManager;
+
+    Q_DISABLE_COPY(SyncJournalReader)
+};
+
 /**
  * @brief Class that handles the sync database
  *
  * This class is thread safe. All public functions lock the mutex.
+ *
+ * The frequent record reads (getFileRecord(), getFileRecordByInode(),
+ * getFilesBelowPath(), listFilesInPath()) only hold it briefly: while there
+ * are no uncommitted changes they run on pooled read-only connections, in
+ * parallel to each other and to writes.
  * @ingroup libsync
  */
 class OCSYNC_EXPORT SyncJournalDb : public QObject
@@ -61,9 +110,32 @@ public:
     // To verify that the record could be found check with SyncJournalFileRecord::isValid()
     bool getFileRecord(const QString &filename, SyncJournalFileRecord *rec) { return getFileRecord(filename.toUtf8(), rec); }
     bool getFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec);
+    /**
+     * Lets SyncJournalReader connections read this journal while it's open
+     *
+     * The journal is locked exclusively unless this is called before it's
+     * opened. Only done for the WAL journal mode and not on Windows, and
+     * OWNCLOUD_SQLITE_LOCKING_MODE still takes precedence.
+     */
+    void enableReadOnlyConnections();
+
+    /**
+     * Whether SyncJournalReader connections can read this journal while it's open
+     *
+     * Only true for the WAL journal mode without exclusive locking.
+     */
+    bool allowsReadOnlyConnections();
+
     bool getFileRecordByE2eMangledName(const QString &mangledName, SyncJournalFileRecord *rec);
     bool getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec);
     bool getFileRecordsByFileId(const QByteArray &fileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
+    /**
+     * Like getFileRecordsByFileId(), but matches the numeric server file id.
+     *
+     * See SyncJournalFileRecord::numericFileId(). This is the kind of id that
+     * push notifications carry.
+     */
+    bool getFileRecordsByNumericFileId(qint64 numericFileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
     bool getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback);
     bool listFilesInPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback);
     Result<void, QString> setFileRecord(const SyncJournalFileRecord &record);
@@ -93,6 +165,37 @@ public:
     bool exists();
     void walCheckpoint();
 
+    /// Size and fragmentation of the database, see databaseStats()
+    struct DatabaseStats
+    {
+        qint64 pageSize = 0;
+        qint64 pageCount = 0;
+        /// Unused pages, reclaimed by performMaintenance()
+        qint64 freePages = 0;
+        /// Size of the write-ahead log in bytes, 0 without WAL
+        qint64 walSize = 0;
+        bool incrementalVacuum = false;
+
+        qint64 databaseSize() const { return pageSize * pageCount; }
+        /// The share of unused pages, between 0 and 1
+        double fragmentation() const { return pageCount ? double(freePages) / pageCount : 0; }
+    };
+    DatabaseStats databaseStats();
+
+    /**
+     * Housekeeping for idle times, when no sync uses the journal.
+     *
+     * Lets sqlite update its statistics (PRAGMA optimize), returns unused
+     * pages to the file system and checkpoints the write-ahead log. If the
+     * log grew beyond its size limit, it is truncated. Journals without
+     * incremental vacuum get a full VACUUM only once a quarter of their
+     * pages are unused.
+     *
+     * Holds the journal for a while: call it from a worker thread.
+     * Commits the open transaction. Returns the stats after the maintenance.
+     */
+    DatabaseStats performMaintenance();
+
     QString databaseFilePath() const;
 
     static qint64 getPHash(const QByteArray &);
@@ -420,7 +523,38 @@ private:
      */
     QByteArray _journalMode;
 
+    /** The locking mode to use for the db.
+     *
+     * NORMAL with WAL so read-only connections can coexist, EXCLUSIVE otherwise.
+     * May be set via environment variable.
+     */
+    QByteArray _lockingMode;
+
+    /** The size limit of the write-ahead log in bytes
+     *
+     * Can be overridden with the OWNCLOUD_SQLITE_WAL_SIZE_LIMIT environment variable.
+     */
+    qint64 _walSizeLimit;
+
     PreparedSqlQueryManager _queryManager;
+
+    /* Pooled read-only connections, see leaseReader()
+     *
+     * The members below are protected by _readerMutex.
+     */
+    class ReaderLease;
+    ReaderLease leaseReader();
+    void returnReader(std::unique_ptr<SyncJournalReader> reader, int generation);
+
+    QMutex _readerMutex;
+    std::vector<std::unique_ptr<SyncJournalReader>> _idleReaders;
+    int _leasedReaders = 0;
+    // Incremented when the pool is emptied, readers of an older generation are dropped
+    int _readerGeneration = 0;
+
+    // sqlite3_total_changes() of _db when the open transaction started, -1 if unknown.
+    // Protected by _mutex.
+    int _committedChanges = -1;
 };
 
 bool OCSYNC_EXPORT
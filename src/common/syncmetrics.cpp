@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "syncmetrics.h"
+
+#include <QJsonDocument>
+#include <QLoggingCategory>
+#include <QSaveFile>
+#include <QtAlgorithms>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcSyncMetrics, "sync.metrics", QtInfoMsg)
+
+constexpr int SyncMetrics::Histogram::BucketCount;
+
+void SyncMetrics::Histogram::record(qint64 value)
+{
+    value = qMax<qint64>(0, value);
+    const int bucket = value == 0 ? 0 : qMin(BucketCount - 1, 64 - int(qCountLeadingZeroBits(quint64(value))));
+    _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+
+    auto max = _max.load(std::memory_order_relaxed);
+    while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+qint64 SyncMetrics::Histogram::quantile(double q) const
+{
+    const auto total = count();
+    if (total == 0)
+        return 0;
+
+    const auto rank = quint64(qBound(0.0, q, 1.0) * (total - 1)) + 1;
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += _buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return qMin(max(), (qint64(1) << i) - 1);
+    }
+    return max();
+}
+
+double SyncMetrics::Rate::perSecond() const
+{
+    const auto time = usecs();
+    return time > 0 ? amount() * 1e6 / time : 0;
+}
+
+SyncMetrics::ScopedTimer::~ScopedTimer()
+{
+    const auto elapsed = std::chrono::steady_clock::now() - _start;
+    if (_resolution == Nanoseconds) {
+        _histogram->record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    } else {
+        _histogram->record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+}
+
+SyncMetrics *SyncMetrics::instance()
+{
+    static SyncMetrics metrics;
+    return &metrics;
+}
+
+template <typename T>
+static T *findOrCreate(std::map<QString, std::unique_ptr<T>> &metrics, const QString &name)
+{
+    auto &metric = metrics[name];
+    if (!metric)
+        metric.reset(new T);
+    return metric.get();
+}
+
+SyncMetrics::Counter *SyncMetrics::counter(const QString &name)
+{
+    QMutexLocker lock(&_mutex);
+    return findOrCreate(_counters, name);
+}
+
+SyncMetrics::Histogram *SyncMetrics::histogram(const QString &name)
+{
+    QMutexLocker lock(&_mutex);
+    return findOrCreate(_histograms, name);
+}
+
+SyncMetrics::Rate *SyncMetrics::rate(const QString &name)
+{
+    QMutexLocker lock(&_mutex);
+    return findOrCreate(_rates, name);
+}
+
+QJsonObject SyncMetrics::toJson() const
+{
+    QMutexLocker lock(&_mutex);
+
+    QJsonObject counters;
+    for (const auto &it : _counters)
+        counters.insert(it.first, double(it.second->value()));
+
+    QJsonObject histograms;
+    for (const auto &it : _histograms) {
+        const auto &histogram = *it.second;
+        histograms.insert(it.first, QJsonObject{
+                                        { QStringLiteral("count"), double(histogram.count()) },
+                                        { QStringLiteral("sum"), double(histogram.sum()) },
+                                        { QStringLiteral("max"), double(histogram.max()) },
+                                        { QStringLiteral("p50"), double(histogram.quantile(0.5)) },
+                                        { QStringLiteral("p90"), double(histogram.quantile(0.9)) },
+                                        { QStringLiteral("p99"), double(histogram.quantile(0.99)) },
+                                    });
+    }
+
+    QJsonObject rates;
+    for (const auto &it : _rates) {
+        const auto &rate = *it.second;
+        rates.insert(it.first, QJsonObject{
+                                   { QStringLiteral("amount"), double(rate.amount()) },
+                                   { QStringLiteral("usecs"), double(rate.usecs()) },
+                                   { QStringLiteral("perSecond"), rate.perSecond() },
+                               });
+    }
+
+    return QJsonObject{
+        { QStringLiteral("counters"), counters },
+        { QStringLiteral("histograms"), histograms },
+        { QStringLiteral("rates"), rates },
+    };
+}
+
+bool SyncMetrics::writeToFile(const QString &fileName) const
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcSyncMetrics) << "Could not open" << fileName << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(toJson()).toJson());
+    if (!file.commit()) {
+        qCWarning(lcSyncMetrics) << "Could not write" << fileName << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+} // namespace OCC
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include "ocsynclib.h"
+
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+
+namespace OCC {
+
+/**
+ * @brief Registry of the sync performance counters
+ * @ingroup libcsync
+ *
+ * Metrics are created on first use and live as long as the process, so
+ * the pointers returned by counter(), histogram() and rate() can be kept
+ * in a static. Updating a metric only touches atomics.
+ *
+ * The names are dotted, the last component carries the unit, for example
+ * "journal.query_us". The registry is exposed through the socket API
+ * (V2/GET_METRICS) and nextcloudcmd --metrics-file.
+ */
+class OCSYNC_EXPORT SyncMetrics
+{
+public:
+    /// A value that is added to or, for gauges, set
+    class OCSYNC_EXPORT Counter
+    {
+    public:
+        void add(qint64 amount = 1) { _value.fetch_add(amount, std::memory_order_relaxed); }
+        void set(qint64 value) { _value.store(value, std::memory_order_relaxed); }
+        qint64 value() const { return _value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<qint64> _value{ 0 };
+    };
+
+    /// Distribution of values in power of two buckets
+    class OCSYNC_EXPORT Histogram
+    {
+    public:
+        /// Bucket i counts the values below 2^i that don't fit into bucket i - 1
+        static constexpr int BucketCount = 48;
+
+        void record(qint64 value);
+
+        quint64 count() const { return _count.load(std::memory_order_relaxed); }
+        qint64 sum() const { return _sum.load(std::memory_order_relaxed); }
+        qint64 max() const { return _max.load(std::memory_order_relaxed); }
+        /// Upper bound of the bucket that holds the quantile q (0..1)
+        qint64 quantile(double q) const;
+
+    private:
+        std::atomic<quint64> _buckets[BucketCount] = {};
+        std::atomic<quint64> _count{ 0 };
+        std::atomic<qint64> _sum{ 0 };
+        std::atomic<qint64> _max{ 0 };
+    };
+
+    /// An amount processed over some time, like bytes checksummed
+    class OCSYNC_EXPORT Rate
+    {
+    public:
+        void add(qint64 amount, qint64 usecs)
+        {
+            _amount.fetch_add(amount, std::memory_order_relaxed);
+            _usecs.fetch_add(usecs, std::memory_order_relaxed);
+        }
+        qint64 amount() const { return _amount.load(std::memory_order_relaxed); }
+        qint64 usecs() const { return _usecs.load(std::memory_order_relaxed); }
+        double perSecond() const;
+
+    private:
+        std::atomic<qint64> _amount{ 0 };
+        std::atomic<qint64> _usecs{ 0 };
+    };
+
+    /// Records the lifetime of the scope, in microseconds unless asked otherwise
+    class OCSYNC_EXPORT ScopedTimer
+    {
+    public:
+        enum Resolution {
+            Microseconds,
+            Nanoseconds,
+        };
+
+        explicit ScopedTimer(Histogram *histogram, Resolution resolution = Microseconds)
+            : _histogram(histogram)
+            , _resolution(resolution)
+            , _start(std::chrono::steady_clock::now())
+        {
+        }
+        ~ScopedTimer();
+
+    private:
+        Q_DISABLE_COPY(ScopedTimer)
+        Histogram *_histogram;
+        Resolution _resolution;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    static SyncMetrics *instance();
+
+    Counter *counter(const QString &name);
+    Histogram *histogram(const QString &name);
+    Rate *rate(const QString &name);
+
+    QJsonObject toJson() const;
+    bool writeToFile(const QString &fileName) const;
+
+private:
+    SyncMetrics() = default;
+
+    mutable QMutex _mutex;
+    std::map<QString, std::unique_ptr<Counter>> _counters;
+    std::map<QString, std::unique_ptr<Histogram>> _histograms;
+    std::map<QString, std::unique_ptr<Rate>> _rates;
+};
+
+} // namespace OCC
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "synctrace.h"
+
+#include <QDateTime>
+#include <QLoggingCategory>
+#include <QMutex>
+
+#include <chrono>
+#include <cstring>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcSyncTrace, "sync.trace", QtInfoMsg)
+
+constexpr char SyncTrace::Magic[8];
+std::atomic<bool> SyncTrace::_enabled{ false };
+
+namespace {
+    // Events are buffered until this many bytes are pending
+    const int flushSize = 64 * 1024;
+    const int recordSize = sizeof(SyncTrace::Record);
+
+    struct TraceWriter
+    {
+        QMutex mutex;
+        QFile file;
+        QByteArray buffer;
+        QHash<QString, quint32> names;
+        qint64 start = 0;
+
+        ~TraceWriter()
+        {
+            if (file.isOpen())
+                flush();
+        }
+
+        void append(const void *data, int size)
+        {
+            buffer.append(static_cast<const char *>(data), size);
+        }
+
+        quint32 nameId(const QString &name)
+        {
+            auto it = names.constFind(name);
+            if (it != names.constEnd())
+                return *it;
+
+            const quint32 id = names.size() + 1;
+            names.insert(name, id);
+
+            const auto utf8 = name.toUtf8();
+            const SyncTrace::Record definition = { 0, 0, utf8.size(), id, 0, 0, SyncTrace::Name };
+            append(&definition, recordSize);
+            // Keep the following records aligned
+            buffer.append(utf8);
+            buffer.append(QByteArray((recordSize - utf8.size() % recordSize) % recordSize, '\0'));
+            return id;
+        }
+
+        void flush()
+        {
+            if (file.write(buffer) != buffer.size())
+                qCWarning(lcSyncTrace) << "Could not write trace" << file.fileName() << file.errorString();
+            buffer.clear();
+        }
+    };
+
+    TraceWriter &traceWriter()
+    {
+        static TraceWriter writer;
+        return writer;
+    }
+}
+
+bool SyncTrace::start(const QString &fileName)
+{
+    stop();
+
+    auto &writer = traceWriter();
+    QMutexLocker lock(&writer.mutex);
+    writer.file.setFileName(fileName);
+    if (!writer.file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(lcSyncTrace) << "Could not open trace file" << fileName << writer.file.errorString();
+        return false;
+    }
+    writer.names.clear();
+    writer.buffer.reserve(flushSize + recordSize);
+    writer.start = now();
+
+    char header[recordSize] = {};
+    const qint64 startTime = QDateTime::currentMSecsSinceEpoch();
+    std::memcpy(header, Magic, sizeof(Magic));
+    std::memcpy(header + sizeof(Magic), &startTime, sizeof(startTime));
+    writer.append(header, recordSize);
+
+    qCInfo(lcSyncTrace) << "Writing sync trace to" << fileName;
+    _enabled.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+bool SyncTrace::startFromEnvironment()
+{
+    const auto fileName = qEnvironmentVariable("OWNCLOUD_SYNC_TRACE");
+    return !fileName.isEmpty() && start(fileName);
+}
+
+void SyncTrace::stop()
+{
+    _enabled.store(false, std::memory_order_relaxed);
+
+    auto &writer = traceWriter();
+    QMutexLocker lock(&writer.mutex);
+    if (!writer.file.isOpen())
+        return;
+    writer.flush();
+    writer.file.close();
+    writer.names.clear();
+    writer.buffer.squeeze();
+}
+
+qint64 SyncTrace::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SyncTrace::record(Category category, Phase phase, const QString &name, quint64 span, qint64 value, qint64 timestamp)
+{
+    if (timestamp < 0)
+        timestamp = now();
+
+    // Small ids are friendlier to the trace viewers than native thread ids
+    static std::atomic<quint16> nextThread{ 1 };
+    thread_local const quint16 thread = nextThread.fetch_add(1, std::memory_order_relaxed);
+
+    auto &writer = traceWriter();
+    QMutexLocker lock(&writer.mutex);
+    if (!writer.file.isOpen())
+        return;
+
+    const quint32 nameId = name.isEmpty() ? 0 : writer.nameId(name);
+    const Record event = { quint64(qMax<qint64>(0, timestamp - writer.start)), span, value, nameId, thread, category, phase };
+    writer.append(&event, recordSize);
+    if (writer.buffer.size() >= flushSize)
+        writer.flush();
+}
+
+SyncTrace::Scope::~Scope()
+{
+    if (_start >= 0 && isEnabled())
+        record(_category, Complete, QString::fromLatin1(_name), 0, now() - _start, _start);
+}
+
+
+bool SyncTraceReader::open(const QString &fileName)
+{
+    _names.clear();
+    _file.setFileName(fileName);
+    if (!_file.open(QIODevice::ReadOnly)) {
+        _error = _file.errorString();
+        return false;
+    }
+
+    char header[recordSize];
+    if (_file.read(header, recordSize) != recordSize
+        || std::memcmp(header, SyncTrace::Magic, sizeof(SyncTrace::Magic)) != 0) {
+        _error = QStringLiteral("Not a sync trace");
+        return false;
+    }
+    std::memcpy(&_startTime, header + sizeof(SyncTrace::Magic), sizeof(_startTime));
+    return true;
+}
+
+bool SyncTraceReader::readRecord(SyncTrace::Record *record)
+{
+    const auto read = _file.read(reinterpret_cast<char *>(record), recordSize);
+    if (read == 0)
+        return false;
+    if (read != recordSize) {
+        _error = QStringLiteral("Truncated record at offset %1").arg(_file.pos() - read);
+        return false;
+    }
+    return true;
+}
+
+bool SyncTraceReader::next(Event *event)
+{
+    SyncTrace::Record record;
+    while (readRecord(&record)) {
+        if (record.phase == SyncTrace::Name) {
+            const int padded = (record.value + recordSize - 1) / recordSize * recordSize;
+            const auto bytes = _file.read(padded);
+            if (record.value < 0 || bytes.size() != padded) {
+                _error = QStringLiteral("Truncated name at offset %1").arg(_file.pos() - bytes.size());
+                return false;
+            }
+            _names.insert(record.nameId, QString::fromUtf8(bytes.constData(), record.value));
+            continue;
+        }
+        if (record.phase < SyncTrace::Begin || record.phase > SyncTrace::Complete) {
+            _error = QStringLiteral("Unknown record at offset %1").arg(_file.pos() - recordSize);
+            return false;
+        }
+
+        event->timestamp = record.timestamp;
+        event->span = record.span;
+        event->value = record.value;
+        event->name = _names.value(record.nameId);
+        event->thread = record.thread;
+        event->category = static_cast<SyncTrace::Category>(record.category);
+        event->phase = static_cast<SyncTrace::Phase>(record.phase);
+        return true;
+    }
+    return false;
+}
+
+QString SyncTraceReader::categoryName(SyncTrace::Category category)
+{
+    switch (category) {
+    case SyncTrace::Discovery:
+        return QStringLiteral("discovery");
+    case SyncTrace::Journal:
+        return QStringLiteral("journal");
+    case SyncTrace::Http:
+        return QStringLiteral("http");
+    case SyncTrace::Propagation:
+        return QStringLiteral("propagation");
+    }
+    return QStringLiteral("unknown");
+}
+
+} // namespace OCC
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include "ocsynclib.h"
+
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+#include <atomic>
+
+namespace OCC {
+
+/**
+ * @brief Opt-in binary trace of what a sync spends its time on
+ * @ingroup libcsync
+ *
+ * Events are fixed size records that are appended to an in-memory buffer
+ * and written to the trace file in large chunks. Names (paths, urls, query
+ * names) are written once to a string table in the same file and referred
+ * to by id afterwards.
+ *
+ * When no trace is running every call returns after checking isEnabled(),
+ * so the trace points can stay in the sync code.
+ *
+ * Traces are enabled by setting OWNCLOUD_SYNC_TRACE to a file name or with
+ * the --trace option of nextcloudcmd. The nextcloudtrace tool converts them
+ * to the Chrome trace format or to folded stacks for flame graphs.
+ */
+class OCSYNC_EXPORT SyncTrace
+{
+public:
+    enum Category : quint8 {
+        Discovery = 1,
+        Journal,
+        Http,
+        Propagation,
+    };
+
+    enum Phase : quint8 {
+        Begin = 1,
+        End,
+        /// A span with a known duration: the value is the duration in microseconds
+        Complete,
+        /// Defines a name, the utf8 bytes follow in the next records
+        Name,
+    };
+
+    /** The on-disk record, in host byte order
+     *
+     * The file starts with a header record carrying the magic and the
+     * wall clock time at which the trace started.
+     */
+    struct Record
+    {
+        /// Microseconds since the trace started
+        quint64 timestamp;
+        /// Pairs Begin and End records
+        quint64 span;
+        /// Size, HTTP status or duration, depending on the event
+        qint64 value;
+        quint32 nameId;
+        quint16 thread;
+        quint8 category;
+        quint8 phase;
+    };
+    static_assert(sizeof(Record) == 32, "trace records have a fixed size");
+
+    static constexpr char Magic[8] = { 'O', 'C', 'T', 'R', 'A', 'C', 'E', '1' };
+
+    /// Starts writing a trace to fileName, ending any trace in progress
+    static bool start(const QString &fileName);
+    /// Starts a trace if OWNCLOUD_SYNC_TRACE names a file
+    static bool startFromEnvironment();
+    /// Writes the remaining events and closes the trace file
+    static void stop();
+
+    static bool isEnabled() { return _enabled.load(std::memory_order_relaxed); }
+
+    static void begin(Category category, const QString &name, quint64 span, qint64 value = 0)
+    {
+        if (isEnabled())
+            record(category, Begin, name, span, value);
+    }
+    static void end(Category category, quint64 span, qint64 value = 0)
+    {
+        if (isEnabled())
+            record(category, End, QString(), span, value);
+    }
+
+    /// Span id for events that belong to an object with a known lifetime
+    static quint64 spanId(const void *object) { return reinterpret_cast<quintptr>(object); }
+
+    /// Records a Complete event for the lifetime of the scope
+    class OCSYNC_EXPORT Scope
+    {
+    public:
+        Scope(Category category, const char *name)
+            : _category(category)
+            , _name(name)
+            , _start(isEnabled() ? now() : -1)
+        {
+        }
+        ~Scope();
+
+    private:
+        Q_DISABLE_COPY(Scope)
+        Category _category;
+        const char *_name;
+        qint64 _start;
+    };
+
+private:
+    static qint64 now();
+    static void record(Category category, Phase phase, const QString &name, quint64 span, qint64 value, qint64 timestamp = -1);
+
+    static std::atomic<bool> _enabled;
+};
+
+/**
+ * @brief Reads the events of a trace written by SyncTrace
+ * @ingroup libcsync
+ */
+class OCSYNC_EXPORT SyncTraceReader
+{
+public:
+    struct Event
+    {
+        quint64 timestamp;
+        quint64 span;
+        qint64 value;
+        QString name;
+        quint16 thread;
+        SyncTrace::Category category;
+        SyncTrace::Phase phase;
+    };
+
+    bool open(const QString &fileName);
+    /// Wall clock time of the start of the trace, in milliseconds since the epoch
+    qint64 startTime() const { return _startTime; }
+
+    /// Reads the next event, skipping name definitions; false at the end or on errors
+    bool next(Event *event);
+    QString errorString() const { return _error; }
+
+    static QString categoryName(SyncTrace::Category category);
+
+private:
+    bool readRecord(SyncTrace::Record *record);
+
+    QFile _file;
+    QHash<quint32, QString> _names;
+    qint64 _startTime = 0;
+    QString _error;
+};
+
+} // namespace OCC
@@ -180,6 +180,13 @@ public:
      */
     virtual Q_REQUIRED_RESULT Result<void, QString> dehydratePlaceholder(const SyncFileItem &item) = 0;
 
+    /** Whether createPlaceholder() and dehydratePlaceholder() may be called from worker threads.
+     *
+     * Allows the placeholders of many files to be changed at once, see
+     * PropagateVirtualFileBatch.
+     */
+    virtual bool canChangePlaceholdersInParallel() const { return false; }
+
     /** Discovery hook: even unchanged files may need UPDATE_METADATA.
      *
      * For instance cfapi vfs wants local hydrated non-placeholder files to
@@ -21,6 +21,7 @@
 #include <creds/credentialsfactory.h>
 #include <creds/abstractcredentials.h>
 #include <cookiejar.h>
+#include <accessmanager.h>
 #include <QSettings>
 #include <QDir>
 #include <QNetworkAccessManager>
@@ -38,6 +39,7 @@ static const char caCertsKeyC[] = "CaCertificates";
 static const char accountsC[] = "Accounts";
 static const char versionC[] = "version";
 static const char serverVersionC[] = "serverVersion";
+static const char http2EnabledC[] = "http2Enabled";
 
 // The maximum versions that this client can read
 static const int maxAccountsVersion = 2;
@@ -90,6 +92,7 @@ bool AccountManager::restore()
                     ASSERT(jar);
                     if (jar)
                         jar->restore(acc->cookieJarPath());
+                    acc->restoreSslSession();
                     addAccountState(accState);
                 }
             }
@@ -223,6 +226,12 @@ void AccountManager::saveAccountHelper(Account *acc, QSettings &settings, bool s
     settings.setValue(QLatin1String(urlC), acc->_url.toString());
     settings.setValue(QLatin1String(davUserC), acc->_davUser);
     settings.setValue(QLatin1String(serverVersionC), acc->_serverVersion);
+    // Only a choice for this account, otherwise the default applies
+    if (acc->_http2Enabled != AccessManager::isHttp2Allowed()) {
+        settings.setValue(QLatin1String(http2EnabledC), acc->_http2Enabled);
+    } else {
+        settings.remove(QLatin1String(http2EnabledC));
+    }
     if (acc->_credentials) {
         if (saveCredentials) {
             // Only persist the credentials if the parameter is set, on migration from 1.8.x
@@ -318,6 +327,8 @@ AccountPtr AccountManager::loadAccountHelper(QSettings &settings)
 
     acc->_serverVersion = settings.value(QLatin1String(serverVersionC)).toString();
     acc->_davUser = settings.value(QLatin1String(davUserC), "").toString();
+    if (settings.contains(QLatin1String(http2EnabledC)))
+        acc->setHttp2Enabled(settings.value(QLatin1String(http2EnabledC)).toBool());
 
     // We want to only restore settings for that auth type and the user value
     acc->_settingsMap.insert(QLatin1String(userC), settings.value(userC));
@@ -370,9 +381,10 @@ void AccountManager::deleteAccount(AccountState *account)
     auto copy = *it; // keep a reference to the shared pointer so it does not delete it just yet
     _accounts.erase(it);
 
-    // Forget account credentials, cookies
+    // Forget account credentials, cookies, TLS session
     account->account()->credentials()->forgetSensitiveData();
     QFile::remove(account->account()->cookieJarPath());
+    account->account()->deleteSslSession();
 
     auto settings = ConfigFile::settingsWithGroup(QLatin1String(accountsC));
     settings->remove(account->account()->id());
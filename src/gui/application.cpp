@@ -43,6 +43,7 @@
 #include "version.h"
 #include "csync_exclude.h"
 #include "common/vfs.h"
+#include "common/synctrace.h"
 
 #include "config.h"
 
@@ -80,6 +81,8 @@ namespace {
         "  --logexpire <hours>  : removes logs older than <hours> hours.\n"
         "                         (to be used with --logdir)\n"
         "  --logflush           : flush the log file after every write.\n"
+        "  --logasync           : write the log file from a background thread,\n"
+        "                         unless --logflush is given.\n"
         "  --logdebug           : also output debug-level messages in the log.\n"
         "  --confdir <dirname>  : Use the given configuration folder.\n"
         "  --background         : launch the application in the background.\n";
@@ -178,6 +181,7 @@ Application::Application(int &argc, char **argv)
     , _showLogWindow(false)
     , _logExpire(0)
     , _logFlush(false)
+    , _logAsync(false)
     , _logDebug(false)
     , _userTriggeredConnect(false)
     , _debugMode(false)
@@ -275,6 +279,7 @@ Application::Application(int &argc, char **argv)
 #endif
 
     setupLogging();
+    SyncTrace::startFromEnvironment();
     setupTranslations();
 
     if (!configVersionMigration()) {
@@ -390,6 +395,8 @@ Application::~Application()
     disconnect(AccountManager::instance(), &AccountManager::accountRemoved,
         this, &Application::slotAccountStateRemoved);
     AccountManager::instance()->shutdown();
+
+    SyncTrace::stop();
 }
 
 void Application::slotAccountStateRemoved(AccountState *accountState)
@@ -517,6 +524,7 @@ void Application::setupLogging()
     }
     logger->setLogExpire(_logExpire > 0 ? _logExpire : ConfigFile().logExpire());
     logger->setLogFlush(_logFlush || ConfigFile().logFlush());
+    logger->setLogAsync(_logAsync || ConfigFile().logAsync());
     logger->setLogDebug(_logDebug || ConfigFile().logDebug());
     if (!logger->isLoggingToFile() && ConfigFile().automaticLogDir()) {
         logger->setupTemporaryFolderLogDir();
@@ -606,6 +614,8 @@ void Application::parseOptions(const QStringList &options)
             }
         } else if (option == QLatin1String("--logflush")) {
             _logFlush = true;
+        } else if (option == QLatin1String("--logasync")) {
+            _logAsync = true;
         } else if (option == QLatin1String("--logdebug")) {
             _logDebug = true;
         } else if (option == QLatin1String("--confdir")) {
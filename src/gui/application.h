@@ -130,6 +130,7 @@ private:
     QString _logDir;
     int _logExpire;
     bool _logFlush;
+    bool _logAsync;
     bool _logDebug;
     bool _userTriggeredConnect;
     bool _debugMode;
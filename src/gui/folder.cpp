@@ -38,6 +38,7 @@
 #include "settingsdialog.h"
 
 #include <QTimer>
+#include <qtconcurrentrun.h>
 #include <QUrl>
 #include <QDir>
 #include <QSettings>
@@ -65,6 +66,9 @@ Folder::Folder(const FolderDefinition &definition,
     , _fileLog(new SyncRunFileLog)
     , _vfs(vfs.release())
 {
+    // The socket api and the sync read the journal from several threads
+    _journal.enableReadOnlyConnections();
+
     _timeSinceLastSyncStart.start();
     _timeSinceLastSyncDone.start();
 
@@ -103,6 +107,7 @@ Folder::Folder(const FolderDefinition &definition,
     connect(_engine.data(), &SyncEngine::seenLockedFile, FolderMan::instance(), &FolderMan::slotSyncOnceFileUnlocks);
     connect(_engine.data(), &SyncEngine::aboutToPropagate,
         this, &Folder::slotLogPropagationStart);
+    connect(_engine.data(), &SyncEngine::propagationStarted, this, &Folder::slotPropagationStarted);
     connect(_engine.data(), &SyncEngine::syncError, this, &Folder::slotSyncError);
 
     connect(_engine.data(), &SyncEngine::addErrorToGui, this, &Folder::slotAddErrorToGui);
@@ -112,6 +117,13 @@ Folder::Folder(const FolderDefinition &definition,
     connect(&_scheduleSelfTimer, &QTimer::timeout,
         this, &Folder::slotScheduleThisFolder);
 
+    _journalMaintenanceTimer.setSingleShot(true);
+    _journalMaintenanceTimer.setInterval(std::chrono::minutes(5));
+    connect(&_journalMaintenanceTimer, &QTimer::timeout,
+        this, &Folder::slotPerformJournalMaintenance);
+    connect(&_journalMaintenance, &QFutureWatcherBase::finished,
+        this, &Folder::slotJournalMaintenanceFinished);
+
     connect(ProgressDispatcher::instance(), &ProgressDispatcher::folderConflicts,
         this, &Folder::slotFolderConflicts);
 
@@ -150,6 +162,9 @@ Folder::~Folder()
 
     // Reset then engine first as it will abort and try to access members of the Folder
     _engine.reset();
+
+    // The maintenance uses the journal
+    _journalMaintenance.waitForFinished();
 }
 
 void Folder::checkLocalPath()
@@ -608,6 +623,7 @@ void Folder::slotWatchedPathChanged(const QString &path, ChangeReason reason)
     warnOnNewExcludedItem(record, relativePath);
 
     emit watchedFileChangedExternally(path);
+    _timeSinceLastLocalChange.start();
 
     // Also schedule this folder for a sync, but only after some delay:
     // The sync will not upload files that were changed too recently.
@@ -765,6 +781,46 @@ void Folder::slotTerminateSync()
     }
 }
 
+void Folder::slotPreemptSync()
+{
+    if (!_engine->isSyncRunning())
+        return;
+
+    qCInfo(lcFolder) << "folder " << alias() << " preempted after" << msecSincePropagationStart().count() << "ms of propagation";
+    _syncPreempted = true;
+    _consecutivePreemptedSyncs++;
+    slotTerminateSync();
+}
+
+bool Folder::isSyncPreemptible() const
+{
+    return _engine->isPropagating();
+}
+
+std::chrono::milliseconds Folder::msecSincePropagationStart() const
+{
+    if (!_timeSincePropagationStart.isValid())
+        return std::chrono::milliseconds(0);
+    return std::chrono::milliseconds(_timeSincePropagationStart.elapsed());
+}
+
+std::chrono::milliseconds Folder::msecSinceLastLocalChange() const
+{
+    if (!_timeSinceLastLocalChange.isValid())
+        return std::chrono::milliseconds::max();
+    return std::chrono::milliseconds(_timeSinceLastLocalChange.elapsed());
+}
+
+void Folder::setNetworkJobBudget(int budget)
+{
+    _networkJobBudget = budget;
+
+    // An explicit OWNCLOUD_MAX_PARALLEL always wins, see SyncOptions::fillFromEnvironmentVariables()
+    if (_engine->isSyncRunning() && qEnvironmentVariableIsEmpty("OWNCLOUD_MAX_PARALLEL")) {
+        _engine->setParallelNetworkJobs(parallelNetworkJobs());
+    }
+}
+
 void Folder::wipeForRemoval()
 {
     // Delete files that have been partially downloaded.
@@ -772,6 +828,8 @@ void Folder::wipeForRemoval()
 
     // Unregister the socket API so it does not keep the .sync_journal file open
     FolderMan::instance()->socketApi()->slotUnregisterPath(alias());
+    _journalMaintenanceTimer.stop();
+    _journalMaintenance.waitForFinished();
     _journal.close(); // close the sync journal
 
     // Remove db and temporaries
@@ -813,7 +871,18 @@ void Folder::startSync(const QStringList &pathList)
         return;
     }
 
+    if (_journalMaintenance.isRunning()) {
+        // The maintenance holds the journal, start once it's done instead of
+        // waiting for it on the GUI thread
+        qCInfo(lcFolder) << "Starting the sync of" << alias() << "after the journal maintenance";
+        _syncAfterJournalMaintenance = true;
+        return;
+    }
+
     _timeSinceLastSyncStart.start();
+    _timeSincePropagationStart.invalidate();
+    _syncPreempted = false;
+    _journalMaintenanceTimer.stop();
     _syncResult.setStatus(SyncResult::SyncPrepare);
     emit syncStateChange();
 
@@ -874,7 +943,7 @@ void Folder::setSyncOptions()
     opt._confirmExternalStorage = cfgFile.confirmExternalStorage();
     opt._moveFilesToTrash = cfgFile.moveToTrash();
     opt._vfs = _vfs;
-    opt._parallelNetworkJobs = _accountState->account()->isHttp2Supported() ? 20 : 6;
+    opt._parallelNetworkJobs = parallelNetworkJobs();
 
     opt._initialChunkSize = cfgFile.chunkSize();
     opt._minChunkSize = cfgFile.minChunkSize();
@@ -887,6 +956,14 @@ void Folder::setSyncOptions()
     _engine->setSyncOptions(opt);
 }
 
+int Folder::parallelNetworkJobs() const
+{
+    int jobs = _accountState->account()->isHttp2Supported() ? 20 : 6;
+    if (_networkJobBudget > 0)
+        jobs = qMin(jobs, _networkJobBudget);
+    return jobs;
+}
+
 void Folder::setDirtyNetworkLimits()
 {
     ConfigFile cfg;
@@ -927,6 +1004,12 @@ void Folder::slotSyncStarted()
     emit syncStateChange();
 }
 
+void Folder::slotPropagationStarted()
+{
+    // Subtrees streamed during the discovery don't count, only now can the sync be preempted
+    _timeSincePropagationStart.start();
+}
+
 void Folder::slotSyncFinished(bool success)
 {
     qCInfo(lcFolder) << "Client version" << qPrintable(Theme::instance()->version())
@@ -945,7 +1028,10 @@ void Folder::slotSyncFinished(bool success)
 
     auto anotherSyncNeeded = _engine->isAnotherSyncNeeded();
 
-    if (syncError) {
+    if (_syncPreempted) {
+        // The sync was interrupted to let other folders sync, FolderMan reschedules it
+        _syncResult.setStatus(SyncResult::NotYetStarted);
+    } else if (syncError) {
         _syncResult.setStatus(SyncResult::Error);
     } else if (_syncResult.foundFilesNotSynced()) {
         _syncResult.setStatus(SyncResult::Problem);
@@ -960,11 +1046,16 @@ void Folder::slotSyncFinished(bool success)
     if (_syncResult.status() == SyncResult::Success
         || _syncResult.status() == SyncResult::Problem) {
         _consecutiveFailingSyncs = 0;
-    } else {
+    } else if (!_syncPreempted) {
         _consecutiveFailingSyncs++;
         qCInfo(lcFolder) << "the last" << _consecutiveFailingSyncs << "syncs failed";
     }
 
+    // Preempted syncs are counted by slotPreemptSync(), see FolderMan::isSyncPreemptionDue()
+    if (!_syncPreempted) {
+        _consecutivePreemptedSyncs = 0;
+    }
+
     if (_syncResult.status() == SyncResult::Success && success) {
         // Clear the white list as all the folders that should be on that list are sync-ed
         journalDb()->setSelectiveSyncList(SyncJournalDb::SelectiveSyncWhiteList, QStringList());
@@ -991,6 +1082,7 @@ void Folder::slotSyncFinished(bool success)
 
     _lastSyncDuration = std::chrono::milliseconds(_timeSinceLastSyncStart.elapsed());
     _timeSinceLastSyncDone.start();
+    _journalMaintenanceTimer.start();
 
     // Increment the follow-up sync counter if necessary.
     if (anotherSyncNeeded == ImmediateFollowUp) {
@@ -1090,6 +1182,27 @@ void Folder::slotLogPropagationStart()
     _fileLog->logLap("Propagation starts");
 }
 
+void Folder::slotPerformJournalMaintenance()
+{
+    if (isBusy() || _journalMaintenance.isRunning()) {
+        // Rescheduled when the sync finishes
+        return;
+    }
+
+    auto journal = &_journal;
+    _journalMaintenance.setFuture(QtConcurrent::run([journal] {
+        journal->performMaintenance();
+    }));
+}
+
+void Folder::slotJournalMaintenanceFinished()
+{
+    if (!_syncAfterJournalMaintenance)
+        return;
+    _syncAfterJournalMaintenance = false;
+    startSync(QStringList());
+}
+
 void Folder::slotScheduleThisFolder()
 {
     FolderMan::instance()->scheduleFolder(this);
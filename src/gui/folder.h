@@ -23,6 +23,7 @@
 #include "networkjobs.h"
 #include "syncoptions.h"
 
+#include <QFutureWatcher>
 #include <QObject>
 #include <QStringList>
 #include <QUuid>
@@ -32,6 +33,7 @@
 
 class QThread;
 class QSettings;
+class TestFolderMan;
 
 namespace OCC {
 
@@ -227,9 +229,31 @@ public:
     RequestEtagJob *etagJob() { return _requestEtagJob; }
     std::chrono::milliseconds msecSinceLastSync() const { return std::chrono::milliseconds(_timeSinceLastSyncDone.elapsed()); }
     std::chrono::milliseconds msecLastSyncDuration() const { return _lastSyncDuration; }
+    std::chrono::milliseconds msecSinceSyncStart() const { return std::chrono::milliseconds(_timeSinceLastSyncStart.elapsed()); }
+    /// Time since the running sync started to propagate, 0 while it's still discovering
+    std::chrono::milliseconds msecSincePropagationStart() const;
+    /// Time since the folder watcher last reported a genuine local change, max() if there was none
+    std::chrono::milliseconds msecSinceLastLocalChange() const;
     int consecutiveFollowUpSyncs() const { return _consecutiveFollowUpSyncs; }
     int consecutiveFailingSyncs() const { return _consecutiveFailingSyncs; }
 
+    /**
+     * Sets this folder's share of the network jobs of all concurrent syncs.
+     *
+     * Applied to a running sync immediately. 0 means no limit beyond the
+     * per-account default.
+     */
+    void setNetworkJobBudget(int budget);
+
+    /// Whether the running sync can be interrupted without losing much work
+    bool isSyncPreemptible() const;
+
+    /// Whether the last sync was interrupted by slotPreemptSync()
+    bool syncWasPreempted() const { return _syncPreempted; }
+
+    /// The number of syncs in a row that were interrupted by slotPreemptSync()
+    int consecutivePreemptedSyncs() const { return _consecutivePreemptedSyncs; }
+
     /// Saves the folder data in the account's settings.
     void saveToSettings() const;
     /// Removes the folder from the account's settings.
@@ -312,6 +336,13 @@ public slots:
        */
     void slotTerminateSync();
 
+    /**
+     * Interrupts the current sync to let other folders sync.
+     *
+     * Unlike a termination this is not counted as a failed sync.
+     */
+    void slotPreemptSync();
+
     // connected to the corresponding signals in the SyncEngine
     void slotAboutToRemoveAllFiles(SyncFileItem::Direction, std::function<void(bool)> callback);
 
@@ -364,6 +395,7 @@ public slots:
 
 private slots:
     void slotSyncStarted();
+    void slotPropagationStarted();
     void slotSyncFinished(bool);
 
     /** Adds a error message that's not tied to a specific item.
@@ -390,6 +422,10 @@ private slots:
      */
     void slotScheduleThisFolder();
 
+    /** Runs SyncJournalDb::performMaintenance() in a worker thread if the folder is idle */
+    void slotPerformJournalMaintenance();
+    void slotJournalMaintenanceFinished();
+
     /** Adjust sync result based on conflict data from IssuesWidget.
      *
      * This is pretty awkward, but IssuesWidget just keeps better track
@@ -424,6 +460,9 @@ private:
 
     void setSyncOptions();
 
+    /// The number of parallel network jobs the next or current sync may use
+    int parallelNetworkJobs() const;
+
     enum LogStatus {
         LogStatusRemove,
         LogStatusRename,
@@ -450,9 +489,21 @@ private:
     QByteArray _lastEtag;
     QElapsedTimer _timeSinceLastSyncDone;
     QElapsedTimer _timeSinceLastSyncStart;
+    QElapsedTimer _timeSincePropagationStart;
     QElapsedTimer _timeSinceLastFullLocalDiscovery;
+    QElapsedTimer _timeSinceLastLocalChange;
     std::chrono::milliseconds _lastSyncDuration;
 
+    /// Share of the global network job budget, see setNetworkJobBudget()
+    int _networkJobBudget = 0;
+
+    /// Set when the running sync was interrupted by slotPreemptSync()
+    bool _syncPreempted = false;
+
+    /// The number of syncs in a row that were preempted.
+    /// Reset when a sync finishes without being preempted.
+    int _consecutivePreemptedSyncs = 0;
+
     /// The number of syncs that failed in a row.
     /// Reset when a sync is successful.
     int _consecutiveFailingSyncs;
@@ -467,6 +518,12 @@ private:
 
     QTimer _scheduleSelfTimer;
 
+    /// Started when a sync finishes, runs the journal maintenance once the folder was idle for a while
+    QTimer _journalMaintenanceTimer;
+    QFutureWatcher<void> _journalMaintenance;
+    /// A sync was requested while the journal maintenance was running
+    bool _syncAfterJournalMaintenance = false;
+
     /**
      * When the same local path is synced to multiple accounts, only one
      * of them can be stored in the settings in a way that's compatible
@@ -510,6 +567,8 @@ private:
      * The vfs mode instance (created by plugin) to use. Never null.
      */
     QSharedPointer<Vfs> _vfs;
+
+    friend class ::TestFolderMan;
 };
 }
 
@@ -26,6 +26,7 @@
 #include "common/asserts.h"
 #include <pushnotifications.h>
 #include <syncengine.h>
+#include <transfergovernor.h>
 
 #ifdef Q_OS_MAC
 #include <CoreServices/CoreServices.h>
@@ -63,10 +64,21 @@ FolderMan::FolderMan(QObject *parent)
     QObject::connect(&_etagPollTimer, &QTimer::timeout, this, &FolderMan::slotEtagPollTimerTimeout);
     _etagPollTimer.start();
 
+    _maxConcurrentSyncs = cfg.maxConcurrentFolderSyncs();
+    _networkJobBudget = cfg.networkJobBudget();
+    _syncPreemptionTimeout = cfg.syncPreemptionTimeout();
+    qCInfo(lcFolderMan) << "up to" << _maxConcurrentSyncs << "concurrent syncs sharing" << _networkJobBudget << "network jobs";
+    TransferGovernor::instance()->setMaxRequestsPerHost(cfg.maxRequestsPerHost());
+    setDirtyNetworkLimits();
+
     _startScheduledSyncTimer.setSingleShot(true);
     connect(&_startScheduledSyncTimer, &QTimer::timeout,
         this, &FolderMan::slotStartScheduledFolderSync);
 
+    _warmUpConnectionsTimer.setSingleShot(true);
+    connect(&_warmUpConnectionsTimer, &QTimer::timeout,
+        this, &FolderMan::slotWarmUpConnections);
+
     _timeScheduler.setInterval(5000);
     _timeScheduler.setSingleShot(false);
     connect(&_timeScheduler, &QTimer::timeout,
@@ -110,6 +122,7 @@ void FolderMan::unloadFolder(Folder *f)
     _socketApi->slotUnregisterPath(f->alias());
 
     _folderMap.remove(f->alias());
+    _currentSyncFolders.removeAll(f);
 
     disconnect(f, &Folder::syncStarted,
         this, &FolderMan::slotFolderSyncStarted);
@@ -141,7 +154,8 @@ int FolderMan::unloadAndDeleteAllFolders()
     ASSERT(_folderMap.isEmpty());
 
     _lastSyncFolder = nullptr;
-    _currentSyncFolder = nullptr;
+    _nextSyncFolder = nullptr;
+    _currentSyncFolders.clear();
     _scheduledFolders.clear();
     emit folderListChanged(_folderMap);
     emit scheduleQueueChanged();
@@ -642,6 +656,7 @@ void FolderMan::scheduleFolderNext(Folder *f)
     f->prepareToSync();
     emit folderSyncStateChange(f);
     _scheduledFolders.prepend(f);
+    _nextSyncFolder = f;
     emit scheduleQueueChanged();
 
     startScheduledSyncSoon();
@@ -749,7 +764,7 @@ void FolderMan::startScheduledSyncSoon()
     if (_scheduledFolders.empty()) {
         return;
     }
-    if (isAnySyncRunning()) {
+    if (freeSyncSlots() == 0) {
         return;
     }
 
@@ -778,6 +793,29 @@ void FolderMan::startScheduledSyncSoon()
 
     qCInfo(lcFolderMan) << "Starting the next scheduled sync in" << (msDelay / 1000) << "seconds";
     _startScheduledSyncTimer.start(msDelay);
+
+    _warmUpConnectionsTimer.start(connectionWarmUpDelay(std::chrono::milliseconds(msDelay)));
+}
+
+void FolderMan::slotWarmUpConnections()
+{
+    _warmUpConnectionsTimer.stop();
+    if (!_syncEnabled) {
+        return;
+    }
+
+    QSet<Account *> accounts;
+    for (auto *folder : qAsConst(_scheduledFolders)) {
+        auto *accountState = folder->accountState();
+        if (!accountState || !accountState->isConnected() || !folder->canSync())
+            continue;
+        auto *account = accountState->account().data();
+        if (accounts.contains(account))
+            continue;
+        accounts.insert(account);
+        qCDebug(lcFolderMan) << "Warming up connection to" << account->url().host();
+        account->warmUpConnection();
+    }
 }
 
 /*
@@ -787,7 +825,7 @@ void FolderMan::startScheduledSyncSoon()
   */
 void FolderMan::slotStartScheduledFolderSync()
 {
-    if (isAnySyncRunning()) {
+    if (freeSyncSlots() == 0) {
         for (auto f : _folderMap) {
             if (f->isSyncRunning())
                 qCInfo(lcFolderMan) << "Currently folder " << f->remoteUrl().toString() << " is running, wait for finish!";
@@ -805,28 +843,145 @@ void FolderMan::slotStartScheduledFolderSync()
         return;
     }
 
-    // Find the first folder in the queue that can be synced.
-    Folder *folder = nullptr;
-    while (!_scheduledFolders.isEmpty()) {
-        Folder *g = _scheduledFolders.dequeue();
-        if (g->canSync()) {
-            folder = g;
-            break;
+    // The sync might have been started before the warm up timer fired
+    if (_warmUpConnectionsTimer.isActive()) {
+        slotWarmUpConnections();
+    }
+
+    // Drop the folders in the queue that can't be synced.
+    QMutableListIterator<Folder *> it(_scheduledFolders);
+    while (it.hasNext()) {
+        if (!it.next()->canSync()) {
+            it.remove();
         }
     }
 
-    emit scheduleQueueChanged();
+    // Start syncing as many folders as there are free slots!
+    while (freeSyncSlots() > 0) {
+        Folder *folder = nextFolderToSync();
+        if (!folder) {
+            break;
+        }
+        _scheduledFolders.removeOne(folder);
+        if (folder == _nextSyncFolder) {
+            _nextSyncFolder = nullptr;
+        }
 
-    // Start syncing this folder!
-    if (folder) {
         // Safe to call several times, and necessary to try again if
         // the folder path didn't exist previously.
         folder->registerFolderWatcher();
         registerFolderWithSocketApi(folder);
 
-        _currentSyncFolder = folder;
+        _currentSyncFolders.append(folder);
+        rebalanceNetworkJobBudget();
         folder->startSync(QStringList());
     }
+
+    emit scheduleQueueChanged();
+}
+
+int FolderMan::freeSyncSlots() const
+{
+    int running = _currentSyncFolders.size();
+    for (auto f : _folderMap) {
+        // externally-managed syncs like placeholder hydrations take a slot, too
+        if (f->isSyncRunning() && !_currentSyncFolders.contains(f))
+            ++running;
+    }
+    return qMax(0, _maxConcurrentSyncs - running);
+}
+
+Folder *FolderMan::nextFolderToSync() const
+{
+    auto isWaiting = [this](Folder *f) {
+        return !_currentSyncFolders.contains(f) && !f->isSyncRunning();
+    };
+
+    if (_nextSyncFolder && _scheduledFolders.contains(_nextSyncFolder) && isWaiting(_nextSyncFolder)) {
+        return _nextSyncFolder;
+    }
+
+    Folder *best = nullptr;
+    qint64 bestScore = 0;
+    for (auto f : _scheduledFolders) {
+        if (!isWaiting(f))
+            continue;
+        const auto score = syncSchedulingScore(f->msecLastSyncDuration(), f->msecSinceLastSync(), f->msecSinceLastLocalChange());
+        // on equal scores the queue order decides
+        if (!best || score < bestScore) {
+            best = f;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+qint64 FolderMan::syncSchedulingScore(std::chrono::milliseconds lastSyncDuration,
+    std::chrono::milliseconds sinceLastSync,
+    std::chrono::milliseconds sinceLastLocalChange)
+{
+    // Local changes within this window are considered to be awaited by the user
+    static constexpr std::chrono::milliseconds recentLocalChangeWindow = std::chrono::minutes(10);
+
+    qint64 score = lastSyncDuration.count() - sinceLastSync.count();
+    if (sinceLastLocalChange < recentLocalChangeWindow) {
+        score -= (recentLocalChangeWindow - sinceLastLocalChange).count();
+    }
+    return score;
+}
+
+bool FolderMan::isSyncPreemptionDue(std::chrono::milliseconds sincePropagationStart,
+    int consecutivePreemptedSyncs,
+    std::chrono::milliseconds timeout)
+{
+    return timeout.count() > 0
+        && consecutivePreemptedSyncs < maxConsecutiveSyncPreemptions()
+        && sincePropagationStart >= timeout;
+}
+
+std::chrono::milliseconds FolderMan::connectionWarmUpDelay(std::chrono::milliseconds syncDelay)
+{
+    return qMax(std::chrono::milliseconds(0), syncDelay - connectionWarmUpLead());
+}
+
+void FolderMan::rebalanceNetworkJobBudget()
+{
+    if (_currentSyncFolders.isEmpty()) {
+        return;
+    }
+    const int share = qMax(1, _networkJobBudget / _currentSyncFolders.size());
+    for (auto f : qAsConst(_currentSyncFolders)) {
+        f->setNetworkJobBudget(share);
+    }
+}
+
+void FolderMan::preemptLongRunningSync()
+{
+    if (_syncPreemptionTimeout.count() <= 0 || !_syncEnabled || freeSyncSlots() > 0) {
+        return;
+    }
+
+    // Only worth it if a waiting folder is expected to finish well before the running one
+    const bool quickFolderWaiting = std::any_of(_scheduledFolders.cbegin(), _scheduledFolders.cend(), [this](Folder *f) {
+        return !_currentSyncFolders.contains(f) && f->canSync()
+            && f->msecLastSyncDuration() < _syncPreemptionTimeout;
+    });
+    if (!quickFolderWaiting) {
+        return;
+    }
+
+    Folder *longest = nullptr;
+    for (auto f : qAsConst(_currentSyncFolders)) {
+        if (!f->isSyncPreemptible()
+            || !isSyncPreemptionDue(f->msecSincePropagationStart(), f->consecutivePreemptedSyncs(), _syncPreemptionTimeout))
+            continue;
+        if (!longest || f->msecSincePropagationStart() > longest->msecSincePropagationStart())
+            longest = f;
+    }
+    if (longest) {
+        qCInfo(lcFolderMan) << "Preempting long running sync of" << longest->alias() << "in favor of waiting folders";
+        longest->slotPreemptSync();
+    }
 }
 
 bool FolderMan::pushNotificationsFilesReady(Account *account)
@@ -1001,11 +1156,13 @@ void FolderMan::slotScheduleFolderByTime()
 
         // Do we want to retry failing syncs or another-sync-needed runs more often?
     }
+
+    preemptLongRunningSync();
 }
 
 bool FolderMan::isAnySyncRunning() const
 {
-    if (_currentSyncFolder)
+    if (!_currentSyncFolders.isEmpty())
         return true;
 
     for (auto f : _folderMap) {
@@ -1046,12 +1203,14 @@ void FolderMan::slotFolderSyncFinished(const SyncResult &)
         qPrintable(f->accountState()->account()->displayName()),
         qPrintable(f->remoteUrl().toString()));
 
-    if (f == _currentSyncFolder) {
-        _lastSyncFolder = _currentSyncFolder;
-        _currentSyncFolder = nullptr;
+    if (_currentSyncFolders.removeAll(f) > 0) {
+        _lastSyncFolder = f;
+        rebalanceNetworkJobBudget();
     }
-    if (!isAnySyncRunning())
-        startScheduledSyncSoon();
+    if (f->syncWasPreempted()) {
+        scheduleFolder(f);
+    }
+    startScheduledSyncSoon();
 }
 
 Folder *FolderMan::addFolder(AccountState *accountState, const FolderDefinition &folderDefinition)
@@ -1307,10 +1466,10 @@ void FolderMan::slotWipeFolderForAccount(AccountState *accountState)
 
         qCInfo(lcFolderMan) << "Removing " << f->alias();
 
-        const bool currentlyRunning = (_currentSyncFolder == f);
+        const bool currentlyRunning = _currentSyncFolders.contains(f);
         if (currentlyRunning) {
             // abort the sync now
-            _currentSyncFolder->slotTerminateSync();
+            f->slotTerminateSync();
         }
 
         if (_scheduledFolders.removeAll(f) > 0) {
@@ -1369,6 +1528,12 @@ void FolderMan::setDirtyProxy()
 
 void FolderMan::setDirtyNetworkLimits()
 {
+    // Absolute limits apply to all syncs together, relative ones to each sync
+    ConfigFile cfg;
+    TransferGovernor::instance()->setThroughputLimits(
+        cfg.useUploadLimit() >= 1 ? cfg.uploadLimit() * 1000LL : 0,
+        cfg.useDownloadLimit() >= 1 ? cfg.downloadLimit() * 1000LL : 0);
+
     for (Folder *f : _folderMap.values()) {
         // set only in busy folders. Otherwise they read the config anyway.
         if (f && f->isBusy()) {
@@ -1671,9 +1836,9 @@ QQueue<Folder *> FolderMan::scheduleQueue() const
     return _scheduledFolders;
 }
 
-Folder *FolderMan::currentSyncFolder() const
+QList<Folder *> FolderMan::currentSyncFolders() const
 {
-    return _currentSyncFolder;
+    return _currentSyncFolders;
 }
 
 void FolderMan::restartApplication()
@@ -1719,6 +1884,64 @@ void FolderMan::slotProcessFilesPushNotification(Account *account)
     }
 }
 
+void FolderMan::slotProcessFileIdsPushNotification(Account *account, const QVector<qint64> &fileIds)
+{
+    qCInfo(lcFolderMan) << "Got file ids push notification for account" << account << "with" << fileIds.size() << "ids";
+
+    QSet<Folder *> affectedFolders;
+    QList<Folder *> accountFolders;
+    QHash<Folder *, QSet<QByteArray>> remoteDiscoveryPaths;
+    bool allIdsKnown = true;
+
+    for (auto folder : qAsConst(_folderMap)) {
+        if (folder->accountState()->account() == account) {
+            accountFolders.append(folder);
+        }
+    }
+
+    for (const auto fileId : fileIds) {
+        bool idKnown = false;
+        for (auto folder : qAsConst(accountFolders)) {
+            const auto ok = folder->journalDb()->getFileRecordsByNumericFileId(fileId, [&](const SyncJournalFileRecord &record) {
+                idKnown = true;
+                affectedFolders.insert(folder);
+
+                auto directory = record._path;
+                if (!record.isDirectory()) {
+                    directory.truncate(qMax(0, directory.lastIndexOf('/')));
+                }
+                if (!directory.isEmpty()) {
+                    remoteDiscoveryPaths[folder].insert(directory);
+                }
+            });
+            if (!ok) {
+                qCWarning(lcFolderMan) << "Could not look up file id" << fileId << "in folder" << folder->alias();
+                allIdsKnown = false;
+            }
+        }
+        // Unknown ids are most likely new files. We can't tell which folder
+        // they belong to.
+        allIdsKnown &= idKnown;
+    }
+
+    // Make the next sync query the directories that hold the changes, and the directories
+    // leading to them, even if the server didn't update their etags (e.g. external storages).
+    // Everything else is only queried if its etag changed.
+    for (auto it = remoteDiscoveryPaths.cbegin(); it != remoteDiscoveryPaths.cend(); ++it) {
+        for (const auto &path : it.value()) {
+            qCDebug(lcFolderMan) << "Schedule" << path << "in folder" << it.key()->alias() << "for remote discovery";
+            it.key()->journalDb()->schedulePathForRemoteDiscovery(path);
+        }
+    }
+
+    for (auto folder : qAsConst(accountFolders)) {
+        if (!allIdsKnown || affectedFolders.contains(folder)) {
+            qCInfo(lcFolderMan) << "Schedule folder" << folder << "for sync";
+            scheduleFolder(folder);
+        }
+    }
+}
+
 void FolderMan::slotConnectToPushNotifications(Account *account)
 {
     const auto pushNotifications = account->pushNotifications();
@@ -1726,6 +1949,7 @@ void FolderMan::slotConnectToPushNotifications(Account *account)
     if (pushNotificationsFilesReady(account)) {
         qCInfo(lcFolderMan) << "Push notifications ready";
         connect(pushNotifications, &PushNotifications::filesChanged, this, &FolderMan::slotProcessFilesPushNotification, Qt::UniqueConnection);
+        connect(pushNotifications, &PushNotifications::fileIdsChanged, this, &FolderMan::slotProcessFileIdsPushNotification, Qt::UniqueConnection);
     }
 }
 
@@ -57,6 +57,12 @@ class LockWatcher;
  * - There was a sync error or a follow-up sync is requested
  *   (_timeScheduler and slotScheduleFolderByTime()
  *    and Folder::slotSyncFinished())
+ *
+ * Up to ConfigFile::maxConcurrentFolderSyncs() scheduled folders sync at
+ * the same time. Free slots go to the waiting folder with the lowest
+ * syncSchedulingScore(), the running folders share the network job budget
+ * and long syncs may be preempted in favor of waiting folders
+ * (slotStartScheduledFolderSync() and preemptLongRunningSync()).
  */
 class FolderMan : public QObject
 {
@@ -163,14 +169,52 @@ public:
     QQueue<Folder *> scheduleQueue() const;
 
     /**
-     * Access to the currently syncing folder.
+     * Access to the currently syncing folders.
      *
-     * Note: This is only the folder that's currently syncing *as-scheduled*. There
+     * Note: These are only the folders that are currently syncing *as-scheduled*. There
      * may be externally-managed syncs such as from placeholder hydrations.
      *
      * See also isAnySyncRunning()
      */
-    Folder *currentSyncFolder() const;
+    QList<Folder *> currentSyncFolders() const;
+
+    /**
+     * Priority of a waiting folder, lower values sync sooner.
+     *
+     * Folders that synced quickly last time are likely small and go first,
+     * waiting time counts in favor of the big ones so they don't starve and
+     * recent local changes get a boost since the user is probably waiting
+     * for them.
+     */
+    static qint64 syncSchedulingScore(std::chrono::milliseconds lastSyncDuration,
+        std::chrono::milliseconds sinceLastSync,
+        std::chrono::milliseconds sinceLastLocalChange);
+
+    /**
+     * Whether a running sync should be interrupted for waiting folders.
+     *
+     * Only the time spent propagating counts: the discovery has to run again
+     * after a preemption, so a sync whose discovery alone takes longer than
+     * @a timeout would never finish otherwise. A folder isn't preempted more
+     * than maxConsecutiveSyncPreemptions() times in a row.
+     */
+    static bool isSyncPreemptionDue(std::chrono::milliseconds sincePropagationStart,
+        int consecutivePreemptedSyncs,
+        std::chrono::milliseconds timeout);
+
+    /** See isSyncPreemptionDue() */
+    static constexpr int maxConsecutiveSyncPreemptions() { return 2; }
+
+    /**
+     * When to open the connections for a sync that starts in @a syncDelay.
+     *
+     * The handshakes get a head start of connectionWarmUpLead(), not more
+     * since idle connections are dropped after a while.
+     */
+    static std::chrono::milliseconds connectionWarmUpDelay(std::chrono::milliseconds syncDelay);
+
+    /** See connectionWarmUpDelay() */
+    static constexpr std::chrono::milliseconds connectionWarmUpLead() { return std::chrono::seconds(2); }
 
     /**
      * Returns true if any folder is currently syncing.
@@ -262,6 +306,8 @@ private slots:
 
     // slot to take the next folder from queue and start syncing.
     void slotStartScheduledFolderSync();
+    // slot to open connections for the folders that are about to sync.
+    void slotWarmUpConnections();
     void slotEtagPollTimerTimeout();
 
     void slotAccountRemoved(AccountState *accountState);
@@ -292,6 +338,7 @@ private slots:
 
     void slotSetupPushNotifications(const Folder::Map &);
     void slotProcessFilesPushNotification(Account *account);
+    void slotProcessFileIdsPushNotification(Account *account, const QVector<qint64> &fileIds);
     void slotConnectToPushNotifications(Account *account);
 
 private:
@@ -307,6 +354,18 @@ private:
     /** Will start a sync after a bit of delay. */
     void startScheduledSyncSoon();
 
+    /** Number of folders that could start syncing right now */
+    int freeSyncSlots() const;
+
+    /** The scheduled folder that should start syncing next, if any */
+    Folder *nextFolderToSync() const;
+
+    /** Divides the network job budget evenly between the running syncs */
+    void rebalanceNetworkJobBudget();
+
+    /** Interrupts a long sync at a safe point if other folders are waiting */
+    void preemptLongRunningSync();
+
     // finds all folder configuration files
     // and create the folders
     QString getBackupName(QString fullPathName) const;
@@ -327,8 +386,13 @@ private:
     QSet<Folder *> _disabledFolders;
     Folder::Map _folderMap;
     QString _folderConfigPath;
-    Folder *_currentSyncFolder = nullptr;
+    QList<Folder *> _currentSyncFolders;
     QPointer<Folder> _lastSyncFolder;
+    /// Set by scheduleFolderNext(), starts before all other scheduled folders
+    QPointer<Folder> _nextSyncFolder;
+    int _maxConcurrentSyncs = 1;
+    int _networkJobBudget = 0;
+    std::chrono::milliseconds _syncPreemptionTimeout = std::chrono::milliseconds(0);
     bool _syncEnabled = true;
 
     /// Folder aliases from the settings that weren't read
@@ -351,6 +415,9 @@ private:
     /// Picks the next scheduled folder and starts the sync
     QTimer _startScheduledSyncTimer;
 
+    /// Warms up the connections of the scheduled folders shortly before they sync
+    QTimer _warmUpConnectionsTimer;
+
     QScopedPointer<SocketApi> _socketApi;
     NavigationPaneHelper _navigationPaneHelper;
 
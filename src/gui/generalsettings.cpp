@@ -21,6 +21,7 @@
 #include "configfile.h"
 #include "owncloudsetupwizard.h"
 #include "accountmanager.h"
+#include "folderman.h"
 #include "guiutility.h"
 
 #if defined(BUILD_UPDATER)
@@ -133,6 +134,20 @@ void createDebugArchive(const QString &filename)
 
     const auto buildInfo = QString(OCC::Theme::instance()->about() + "\n\n" + OCC::Theme::instance()->aboutDetails());
     zip.addFile("__nextcloud_client_buildinfo.txt", buildInfo.toUtf8());
+
+    QString journalStats;
+    for (const auto folder : OCC::FolderMan::instance()->map()) {
+        const auto stats = folder->journalDb()->databaseStats();
+        journalStats += QStringLiteral("%1: %2 pages of %3 bytes, %4 free (%5%), WAL %6 bytes, incremental vacuum %7\n")
+                            .arg(folder->journalDb()->databaseFilePath())
+                            .arg(stats.pageCount)
+                            .arg(stats.pageSize)
+                            .arg(stats.freePages)
+                            .arg(qRound(stats.fragmentation() * 100))
+                            .arg(stats.walSize)
+                            .arg(stats.incrementalVacuum ? QStringLiteral("on") : QStringLiteral("off"));
+    }
+    zip.addFile("__nextcloud_journal_stats.txt", journalStats.toUtf8());
 }
 }
 
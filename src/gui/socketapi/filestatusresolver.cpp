@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "filestatusresolver.h"
+#include "common/syncjournaldb.h"
+
+#include <QLoggingCategory>
+
+#include <map>
+#include <memory>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcFileStatusResolver, "nextcloud.gui.socketapi.statusresolver", QtInfoMsg)
+
+/* Lives in the resolver's thread and owns the read-only connections */
+class FileStatusResolverWorker : public QObject
+{
+public:
+    SyncJournalReader *reader(const QString &journalPath)
+    {
+        auto &reader = _readers[journalPath];
+        if (!reader) {
+            qCInfo(lcFileStatusResolver) << "Opening read-only journal connection for" << journalPath;
+            reader.reset(new SyncJournalReader(journalPath));
+        }
+        return reader.get();
+    }
+
+    void closeJournal(const QString &journalPath)
+    {
+        _readers.erase(journalPath);
+    }
+
+private:
+    std::map<QString, std::unique_ptr<SyncJournalReader>> _readers;
+};
+
+FileStatusResolver::FileStatusResolver(QObject *parent)
+    : QObject(parent)
+    , _worker(new FileStatusResolverWorker)
+{
+    _thread.setObjectName(QStringLiteral("FileStatusResolver"));
+    _worker->moveToThread(&_thread);
+    _thread.start();
+}
+
+FileStatusResolver::~FileStatusResolver()
+{
+    _thread.quit();
+    _thread.wait();
+    // The thread is done, closing the connections from here is fine
+    delete _worker;
+}
+
+void FileStatusResolver::resolve(const QString &journalPath, const QStringList &relativePaths, const Callback &callback)
+{
+    auto worker = _worker;
+    QMetaObject::invokeMethod(_worker, [this, worker, journalPath, relativePaths, callback] {
+        QVector<SyncJournalFileRecord> records(relativePaths.size());
+        bool ok = true;
+        auto reader = worker->reader(journalPath);
+        for (int i = 0; i < relativePaths.size(); ++i) {
+            if (!reader->getFileRecord(relativePaths.at(i), &records[i])) {
+                qCWarning(lcFileStatusResolver) << "Could not read records from" << journalPath;
+                records = QVector<SyncJournalFileRecord>(relativePaths.size());
+                ok = false;
+                break;
+            }
+        }
+
+        QMetaObject::invokeMethod(this, [callback, records, ok] {
+            callback(records, ok);
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+void FileStatusResolver::closeJournal(const QString &journalPath)
+{
+    if (!_thread.isRunning())
+        return;
+    auto worker = _worker;
+    QMetaObject::invokeMethod(_worker, [worker, journalPath] {
+        worker->closeJournal(journalPath);
+    }, Qt::BlockingQueuedConnection);
+}
+
+} // namespace OCC
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "common/syncjournalfilerecord.h"
+
+#include <QObject>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+
+#include <functional>
+
+namespace OCC {
+
+class FileStatusResolverWorker;
+
+/**
+ * @brief Looks up journal records for the socket api in a worker thread
+ * @ingroup gui
+ *
+ * Shell extensions ask for the status of every file they display. The
+ * journal lookups for these requests are done in a worker thread with
+ * one read-only connection per journal (see SyncJournalReader), so they
+ * neither block the GUI thread on the disk nor wait for a sync that holds
+ * the SyncJournalDb mutex.
+ *
+ * Only the journal lookups happen in the worker: the in-memory state of
+ * the SyncFileStatusTracker is combined with the records in the GUI thread.
+ */
+class FileStatusResolver : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * Receives the records in the order of the requested paths.
+     *
+     * ok is false if the journal couldn't be read; the records are invalid then.
+     */
+    using Callback = std::function<void(const QVector<SyncJournalFileRecord> &records, bool ok)>;
+
+    explicit FileStatusResolver(QObject *parent = nullptr);
+    ~FileStatusResolver() override;
+
+    /**
+     * Looks up the records for the folder relative paths in the journal.
+     *
+     * The callback is called in this object's thread, unless this object
+     * is destroyed first.
+     */
+    void resolve(const QString &journalPath, const QStringList &relativePaths, const Callback &callback);
+
+    /** Closes the read-only connection to the journal, if any. Blocks until it's closed. */
+    void closeJournal(const QString &journalPath);
+
+private:
+    QThread _thread;
+    FileStatusResolverWorker *_worker;
+};
+
+} // namespace OCC
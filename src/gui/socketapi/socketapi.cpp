@@ -27,6 +27,7 @@
 #include "folder.h"
 #include "theme.h"
 #include "common/syncjournalfilerecord.h"
+#include "common/syncmetrics.h"
 #include "syncengine.h"
 #include "syncfileitem.h"
 #include "filesystem.h"
@@ -79,7 +80,7 @@
 // This is the version that is returned when the client asks for the VERSION.
 // The first number should be changed if there is an incompatible change that breaks old clients.
 // The second number should be changed when there are new features.
-#define MIRALL_SOCKET_API_VERSION "1.1"
+#define MIRALL_SOCKET_API_VERSION "1.2"
 
 namespace {
 
@@ -453,6 +454,10 @@ void SocketApi::slotRegisterPath(const QString &alias)
 
 void SocketApi::slotUnregisterPath(const QString &alias)
 {
+    // Release the read-only journal connection, the journal may be about to be wiped
+    if (Folder *f = FolderMan::instance()->folder(alias))
+        _statusResolver.closeJournal(f->journalDb()->databaseFilePath());
+
     if (!_registeredAliases.contains(alias))
         return;
 
@@ -573,6 +578,92 @@ void SocketApi::command_RETRIEVE_FILE_STATUS(const QString &argument, SocketList
     listener->sendMessage(message);
 }
 
+struct SocketApi::FileStatusBatch
+{
+    QPointer<QIODevice> socket;
+    QStringList files;
+    QStringList statuses;
+    int pendingLookups = 0;
+};
+
+void SocketApi::command_RETRIEVE_FILE_STATUS_MULTI(const QString &argument, SocketListener *listener)
+{
+    auto batch = QSharedPointer<FileStatusBatch>::create();
+    batch->socket = listener->socket;
+    batch->files = split(argument);
+    batch->statuses.reserve(batch->files.size());
+
+    // Group the files by folder to do one batch of lookups per journal
+    QHash<Folder *, QVector<int>> indexesByFolder;
+    QStringList relativePaths;
+    relativePaths.reserve(batch->files.size());
+    for (int i = 0; i < batch->files.size(); ++i) {
+        const auto fileData = FileData::get(batch->files.at(i));
+        relativePaths.append(fileData.folderRelativePath);
+        batch->statuses.append(QStringLiteral("NOP"));
+        if (!fileData.folder)
+            continue;
+
+        QString directory = fileData.localPath.left(fileData.localPath.lastIndexOf('/'));
+        listener->registerMonitoredDirectory(qHash(directory));
+        indexesByFolder[fileData.folder].append(i);
+    }
+
+    for (auto it = indexesByFolder.cbegin(); it != indexesByFolder.cend(); ++it) {
+        Folder *folder = it.key();
+        const auto &indexes = it.value();
+        auto &tracker = folder->syncEngine().syncFileStatusTracker();
+
+        if (!folder->journalDb()->allowsReadOnlyConnections()) {
+            for (int i : indexes) {
+                batch->statuses[i] = tracker.fileStatus(relativePaths.at(i)).toSocketAPIString();
+            }
+            continue;
+        }
+
+        QStringList folderPaths;
+        folderPaths.reserve(indexes.size());
+        for (int i : indexes) {
+            folderPaths.append(relativePaths.at(i));
+        }
+
+        batch->pendingLookups++;
+        const auto alias = folder->alias();
+        _statusResolver.resolve(folder->journalDb()->databaseFilePath(), folderPaths,
+            [this, batch, alias, indexes, folderPaths](const QVector<SyncJournalFileRecord> &records, bool ok) {
+                // The folder may have been removed in the meantime
+                if (auto folder = FolderMan::instance()->folder(alias)) {
+                    auto &tracker = folder->syncEngine().syncFileStatusTracker();
+                    for (int k = 0; k < indexes.size(); ++k) {
+                        const auto status = ok
+                            ? tracker.fileStatus(folderPaths.at(k), records.at(k))
+                            : tracker.fileStatus(folderPaths.at(k));
+                        batch->statuses[indexes.at(k)] = status.toSocketAPIString();
+                    }
+                }
+                if (--batch->pendingLookups == 0)
+                    sendFileStatusBatch(*batch);
+            });
+    }
+
+    if (batch->pendingLookups == 0)
+        sendFileStatusBatch(*batch);
+}
+
+void SocketApi::sendFileStatusBatch(const FileStatusBatch &batch)
+{
+    const auto listener = _listeners.value(batch.socket);
+    if (!listener) {
+        qCInfo(lcSocketApi) << "Dropping status replies for a closed connection";
+        return;
+    }
+
+    for (int i = 0; i < batch.files.size(); ++i) {
+        listener->sendMessage(QLatin1String("STATUS:") % batch.statuses.at(i) % QLatin1Char(':') % QDir::toNativeSeparators(batch.files.at(i)));
+    }
+    listener->sendMessage(QStringLiteral("RETRIEVE_FILE_STATUS_MULTI:END"));
+}
+
 void SocketApi::command_SHARE(const QString &localFile, SocketListener *listener)
 {
     processShareRequest(localFile, listener, ShareDialogStartPage::UsersAndGroups);
@@ -961,6 +1052,11 @@ void SocketApi::command_V2_UPLOAD_FILES_FROM(const QSharedPointer<SocketApiJobV2
     uploadJob->start();
 }
 
+void SocketApi::command_V2_GET_METRICS(const QSharedPointer<SocketApiJobV2> &job) const
+{
+    job->success(SyncMetrics::instance()->toJson());
+}
+
 void SocketApi::emailPrivateLink(const QString &link)
 {
     Utility::openEmailComposer(
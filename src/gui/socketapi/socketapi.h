@@ -19,6 +19,7 @@
 #include "common/syncfilestatus.h"
 #include "sharedialog.h" // for the ShareDialogStartPage
 #include "common/syncjournalfilerecord.h"
+#include "socketapi/filestatusresolver.h"
 
 #include "config.h"
 
@@ -106,6 +107,14 @@ private:
     Q_INVOKABLE void command_RETRIEVE_FOLDER_STATUS(const QString &argument, SocketListener *listener);
     Q_INVOKABLE void command_RETRIEVE_FILE_STATUS(const QString &argument, SocketListener *listener);
 
+    /** Send the status of several files at once (added in version 1.2)
+     * argument is a list of files, separated by '\x1e'
+     * Replies with one STATUS:[status]:[file] per file, like RETRIEVE_FILE_STATUS,
+     * and ends with RETRIEVE_FILE_STATUS_MULTI:END
+     * The journal lookups are done in a worker thread, see FileStatusResolver.
+     */
+    Q_INVOKABLE void command_RETRIEVE_FILE_STATUS_MULTI(const QString &argument, SocketListener *listener);
+
     Q_INVOKABLE void command_VERSION(const QString &argument, SocketListener *listener);
 
     Q_INVOKABLE void command_SHARE_MENU_TITLE(const QString &argument, SocketListener *listener);
@@ -134,6 +143,9 @@ private:
     Q_INVOKABLE void command_V2_LIST_ACCOUNTS(const QSharedPointer<SocketApiJobV2> &job) const;
     Q_INVOKABLE void command_V2_UPLOAD_FILES_FROM(const QSharedPointer<SocketApiJobV2> &job) const;
 
+    // Sync performance counters, see SyncMetrics
+    Q_INVOKABLE void command_V2_GET_METRICS(const QSharedPointer<SocketApiJobV2> &job) const;
+
     // Fetch the private link and call targetFun
     void fetchPrivateLinkUrlHelper(const QString &localFile, const std::function<void(const QString &url)> &targetFun);
 
@@ -168,9 +180,13 @@ private:
 
     QString buildRegisterPathMessage(const QString &path);
 
+    struct FileStatusBatch;
+    void sendFileStatusBatch(const FileStatusBatch &batch);
+
     QSet<QString> _registeredAliases;
     QMap<QIODevice *, QSharedPointer<SocketListener>> _listeners;
     SocketApiServer _localServer;
+    FileStatusResolver _statusResolver;
 };
 }
 
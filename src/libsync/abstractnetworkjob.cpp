@@ -35,6 +35,9 @@
 #include "account.h"
 #include "owncloudpropagator.h"
 #include "httplogger.h"
+#include "transfergovernor.h"
+#include "common/syncmetrics.h"
+#include "common/synctrace.h"
 
 #include "creds/abstractcredentials.h"
 
@@ -150,6 +153,12 @@ QNetworkReply *AbstractNetworkJob::sendRequest(const QByteArray &verb, const QUr
 
 void AbstractNetworkJob::adoptRequest(QNetworkReply *reply)
 {
+    _requestTime.start();
+    if (SyncTrace::isEnabled()) {
+        const QString name = QString::fromLatin1(HttpLogger::requestVerb(*reply)) + QLatin1Char(' ') + reply->request().url().path();
+        SyncTrace::begin(SyncTrace::Http, name, SyncTrace::spanId(this));
+    }
+    TransferGovernor::instance()->registerRequest(this, reply->request().url());
     addTimer(reply);
     setReply(reply);
     setupConnections(reply);
@@ -169,6 +178,13 @@ QUrl AbstractNetworkJob::makeDavUrl(const QString &relativePath) const
 void AbstractNetworkJob::slotFinished()
 {
     _timer.stop();
+    TransferGovernor::instance()->unregisterRequest(this);
+    SyncTrace::end(SyncTrace::Http, SyncTrace::spanId(this),
+        _reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    if (_requestTime.isValid()) {
+        SyncMetrics::instance()->histogram(QStringLiteral("http.latency_ms.") + QString::fromLatin1(HttpLogger::requestVerb(*_reply)))
+            ->record(_requestTime.elapsed());
+    }
 
     if (_reply->error() == QNetworkReply::SslHandshakeFailedError) {
         qCWarning(lcNetworkJob) << "SslHandshakeFailedError: " << errorString() << " : can be caused by a webserver wanting SSL client certificates";
@@ -188,6 +204,8 @@ void AbstractNetworkJob::slotFinished()
         } else {
             qCInfo(lcNetworkJob) << "HTTP2 resending" << _reply->request().url();
             _http2ResendCount++;
+            static auto resends = SyncMetrics::instance()->counter(QStringLiteral("http.resends"));
+            resends->add();
 
             resetTimeout();
             if (_requestBody) {
@@ -336,6 +354,7 @@ QString AbstractNetworkJob::errorStringParsingBody(QByteArray *body)
 
 AbstractNetworkJob::~AbstractNetworkJob()
 {
+    TransferGovernor::instance()->unregisterRequest(this);
     setReply(nullptr);
 }
 
@@ -446,6 +465,8 @@ void AbstractNetworkJob::retry()
     QUrl requestedUrl = req.url();
     QByteArray verb = HttpLogger::requestVerb(*_reply);
     qCInfo(lcNetworkJob) << "Restarting" << verb << requestedUrl;
+    static auto retries = SyncMetrics::instance()->counter(QStringLiteral("http.retries"));
+    retries->add();
     resetTimeout();
     if (_requestBody) {
         _requestBody->seek(0);
@@ -197,6 +197,7 @@ private:
     QPointer<QNetworkReply> _reply; // (QPointer because the NetworkManager may be destroyed before the jobs at exit)
     QString _path;
     QTimer _timer;
+    QElapsedTimer _requestTime;
     int _redirectCount = 0;
     int _http2ResendCount = 0;
 
@@ -102,6 +102,14 @@ void AbstractPropagateRemoteDeleteEncrypted::slotFolderUnLockedSuccessfully(cons
     _folderToken = "";
 }
 
+void AbstractPropagateRemoteDeleteEncrypted::slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode)
+{
+    Q_UNUSED(json);
+    Q_UNUSED(statusCode);
+    qCWarning(ABSTRACT_PROPAGATE_REMOVE_ENCRYPTED) << "Unexpected metadata received";
+    taskFailed();
+}
+
 void AbstractPropagateRemoteDeleteEncrypted::slotDeleteRemoteItemFinished()
 {
     auto *deleteJob = qobject_cast<DeleteJob *>(QObject::sender());
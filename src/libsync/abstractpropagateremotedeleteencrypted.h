@@ -51,7 +51,7 @@ protected:
     void slotTryLock(const QByteArray &folderId);
     void slotFolderLockedSuccessfully(const QByteArray &folderId, const QByteArray &token);
     virtual void slotFolderUnLockedSuccessfully(const QByteArray &folderId);
-    virtual void slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode) = 0;
+    virtual void slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode);
     void slotDeleteRemoteItemFinished();
 
     void deleteRemoteItem(const QString &filename);
@@ -54,6 +54,13 @@ QByteArray AccessManager::generateRequestId()
     return QUuid::createUuid().toByteArray(QUuid::WithoutBraces);
 }
 
+bool AccessManager::isHttp2Allowed()
+{
+    // http2 seems to cause issues, as with our recommended server setup we don't support http2, disable it by default for now
+    static const bool http2EnabledEnv = qEnvironmentVariableIntValue("OWNCLOUD_HTTP2_ENABLED") == 1;
+    return http2EnabledEnv;
+}
+
 QNetworkReply *AccessManager::createRequest(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData)
 {
     QNetworkRequest newRequest(request);
@@ -81,10 +88,7 @@ QNetworkReply *AccessManager::createRequest(QNetworkAccessManager::Operation op,
 #if QT_VERSION >= QT_VERSION_CHECK(5, 9, 4)
     // only enable HTTP2 with Qt 5.9.4 because old Qt have too many bugs (e.g. QTBUG-64359 is fixed in >= Qt 5.9.4)
     if (newRequest.url().scheme() == "https") { // Not for "http": QTBUG-61397
-        // http2 seems to cause issues, as with our recommended server setup we don't support http2, disable it by default for now
-        static const bool http2EnabledEnv = qEnvironmentVariableIntValue("OWNCLOUD_HTTP2_ENABLED") == 1;
-
-        newRequest.setAttribute(QNetworkRequest::HTTP2AllowedAttribute, http2EnabledEnv);
+        newRequest.setAttribute(QNetworkRequest::HTTP2AllowedAttribute, _http2Allowed);
     }
 #endif
 
@@ -34,10 +34,26 @@ class OWNCLOUDSYNC_EXPORT AccessManager : public QNetworkAccessManager
 public:
     static QByteArray generateRequestId();
 
+    /**
+     * Whether requests to https urls may use HTTP/2 by default
+     *
+     * Off unless OWNCLOUD_HTTP2_ENABLED is 1. Accounts can override it,
+     * see Account::setHttp2Enabled(). The protocol is then negotiated
+     * with every server, HTTP/1.1 is used when the server doesn't offer
+     * HTTP/2.
+     */
+    static bool isHttp2Allowed();
+
     AccessManager(QObject *parent = nullptr);
 
+    /** Whether the requests of this access manager may use HTTP/2 */
+    void setHttp2Allowed(bool allowed) { _http2Allowed = allowed; }
+
 protected:
     QNetworkReply *createRequest(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData = nullptr) override;
+
+private:
+    bool _http2Allowed = isHttp2Allowed();
 };
 
 } // namespace OCC
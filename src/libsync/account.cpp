@@ -20,6 +20,7 @@
 #include "configfile.h"
 #include "accessmanager.h"
 #include "creds/abstractcredentials.h"
+#include "creds/keychainchunk.h"
 #include "capabilities.h"
 #include "theme.h"
 #include "pushnotifications.h"
@@ -46,6 +47,8 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QDataStream>
+#include <QDateTime>
 #include <QLoggingCategory>
 
 #include <qsslconfiguration.h>
@@ -56,16 +59,22 @@ using namespace QKeychain;
 
 namespace {
 constexpr int pushNotificationsReconnectInterval = 1000 * 60 * 2;
+constexpr int sslSessionFormatVersion = 1;
+// Used when the server doesn't hint at the lifetime of its tickets
+constexpr int sslSessionDefaultLifetimeSecs = 2 * 60 * 60;
+constexpr qint64 sslSessionPersistIntervalMs = 60 * 60 * 1000;
 }
 
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcAccount, "nextcloud.sync.account", QtInfoMsg)
 const char app_password[] = "_app-password";
+const char tls_session[] = "_tls-session";
 
 Account::Account(QObject *parent)
     : QObject(parent)
     , _capabilities(QVariantMap())
+    , _http2Enabled(AccessManager::isHttp2Allowed())
 {
     qRegisterMetaType<AccountPtr>("AccountPtr");
     qRegisterMetaType<Account *>("Account*");
@@ -192,6 +201,8 @@ void Account::setCredentials(AbstractCredentials *cred)
     // This is necessary to avoid issues with the QNAM being deleted while
     // processing slotHandleSslErrors().
     _am = QSharedPointer<QNetworkAccessManager>(_credentials->createQNAM(), &QObject::deleteLater);
+    if (auto accessManager = qobject_cast<AccessManager *>(_am.data()))
+        accessManager->setHttp2Allowed(_http2Enabled);
 
     if (jar) {
         _am->setCookieJar(jar);
@@ -304,6 +315,8 @@ void Account::resetNetworkAccessManager()
     // Use a QSharedPointer to allow locking the life of the QNAM on the stack.
     // Make it call deleteLater to make sure that we can return to any QNAM stack frames safely.
     _am = QSharedPointer<QNetworkAccessManager>(_credentials->createQNAM(), &QObject::deleteLater);
+    if (auto accessManager = qobject_cast<AccessManager *>(_am.data()))
+        accessManager->setHttp2Allowed(_http2Enabled);
 
     _am->setCookieJar(jar); // takes ownership of the old cookie jar
     _am->setProxy(proxy);   // Remember proxy (issue #2108)
@@ -314,6 +327,17 @@ void Account::resetNetworkAccessManager()
         this, &Account::proxyAuthenticationRequired);
 }
 
+void Account::setHttp2Enabled(bool enabled)
+{
+    _http2Enabled = enabled;
+    if (auto accessManager = qobject_cast<AccessManager *>(_am.data()))
+        accessManager->setHttp2Allowed(enabled);
+    // Open connections keep their protocol, the next connection check
+    // finds out whether the server negotiates HTTP/2
+    if (!enabled)
+        _http2Supported = false;
+}
+
 QNetworkAccessManager *Account::networkAccessManager()
 {
     return _am.data();
@@ -389,9 +413,113 @@ QSslConfiguration Account::getOrCreateSslConfig()
     sslConfig.setSslOption(QSsl::SslOptionDisableSessionSharing, false);
     sslConfig.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
 
+    // A session of the last run lets the first connection skip the full handshake
+    if (!_restoredSslSession.isEmpty()) {
+        sslConfig.setSessionTicket(_restoredSslSession);
+    }
+
     return sslConfig;
 }
 
+void Account::restoreSslSession()
+{
+    if (id().isEmpty()) {
+        return;
+    }
+
+    auto job = new KeychainChunk::ReadJob(this, davUser() + tls_session, false);
+    connect(job, &KeychainChunk::ReadJob::finished, this, [this](KeychainChunk::ReadJob *readJob) {
+        if (readJob->error() != NoError || readJob->binaryData().isEmpty()) {
+            return;
+        }
+
+        QDataStream stream(readJob->binaryData());
+        int version = 0;
+        QDateTime expiry;
+        QByteArray ticket;
+        stream >> version;
+        if (version != sslSessionFormatVersion) {
+            return;
+        }
+        stream >> expiry >> ticket;
+        if (stream.status() != QDataStream::Ok || ticket.isEmpty() || expiry <= QDateTime::currentDateTimeUtc()) {
+            qCInfo(lcAccount) << "Discarding expired TLS session of" << displayName();
+            return;
+        }
+
+        qCInfo(lcAccount) << "Restored TLS session of" << displayName() << "valid until" << expiry;
+        _restoredSslSession = ticket;
+        _persistedSslSession = ticket;
+    });
+    job->start();
+}
+
+void Account::persistSslSession(const QSslConfiguration &config)
+{
+    const auto ticket = config.sessionTicket();
+    if (id().isEmpty() || ticket.isEmpty() || ticket == _persistedSslSession) {
+        return;
+    }
+    // Servers hand out new tickets all the time, don't hit the keychain for each of them
+    if (!_persistedSslSession.isEmpty() && _sslSessionPersistTimer.isValid()
+        && !_sslSessionPersistTimer.hasExpired(sslSessionPersistIntervalMs)) {
+        return;
+    }
+
+    const int lifetime = config.sessionTicketLifeTimeHint() > 0
+        ? config.sessionTicketLifeTimeHint()
+        : sslSessionDefaultLifetimeSecs;
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << sslSessionFormatVersion << QDateTime::currentDateTimeUtc().addSecs(lifetime) << ticket;
+
+    _persistedSslSession = ticket;
+    _sslSessionPersistTimer.start();
+
+    // The session holds the master secret, it must not end up in a plain text fallback
+    auto job = new KeychainChunk::WriteJob(this, davUser() + tls_session, data);
+    connect(job, &KeychainChunk::WriteJob::finished, this, [](KeychainChunk::WriteJob *writeJob) {
+        if (writeJob->error() != NoError)
+            qCWarning(lcAccount) << "Unable to store TLS session in keychain" << writeJob->errorString();
+    });
+    job->start();
+}
+
+void Account::deleteSslSession()
+{
+    _restoredSslSession.clear();
+    _persistedSslSession.clear();
+    _sslSessionPersistTimer.invalidate();
+
+    auto job = new KeychainChunk::DeleteJob(this, davUser() + tls_session, false);
+    connect(job, &KeychainChunk::DeleteJob::finished, this, [](KeychainChunk::DeleteJob *deleteJob) {
+        if (deleteJob->error() != NoError && deleteJob->error() != EntryNotFound)
+            qCWarning(lcAccount) << "Unable to delete TLS session from keychain" << deleteJob->errorString();
+    });
+    job->start();
+}
+
+void Account::warmUpConnection()
+{
+    if (!_am) {
+        return;
+    }
+
+    const auto host = url().host();
+    if (url().scheme() == QLatin1String("https")) {
+        auto sslConfig = getOrCreateSslConfig();
+        // Requests only pick up a connection that negotiated the protocol they allow
+        if (_http2Enabled) {
+            sslConfig.setAllowedNextProtocols({ QSslConfiguration::ALPNProtocolHTTP2, QSslConfiguration::NextProtocolHttp1_1 });
+        } else {
+            sslConfig.setAllowedNextProtocols({ QSslConfiguration::NextProtocolHttp1_1 });
+        }
+        _am->connectToHostEncrypted(host, static_cast<quint16>(url().port(443)), sslConfig);
+    } else {
+        _am->connectToHost(host, static_cast<quint16>(url().port(80)));
+    }
+}
+
 void Account::setApprovedCerts(const QList<QSslCertificate> certs)
 {
     _approvedCerts = certs;
@@ -26,6 +26,7 @@
 #include <QSslCipher>
 #include <QSslError>
 #include <QSharedPointer>
+#include <QElapsedTimer>
 
 #ifndef TOKEN_AUTH_ONLY
 #include <QPixmap>
@@ -172,6 +173,24 @@ public:
     QByteArray _sessionTicket;
     QList<QSslCertificate> _peerCertificateChain;
 
+    /** Reads the TLS session of the last run from the keychain.
+     *
+     * Until CheckServerJob sets the shared ssl configuration, it is used
+     * by getOrCreateSslConfig() so that the first connection after a
+     * restart can resume the session instead of a full handshake.
+     */
+    void restoreSslSession();
+    /// Stores the session of \a config in the keychain, at most once an hour
+    void persistSslSession(const QSslConfiguration &config);
+    void deleteSslSession();
+
+    /** Opens a connection to the server ahead of the first request.
+     *
+     * The connection is kept by the QNAM, so that jobs started shortly
+     * after don't have to wait for the TCP and TLS handshakes.
+     */
+    void warmUpConnection();
+
 
     /** The certificates of the account */
     QList<QSslCertificate> approvedCerts() const { return _approvedCerts; }
@@ -231,6 +250,15 @@ public:
     bool isHttp2Supported() { return _http2Supported; }
     void setHttp2Supported(bool value) { _http2Supported = value; }
 
+    /** Whether HTTP/2 is offered to the server of this account
+     *
+     * Defaults to AccessManager::isHttp2Allowed(). Only when the server
+     * then negotiates it, isHttp2Supported() becomes true and the syncs
+     * run more small requests in parallel.
+     */
+    bool isHttp2Enabled() const { return _http2Enabled; }
+    void setHttp2Enabled(bool enabled);
+
     void clearCookieJar();
     void lendCookieJarTo(QNetworkAccessManager *guest);
     QString cookieJarPath();
@@ -328,12 +356,16 @@ private:
 
     QList<QSslCertificate> _approvedCerts;
     QSslConfiguration _sslConfiguration;
+    QByteArray _restoredSslSession;
+    QByteArray _persistedSslSession;
+    QElapsedTimer _sslSessionPersistTimer;
     Capabilities _capabilities;
     QString _serverVersion;
     QScopedPointer<AbstractSslErrorHandler> _sslErrorHandler;
     QSharedPointer<QNetworkAccessManager> _am;
     QScopedPointer<AbstractCredentials> _credentials;
     bool _http2Supported = false;
+    bool _http2Enabled = false;
 
     /// Certificates that were explicitly rejected by the user
     QList<QSslCertificate> _rejectedCertificates;
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "asynclogwriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iterator>
+#include <limits>
+
+namespace OCC {
+
+constexpr int AsyncLogWriter::RingCapacity;
+constexpr std::chrono::milliseconds AsyncLogWriter::FullRingWait;
+
+struct AsyncLogWriter::Ring
+{
+    struct Entry
+    {
+        quint64 sequence = 0;
+        QString message;
+    };
+    std::vector<Entry> entries = std::vector<Entry>(RingCapacity);
+    // Only advanced by the producing thread
+    std::atomic<quint64> tail{ 0 };
+    // Only advanced by the writer thread
+    std::atomic<quint64> head{ 0 };
+    // Set when the producing thread no longer posts to this ring
+    std::atomic<bool> abandoned{ false };
+};
+
+namespace {
+    std::atomic<quint64> nextWriterId{ 1 };
+
+    // The ring of the current thread and the writer it belongs to
+    struct ThreadRing
+    {
+        quint64 writerId = 0;
+        std::shared_ptr<AsyncLogWriter::Ring> ring;
+
+        ~ThreadRing()
+        {
+            if (ring)
+                ring->abandoned.store(true, std::memory_order_release);
+        }
+    };
+    thread_local ThreadRing currentThreadRing;
+}
+
+AsyncLogWriter::AsyncLogWriter(BatchWriter writeBatch)
+    : _writeBatch(std::move(writeBatch))
+    , _id(nextWriterId.fetch_add(1))
+    , _thread([this] { run(); })
+{
+}
+
+AsyncLogWriter::~AsyncLogWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_one();
+    _thread.join();
+}
+
+AsyncLogWriter::Ring *AsyncLogWriter::threadRing()
+{
+    auto &slot = currentThreadRing;
+    if (slot.writerId != _id) {
+        if (slot.ring)
+            slot.ring->abandoned.store(true, std::memory_order_release);
+        slot.ring = std::make_shared<Ring>();
+        slot.writerId = _id;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _rings.push_back(slot.ring);
+    }
+    return slot.ring.get();
+}
+
+void AsyncLogWriter::post(const QString &message)
+{
+    auto ring = threadRing();
+    const auto tail = ring->tail.load(std::memory_order_relaxed);
+    auto used = tail - ring->head.load(std::memory_order_acquire);
+    if (used >= RingCapacity) {
+        _wake.notify_one();
+        // The writer thread can't drain its own ring while it waits here
+        if (!isWriterThread()) {
+            const auto deadline = std::chrono::steady_clock::now() + FullRingWait;
+            while (used >= RingCapacity && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                used = tail - ring->head.load(std::memory_order_acquire);
+            }
+        }
+        if (used >= RingCapacity) {
+            // The writer is stuck, e.g. on a slow disk: keep the message anyway
+            std::lock_guard<std::mutex> lock(_mutex);
+            _overflow.emplace_back(_sequence.fetch_add(1, std::memory_order_relaxed), message);
+            _overflowed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    auto &entry = ring->entries[tail % RingCapacity];
+    entry.sequence = _sequence.fetch_add(1, std::memory_order_relaxed);
+    entry.message = message;
+    ring->tail.store(tail + 1, std::memory_order_release);
+
+    // Don't wait for the next round when the ring fills up
+    if (used + 1 == RingCapacity / 2)
+        _wake.notify_one();
+}
+
+void AsyncLogWriter::runOnWriterThread(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back({ _sequence.fetch_add(1), std::move(task) });
+    }
+    _wake.notify_one();
+}
+
+void AsyncLogWriter::sync()
+{
+    // The writer thread gets to its own messages after the current batch
+    if (isWriterThread())
+        return;
+
+    std::promise<void> written;
+    runOnWriterThread([&written] { written.set_value(); });
+    written.get_future().wait();
+}
+
+bool AsyncLogWriter::isWriterThread() const
+{
+    return std::this_thread::get_id() == _thread.get_id();
+}
+
+void AsyncLogWriter::run()
+{
+    forever {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (!_stop && _tasks.empty())
+                _wake.wait_for(lock, std::chrono::milliseconds(50));
+            if (_stop)
+                break;
+        }
+        drain();
+    }
+
+    // Whatever was posted until now
+    while (drain()) {
+    }
+}
+
+bool AsyncLogWriter::drain()
+{
+    std::vector<Task> tasks;
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        tasks.swap(_tasks);
+        rings = _rings;
+    }
+
+    // Taking the tasks first ensures that the messages posted before them are visible now
+    const auto sequenceBeforeRings = _sequence.load(std::memory_order_acquire);
+    std::vector<std::pair<quint64, QString>> pending;
+    bool hasAbandoned = false;
+    for (const auto &ring : rings) {
+        // Nothing gets added to an abandoned ring once it's drained
+        const bool abandoned = ring->abandoned.load(std::memory_order_acquire);
+        hasAbandoned = hasAbandoned || abandoned;
+
+        auto head = ring->head.load(std::memory_order_relaxed);
+        const auto tail = ring->tail.load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            auto &entry = ring->entries[head % RingCapacity];
+            pending.emplace_back(entry.sequence, std::move(entry.message));
+            entry.message = QString();
+        }
+        ring->head.store(head, std::memory_order_release);
+    }
+
+    bool overflowLeft = false;
+    {
+        // Messages that overflowed while the rings were read wait for the next
+        // round, the earlier messages of their thread may not have been taken
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto split = std::stable_partition(_overflow.begin(), _overflow.end(), [&](const std::pair<quint64, QString> &entry) {
+            return entry.first < sequenceBeforeRings;
+        });
+        std::move(_overflow.begin(), split, std::back_inserter(pending));
+        _overflow.erase(_overflow.begin(), split);
+        overflowLeft = !_overflow.empty();
+    }
+
+    if (hasAbandoned) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _rings.erase(std::remove_if(_rings.begin(), _rings.end(), [](const std::shared_ptr<Ring> &ring) {
+            return ring->abandoned.load(std::memory_order_acquire)
+                && ring->head.load(std::memory_order_relaxed) == ring->tail.load(std::memory_order_acquire);
+        }),
+            _rings.end());
+    }
+
+    std::sort(pending.begin(), pending.end(), [](const std::pair<quint64, QString> &a, const std::pair<quint64, QString> &b) {
+        return a.first < b.first;
+    });
+
+    size_t next = 0;
+    auto writeUntil = [&](quint64 sequence) {
+        QVector<QString> batch;
+        for (; next < pending.size() && pending[next].first < sequence; ++next)
+            batch.append(std::move(pending[next].second));
+        if (!batch.isEmpty())
+            _writeBatch(batch);
+    };
+
+    for (auto &task : tasks) {
+        writeUntil(task.sequence);
+        task.run();
+    }
+    writeUntil(std::numeric_limits<quint64>::max());
+
+    return !pending.empty() || !tasks.empty() || overflowLeft;
+}
+
+} // namespace OCC
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace OCC {
+
+/**
+ * @brief Hands log messages to a writer thread
+ * @ingroup libsync
+ *
+ * Every thread that posts gets its own fixed size ring buffer with a single
+ * producer and the writer thread as the single consumer, so post() neither
+ * locks nor allocates beyond the message itself. When a ring is full, post()
+ * waits briefly for the writer thread to catch up. If it doesn't, the message
+ * goes to a locked overflow queue instead of being lost.
+ *
+ * The writer thread collects the messages of all rings, restores the order
+ * in which they were posted and passes them to the batch callback. Tasks
+ * from runOnWriterThread() run in order with the messages posted before them.
+ */
+class OWNCLOUDSYNC_EXPORT AsyncLogWriter
+{
+public:
+    using BatchWriter = std::function<void(const QVector<QString> &messages)>;
+
+    /// Messages each thread can have in flight
+    static constexpr int RingCapacity = 4096;
+    /// How long post() waits for room in a full ring
+    static constexpr std::chrono::milliseconds FullRingWait{ 20 };
+
+    explicit AsyncLogWriter(BatchWriter writeBatch);
+    /// Writes all pending messages and stops the writer thread
+    ~AsyncLogWriter();
+
+    void post(const QString &message);
+
+    /// Runs the task on the writer thread, after the messages posted so far
+    void runOnWriterThread(std::function<void()> task);
+
+    /// Blocks until all messages posted so far are written
+    void sync();
+
+    bool isWriterThread() const;
+
+    /// Messages that went to the overflow queue because their ring stayed full
+    quint64 overflowedMessages() const { return _overflowed.load(std::memory_order_relaxed); }
+
+    struct Ring;
+
+private:
+    Ring *threadRing();
+    void run();
+    // Returns whether anything was done
+    bool drain();
+
+    BatchWriter _writeBatch;
+    const quint64 _id;
+    std::atomic<quint64> _sequence{ 0 };
+    std::atomic<quint64> _overflowed{ 0 };
+
+    // Protects _rings, _overflow, _tasks and _stop
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::vector<std::shared_ptr<Ring>> _rings;
+    std::vector<std::pair<quint64, QString>> _overflow;
+    struct Task
+    {
+        quint64 sequence;
+        std::function<void()> run;
+    };
+    std::vector<Task> _tasks;
+    bool _stop = false;
+
+    std::thread _thread;
+};
+
+} // namespace OCC
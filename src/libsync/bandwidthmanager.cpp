@@ -17,6 +17,7 @@
 #include "propagateupload.h"
 #include "propagatorjobs.h"
 #include "common/utility.h"
+#include "transfergovernor.h"
 
 #ifdef Q_OS_WIN
 #include <windef.h>
@@ -53,8 +54,9 @@ BandwidthManager::BandwidthManager(OwncloudPropagator *p)
     , _relativeLimitCurrentMeasuredJob(nullptr)
     , _currentDownloadLimit(0)
 {
-    _currentUploadLimit = _propagator->_uploadLimit;
-    _currentDownloadLimit = _propagator->_downloadLimit;
+    TransferGovernor::instance()->registerBandwidthManager(this);
+    _currentUploadLimit = TransferGovernor::instance()->effectiveUploadLimit(_propagator->_uploadLimit);
+    _currentDownloadLimit = TransferGovernor::instance()->effectiveDownloadLimit(_propagator->_downloadLimit);
 
     QObject::connect(&_switchingTimer, &QTimer::timeout, this, &BandwidthManager::switchingTimerExpired);
     _switchingTimer.setInterval(10 * 1000);
@@ -87,7 +89,10 @@ BandwidthManager::BandwidthManager(OwncloudPropagator *p)
     _relativeDownloadDelayTimer.setSingleShot(true); // will be restarted from the measuring timer
 }
 
-BandwidthManager::~BandwidthManager() = default;
+BandwidthManager::~BandwidthManager()
+{
+    TransferGovernor::instance()->unregisterBandwidthManager(this);
+}
 
 void BandwidthManager::registerUploadDevice(UploadDevice *p)
 {
@@ -337,7 +342,8 @@ void BandwidthManager::relativeDownloadDelayTimerExpired()
 
 void BandwidthManager::switchingTimerExpired()
 {
-    qint64 newUploadLimit = _propagator->_uploadLimit;
+    // The share of the global limits changes as other syncs start and finish
+    qint64 newUploadLimit = TransferGovernor::instance()->effectiveUploadLimit(_propagator->_uploadLimit);
     if (newUploadLimit != _currentUploadLimit) {
         qCInfo(lcBandwidthManager) << "Upload Bandwidth limit changed" << _currentUploadLimit << newUploadLimit;
         _currentUploadLimit = newUploadLimit;
@@ -354,7 +360,7 @@ void BandwidthManager::switchingTimerExpired()
             }
         }
     }
-    qint64 newDownloadLimit = _propagator->_downloadLimit;
+    qint64 newDownloadLimit = TransferGovernor::instance()->effectiveDownloadLimit(_propagator->_downloadLimit);
     if (newDownloadLimit != _currentDownloadLimit) {
         qCInfo(lcBandwidthManager) << "Download Bandwidth limit changed" << _currentDownloadLimit << newDownloadLimit;
         _currentDownloadLimit = newDownloadLimit;
@@ -11,6 +11,7 @@
 #include "capabilities.h"
 #include "networkjobs.h"
 #include "clientsideencryptionjobs.h"
+#include "filesystem.h"
 #include "theme.h"
 #include "creds/abstractcredentials.h"
 
@@ -19,6 +20,7 @@
 #include <algorithm>
 
 #include <cstdio>
+#include <cstring>
 
 #include <QDebug>
 #include <QLoggingCategory>
@@ -1810,31 +1812,18 @@ EncryptionHelper::StreamingDecryptor::StreamingDecryptor(const QByteArray &key,
 QByteArray EncryptionHelper::StreamingDecryptor::chunkDecryption(const char *input, quint64 chunkSize)
 {
     QByteArray byteArray;
-    QBuffer buffer(&byteArray);
-    buffer.open(QIODevice::WriteOnly);
+    if (!chunkDecryption(input, chunkSize, byteArray)) {
+        return QByteArray();
+    }
+    return byteArray;
+}
 
+bool EncryptionHelper::StreamingDecryptor::chunkDecryption(const char *input, quint64 chunkSize, QByteArray &output)
+{
     Q_ASSERT(isInitialized());
     if (!isInitialized()) {
         qCritical(lcCse()) << "Decryption failed. Decryptor is not initialized!";
-        return QByteArray();
-    }
-
-    Q_ASSERT(buffer.isOpen() && buffer.isWritable());
-    if (!buffer.isOpen() || !buffer.isWritable()) {
-        qCritical(lcCse()) << "Decryption failed. Incorrect output device!";
-        return QByteArray();
-    }
-
-    Q_ASSERT(input);
-    if (!input) {
-        qCritical(lcCse()) << "Decryption failed. Incorrect input!";
-        return QByteArray();
-    }
-
-    Q_ASSERT(chunkSize > 0);
-    if (chunkSize <= 0) {
-        qCritical(lcCse()) << "Decryption failed. Incorrect chunkSize!";
-        return QByteArray();
+        return false;
     }
 
     if (_decryptedSoFar == 0) {
@@ -1844,97 +1833,66 @@ QByteArray EncryptionHelper::StreamingDecryptor::chunkDecryption(const char *inp
     Q_ASSERT(_decryptedSoFar + chunkSize <= _totalSize);
     if (_decryptedSoFar + chunkSize > _totalSize) {
         qCritical(lcCse()) << "Decryption failed. Chunk is out of range!";
-        return QByteArray();
-    }
-
-    Q_ASSERT(_decryptedSoFar + chunkSize < OCC::Constants::e2EeTagSize || _totalSize - OCC::Constants::e2EeTagSize >= _decryptedSoFar + chunkSize - OCC::Constants::e2EeTagSize);
-    if (_decryptedSoFar + chunkSize > OCC::Constants::e2EeTagSize && _totalSize - OCC::Constants::e2EeTagSize < _decryptedSoFar + chunkSize - OCC::Constants::e2EeTagSize) {
-        qCritical(lcCse()) << "Decryption failed. Incorrect chunk!";
-        return QByteArray();
+        return false;
     }
 
     const bool isLastChunk = _decryptedSoFar + chunkSize == _totalSize;
 
     // last OCC::Constants::e2EeTagSize bytes is ALWAYS a e2EeTag!!!
-    const qint64 size = isLastChunk ? chunkSize - OCC::Constants::e2EeTagSize : chunkSize;
+    const qint64 size = isLastChunk ? qint64(chunkSize) - OCC::Constants::e2EeTagSize : qint64(chunkSize);
 
     // either the size is more than 0 and an e2EeTag is at the end of chunk, or, chunk is the e2EeTag itself
     Q_ASSERT(size > 0 || chunkSize == OCC::Constants::e2EeTagSize);
-    if (size <= 0 && chunkSize != OCC::Constants::e2EeTagSize) {
+    if (size < 0 || (size == 0 && chunkSize != OCC::Constants::e2EeTagSize)) {
         qCritical(lcCse()) << "Decryption failed. Invalid input size: " << size << " !";
-        return QByteArray();
+        return false;
     }
 
-    qint64 bytesWritten = 0;
+    // GCM doesn't pad: the decrypted data has the size of the encrypted data,
+    // so it's written to output directly, reusing its allocation
+    output.resize(int(size));
+    auto out = reinterpret_cast<unsigned char *>(output.data());
     qint64 inputPos = 0;
 
-    QByteArray decryptedBlock(blockSize + OCC::Constants::e2EeTagSize - 1, '\0');
-
-    while(inputPos < size) {
-        // read blockSize or less bytes
-        const QByteArray encryptedBlock(input + inputPos, qMin(size - inputPos, blockSize));
-
-        if (encryptedBlock.size() == 0) {
-            qCritical(lcCse()) << "Could not read data from the input buffer.";
-            return QByteArray();
-        }
-
+    while (inputPos < size) {
+        const auto toDecrypt = int(qMin(size - inputPos, blockSize * 1024));
         int outLen = 0;
 
-        if(!EVP_DecryptUpdate(_ctx, unsignedData(decryptedBlock), &outLen, reinterpret_cast<const unsigned char*>(encryptedBlock.data()), encryptedBlock.size())) {
+        if(!EVP_DecryptUpdate(_ctx, out + inputPos, &outLen, reinterpret_cast<const unsigned char*>(input + inputPos), toDecrypt)) {
             qCritical(lcCse()) << "Could not decrypt";
-            return QByteArray();
+            return false;
         }
 
-        const auto writtenToOutput = buffer.write(decryptedBlock, outLen);
-
-        Q_ASSERT(writtenToOutput == outLen);
-        if (writtenToOutput != outLen) {
-            qCritical(lcCse()) << "Failed to write decrypted data to device.";
-            return QByteArray();
+        Q_ASSERT(outLen == toDecrypt);
+        if (outLen != toDecrypt) {
+            qCritical(lcCse()) << "Failed to write decrypted data to the output buffer.";
+            return false;
         }
 
-        bytesWritten += writtenToOutput;
-
         // advance input position for further read
-        inputPos += encryptedBlock.size();
+        inputPos += toDecrypt;
 
-        _decryptedSoFar += encryptedBlock.size();
+        _decryptedSoFar += toDecrypt;
     }
 
     if (isLastChunk) {
         // if it's a last chunk, we'd need to read a e2EeTag at the end and finalize the decryption
-
-        Q_ASSERT(chunkSize - inputPos == OCC::Constants::e2EeTagSize);
-        if (chunkSize - inputPos != OCC::Constants::e2EeTagSize) {
-            qCritical(lcCse()) << "Decryption failed. e2EeTag is missing!";
-            return QByteArray();
-        }
-
-        int outLen = 0;
-
         QByteArray e2EeTag = QByteArray(input + inputPos, OCC::Constants::e2EeTagSize);
 
         /* Set expected e2EeTag value. Works in OpenSSL 1.0.1d and later */
         if(!EVP_CIPHER_CTX_ctrl(_ctx, EVP_CTRL_GCM_SET_TAG, e2EeTag.size(), reinterpret_cast<unsigned char*>(e2EeTag.data()))) {
             qCritical(lcCse()) << "Could not set expected e2EeTag";
-            return QByteArray();
+            return false;
         }
 
-        if(1 != EVP_DecryptFinal_ex(_ctx, unsignedData(decryptedBlock), &outLen)) {
+        // Nothing is left in the cipher since GCM doesn't pad, this verifies the tag
+        unsigned char finalBlock[OCC::Constants::e2EeTagSize];
+        int outLen = 0;
+        if(1 != EVP_DecryptFinal_ex(_ctx, finalBlock, &outLen)) {
             qCritical(lcCse()) << "Could finalize decryption";
-            return QByteArray();
-        }
-
-        const auto writtenToOutput = buffer.write(decryptedBlock, outLen);
-
-        Q_ASSERT(writtenToOutput == outLen);
-        if (writtenToOutput != outLen) {
-            qCritical(lcCse()) << "Failed to write decrypted data to device.";
-            return QByteArray();
+            return false;
         }
-
-        bytesWritten += writtenToOutput;
+        Q_ASSERT(outLen == 0);
 
         _decryptedSoFar += OCC::Constants::e2EeTagSize;
 
@@ -1945,7 +1903,7 @@ QByteArray EncryptionHelper::StreamingDecryptor::chunkDecryption(const char *inp
         qCDebug(lcCse()) << "Decryption complete";
     }
 
-    return byteArray;
+    return true;
 }
 
 bool EncryptionHelper::StreamingDecryptor::isInitialized() const
@@ -1957,4 +1915,155 @@ bool EncryptionHelper::StreamingDecryptor::isFinished() const
 {
     return _isFinished;
 }
+
+EncryptionHelper::StreamingEncryptor::StreamingEncryptor(const QString &fileName, const QByteArray &key, const QByteArray &iv, QObject *parent)
+    : QIODevice(parent)
+    , _file(fileName)
+    , _key(key)
+    , _iv(iv)
+    , _plainSize(FileSystem::getSize(fileName))
+{
+}
+
+bool EncryptionHelper::StreamingEncryptor::open(OpenMode mode)
+{
+    if (mode & WriteOnly) {
+        setErrorString(QStringLiteral("The encrypted file can only be read"));
+        return false;
+    }
+
+    QString error;
+    if (!FileSystem::openAndSeekFileSharedRead(&_file, &error, 0)) {
+        setErrorString(error);
+        return false;
+    }
+    _plainSize = _file.size();
+
+    if (!restart()) {
+        _file.close();
+        return false;
+    }
+    return QIODevice::open(mode | Unbuffered);
+}
+
+void EncryptionHelper::StreamingEncryptor::close()
+{
+    _file.close();
+    QIODevice::close();
+}
+
+qint64 EncryptionHelper::StreamingEncryptor::size() const
+{
+    return _plainSize + OCC::Constants::e2EeTagSize;
+}
+
+bool EncryptionHelper::StreamingEncryptor::seek(qint64 pos)
+{
+    if (pos < 0 || pos > size() || !QIODevice::seek(pos))
+        return false;
+
+    // The cipher state only moves forward, start over to go back
+    const auto target = qMin(pos, _plainSize);
+    if (target < qMin(_pos, _plainSize) && !restart())
+        return false;
+
+    QByteArray skipped;
+    while (_pos < target) {
+        skipped.resize(static_cast<int>(qMin(target - _pos, blockSize)));
+        if (readData(skipped.data(), skipped.size()) <= 0)
+            return false;
+    }
+    _pos = pos;
+    return true;
+}
+
+qint64 EncryptionHelper::StreamingEncryptor::readData(char *data, qint64 maxlen)
+{
+    if (_pos >= _plainSize) {
+        const auto tagPos = _pos - _plainSize;
+        const auto len = qMin(maxlen, _tag.size() - tagPos);
+        if (len <= 0)
+            return -1;
+        std::memcpy(data, _tag.constData() + tagPos, len);
+        _pos += len;
+        return len;
+    }
+
+    // GCM doesn't pad, so the data can be encrypted in place
+    const auto read = _file.read(data, qMin(qMin(maxlen, _plainSize - _pos), blockSize * 64));
+    if (read <= 0) {
+        qCWarning(lcCse()) << "Could not read data from file" << _file.fileName() << _file.errorString();
+        setErrorString(_file.errorString());
+        return -1;
+    }
+
+    int len = 0;
+    if (!EVP_EncryptUpdate(_ctx, reinterpret_cast<unsigned char *>(data), &len, reinterpret_cast<const unsigned char *>(data), static_cast<int>(read))) {
+        qCWarning(lcCse()) << "Could not encrypt";
+        setErrorString(QStringLiteral("Could not encrypt"));
+        return -1;
+    }
+    Q_ASSERT(len == read);
+
+    _pos += len;
+    if (_pos == _plainSize && !finish())
+        return -1;
+    return len;
+}
+
+qint64 EncryptionHelper::StreamingEncryptor::writeData(const char *, qint64)
+{
+    return -1;
+}
+
+bool EncryptionHelper::StreamingEncryptor::restart()
+{
+    _pos = 0;
+    _tag.clear();
+
+    if (!_file.seek(0)) {
+        setErrorString(_file.errorString());
+        return false;
+    }
+
+    if (!_ctx || !EVP_EncryptInit_ex(_ctx, EVP_aes_128_gcm(), nullptr, nullptr, nullptr)) {
+        qCWarning(lcCse()) << "Could not init cipher";
+        setErrorString(QStringLiteral("Could not init cipher"));
+        return false;
+    }
+
+    EVP_CIPHER_CTX_set_padding(_ctx, 0);
+
+    if (!EVP_CIPHER_CTX_ctrl(_ctx, EVP_CTRL_GCM_SET_IVLEN, _iv.size(), nullptr)
+        || !EVP_EncryptInit_ex(_ctx, nullptr, nullptr, reinterpret_cast<const unsigned char *>(_key.constData()), reinterpret_cast<const unsigned char *>(_iv.constData()))) {
+        qCWarning(lcCse()) << "Could not set key and iv";
+        setErrorString(QStringLiteral("Could not set key and iv"));
+        return false;
+    }
+
+    return _plainSize > 0 || finish();
+}
+
+bool EncryptionHelper::StreamingEncryptor::finish()
+{
+    // Nothing is left in the cipher since GCM doesn't pad
+    QByteArray out(OCC::Constants::e2EeTagSize, '\0');
+    int len = 0;
+    if (1 != EVP_EncryptFinal_ex(_ctx, unsignedData(out), &len)) {
+        qCWarning(lcCse()) << "Could not finalize encryption";
+        setErrorString(QStringLiteral("Could not finalize encryption"));
+        return false;
+    }
+    Q_ASSERT(len == 0);
+
+    QByteArray tag(OCC::Constants::e2EeTagSize, '\0');
+    if (1 != EVP_CIPHER_CTX_ctrl(_ctx, EVP_CTRL_GCM_GET_TAG, OCC::Constants::e2EeTagSize, unsignedData(tag))) {
+        qCWarning(lcCse()) << "Could not get e2EeTag";
+        setErrorString(QStringLiteral("Could not get e2EeTag"));
+        return false;
+    }
+    _tag = tag;
+    qCDebug(lcCse()) << "File encrypted while streaming" << _file.fileName();
+    return true;
+}
 }
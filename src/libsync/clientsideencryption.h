@@ -98,6 +98,11 @@ public:
     ~StreamingDecryptor() = default;
 
     QByteArray chunkDecryption(const char *input, quint64 chunkSize);
+    /** Decrypts into output, which is resized and whose memory can be reused across chunks
+     *
+     * The last chunk must end with the complete tag, it's verified then.
+     */
+    bool chunkDecryption(const char *input, quint64 chunkSize, QByteArray &output);
 
     bool isInitialized() const;
     bool isFinished() const;
@@ -111,6 +116,49 @@ private:
     quint64 _decryptedSoFar = 0;
     quint64 _totalSize = 0;
 };
+
+/**
+ * @brief Encrypts a file while it is being read
+ *
+ * Reading the device gives the same bytes fileEncryption() would write:
+ * the AES-GCM ciphertext of the file followed by the authentication tag.
+ * This allows uploading an encrypted file without an encrypted copy of it
+ * on disk.
+ *
+ * The device can be seeked so it can back the UploadDevice of every chunk,
+ * but encryption itself is sequential: seeking backwards starts it over
+ * from the beginning of the file.
+ */
+class OWNCLOUDSYNC_EXPORT StreamingEncryptor : public QIODevice
+{
+    Q_OBJECT
+public:
+    StreamingEncryptor(const QString &fileName, const QByteArray &key, const QByteArray &iv, QObject *parent = nullptr);
+
+    bool open(OpenMode mode) override;
+    void close() override;
+    qint64 size() const override;
+    bool seek(qint64 pos) override;
+
+    /** The authentication tag, empty until the whole file was encrypted */
+    QByteArray tag() const { return _tag; }
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    bool restart();
+    bool finish();
+
+    QFile _file;
+    QByteArray _key;
+    QByteArray _iv;
+    CipherCtx _ctx;
+    qint64 _plainSize = 0;
+    qint64 _pos = 0;
+    QByteArray _tag;
+};
 }
 
 class OWNCLOUDSYNC_EXPORT ClientSideEncryption : public QObject {
@@ -63,6 +63,10 @@ Q_LOGGING_CATEGORY(lcConfigFile, "nextcloud.sync.configfile", QtInfoMsg)
 static const char remotePollIntervalC[] = "remotePollInterval";
 static const char forceSyncIntervalC[] = "forceSyncInterval";
 static const char fullLocalDiscoveryIntervalC[] = "fullLocalDiscoveryInterval";
+static const char maxConcurrentFolderSyncsC[] = "maxConcurrentFolderSyncs";
+static const char networkJobBudgetC[] = "networkJobBudget";
+static const char syncPreemptionTimeoutC[] = "syncPreemptionTimeout";
+static const char maxRequestsPerHostC[] = "maxRequestsPerHost";
 static const char notificationRefreshIntervalC[] = "notificationRefreshInterval";
 static const char monoIconsC[] = "monoIcons";
 static const char promptDeleteC[] = "promptDeleteAllFiles";
@@ -85,6 +89,7 @@ static const char logDirC[] = "logDir";
 static const char logDebugC[] = "logDebug";
 static const char logExpireC[] = "logExpire";
 static const char logFlushC[] = "logFlush";
+static const char logAsyncC[] = "logAsync";
 static const char showExperimentalOptionsC[] = "showExperimentalOptions";
 static const char clientVersionC[] = "clientVersion";
 
@@ -549,6 +554,30 @@ chrono::milliseconds OCC::ConfigFile::fullLocalDiscoveryInterval() const
     return millisecondsValue(settings, fullLocalDiscoveryIntervalC, chrono::hours(1));
 }
 
+int ConfigFile::maxConcurrentFolderSyncs() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return qMax(1, settings.value(QLatin1String(maxConcurrentFolderSyncsC), 1).toInt());
+}
+
+int ConfigFile::networkJobBudget() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return qMax(1, settings.value(QLatin1String(networkJobBudgetC), 20).toInt());
+}
+
+chrono::milliseconds ConfigFile::syncPreemptionTimeout() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return millisecondsValue(settings, syncPreemptionTimeoutC, chrono::minutes(30));
+}
+
+int ConfigFile::maxRequestsPerHost() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return qMax(0, settings.value(QLatin1String(maxRequestsPerHostC), 30).toInt());
+}
+
 chrono::milliseconds ConfigFile::notificationRefreshInterval(const QString &connection) const
 {
     QString con(connection);
@@ -998,6 +1027,18 @@ void ConfigFile::setLogFlush(bool enabled)
     settings.setValue(QLatin1String(logFlushC), enabled);
 }
 
+bool ConfigFile::logAsync() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(logAsyncC), false).toBool();
+}
+
+void ConfigFile::setLogAsync(bool enabled)
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    settings.setValue(QLatin1String(logAsyncC), enabled);
+}
+
 bool ConfigFile::showExperimentalOptions() const
 {
     QSettings settings(configFile(), QSettings::IniFormat);
@@ -83,6 +83,26 @@ public:
      */
     std::chrono::milliseconds fullLocalDiscoveryInterval() const;
 
+    /** How many folders may sync at the same time */
+    int maxConcurrentFolderSyncs() const;
+
+    /**
+     * Number of parallel network jobs shared by all concurrently syncing folders
+     *
+     * Each folder still never exceeds its own per-account limit.
+     */
+    int networkJobBudget() const;
+
+    /**
+     * Time after which a propagating sync may be interrupted to let waiting folders sync
+     *
+     * Use 0 to never preempt running syncs.
+     */
+    std::chrono::milliseconds syncPreemptionTimeout() const;
+
+    /** Maximum number of concurrent requests to one server host, 0 for no limit */
+    int maxRequestsPerHost() const;
+
     bool monoIcons() const;
     void setMonoIcons(bool);
 
@@ -107,6 +127,10 @@ public:
     bool logFlush() const;
     void setLogFlush(bool enabled);
 
+    /// Whether log messages are written by a background thread, see Logger::setLogAsync()
+    bool logAsync() const;
+    void setLogAsync(bool enabled);
+
     // Whether experimental UI options should be shown
     bool showExperimentalOptions() const;
 
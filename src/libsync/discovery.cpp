@@ -26,6 +26,7 @@
 #include <QThreadPool>
 #include <common/checksums.h>
 #include <common/constants.h>
+#include <common/synctrace.h>
 #include "csync_exclude.h"
 #include "csync.h"
 
@@ -37,6 +38,8 @@ Q_LOGGING_CATEGORY(lcDisco, "sync.discovery", QtInfoMsg)
 void ProcessDirectoryJob::start()
 {
     qCInfo(lcDisco) << "STARTING" << _currentFolder._server << _queryServer << _currentFolder._local << _queryLocal;
+    SyncTrace::begin(SyncTrace::Discovery, _currentFolder._original, SyncTrace::spanId(this));
+    _discoveryData->_discoveredDirectories++;
 
     if (_queryServer == NormalQuery) {
         _serverJob = startAsyncServerQuery();
@@ -132,6 +135,7 @@ void ProcessDirectoryJob::process()
         }
     }
     _localNormalQueryEntries.clear();
+    _discoveryData->_discoveredEntries += entries.size();
 
     //
     // Iterate over entries and process them
@@ -199,7 +203,11 @@ void ProcessDirectoryJob::process()
 
 bool ProcessDirectoryJob::handleExcluded(const QString &path, const QString &localName, bool isDirectory, bool isHidden, bool isSymlink)
 {
+    // Summed up for the whole sync, a metric update per file would cost more than the match
+    const auto matchStart = std::chrono::steady_clock::now();
     auto excluded = _discoveryData->_excludes->traversalPatternMatch(path, isDirectory ? ItemTypeDirectory : ItemTypeFile);
+    _discoveryData->_excludeMatchTime += std::chrono::steady_clock::now() - matchStart;
+    _discoveryData->_excludeMatches++;
 
     // FIXME: move to ExcludedFiles 's regexp ?
     bool isInvalidPattern = false;
@@ -1504,6 +1512,7 @@ int ProcessDirectoryJob::processSubJobs(int nbJobs)
                 _dirItem->_instruction = CSYNC_INSTRUCTION_NONE;
             }
         }
+        SyncTrace::end(SyncTrace::Discovery, SyncTrace::spanId(this));
         emit finished();
     }
 
@@ -1557,39 +1566,26 @@ DiscoverySingleDirectoryJob *ProcessDirectoryJob::startAsyncServerQuery()
         _discoveryData->_remoteFolder + _currentFolder._server, this);
     if (!_dirItem)
         serverJob->setIsRootPath(); // query the fingerprint on the root
+    const bool refresh = canUseRefreshListing();
+    if (refresh)
+        serverJob->setPropertySet(DiscoverySingleDirectoryJob::RefreshProperties);
     connect(serverJob, &DiscoverySingleDirectoryJob::etag, this, &ProcessDirectoryJob::etag);
     _discoveryData->_currentlyActiveJobs++;
     _pendingAsyncJobs++;
-    connect(serverJob, &DiscoverySingleDirectoryJob::finished, this, [this, serverJob](const auto &results) {
+    connect(serverJob, &DiscoverySingleDirectoryJob::finished, this, [this, serverJob, refresh](const auto &results) {
         _discoveryData->_currentlyActiveJobs--;
         _pendingAsyncJobs--;
         if (results) {
             _serverNormalQueryEntries = *results;
-            _serverQueryDone = true;
             if (!serverJob->_dataFingerprint.isEmpty() && _discoveryData->_dataFingerprint.isEmpty())
                 _discoveryData->_dataFingerprint = serverJob->_dataFingerprint;
+            if (refresh && startAsyncDetailsQuery())
+                return;
+            _serverQueryDone = true;
             if (_localQueryDone)
                 this->process();
         } else {
-            auto code = results.error().code;
-            qCWarning(lcDisco) << "Server error in directory" << _currentFolder._server << code;
-            if (_dirItem && code >= 403) {
-                // In case of an HTTP error, we ignore that directory
-                // 403 Forbidden can be sent by the server if the file firewall is active.
-                // A file or directory should be ignored and sync must continue. See #3490
-                // The server usually replies with the custom "503 Storage not available"
-                // if some path is temporarily unavailable. But in some cases a standard 503
-                // is returned too. Thus we can't distinguish the two and will treat any
-                // 503 as request to ignore the folder. See #3113 #2884.
-                // Similarly, the server might also return 404 or 50x in case of bugs. #7199 #7586
-                _dirItem->_instruction = CSYNC_INSTRUCTION_IGNORE;
-                _dirItem->_errorString = results.error().message;
-                emit this->finished();
-            } else {
-                // Fatal for the root job since it has no SyncFileItem, or for the network errors
-                emit _discoveryData->fatalError(tr("Server replied with an error while reading directory \"%1\" : %2")
-                    .arg(_currentFolder._server, results.error().message));
-            }
+            serverQueryFailed(results.error());
         }
     });
     connect(serverJob, &DiscoverySingleDirectoryJob::firstDirectoryPermissions, this,
@@ -1598,6 +1594,118 @@ DiscoverySingleDirectoryJob *ProcessDirectoryJob::startAsyncServerQuery()
     return serverJob;
 }
 
+bool ProcessDirectoryJob::canUseRefreshListing() const
+{
+    // The metadata of encrypted folders is fetched along with the listing
+    if (_isInsideEncryptedTree)
+        return false;
+    if (!_dirItem)
+        return _lastSyncTimestamp > 0;
+    if (_dirItem->_isEncrypted)
+        return false;
+
+    SyncJournalFileRecord record;
+    return _discoveryData->_statedb->getFileRecord(_currentFolder._original, &record)
+        && record.isValid() && record.isDirectory() && !record._isE2eEncrypted;
+}
+
+bool ProcessDirectoryJob::startAsyncDetailsQuery()
+{
+    QHash<QString, QByteArray> dbEtags;
+    const auto pathU8 = _currentFolder._original.toUtf8();
+    if (!_discoveryData->_statedb->listFilesInPath(pathU8, [&](const SyncJournalFileRecord &rec) {
+            auto name = pathU8.isEmpty() ? rec._path : QString::fromUtf8(rec._path.constData() + (pathU8.size() + 1));
+            if (rec.isVirtualFile() && isVfsWithSuffix())
+                chopVirtualFileSuffix(name);
+            dbEtags.insert(name, rec._etag);
+        })) {
+        // process() reports the database error
+        return false;
+    }
+
+    // Unchanged entries are taken from the database, and only files use
+    // the checksums and direct download urls. The size is needed for the
+    // encrypted folders, see processFile().
+    QSet<QString> names;
+    for (const auto &entry : qAsConst(_serverNormalQueryEntries)) {
+        const auto it = dbEtags.constFind(entry.name);
+        const bool changed = it == dbEtags.cend() || *it != entry.etag;
+        if ((changed && !entry.isDirectory) || entry.isE2eEncrypted)
+            names.insert(entry.name);
+    }
+    if (names.isEmpty())
+        return false;
+
+    auto detailsJob = new DiscoverySingleDirectoryJob(_discoveryData->_account,
+        _discoveryData->_remoteFolder + _currentFolder._server, this);
+    detailsJob->setPropertySet(DiscoverySingleDirectoryJob::DetailProperties);
+    // A few entries are queried one by one, many are cheaper to get
+    // with a listing of the directory
+    if (names.size() <= maxDetailEntryQueries() && names.size() * 2 <= _serverNormalQueryEntries.size()) {
+        qCInfo(lcDisco) << "Fetching details of" << names.size() << "entries in" << _currentFolder._server << "one by one";
+        detailsJob->setEntries(names.values());
+    } else {
+        qCInfo(lcDisco) << "Fetching details of" << names.size() << "entries in" << _currentFolder._server;
+    }
+    _discoveryData->_currentlyActiveJobs++;
+    _pendingAsyncJobs++;
+    connect(detailsJob, &DiscoverySingleDirectoryJob::finished, this, [this, names](const auto &results) {
+        _discoveryData->_currentlyActiveJobs--;
+        _pendingAsyncJobs--;
+        if (!results) {
+            serverQueryFailed(results.error());
+            return;
+        }
+
+        QHash<QString, const RemoteInfo *> details;
+        for (const auto &detail : *results)
+            details.insert(detail.name, &detail);
+        for (auto &entry : _serverNormalQueryEntries) {
+            if (!names.contains(entry.name))
+                continue;
+            const auto detail = details.value(entry.name);
+            if (!detail || detail->etag != entry.etag) {
+                // Changed in between, the next sync will see the new version
+                qCInfo(lcDisco) << "Entry" << entry.name << "changed while listing" << _currentFolder._server;
+                continue;
+            }
+            entry.checksumHeader = detail->checksumHeader;
+            entry.directDownloadUrl = detail->directDownloadUrl;
+            entry.directDownloadCookies = detail->directDownloadCookies;
+            entry.sizeOfFolder = detail->sizeOfFolder;
+        }
+
+        _serverQueryDone = true;
+        if (_localQueryDone)
+            this->process();
+    });
+    detailsJob->start();
+    _serverJob = detailsJob;
+    return true;
+}
+
+void ProcessDirectoryJob::serverQueryFailed(const HttpError &error)
+{
+    qCWarning(lcDisco) << "Server error in directory" << _currentFolder._server << error.code;
+    if (_dirItem && error.code >= 403) {
+        // In case of an HTTP error, we ignore that directory
+        // 403 Forbidden can be sent by the server if the file firewall is active.
+        // A file or directory should be ignored and sync must continue. See #3490
+        // The server usually replies with the custom "503 Storage not available"
+        // if some path is temporarily unavailable. But in some cases a standard 503
+        // is returned too. Thus we can't distinguish the two and will treat any
+        // 503 as request to ignore the folder. See #3113 #2884.
+        // Similarly, the server might also return 404 or 50x in case of bugs. #7199 #7586
+        _dirItem->_instruction = CSYNC_INSTRUCTION_IGNORE;
+        _dirItem->_errorString = error.message;
+        emit this->finished();
+    } else {
+        // Fatal for the root job since it has no SyncFileItem, or for the network errors
+        emit _discoveryData->fatalError(tr("Server replied with an error while reading directory \"%1\" : %2")
+            .arg(_currentFolder._server, error.message));
+    }
+}
+
 void ProcessDirectoryJob::startAsyncLocalQuery()
 {
     QString localPath = _discoveryData->_localDir + _currentFolder._local;
@@ -219,6 +219,26 @@ private:
      */
     DiscoverySingleDirectoryJob *startAsyncServerQuery();
 
+    /** Whether the directory is known well enough for a refresh listing
+     *
+     * Most entries of a directory that was synced before are unchanged and
+     * don't need the properties that the refresh listing leaves out.
+     */
+    bool canUseRefreshListing() const;
+
+    /** Complete the entries of a refresh listing that are new or changed
+     *
+     * Returns false if no entry needs more details, otherwise a details
+     * query is started that sets _serverQueryDone when done. Up to
+     * maxDetailEntryQueries() entries are queried one by one, unless they
+     * are half of the directory or more; otherwise the directory is listed.
+     */
+    bool startAsyncDetailsQuery();
+    static int maxDetailEntryQueries() { return 8; }
+
+    /** Handle a failed listing of the server directory */
+    void serverQueryFailed(const HttpError &error);
+
     /** Discover the local directory
       *
       * Fills _localNormalQueryEntries.
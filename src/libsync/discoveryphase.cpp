@@ -20,6 +20,7 @@
 
 #include "common/asserts.h"
 #include "common/checksums.h"
+#include "transfergovernor.h"
 
 #include <csync_exclude.h>
 #include "vio/csync_vio_local.h"
@@ -30,6 +31,7 @@
 #include <QFileInfo>
 #include <QTextCodec>
 #include <cstring>
+#include <algorithm>
 #include <QDateTime>
 
 
@@ -221,6 +223,8 @@ void DiscoveryPhase::startJob(ProcessDirectoryJob *job)
         }
     });
     _currentRootJob = job;
+    connect(TransferGovernor::instance(), &TransferGovernor::requestSlotAvailable,
+        this, &DiscoveryPhase::scheduleMoreJobs, Qt::UniqueConnection);
     job->start();
 }
 
@@ -236,9 +240,23 @@ void DiscoveryPhase::setSelectiveSyncWhiteList(const QStringList &list)
     std::sort(_selectiveSyncWhiteList.begin(), _selectiveSyncWhiteList.end());
 }
 
+void DiscoveryPhase::setParallelNetworkJobs(int jobs)
+{
+    _syncOptions._parallelNetworkJobs = jobs;
+    scheduleMoreJobs();
+}
+
 void DiscoveryPhase::scheduleMoreJobs()
 {
-    auto limit = qMax(1, _syncOptions._parallelNetworkJobs);
+    // The PROPFINDs are small requests
+    auto limit = _syncOptions.parallelSmallRequests(_account->isHttp2Supported());
+
+    // Leave the server's remaining request slots to other syncs, but keep at least one job going
+    const auto freeSlots = TransferGovernor::instance()->freeRequestSlots(_account->url());
+    if (freeSlots < limit - _currentlyActiveJobs) {
+        limit = qMax(1, _currentlyActiveJobs + freeSlots);
+    }
+
     if (_currentRootJob && _currentlyActiveJobs < limit) {
         _currentRootJob->processSubJobs(limit - _currentlyActiveJobs);
     }
@@ -341,30 +359,38 @@ DiscoverySingleDirectoryJob::DiscoverySingleDirectoryJob(const AccountPtr &accou
 
 void DiscoverySingleDirectoryJob::start()
 {
-    // Start the actual HTTP job
-    auto *lsColJob = new LsColJob(_account, _subPath, this);
-
     QList<QByteArray> props;
     props << "resourcetype"
-          << "getlastmodified"
-          << "getcontentlength"
-          << "getetag"
-          << "http://owncloud.org/ns:size"
-          << "http://owncloud.org/ns:id"
-          << "http://owncloud.org/ns:downloadURL"
-          << "http://owncloud.org/ns:dDC"
-          << "http://owncloud.org/ns:permissions"
-          << "http://owncloud.org/ns:checksums";
-    if (_isRootPath)
-        props << "http://owncloud.org/ns:data-fingerprint";
-    if (_account->serverVersionInt() >= Account::makeServerVersion(10, 0, 0)) {
-        // Server older than 10.0 have performances issue if we ask for the share-types on every PROPFIND
-        props << "http://owncloud.org/ns:share-types";
+          << "getetag";
+    if (_propertySet != DetailProperties) {
+        props << "getlastmodified"
+              << "getcontentlength"
+              << "http://owncloud.org/ns:id"
+              << "http://owncloud.org/ns:permissions";
+        if (_isRootPath)
+            props << "http://owncloud.org/ns:data-fingerprint";
+        if (_account->serverVersionInt() >= Account::makeServerVersion(10, 0, 0)) {
+            // Server older than 10.0 have performances issue if we ask for the share-types on every PROPFIND
+            props << "http://owncloud.org/ns:share-types";
+        }
+        if (_account->capabilities().clientSideEncryptionAvailable()) {
+            props << "http://nextcloud.org/ns:is-encrypted";
+        }
+    }
+    if (_propertySet != RefreshProperties) {
+        props << "http://owncloud.org/ns:size"
+              << "http://owncloud.org/ns:downloadURL"
+              << "http://owncloud.org/ns:dDC"
+              << "http://owncloud.org/ns:checksums";
     }
-    if (_account->capabilities().clientSideEncryptionAvailable()) {
-        props << "http://nextcloud.org/ns:is-encrypted";
+
+    if (!_entries.isEmpty()) {
+        startEntryQueries(props);
+        return;
     }
 
+    // Start the actual HTTP job
+    auto *lsColJob = new LsColJob(_account, _subPath, this);
     lsColJob->setProperties(props);
 
     QObject::connect(lsColJob, &LsColJob::directoryListingIterated,
@@ -381,6 +407,10 @@ void DiscoverySingleDirectoryJob::abort()
     if (_lsColJob && _lsColJob->reply()) {
         _lsColJob->reply()->abort();
     }
+    for (const auto &job : qAsConst(_entryJobs)) {
+        if (job && job->reply())
+            job->reply()->abort();
+    }
 }
 
 static void propertyMapToRemoteInfo(const QMap<QString, QString> &map, RemoteInfo &result)
@@ -436,6 +466,55 @@ static void propertyMapToRemoteInfo(const QMap<QString, QString> &map, RemoteInf
     }
 }
 
+void DiscoverySingleDirectoryJob::startEntryQueries(const QList<QByteArray> &props)
+{
+    const QString dirPath = _subPath.endsWith('/') ? _subPath : _subPath + '/';
+    _pendingEntryQueries = _entries.size();
+    for (const auto &name : qAsConst(_entries)) {
+        auto *lsColJob = new LsColJob(_account, dirPath + name, this);
+        lsColJob->setProperties(props);
+        lsColJob->setDepth(0);
+
+        QObject::connect(lsColJob, &LsColJob::directoryListingIterated, this, [this, name](const QString &, const QMap<QString, QString> &map) {
+            // Only the first response is for the entry, servers that ignore
+            // the depth also list the children of a directory
+            if (std::any_of(_results.cbegin(), _results.cend(), [&name](const RemoteInfo &info) { return info.name == name; }))
+                return;
+            RemoteInfo result;
+            result.name = name;
+            result.size = -1;
+            propertyMapToRemoteInfo(map, result);
+            if (result.isDirectory)
+                result.size = 0;
+            _results.push_back(std::move(result));
+        });
+        QObject::connect(lsColJob, &LsColJob::finishedWithError, this, [this](QNetworkReply *r) {
+            if (r->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 404) {
+                // Removed since the directory was listed
+                entryQueryFinished();
+                return;
+            }
+            if (_entryQueryFailed)
+                return;
+            _entryQueryFailed = true;
+            abort();
+            lsJobFinishedWithErrorSlot(r);
+        });
+        QObject::connect(lsColJob, &LsColJob::finishedWithoutError, this, &DiscoverySingleDirectoryJob::entryQueryFinished);
+        lsColJob->start();
+
+        _entryJobs.append(lsColJob);
+    }
+}
+
+void DiscoverySingleDirectoryJob::entryQueryFinished()
+{
+    if (--_pendingEntryQueries > 0 || _entryQueryFailed)
+        return;
+    emit finished(_results);
+    deleteLater();
+}
+
 void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(const QString &file, const QMap<QString, QString> &map)
 {
     if (!_ignoredFirst) {
@@ -24,6 +24,7 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <QRunnable>
+#include <chrono>
 #include <deque>
 #include "syncoptions.h"
 #include "syncfileitem.h"
@@ -118,9 +119,29 @@ class DiscoverySingleDirectoryJob : public QObject
 {
     Q_OBJECT
 public:
+    /** The properties requested for the entries of the directory.
+     *
+     * A refresh listing leaves out the properties that are only needed for
+     * new or changed files (checksums, direct download, folder size). A
+     * details listing asks for just these, so that they can be completed
+     * for the entries that need them.
+     */
+    enum PropertySet {
+        FullProperties,
+        RefreshProperties,
+        DetailProperties
+    };
+
     explicit DiscoverySingleDirectoryJob(const AccountPtr &account, const QString &path, QObject *parent = nullptr);
     // Specify that this is the root and we need to check the data-fingerprint
     void setIsRootPath() { _isRootPath = true; }
+    void setPropertySet(PropertySet propertySet) { _propertySet = propertySet; }
+    /** Only query the given entries of the directory, with one PROPFIND of
+     * Depth 0 each, instead of listing it.
+     *
+     * Entries that are gone by then are missing from the results.
+     */
+    void setEntries(const QStringList &names) { _entries = names; }
     void start();
     void abort();
 
@@ -139,6 +160,9 @@ private slots:
     void metadataError(const QByteArray& fileId, int httpReturnCode);
 
 private:
+    void startEntryQueries(const QList<QByteArray> &props);
+    void entryQueryFinished();
+
     QVector<RemoteInfo> _results;
     QString _subPath;
     QByteArray _firstEtag;
@@ -157,6 +181,11 @@ private:
     int64_t _size = 0;
     QString _error;
     QPointer<LsColJob> _lsColJob;
+    PropertySet _propertySet = FullProperties;
+    QStringList _entries;
+    QVector<QPointer<LsColJob>> _entryJobs;
+    int _pendingEntryQueries = 0;
+    bool _entryQueryFailed = false;
 
 public:
     QByteArray _dataFingerprint;
@@ -261,12 +290,25 @@ public:
 
     void startJob(ProcessDirectoryJob *);
 
+    /// Changes the job limit of a running discovery and starts more jobs if possible
+    void setParallelNetworkJobs(int jobs);
+
     void setSelectiveSyncBlackList(const QStringList &list);
     void setSelectiveSyncWhiteList(const QStringList &list);
 
+    /** Whether a later rename detection may still cancel the item at the db-path
+     *
+     * See findAndCancelDeletedJob().
+     */
+    bool mayBeCancelled(const QString &originalPath) const { return _deletedItem.contains(originalPath); }
+
     // output
     QByteArray _dataFingerprint;
     bool _anotherSyncNeeded = false;
+    int _discoveredDirectories = 0;
+    int _discoveredEntries = 0;
+    int _excludeMatches = 0;
+    std::chrono::steady_clock::duration _excludeMatchTime{};
 
 signals:
     void fatalError(const QString &errorString);
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "foldermetadatasession.h"
+#include "account.h"
+#include "clientsideencryption.h"
+#include "clientsideencryptionjobs.h"
+#include "networkjobs.h"
+#include "common/syncjournaldb.h"
+
+#include <QLoggingCategory>
+#include <QTimer>
+
+#include <utility>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcFolderMetadataSession, "nextcloud.sync.propagator.metadatasession", QtInfoMsg)
+
+int FolderMetadataSession::maxItemsPerLock = 100;
+std::chrono::milliseconds FolderMetadataSession::maxLockDuration = std::chrono::minutes(5);
+std::chrono::milliseconds FolderMetadataSession::lockRetryInterval = std::chrono::seconds(5);
+
+FolderMetadataSession::FolderMetadataSession(const AccountPtr &account, SyncJournalDb *journal,
+    const QString &folder, const QString &remoteFolderPath)
+    : _account(account)
+    , _journal(journal)
+    , _folder(folder)
+    , _remoteFolderPath(remoteFolderPath)
+{
+}
+
+FolderMetadataSession::~FolderMetadataSession() = default;
+
+void FolderMetadataSession::open(QObject *receiver, const std::function<void()> &onReady, const std::function<void()> &onError)
+{
+    switch (_state) {
+    case Open:
+        if (!isLockUsedUp() && _waiters.isEmpty()) {
+            addUser(receiver);
+            QTimer::singleShot(0, receiver, onReady);
+            return;
+        }
+        // Lock again once the items using the lock are done
+        _waiters.append({ receiver, onReady, onError });
+        _relockPending = true;
+        if (_users == 0)
+            startCommit();
+        return;
+    case Committing:
+        if (_relocking && !_commitRequested) {
+            _waiters.append({ receiver, onReady, onError });
+            return;
+        }
+        QTimer::singleShot(0, receiver, onError);
+        return;
+    case Failed:
+    case Committed:
+        QTimer::singleShot(0, receiver, onError);
+        return;
+    case Opening:
+        _waiters.append({ receiver, onReady, onError });
+        return;
+    case NotOpened:
+        break;
+    }
+
+    _waiters.append({ receiver, onReady, onError });
+    _state = Opening;
+
+    /* Find the ID of the folder, lock it and download its metadata,
+     * once for all the items of the folder that are propagated. */
+    qCInfo(lcFolderMetadataSession) << "Opening the metadata of" << _folder;
+    auto job = new LsColJob(_account, _remoteFolderPath, this);
+    job->setProperties({ "resourcetype", "http://owncloud.org/ns:fileid" });
+    connect(job, &LsColJob::directoryListingSubfolders, this, [this, job](const QStringList &list) {
+        _folderId = job->_folderInfos.value(list.first()).fileId;
+        _lockFirstTry.start();
+        tryLock();
+    });
+    connect(job, &LsColJob::finishedWithError, this, [this] {
+        qCWarning(lcFolderMetadataSession) << "Error retrieving the Id of the encrypted folder" << _folder;
+        setOpenResult(Failed);
+    });
+    job->start();
+}
+
+void FolderMetadataSession::tryLock()
+{
+    auto lockJob = new LockEncryptFolderApiJob(_account, _folderId, this);
+    connect(lockJob, &LockEncryptFolderApiJob::success, this, [this](const QByteArray &folderId, const QByteArray &token) {
+        qCDebug(lcFolderMetadataSession) << "Folder" << folderId << "locked, fetching its metadata";
+        _folderToken = token;
+
+        auto job = new GetMetadataApiJob(_account, _folderId, this);
+        connect(job, &GetMetadataApiJob::jsonReceived, this, &FolderMetadataSession::slotMetadataReceived);
+        connect(job, &GetMetadataApiJob::error, this, [this](const QByteArray &, int httpReturnCode) {
+            qCDebug(lcFolderMetadataSession) << "Error getting the encrypted metadata. Pretend we got empty metadata.";
+            FolderMetadata emptyMetadata(_account);
+            slotMetadataReceived(QJsonDocument::fromJson(emptyMetadata.encryptedMetadata()), httpReturnCode);
+        });
+        job->start();
+    });
+    connect(lockJob, &LockEncryptFolderApiJob::error, this, &FolderMetadataSession::slotFolderLockedError);
+    lockJob->start();
+}
+
+void FolderMetadataSession::slotFolderLockedError(const QByteArray &folderId, int httpErrorCode)
+{
+    qCDebug(lcFolderMetadataSession) << "Folder" << folderId << "couldn't be locked:" << httpErrorCode;
+
+    // Perhaps another client locked it: try again for five minutes
+    if (_lockFirstTry.elapsed() > /* five minutes */ 1000 * 60 * 5) {
+        qCWarning(lcFolderMetadataSession) << "Giving up locking the folder" << _folder;
+        setOpenResult(Failed);
+        return;
+    }
+    QTimer::singleShot(lockRetryInterval, this, &FolderMetadataSession::tryLock);
+}
+
+void FolderMetadataSession::slotMetadataReceived(const QJsonDocument &json, int statusCode)
+{
+    // Decrypting the metadata keys is the expensive part, done once per lock
+    _metadata.reset(new FolderMetadata(_account, json.toJson(QJsonDocument::Compact), statusCode));
+    _metadataStatusCode = statusCode;
+    _lockedSince.start();
+    setOpenResult(Open);
+}
+
+void FolderMetadataSession::setOpenResult(State state)
+{
+    _state = state;
+    if (state == Open) {
+        serveWaiters();
+    } else {
+        failWaiters();
+    }
+
+    if (_commitRequested)
+        commit();
+}
+
+bool FolderMetadataSession::isLockUsedUp() const
+{
+    // At least one item gets to use each lock
+    return _lockItems > 0
+        && (_lockItems >= maxItemsPerLock || std::chrono::milliseconds(_lockedSince.elapsed()) >= maxLockDuration);
+}
+
+void FolderMetadataSession::addUser(QObject *receiver)
+{
+    ++_users;
+    ++_lockItems;
+    connect(receiver, &QObject::destroyed, this, &FolderMetadataSession::releaseUser);
+}
+
+void FolderMetadataSession::releaseUser()
+{
+    --_users;
+    if (_users == 0 && _relockPending && _state == Open)
+        startCommit();
+}
+
+void FolderMetadataSession::serveWaiters()
+{
+    while (!_waiters.isEmpty() && !isLockUsedUp()) {
+        const auto waiter = _waiters.takeFirst();
+        if (!waiter.receiver)
+            continue;
+        addUser(waiter.receiver);
+        waiter.onReady();
+    }
+    if (!_waiters.isEmpty()) {
+        _relockPending = true;
+        if (_users == 0)
+            startCommit();
+    }
+}
+
+void FolderMetadataSession::failWaiters()
+{
+    const auto waiters = std::exchange(_waiters, {});
+    for (const auto &waiter : waiters) {
+        if (waiter.receiver)
+            waiter.onError();
+    }
+}
+
+void FolderMetadataSession::setChanged(const QString &file)
+{
+    if (!_changedFiles.contains(file))
+        _changedFiles.append(file);
+}
+
+void FolderMetadataSession::commit()
+{
+    switch (_state) {
+    case Opening:
+    case Committing:
+        // Unlock the folder once the lock is known, or end the session once
+        // the metadata sent before locking again is stored
+        _commitRequested = true;
+        return;
+    case NotOpened:
+    case Failed:
+        finishCommit(true);
+        return;
+    case Committed:
+        return;
+    case Open:
+        break;
+    }
+
+    _commitRequested = true;
+    startCommit();
+}
+
+void FolderMetadataSession::startCommit()
+{
+    _state = Committing;
+    _relocking = _relockPending && !_commitRequested;
+    _relockPending = false;
+    if (_changedFiles.isEmpty()) {
+        unlock();
+        return;
+    }
+
+    qCInfo(lcFolderMetadataSession) << "Sending the metadata of" << _folder << "changed for" << _changedFiles.size() << "items";
+    sendMetadata();
+}
+
+void FolderMetadataSession::sendMetadata()
+{
+    const auto onSuccess = [this](const QByteArray &) {
+        unlock();
+    };
+    const auto onError = [this](const QByteArray &folderId, int httpReturnCode) {
+        qCWarning(lcFolderMetadataSession) << "Update metadata error for folder" << folderId << "with error" << httpReturnCode;
+
+        // The items changed since the folder was locked aren't known to
+        // other clients, propagate them again next time
+        if (_journal) {
+            for (const auto &file : qAsConst(_changedFiles))
+                _journal->deleteFileRecord(file, true);
+            _journal->commit(QStringLiteral("metadata session"));
+        }
+        _commitFailed = true;
+        unlock();
+    };
+
+    if (_metadataStatusCode == 404) {
+        auto job = new StoreMetaDataApiJob(_account, _folderId, _metadata->encryptedMetadata(), this);
+        connect(job, &StoreMetaDataApiJob::success, this, onSuccess);
+        connect(job, &StoreMetaDataApiJob::error, this, onError);
+        job->start();
+    } else {
+        auto job = new UpdateMetadataApiJob(_account, _folderId, _metadata->encryptedMetadata(), _folderToken, this);
+        connect(job, &UpdateMetadataApiJob::success, this, onSuccess);
+        connect(job, &UpdateMetadataApiJob::error, this, onError);
+        job->start();
+    }
+}
+
+void FolderMetadataSession::unlock()
+{
+    auto unlockJob = new UnlockEncryptFolderApiJob(_account, _folderId, _folderToken, this);
+    connect(unlockJob, &UnlockEncryptFolderApiJob::success, this, [this] {
+        finishCommit(true);
+    });
+    connect(unlockJob, &UnlockEncryptFolderApiJob::error, this, [this](const QByteArray &folderId, int httpStatus) {
+        qCWarning(lcFolderMetadataSession) << "Failed to unlock encrypted folder" << folderId << httpStatus;
+        finishCommit(false);
+    });
+    unlockJob->start();
+}
+
+void FolderMetadataSession::finishCommit(bool success)
+{
+    _commitFailed = _commitFailed || !success;
+    _folderToken.clear();
+    _changedFiles.clear();
+
+    if (_relocking && !_commitRequested && !_waiters.isEmpty()) {
+        _relocking = false;
+        qCInfo(lcFolderMetadataSession) << "Locking" << _folder << "again for" << _waiters.size() << "more items";
+        _state = Opening;
+        _lockItems = 0;
+        _lockFirstTry.start();
+        tryLock();
+        return;
+    }
+
+    _relocking = false;
+    _state = Committed;
+    failWaiters();
+    emit committed(!_commitFailed);
+    deleteLater();
+}
+
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include "accountfwd.h"
+#include "owncloudlib.h"
+
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QObject>
+#include <QPointer>
+#include <QScopedPointer>
+#include <QStringList>
+#include <QVector>
+
+#include <chrono>
+#include <functional>
+
+namespace OCC {
+
+class FolderMetadata;
+class SyncJournalDb;
+
+/**
+ * @brief The lock and metadata of an end-to-end encrypted folder during a sync
+ * @ingroup libsync
+ *
+ * Uploads and deletes in an encrypted folder change its metadata, which
+ * needs the folder locked. Instead of locking, fetching and decrypting the
+ * metadata, then encrypting, storing and unlocking it again for every item,
+ * all items of a folder share one session for the whole sync: the folder is
+ * locked and its metadata decrypted once, the items change it in memory and
+ * it's sent once by commit(), when the folder's items are done.
+ *
+ * To not keep other clients out of a big folder for the whole sync, and to
+ * lose little when sending the metadata fails, the lock is only used for
+ * maxItemsPerLock items or maxLockDuration. Items that come later wait until
+ * the ones using the lock are done, i.e. until the receivers passed to
+ * open() are deleted, then the metadata is sent, the folder unlocked and
+ * locked again for them.
+ *
+ * See OwncloudPropagator::folderMetadataSession(). The session deletes
+ * itself once it was committed.
+ */
+class OWNCLOUDSYNC_EXPORT FolderMetadataSession : public QObject
+{
+    Q_OBJECT
+public:
+    /** @a folder is the local path of the folder, @a remoteFolderPath its full remote path */
+    FolderMetadataSession(const AccountPtr &account, SyncJournalDb *journal,
+        const QString &folder, const QString &remoteFolderPath);
+    ~FolderMetadataSession() override;
+
+    QString folder() const { return _folder; }
+
+    /**
+     * Calls @a onReady once the folder is locked and its metadata is known,
+     * or @a onError if that failed.
+     *
+     * The callbacks are dropped if @a receiver is deleted before. The item
+     * uses the lock until @a receiver is deleted.
+     */
+    void open(QObject *receiver, const std::function<void()> &onReady, const std::function<void()> &onError);
+
+    bool isOpen() const { return _state == Open; }
+
+    /** The decrypted metadata, to be changed in place while open */
+    FolderMetadata *metadata() const { return _metadata.data(); }
+    QByteArray folderId() const { return _folderId; }
+    QByteArray folderToken() const { return _folderToken; }
+
+    /** Records that the metadata was changed for the item at @a file */
+    void setChanged(const QString &file);
+
+    /**
+     * Sends the changed metadata and unlocks the folder, then emits committed().
+     *
+     * If sending the metadata fails, the database records of the items
+     * changed since the folder was last locked are removed so that the next
+     * sync propagates them again, and committed() reports the failure.
+     */
+    void commit();
+
+    /** The number of items that use one lock of the folder */
+    static int maxItemsPerLock;
+
+    /**
+     * Time after which no more items use the lock.
+     *
+     * Other clients give up locking the folder after about as long.
+     */
+    static std::chrono::milliseconds maxLockDuration;
+
+    /** Time between the tries to lock a folder that is locked by someone else */
+    static std::chrono::milliseconds lockRetryInterval;
+
+signals:
+    void committed(bool success);
+
+private:
+    enum State {
+        NotOpened,
+        Opening,
+        Open,
+        Failed,
+        Committing,
+        Committed
+    };
+
+    struct Waiter
+    {
+        QPointer<QObject> receiver;
+        std::function<void()> onReady;
+        std::function<void()> onError;
+    };
+
+    void tryLock();
+    void slotFolderLockedError(const QByteArray &folderId, int httpErrorCode);
+    void slotMetadataReceived(const QJsonDocument &json, int statusCode);
+    void setOpenResult(State state);
+    bool isLockUsedUp() const;
+    void addUser(QObject *receiver);
+    void releaseUser();
+    void serveWaiters();
+    void failWaiters();
+    void startCommit();
+    void sendMetadata();
+    void unlock();
+    void finishCommit(bool success);
+
+    AccountPtr _account;
+    QPointer<SyncJournalDb> _journal;
+    QString _folder;
+    QString _remoteFolderPath;
+
+    State _state = NotOpened;
+    bool _commitRequested = false;
+    QVector<Waiter> _waiters;
+    QElapsedTimer _lockFirstTry;
+    QElapsedTimer _lockedSince;
+
+    /// Items that use the current lock and haven't finished yet
+    int _users = 0;
+    /// Items that used the current lock
+    int _lockItems = 0;
+    /// Waiting for the users to finish to send the metadata and lock again
+    bool _relockPending = false;
+    bool _relocking = false;
+
+    QByteArray _folderId;
+    QByteArray _folderToken;
+    QScopedPointer<FolderMetadata> _metadata;
+    int _metadataStatusCode = 0;
+    QStringList _changedFiles;
+    bool _commitFailed = false;
+};
+
+}
@@ -13,6 +13,7 @@
  */
 
 #include "logger.h"
+#include "asynclogwriter.h"
 
 #include "config.h"
 
@@ -60,6 +61,9 @@ Logger::~Logger()
 #ifndef NO_MSG_HANDLER
     qInstallMessageHandler(nullptr);
 #endif
+    // Writes the pending messages, which needs the members
+    _logAsync = false;
+    _asyncWriter.reset();
 }
 
 
@@ -87,6 +91,15 @@ bool Logger::isLoggingToFile() const
 void Logger::doLog(QtMsgType type, const QMessageLogContext &ctx, const QString &message)
 {
     const QString msg = qFormatLogMessage(type, ctx, message);
+    if (_logAsync.load(std::memory_order_acquire)) {
+        if (type != QtFatalMsg) {
+            _asyncWriter->post(msg);
+            emit logWindowLog(msg);
+            return;
+        }
+        // Get everything before into the log file, then write this one directly
+        _asyncWriter->sync();
+    }
     {
         QMutexLocker lock(&_mutex);
         _crashLogIndex = (_crashLogIndex + 1) % CrashLogSize;
@@ -107,6 +120,21 @@ void Logger::doLog(QtMsgType type, const QMessageLogContext &ctx, const QString
     emit logWindowLog(msg);
 }
 
+// Called on the writer thread in async mode
+void Logger::writeBatch(const QVector<QString> &messages)
+{
+    QMutexLocker lock(&_mutex);
+    for (const auto &msg : messages) {
+        _crashLogIndex = (_crashLogIndex + 1) % CrashLogSize;
+        _crashLog[_crashLogIndex] = msg;
+        if (_logstream)
+            (*_logstream) << msg << QLatin1Char('\n');
+    }
+    // One flush per batch instead of one per line
+    if (_logstream)
+        _logstream->flush();
+}
+
 void Logger::close()
 {
     dumpCrashLog();
@@ -174,6 +202,28 @@ void Logger::setLogDir(const QString &dir)
 void Logger::setLogFlush(bool flush)
 {
     _doFileFlush = flush;
+    if (flush)
+        setLogAsync(false);
+}
+
+void Logger::setLogAsync(bool async)
+{
+    // Each message must be in the file before logging returns
+    if (_doFileFlush)
+        async = false;
+
+    QMutexLocker locker(&_mutex);
+    if (async && !_asyncWriter) {
+        _asyncWriter.reset(new AsyncLogWriter([this](const QVector<QString> &messages) {
+            writeBatch(messages);
+        }));
+    }
+    const bool wasAsync = _logAsync.exchange(async);
+    locker.unlock();
+
+    // Keep the order with the messages written directly from now on
+    if (wasAsync && !async)
+        _asyncWriter->sync();
 }
 
 void Logger::setLogDebug(bool debug)
@@ -266,6 +316,13 @@ static bool compressLog(const QString &originalName, const QString &targetName)
 
 void Logger::enterNextLogFile()
 {
+    if (_logAsync && !_asyncWriter->isWriterThread()) {
+        // Switch files and compress the old one in the background, after the
+        // messages logged so far
+        _asyncWriter->runOnWriterThread([this] { enterNextLogFile(); });
+        return;
+    }
+
     if (!_logDirectory.isEmpty()) {
 
         QDir dir(_logDirectory);
@@ -22,11 +22,15 @@
 #include <QTextStream>
 #include <qmutex.h>
 
+#include <atomic>
+
 #include "common/utility.h"
 #include "owncloudlib.h"
 
 namespace OCC {
 
+class AsyncLogWriter;
+
 /**
  * @brief The Logger class
  * @ingroup libsync
@@ -53,8 +57,20 @@ public:
     QString logDir() const;
     void setLogDir(const QString &dir);
 
+    /// Flushes the log file after every message, turns off logAsync()
     void setLogFlush(bool flush);
 
+    /** Whether the log file is written by a background thread
+     *
+     * Logging then costs the calling thread the formatting and a copy into
+     * a per-thread buffer, the file writes are batched. Log rotation and the
+     * compression of old logs move to the background thread, too.
+     *
+     * Not possible while the log is flushed after every message.
+     */
+    bool logAsync() const { return _logAsync.load(); }
+    void setLogAsync(bool async);
+
     bool logDebug() const { return _logDebug; }
     void setLogDebug(bool debug);
 
@@ -98,6 +114,7 @@ private:
 
     void close();
     void dumpCrashLog();
+    void writeBatch(const QVector<QString> &messages);
 
     QFile _logFile;
     bool _doFileFlush = false;
@@ -110,6 +127,9 @@ private:
     QSet<QString> _logRules;
     QVector<QString> _crashLog;
     int _crashLogIndex = 0;
+    // Created on first use and kept, so doLog() can use it without locking
+    QScopedPointer<AsyncLogWriter> _asyncWriter;
+    std::atomic<bool> _logAsync{ false };
 };
 
 } // namespace OCC
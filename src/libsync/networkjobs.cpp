@@ -43,6 +43,7 @@
 
 #include "creds/abstractcredentials.h"
 #include "creds/httpcredentials.h"
+#include "common/syncmetrics.h"
 
 namespace OCC {
 
@@ -368,8 +369,10 @@ void LsColJob::start()
         }
     }
 
+    // No Accept-Encoding header: Qt only asks for gzip and deflate compressed
+    // listings and decompresses them transparently if none is set here.
     QNetworkRequest req;
-    req.setRawHeader("Depth", "1");
+    req.setRawHeader("Depth", QByteArray::number(_depth));
     QByteArray xml("<?xml version=\"1.0\" ?>\n"
                    "<d:propfind xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">\n"
                    "  <d:prop>\n"
@@ -407,8 +410,16 @@ bool LsColJob::finished()
         connect(&parser, &LsColXMLParser::finishedWithoutError,
             this, &LsColJob::finishedWithoutError);
 
+        const QByteArray body = reply()->readAll();
+        static auto listingBytes = SyncMetrics::instance()->histogram(QStringLiteral("dav.listing_bytes"));
+        listingBytes->record(body.size());
+        if (!reply()->rawHeader("content-encoding").isEmpty()) {
+            static auto compressed = SyncMetrics::instance()->counter(QStringLiteral("dav.listings_compressed"));
+            compressed->add();
+        }
+
         QString expectedPath = reply()->request().url().path(); // something like "/owncloud/remote.php/dav/folder"
-        if (!parser.parse(reply()->readAll(), &_folderInfos, expectedPath)) {
+        if (!parser.parse(body, &_folderInfos, expectedPath)) {
             // XML parse error
             emit finishedWithError(reply());
         }
@@ -482,6 +493,7 @@ static void mergeSslConfigurationForSslButton(const QSslConfiguration &config, A
     }
     if (config.sessionTicket().length() > 0) {
         account->_sessionTicket = config.sessionTicket();
+        account->persistSslSession(config);
     }
 }
 
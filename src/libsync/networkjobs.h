@@ -127,6 +127,12 @@ public:
     void setProperties(QList<QByteArray> properties);
     QList<QByteArray> properties() const;
 
+    /** The Depth of the PROPFIND, 1 by default to list the collection.
+     *
+     * With 0 only the properties of the resource itself are queried.
+     */
+    void setDepth(int depth) { _depth = depth; }
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
@@ -139,6 +145,7 @@ private slots:
 private:
     QList<QByteArray> _properties;
     QUrl _url; // Used instead of path() if the url is specified in the constructor
+    int _depth = 1;
 };
 
 /**
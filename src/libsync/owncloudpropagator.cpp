@@ -18,16 +18,21 @@
 #include "common/syncjournalfilerecord.h"
 #include "propagatedownload.h"
 #include "propagateupload.h"
+#include "propagateremotebatch.h"
+#include "propagatevirtualfilebatch.h"
+#include "foldermetadatasession.h"
 #include "propagateremotedelete.h"
 #include "propagateremotemove.h"
 #include "propagateremotemkdir.h"
 #include "propagatorjobs.h"
 #include "filesystem.h"
 #include "common/utility.h"
+#include "common/syncmetrics.h"
 #include "account.h"
 #include "common/asserts.h"
 #include "discoveryphase.h"
 #include "syncfileitem.h"
+#include "transfergovernor.h"
 
 #ifdef Q_OS_WIN
 #include <windef.h>
@@ -44,6 +49,8 @@
 #include <QRegularExpression>
 #include <qmath.h>
 
+#include <algorithm>
+
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcPropagator, "nextcloud.sync.propagator", QtInfoMsg)
@@ -98,6 +105,11 @@ int OwncloudPropagator::hardMaximumActiveJob()
     return _syncOptions._parallelNetworkJobs;
 }
 
+int OwncloudPropagator::maximumActiveSmallJob()
+{
+    return qMax(hardMaximumActiveJob(), _syncOptions.parallelSmallRequests(account()->isHttp2Supported()));
+}
+
 PropagateItemJob::~PropagateItemJob()
 {
     if (auto p = propagator()) {
@@ -137,6 +149,10 @@ static SyncJournalErrorBlacklistRecord createBlacklistEntry(
     entry._lastTryTime = Utility::qDateTimeToTime_t(QDateTime::currentDateTimeUtc());
     entry._renameTarget = item._renameTarget;
     entry._retryCount = old._retryCount + 1;
+    if (old.isValid()) {
+        static auto retries = SyncMetrics::instance()->counter(QStringLiteral("propagation.failed_retries"));
+        retries->add();
+    }
     entry._requestId = item._requestId;
 
     static qint64 minBlacklistTime(getMinBlacklistTime());
@@ -223,6 +239,7 @@ void PropagateItemJob::done(SyncFileItem::Status statusArg, const QString &error
     // Duplicate calls to done() are a logic error
     ENFORCE(_state != Finished);
     _state = Finished;
+    SyncTrace::end(SyncTrace::Propagation, SyncTrace::spanId(this), _item->_size);
 
     _item->_status = statusArg;
 
@@ -391,6 +408,15 @@ qint64 OwncloudPropagator::smallFileSize()
 }
 
 void OwncloudPropagator::start(SyncFileItemVector &&items)
+{
+    appendItems(std::move(items));
+
+    // Nothing is added anymore, the root job may finish once it ran out of jobs
+    _rootJob->_subJobs._acceptsMoreJobs = false;
+    scheduleNextJob();
+}
+
+void OwncloudPropagator::appendItems(SyncFileItemVector &&items)
 {
     Q_ASSERT(std::is_sorted(items.begin(), items.end()));
 
@@ -419,7 +445,11 @@ void OwncloudPropagator::start(SyncFileItemVector &&items)
             items.end());
     }
 
-    _rootJob.reset(new PropagateRootDirectory(this));
+    if (!_rootJob) {
+        _rootJob.reset(new PropagateRootDirectory(this));
+        _rootJob->_subJobs._acceptsMoreJobs = true;
+        connect(_rootJob.data(), &PropagatorJob::finished, this, &OwncloudPropagator::emitFinished);
+    }
     QStack<QPair<QString /* directory name */, PropagateDirectory * /* job */>> directories;
     directories.push(qMakePair(QString(), _rootJob.data()));
     QVector<PropagatorJob *> directoriesToRemove;
@@ -531,9 +561,6 @@ void OwncloudPropagator::start(SyncFileItemVector &&items)
         _rootJob->_dirDeletionJobs.appendJob(it);
     }
 
-    connect(_rootJob.data(), &PropagatorJob::finished, this, &OwncloudPropagator::emitFinished);
-
-    _jobScheduled = false;
     scheduleNextJob();
 }
 
@@ -548,6 +575,13 @@ void OwncloudPropagator::setSyncOptions(const SyncOptions &syncOptions)
     _chunkSize = syncOptions._initialChunkSize;
 }
 
+void OwncloudPropagator::setParallelNetworkJobs(int jobs)
+{
+    _syncOptions._parallelNetworkJobs = jobs;
+    // Start more jobs if the limit was raised
+    scheduleNextJob();
+}
+
 bool OwncloudPropagator::localFileNameClash(const QString &relFile)
 {
     const QString file(_localDir + relFile);
@@ -653,6 +687,12 @@ void OwncloudPropagator::scheduleNextJobImpl()
 
     _jobScheduled = false;
 
+    // Leave the server's remaining request slots to other syncs, but keep at least one job going.
+    // TransferGovernor::requestSlotAvailable() schedules again.
+    if (!_activeJobList.isEmpty() && TransferGovernor::instance()->freeRequestSlots(account()->url()) == 0) {
+        return;
+    }
+
     if (_activeJobList.count() < maximumActiveTransferJob()) {
         if (_rootJob->scheduleSelfOrChild()) {
             scheduleNextJob();
@@ -674,6 +714,15 @@ void OwncloudPropagator::scheduleNextJobImpl()
                 scheduleNextJob();
             }
         }
+    } else if (_activeJobList.count() < maximumActiveSmallJob()) {
+        // With HTTP/2 the small requests are multiplexed over one connection,
+        // keep adding jobs as long as none of the running ones is a large transfer.
+        const bool onlySmallJobs = std::all_of(_activeJobList.cbegin(), _activeJobList.cend(), [](PropagateItemJob *job) {
+            return job->isLikelyFinishedQuickly();
+        });
+        if (onlySmallJobs && _rootJob->scheduleSelfOrChild()) {
+            scheduleNextJob();
+        }
     }
 }
 
@@ -877,7 +926,9 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
     while (_jobsToDo.isEmpty() && !_tasksToDo.isEmpty()) {
         SyncFileItemPtr nextTask = _tasksToDo.first();
         _tasksToDo.remove(0);
-        PropagatorJob *job = propagator()->createJob(nextTask);
+        PropagatorJob *job = PropagateVirtualFileBatch::create(propagator(), nextTask, _tasksToDo);
+        if (!job)
+            job = PropagateRemoteBatch::create(propagator(), nextTask, _tasksToDo);
         if (!job) {
             qCWarning(lcDirectory) << "Useless task found for file" << nextTask->destination() << "instruction" << nextTask->_instruction;
             continue;
@@ -895,7 +946,7 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
 
     // If neither us or our children had stuff left to do we could hang. Make sure
     // we mark this job as finished so that the propagator can schedule a new one.
-    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty()) {
+    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty() && !_acceptsMoreJobs) {
         // Our parent jobs are already iterating over their running jobs, post to the event loop
         // to avoid removing ourself from that list while they iterate.
         QMetaObject::invokeMethod(this, "finalize", Qt::QueuedConnection);
@@ -914,23 +965,27 @@ void PropagatorCompositeJob::slotSubJobFinished(SyncFileItem::Status status)
     ENFORCE(i >= 0); // should only happen if this function is called more than once
     _runningJobs.remove(i);
 
-    // Any sub job error will cause the whole composite to fail. This is important
-    // for knowing whether to update the etag in PropagateDirectory, for example.
-    if (status == SyncFileItem::FatalError
-        || status == SyncFileItem::NormalError
-        || status == SyncFileItem::SoftError
-        || status == SyncFileItem::DetailError
-        || status == SyncFileItem::BlacklistedError) {
+    // Any sub job error will cause the whole composite to fail.
+    if (isErrorStatus(status)) {
         _hasError = status;
     }
 
-    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty()) {
+    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty() && !_acceptsMoreJobs) {
         finalize();
     } else {
         propagator()->scheduleNextJob();
     }
 }
 
+bool PropagatorCompositeJob::isErrorStatus(SyncFileItem::Status status)
+{
+    return status == SyncFileItem::FatalError
+        || status == SyncFileItem::NormalError
+        || status == SyncFileItem::SoftError
+        || status == SyncFileItem::DetailError
+        || status == SyncFileItem::BlacklistedError;
+}
+
 void PropagatorCompositeJob::finalize()
 {
     // The propagator will do parallel scheduling and this could be posted
@@ -1021,6 +1076,21 @@ void PropagateDirectory::slotFirstJobFinished(SyncFileItem::Status status)
 }
 
 void PropagateDirectory::slotSubJobsFinished(SyncFileItem::Status status)
+{
+    // The metadata of encrypted folders is sent once all their items are done
+    const bool committing = propagator()->commitFolderMetadataSessions(_item->_file, this, [this, status](bool success) {
+        if (!success && (status == SyncFileItem::Success || status == SyncFileItem::Restoration || status == SyncFileItem::Conflict)) {
+            // Don't update the etag, the items will be propagated again
+            finalize(SyncFileItem::NormalError);
+        } else {
+            finalize(status);
+        }
+    });
+    if (!committing)
+        finalize(status);
+}
+
+void PropagateDirectory::finalize(SyncFileItem::Status status)
 {
     if (!_item->isEmpty() && status == SyncFileItem::Success) {
         // If a directory is renamed, recursively delete any stale items
@@ -1138,8 +1208,17 @@ void PropagateRootDirectory::slotSubJobsFinished(SyncFileItem::Status status)
 
 void PropagateRootDirectory::slotDirDeletionJobsFinished(SyncFileItem::Status status)
 {
-    _state = Finished;
-    emit finished(status);
+    const auto finish = [this](SyncFileItem::Status status) {
+        _state = Finished;
+        emit finished(status);
+    };
+
+    // Directory deletions change the metadata of encrypted folders that are done already
+    const bool committing = propagator()->commitFolderMetadataSessions(QString(), this, [finish, status](bool success) {
+        finish(!success && status == SyncFileItem::Success ? SyncFileItem::NormalError : status);
+    });
+    if (!committing)
+        finish(status);
 }
 
 // ================================================================================
@@ -1196,6 +1275,46 @@ QString OwncloudPropagator::fullRemotePath(const QString &tmp_file_name) const
     return _remoteFolder + tmp_file_name;
 }
 
+FolderMetadataSession *OwncloudPropagator::folderMetadataSession(const QString &file, const QString &remoteFolderPath)
+{
+    const auto slashPosition = file.lastIndexOf('/');
+    const auto folder = slashPosition >= 0 ? file.left(slashPosition) : QString();
+
+    auto &session = _folderMetadataSessions[folder];
+    if (!session)
+        session = new FolderMetadataSession(_account, _journal, folder, fullRemotePath(remoteFolderPath));
+    return session;
+}
+
+bool OwncloudPropagator::commitFolderMetadataSessions(const QString &folder, QObject *receiver, const std::function<void(bool)> &done)
+{
+    QVector<FolderMetadataSession *> sessions;
+    for (auto it = _folderMetadataSessions.begin(); it != _folderMetadataSessions.end();) {
+        if (!it.value()) {
+            it = _folderMetadataSessions.erase(it);
+        } else if (folder.isEmpty() || it.key() == folder || it.key().startsWith(folder + QLatin1Char('/'))) {
+            sessions.append(it.value());
+            it = _folderMetadataSessions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (sessions.isEmpty())
+        return false;
+
+    auto pending = QSharedPointer<int>::create(sessions.size());
+    auto allCommitted = QSharedPointer<bool>::create(true);
+    for (auto *session : qAsConst(sessions)) {
+        connect(session, &FolderMetadataSession::committed, receiver, [pending, allCommitted, done](bool success) {
+            *allCommitted = *allCommitted && success;
+            if (--*pending == 0)
+                done(*allCommitted);
+        });
+        session->commit();
+    }
+    return true;
+}
+
 QString OwncloudPropagator::remotePath() const
 {
     return _remoteFolder;
@@ -24,9 +24,12 @@
 #include <QIODevice>
 #include <QMutex>
 
+#include <functional>
+
 #include "csync.h"
 #include "syncfileitem.h"
 #include "common/syncjournaldb.h"
+#include "common/synctrace.h"
 #include "bandwidthmanager.h"
 #include "accountfwd.h"
 #include "syncoptions.h"
@@ -49,6 +52,7 @@ qint64 freeSpaceLimit();
 class SyncJournalDb;
 class OwncloudPropagator;
 class PropagatorCompositeJob;
+class FolderMetadataSession;
 
 /**
  * @brief the base class of propagator jobs
@@ -200,6 +204,7 @@ public:
             return false;
         }
         qCInfo(lcPropagator) << "Starting" << _item->_instruction << "propagation of" << _item->destination() << "by" << this;
+        SyncTrace::begin(SyncTrace::Propagation, _item->destination(), SyncTrace::spanId(this), _item->_size);
 
         _state = Running;
         QMetaObject::invokeMethod(this, "start"); // We could be in a different thread (neon jobs)
@@ -227,6 +232,7 @@ public:
     QVector<PropagatorJob *> _runningJobs;
     SyncFileItem::Status _hasError; // NoStatus,  or NormalError / SoftError if there was an error
     quint64 _abortsCount;
+    bool _acceptsMoreJobs = false; // Don't finish when running out of jobs, more will be appended
 
     explicit PropagatorCompositeJob(OwncloudPropagator *propagator)
         : PropagatorJob(propagator)
@@ -271,6 +277,13 @@ public:
 
     qint64 committedDiskSpace() const override;
 
+    /**
+     * Whether a sub job finishing with this status makes the whole composite fail
+     *
+     * Important for knowing whether to update the etag in PropagateDirectory, for example.
+     */
+    static bool isErrorStatus(SyncFileItem::Status status);
+
 private slots:
     void slotSubJobAbortFinished();
     bool possiblyRunNextJob(PropagatorJob *next)
@@ -342,6 +355,8 @@ private slots:
     void slotFirstJobFinished(SyncFileItem::Status status);
     virtual void slotSubJobsFinished(SyncFileItem::Status status);
 
+private:
+    void finalize(SyncFileItem::Status status);
 };
 
 /**
@@ -423,8 +438,17 @@ public:
 
     void start(SyncFileItemVector &&_syncedItems);
 
+    /** Starts propagating items before start() is called
+     *
+     * The items must be sorted and form complete top level subtrees that
+     * later items can't affect. The propagation doesn't finish before
+     * start() was called with the remaining items.
+     */
+    void appendItems(SyncFileItemVector &&items);
+
     const SyncOptions &syncOptions() const;
     void setSyncOptions(const SyncOptions &syncOptions);
+    void setParallelNetworkJobs(int jobs);
 
     int _downloadLimit = 0;
     int _uploadLimit = 0;
@@ -471,6 +495,12 @@ public:
     /* The maximum number of active jobs in parallel  */
     int hardMaximumActiveJob();
 
+    /** The maximum number of active jobs while all of them are likely to finish quickly
+     *
+     * Higher than hardMaximumActiveJob() when requests are multiplexed over HTTP/2.
+     */
+    int maximumActiveSmallJob();
+
     /** Check whether a download would clash with an existing file
      * in filesystems that are only case-preserving.
      */
@@ -572,6 +602,21 @@ public:
     static Result<Vfs::ConvertToPlaceholderResult, QString> staticUpdateMetadata(const SyncFileItem &item, const QString localDir,
                                                                                  Vfs *vfs, SyncJournalDb * const journal);
 
+    /** The metadata session of the end-to-end encrypted folder containing @a file
+     *
+     * All items of the folder share it until the folder's items are done,
+     * see commitFolderMetadataSessions(). @a remoteFolderPath is the remote
+     * path of the folder, with its mangled name.
+     */
+    FolderMetadataSession *folderMetadataSession(const QString &file, const QString &remoteFolderPath);
+
+    /** Sends the metadata of the encrypted folders in @a folder and below, all if it's empty
+     *
+     * Calls @a done with whether all of them were sent and unlocked, unless
+     * @a receiver is gone. Returns false if there was no session to commit.
+     */
+    bool commitFolderMetadataSessions(const QString &folder, QObject *receiver, const std::function<void(bool)> &done);
+
 private slots:
 
     void abortTimeout()
@@ -584,6 +629,9 @@ private slots:
     /** Emit the finished signal and make sure it is only emitted once */
     void emitFinished(SyncFileItem::Status status)
     {
+        // Don't leave encrypted folders locked after an abort or an error
+        commitFolderMetadataSessions(QString(), this, [](bool) {});
+
         if (!_finishedEmited)
             emit finished(status == SyncFileItem::Success);
         _finishedEmited = true;
@@ -614,6 +662,7 @@ private:
     AccountPtr _account;
     QScopedPointer<PropagateRootDirectory> _rootJob;
     SyncOptions _syncOptions;
+    QHash<QString, QPointer<FolderMetadataSession>> _folderMetadataSessions;
     bool _jobScheduled = false;
 
     const QString _localDir; // absolute path to the local directory. ends with '/'
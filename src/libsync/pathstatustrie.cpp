@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "pathstatustrie.h"
+#include "common/asserts.h"
+
+namespace OCC {
+
+constexpr PathStatusTrie::NodeId PathStatusTrie::InvalidNode;
+constexpr PathStatusTrie::NodeId PathStatusTrie::RootNode;
+
+// The key of a path component in Node::children
+static QString childKey(const QStringRef &name)
+{
+    // Should match Utility::fsCasePreserving, without paying for the runtime check on every lookup.
+#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
+    return name.toString().toCaseFolded();
+#else
+    return name.toString();
+#endif
+}
+
+// Like childKey(), but may point into the path's data, only for lookups
+static QString lookupKey(const QStringRef &name)
+{
+#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
+    return childKey(name);
+#else
+    return QString::fromRawData(name.unicode(), name.size());
+#endif
+}
+
+// Calls f with each component of the path, stops when f returns false
+template <typename F>
+static void forEachComponent(const QString &path, F f)
+{
+    int start = 0;
+    while (start < path.size()) {
+        int end = path.indexOf(QLatin1Char('/'), start);
+        if (end == -1)
+            end = path.size();
+        if (end > start && !f(path.midRef(start, end - start)))
+            return;
+        start = end + 1;
+    }
+}
+
+PathStatusTrie::PathStatusTrie()
+{
+    _nodes.append(Node());
+}
+
+PathStatusTrie::NodeId PathStatusTrie::find(const QString &path) const
+{
+    NodeId id = RootNode;
+    forEachComponent(path, [&](const QStringRef &name) {
+        id = _nodes.at(id).children.value(lookupKey(name), InvalidNode);
+        return id != InvalidNode;
+    });
+    return id;
+}
+
+PathStatusTrie::NodeId PathStatusTrie::findOrInsert(const QString &path)
+{
+    NodeId id = RootNode;
+    forEachComponent(path, [&](const QStringRef &name) {
+        const NodeId child = _nodes.at(id).children.value(lookupKey(name), InvalidNode);
+        if (child != InvalidNode) {
+            id = child;
+            return true;
+        }
+
+        Node node;
+        node.parent = id;
+        const auto key = childKey(name);
+#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
+        node.name = name.toString();
+#else
+        node.name = key; // shares the data with the key
+#endif
+
+        NodeId newId;
+        if (!_freeNodes.isEmpty()) {
+            newId = _freeNodes.takeLast();
+            _nodes[newId] = std::move(node);
+        } else {
+            newId = _nodes.size();
+            _nodes.append(std::move(node));
+        }
+        _nodes[id].children.insert(key, newId);
+        id = newId;
+        return true;
+    });
+    return id;
+}
+
+QString PathStatusTrie::path(NodeId id) const
+{
+    QVector<const QString *> names;
+    int length = 0;
+    for (; id != RootNode; id = _nodes.at(id).parent) {
+        names.append(&_nodes.at(id).name);
+        length += _nodes.at(id).name.size() + 1;
+    }
+
+    QString result;
+    result.reserve(qMax(0, length - 1));
+    for (auto it = names.crbegin(); it != names.crend(); ++it) {
+        if (!result.isEmpty())
+            result += QLatin1Char('/');
+        result += **it;
+    }
+    return result;
+}
+
+int PathStatusTrie::addSyncCount(NodeId id, int delta)
+{
+    return _nodes[id].syncCount += delta;
+}
+
+void PathStatusTrie::setDirty(NodeId id, bool dirty)
+{
+    _nodes[id].dirty = dirty;
+}
+
+void PathStatusTrie::setProblem(NodeId id, SyncFileStatus::SyncFileStatusTag problem)
+{
+    auto &node = _nodes[id];
+    const int delta = (problem == SyncFileStatus::StatusError) - (node.problem == SyncFileStatus::StatusError);
+    node.problem = problem;
+    if (!delta)
+        return;
+    for (NodeId parent = node.parent; parent != InvalidNode; parent = _nodes.at(parent).parent) {
+        _nodes[parent].errorDescendants += delta;
+        ASSERT(_nodes.at(parent).errorDescendants >= 0);
+    }
+}
+
+SyncFileStatus::SyncFileStatusTag PathStatusTrie::problemStatus(NodeId id) const
+{
+    const auto &node = _nodes.at(id);
+    if (node.problem != SyncFileStatus::StatusNone)
+        return node.problem;
+    if (node.errorDescendants > 0)
+        return SyncFileStatus::StatusWarning;
+    return SyncFileStatus::StatusNone;
+}
+
+void PathStatusTrie::prune(NodeId id)
+{
+    while (id != RootNode && id != InvalidNode && !isFree(id) && _nodes.at(id).isUnused()) {
+        auto &node = _nodes[id];
+        const NodeId parent = node.parent;
+        _nodes[parent].children.remove(lookupKey(QStringRef(&node.name)));
+        node = Node();
+        _freeNodes.append(id);
+        id = parent;
+    }
+}
+
+QVector<PathStatusTrie::NodeId> PathStatusTrie::nodes(const std::function<bool(const Node &)> &predicate) const
+{
+    QVector<NodeId> result;
+    for (NodeId id = 0; id < _nodes.size(); ++id) {
+        if (!isFree(id) && predicate(_nodes.at(id)))
+            result.append(id);
+    }
+    return result;
+}
+
+} // namespace OCC
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+#include "common/syncfilestatus.h"
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+namespace OCC {
+
+/**
+ * @brief Per-path state of the SyncFileStatusTracker
+ * @ingroup libsync
+ *
+ * Every path component is stored once, in a node that knows its parent.
+ * Nodes are addressed by integer ids, so walking up to the root costs an
+ * integer lookup per level instead of string operations.
+ *
+ * Nodes only exist while they or one of their children carry state; call
+ * prune() after clearing state. Ids of pruned nodes get reused.
+ *
+ * On Windows and macOS paths are matched case-insensitively, like the
+ * file systems there.
+ */
+class OWNCLOUDSYNC_EXPORT PathStatusTrie
+{
+public:
+    using NodeId = int;
+    static constexpr NodeId InvalidNode = -1;
+    /// The root node, for the empty path
+    static constexpr NodeId RootNode = 0;
+
+    struct Node
+    {
+        /// The last path component, as first seen
+        QString name;
+        NodeId parent = InvalidNode;
+        /// See SyncFileStatusTracker::_paths
+        int syncCount = 0;
+        /// Number of nodes below this one with a StatusError problem
+        int errorDescendants = 0;
+        SyncFileStatus::SyncFileStatusTag problem = SyncFileStatus::StatusNone;
+        /// Touched locally and not yet picked up by a sync
+        bool dirty = false;
+        QHash<QString, NodeId> children;
+
+        bool isUnused() const
+        {
+            return syncCount == 0 && errorDescendants == 0 && problem == SyncFileStatus::StatusNone
+                && !dirty && children.isEmpty();
+        }
+    };
+
+    PathStatusTrie();
+
+    /// Returns InvalidNode if there's no node for the path
+    NodeId find(const QString &path) const;
+    NodeId findOrInsert(const QString &path);
+
+    const Node &node(NodeId id) const { return _nodes.at(id); }
+    NodeId parent(NodeId id) const { return _nodes.at(id).parent; }
+    QString path(NodeId id) const;
+
+    /// Returns the new sync count
+    int addSyncCount(NodeId id, int delta);
+    void setDirty(NodeId id, bool dirty);
+    /// Keeps the errorDescendants of all parents up to date
+    void setProblem(NodeId id, SyncFileStatus::SyncFileStatusTag problem);
+
+    /**
+     * The problem to show for the node: its own, otherwise StatusWarning if
+     * there's an error below it.
+     */
+    SyncFileStatus::SyncFileStatusTag problemStatus(NodeId id) const;
+
+    /// Removes the node and then its parents, as long as they're unused
+    void prune(NodeId id);
+
+    /// Ids of all nodes matching the predicate
+    QVector<NodeId> nodes(const std::function<bool(const Node &)> &predicate) const;
+    int nodeCount() const { return _nodes.size() - _freeNodes.size(); }
+
+private:
+    bool isFree(NodeId id) const { return id != RootNode && _nodes.at(id).parent == InvalidNode; }
+
+    QVector<Node> _nodes;
+    QVector<NodeId> _freeNodes;
+};
+
+} // namespace OCC
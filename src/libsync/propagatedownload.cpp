@@ -20,6 +20,7 @@
 #include "common/syncjournaldb.h"
 #include "common/syncjournalfilerecord.h"
 #include "common/utility.h"
+#include "common/syncmetrics.h"
 #include "filesystem.h"
 #include "propagatorjobs.h"
 #include <common/checksums.h>
@@ -298,8 +299,10 @@ void GETFileJob::slotReadyRead()
     QByteArray buffer(bufferSize, Qt::Uninitialized);
 
     while (reply()->bytesAvailable() > 0 && _saveBodyToFile) {
+        static auto throttled = SyncMetrics::instance()->counter(QStringLiteral("bandwidth.download_throttled"));
         if (_bandwidthChoked) {
             qCWarning(lcGetJob) << "Download choked";
+            throttled->add();
             break;
         }
         qint64 toRead = bufferSize;
@@ -307,6 +310,7 @@ void GETFileJob::slotReadyRead()
             toRead = qMin(qint64(bufferSize), _bandwidthQuota);
             if (toRead == 0) {
                 qCWarning(lcGetJob) << "Out of quota";
+                throttled->add();
                 break;
             }
             _bandwidthQuota -= toRead;
@@ -405,49 +409,50 @@ qint64 GETEncryptedFileJob::writeToDevice(const QByteArray &data)
         return -1;
     }
 
-    const auto bytesRemaining = _contentLength - _processedSoFar - data.length();
-
-    if (bytesRemaining != 0 && bytesRemaining < OCC::Constants::e2EeTagSize) {
-        // decryption is going to fail if last chunk does not include or does not equal to OCC::Constants::e2EeTagSize bytes tag
-        // we may end up receiving packets beyond OCC::Constants::e2EeTagSize bytes tag at the end
-        // in that case, we don't want to try and decrypt less than OCC::Constants::e2EeTagSize ending bytes of tag, we will accumulate all the incoming data till the end
-        // and then, we are going to decrypt the entire chunk containing OCC::Constants::e2EeTagSize bytes at the end
-        _pendingBytes += QByteArray(data.constData(), data.length());
-        _processedSoFar += data.length();
-        if (_processedSoFar != _contentLength) {
-            return data.length();
-        }
+    const char *input = data.constData();
+    qint64 inputSize = data.size();
+    if (!_pendingBytes.isEmpty()) {
+        _pendingBytes.append(data);
+        input = _pendingBytes.constData();
+        inputSize = _pendingBytes.size();
     }
 
-    if (!_pendingBytes.isEmpty()) {
-        const auto decryptedChunk = _decryptor->chunkDecryption(_pendingBytes.constData(), _pendingBytes.size());
+    // The e2EeTag at the end must be given to the decryptor in one piece with the
+    // last encrypted bytes, hold back what might be part of it until it's complete
+    auto toDecrypt = inputSize;
+    if (_processedSoFar + inputSize < _contentLength) {
+        toDecrypt = qBound(0ll, _contentLength - OCC::Constants::e2EeTagSize - _processedSoFar, inputSize);
+    }
 
-        if (decryptedChunk.isEmpty()) {
+    if (toDecrypt > 0) {
+        if (!_decryptor->chunkDecryption(input, toDecrypt, _decryptedBytes)) {
             qCCritical(lcPropagateDownload) << "Decryption failed!";
             return -1;
         }
-
-        GETFileJob::writeToDevice(decryptedChunk);
-
-        return data.length();
-    }
-
-    const auto decryptedChunk = _decryptor->chunkDecryption(data.constData(), data.length());
-
-    if (decryptedChunk.isEmpty()) {
-        qCCritical(lcPropagateDownload) << "Decryption failed!";
-        return -1;
+        if (GETFileJob::writeToDevice(_decryptedBytes) != _decryptedBytes.size()) {
+            return -1;
+        }
+        _processedSoFar += toDecrypt;
     }
 
-    GETFileJob::writeToDevice(decryptedChunk);
-
-    _processedSoFar += data.length();
+    _pendingBytes = QByteArray(input + toDecrypt, int(inputSize - toDecrypt));
+    return data.size();
+}
 
-    return data.length();
+bool GETEncryptedFileJob::isDecryptionFinished() const
+{
+    return _decryptor && _decryptor->isFinished();
 }
 
 void PropagateDownloadFile::start()
 {
+    // The placeholder is there already, the journal must know about it even when aborting
+    if (_placeholderChanged) {
+        _stopwatch.start();
+        finishPlaceholder(_placeholderResult);
+        return;
+    }
+
     if (propagator()->_abortRequested)
         return;
     _isEncrypted = false;
@@ -488,58 +493,12 @@ void PropagateDownloadFile::startAfterIsEncryptedIsChecked()
     auto &vfs = syncOptions._vfs;
 
     // For virtual files just dehydrate or create the file and be done
-    if (_item->_type == ItemTypeVirtualFileDehydration) {
-        QString fsPath = propagator()->fullLocalPath(_item->_file);
-        if (!FileSystem::verifyFileUnchanged(fsPath, _item->_previousSize, _item->_previousModtime)) {
-            propagator()->_anotherSyncNeeded = true;
-            done(SyncFileItem::SoftError, tr("File has changed since discovery"));
-            return;
-        }
-
-        qCDebug(lcPropagateDownload) << "dehydrating file" << _item->_file;
-        auto r = vfs->dehydratePlaceholder(*_item);
-        if (!r) {
-            done(SyncFileItem::NormalError, r.error());
-            return;
-        }
-        propagator()->_journal->deleteFileRecord(_item->_originalFile);
-        updateMetadata(false);
-
-        if (!_item->_remotePerm.isNull() && !_item->_remotePerm.hasPermission(RemotePermissions::CanWrite)) {
-            // make sure ReadOnly flag is preserved for placeholder, similarly to regular files
-            FileSystem::setFileReadOnly(propagator()->fullLocalPath(_item->_file), true);
-        }
-
-        return;
-    }
     if (vfs->mode() == Vfs::Off && _item->_type == ItemTypeVirtualFile) {
         qCWarning(lcPropagateDownload) << "ignored virtual file type of" << _item->_file;
         _item->_type = ItemTypeFile;
     }
-    if (_item->_type == ItemTypeVirtualFile) {
-        if (propagator()->localFileNameClash(_item->_file)) {
-            done(SyncFileItem::NormalError, tr("File %1 cannot be downloaded because of a local file name clash!").arg(QDir::toNativeSeparators(_item->_file)));
-            return;
-        }
-
-        qCDebug(lcPropagateDownload) << "creating virtual file" << _item->_file;
-        // do a klaas' case clash check.
-        if (propagator()->localFileNameClash(_item->_file)) {
-            done(SyncFileItem::NormalError, tr("File %1 can not be downloaded because of a local file name clash!").arg(QDir::toNativeSeparators(_item->_file)));
-            return;
-        }
-        auto r = vfs->createPlaceholder(*_item);
-        if (!r) {
-            done(SyncFileItem::NormalError, r.error());
-            return;
-        }
-        updateMetadata(false);
-
-        if (!_item->_remotePerm.isNull() && !_item->_remotePerm.hasPermission(RemotePermissions::CanWrite)) {
-            // make sure ReadOnly flag is preserved for placeholder, similarly to regular files
-            FileSystem::setFileReadOnly(propagator()->fullLocalPath(_item->_file), true);
-        }
-
+    if (_item->_type == ItemTypeVirtualFileDehydration || _item->_type == ItemTypeVirtualFile) {
+        finishPlaceholder(changePlaceholder(propagator(), *_item));
         return;
     }
 
@@ -581,6 +540,59 @@ void PropagateDownloadFile::startAfterIsEncryptedIsChecked()
     startDownload();
 }
 
+PropagateDownloadFile::PlaceholderResult PropagateDownloadFile::changePlaceholder(OwncloudPropagator *propagator, const SyncFileItem &item)
+{
+    auto &vfs = propagator->syncOptions()._vfs;
+    const QString fsPath = propagator->fullLocalPath(item._file);
+
+    if (item._type == ItemTypeVirtualFileDehydration) {
+        if (!FileSystem::verifyFileUnchanged(fsPath, item._previousSize, item._previousModtime)) {
+            // SoftError makes finishPlaceholder() ask for another sync
+            return { SyncFileItem::SoftError, tr("File has changed since discovery") };
+        }
+
+        qCDebug(lcPropagateDownload) << "dehydrating file" << item._file;
+        auto r = vfs->dehydratePlaceholder(item);
+        if (!r)
+            return { SyncFileItem::NormalError, r.error() };
+    } else {
+        qCDebug(lcPropagateDownload) << "creating virtual file" << item._file;
+        // do a klaas' case clash check.
+        if (propagator->localFileNameClash(item._file)) {
+            return { SyncFileItem::NormalError, tr("File %1 cannot be downloaded because of a local file name clash!").arg(QDir::toNativeSeparators(item._file)) };
+        }
+        auto r = vfs->createPlaceholder(item);
+        if (!r)
+            return { SyncFileItem::NormalError, r.error() };
+    }
+
+    if (!item._remotePerm.isNull() && !item._remotePerm.hasPermission(RemotePermissions::CanWrite)) {
+        // make sure ReadOnly flag is preserved for placeholder, similarly to regular files
+        FileSystem::setFileReadOnly(fsPath, true);
+    }
+    return {};
+}
+
+void PropagateDownloadFile::setPlaceholderChanged(const PlaceholderResult &result)
+{
+    _placeholderResult = result;
+    _placeholderChanged = true;
+}
+
+void PropagateDownloadFile::finishPlaceholder(const PlaceholderResult &result)
+{
+    if (result.status != SyncFileItem::Success) {
+        if (result.status == SyncFileItem::SoftError)
+            propagator()->_anotherSyncNeeded = true;
+        done(result.status, result.errorString);
+        return;
+    }
+
+    if (_item->_type == ItemTypeVirtualFileDehydration)
+        propagator()->_journal->deleteFileRecord(_item->_originalFile);
+    updateMetadata(false);
+}
+
 void PropagateDownloadFile::conflictChecksumComputed(const QByteArray &checksumType, const QByteArray &checksum)
 {
     propagator()->_activeJobList.removeOne(this);
@@ -620,7 +632,8 @@ void PropagateDownloadFile::startDownload()
     const SyncJournalDb::DownloadInfo progressInfo = propagator()->_journal->getDownloadInfo(_item->_file);
     if (progressInfo._valid) {
         // if the etag has changed meanwhile, remove the already downloaded part.
-        if (progressInfo._etag != _item->_etag) {
+        // Encrypted files are decrypted while downloading, they can't be resumed.
+        if (progressInfo._etag != _item->_etag || _isEncrypted) {
             FileSystem::remove(propagator()->fullLocalPath(progressInfo._tmpfile));
             propagator()->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
         } else {
@@ -687,10 +700,24 @@ void PropagateDownloadFile::startDownload()
 
     QMap<QByteArray, QByteArray> headers;
 
-    if (_item->_directDownloadUrl.isEmpty()) {
+    if (_isEncrypted) {
+        // Decrypted on the fly, the temporary file only ever has the decrypted data
+        const auto path = propagator()->fullRemotePath(_item->_encryptedFileName);
+        const auto encryptedInfo = _downloadEncryptedHelper->encryptedInfo();
+        if (_item->_directDownloadUrl.isEmpty()) {
+            _job = new GETEncryptedFileJob(propagator()->account(), path,
+                &_tmpFile, headers, expectedEtagForResume, _resumeStart, encryptedInfo, this);
+        } else {
+            if (!_item->_directDownloadCookies.isEmpty()) {
+                headers["Cookie"] = _item->_directDownloadCookies.toUtf8();
+            }
+            _job = new GETEncryptedFileJob(propagator()->account(), QUrl::fromUserInput(_item->_directDownloadUrl),
+                &_tmpFile, headers, expectedEtagForResume, _resumeStart, encryptedInfo, this);
+        }
+    } else if (_item->_directDownloadUrl.isEmpty()) {
         // Normal job, download from oC instance
         _job = new GETFileJob(propagator()->account(),
-            propagator()->fullRemotePath(_isEncrypted ? _item->_encryptedFileName : _item->_file),
+            propagator()->fullRemotePath(_item->_file),
             &_tmpFile, headers, expectedEtagForResume, _resumeStart, this);
     } else {
         // We were provided a direct URL, use that one
@@ -852,14 +879,23 @@ void PropagateDownloadFile::slotGetFinished()
         return;
     }
 
-    if (bodySize > 0 && bodySize != _tmpFile.size() - job->resumeStart()) {
+    // The e2EeTag isn't written to the temporary file, it's only checked
+    const auto receivedSize = _tmpFile.size() + (_isEncrypted ? Constants::e2EeTagSize : 0);
+    if (bodySize > 0 && bodySize != receivedSize - job->resumeStart()) {
         qCDebug(lcPropagateDownload) << bodySize << _tmpFile.size() << job->resumeStart();
         propagator()->_anotherSyncNeeded = true;
         done(SyncFileItem::SoftError, tr("The file could not be downloaded completely."));
         return;
     }
 
-    if (_tmpFile.size() == 0 && _item->_size > 0) {
+    if (_isEncrypted && !qobject_cast<GETEncryptedFileJob *>(job)->isDecryptionFinished()) {
+        FileSystem::remove(_tmpFile.fileName());
+        propagator()->_anotherSyncNeeded = true;
+        done(SyncFileItem::SoftError, tr("The file could not be downloaded completely."));
+        return;
+    }
+
+    if (!_isEncrypted && _tmpFile.size() == 0 && _item->_size > 0) {
         FileSystem::remove(_tmpFile.fileName());
         done(SyncFileItem::NormalError,
             tr("The downloaded file is empty, but the server said it should have been %1.")
@@ -900,6 +936,9 @@ void PropagateDownloadFile::slotGetFinished()
     auto contentMd5Header = job->reply()->rawHeader(contentMd5HeaderC);
     if (checksumHeader.isEmpty() && !contentMd5Header.isEmpty())
         checksumHeader = "MD5:" + contentMd5Header;
+    // The checksum is of the encrypted data, the e2EeTag was verified instead
+    if (_isEncrypted)
+        checksumHeader.clear();
     validator->start(_tmpFile.fileName(), checksumHeader);
 }
 
@@ -1033,16 +1072,7 @@ void PropagateDownloadFile::contentChecksumComputed(const QByteArray &checksumTy
 {
     _item->_checksumHeader = makeChecksumHeader(checksumType, checksum);
 
-    if (_isEncrypted) {
-        if (_downloadEncryptedHelper->decryptFile(_tmpFile)) {
-          downloadFinished();
-        } else {
-          done(SyncFileItem::NormalError, _downloadEncryptedHelper->errorString());
-        }
-
-    } else {
-        downloadFinished();
-    }
+    downloadFinished();
 }
 
 void PropagateDownloadFile::downloadFinished()
@@ -1192,7 +1222,8 @@ void PropagateDownloadFile::updateMetadata(bool isConflict)
         propagator()->_journal->setDownloadInfo(_item->_encryptedFileName, SyncJournalDb::DownloadInfo());
     }
 
-    propagator()->_journal->commit("download file start2");
+    if (!_placeholderChanged)
+        propagator()->_journal->commit("download file start2");
 
     done(isConflict ? SyncFileItem::Conflict : SyncFileItem::Success);
 
@@ -141,6 +141,9 @@ public:
         qint64 resumeStart, EncryptedFile encryptedInfo, QObject *parent = nullptr);
     ~GETEncryptedFileJob() override = default;
 
+    /** Whether the whole file was decrypted and its e2EeTag verified */
+    bool isDecryptionFinished() const;
+
 protected:
     qint64 writeToDevice(const QByteArray &data) override;
 
@@ -148,6 +151,7 @@ private:
     QSharedPointer<EncryptionHelper::StreamingDecryptor> _decryptor;
     EncryptedFile _encryptedFileInfo = {};
     QByteArray _pendingBytes;
+    QByteArray _decryptedBytes;
     qint64 _processedSoFar = 0;
 };
 
@@ -217,6 +221,26 @@ public:
      */
     void setDeleteExistingFolder(bool enabled);
 
+    /// The outcome of changePlaceholder()
+    struct PlaceholderResult
+    {
+        SyncFileItem::Status status = SyncFileItem::Success;
+        QString errorString;
+    };
+
+    /** Creates or dehydrates the placeholder of a virtual file item
+     *
+     * Only touches the file system and the vfs, not the job or the propagator,
+     * so that PropagateVirtualFileBatch can call it from worker threads.
+     */
+    static PlaceholderResult changePlaceholder(OwncloudPropagator *propagator, const SyncFileItem &item);
+
+    /** Makes start() only record the placeholder changed by changePlaceholder()
+     *
+     * The journal isn't committed then, the batch commits it once for all its items.
+     */
+    void setPlaceholderChanged(const PlaceholderResult &result);
+
 private slots:
     /// Called when ComputeChecksum on the local file finishes,
     /// maybe the local and remote checksums are identical?
@@ -239,6 +263,7 @@ private slots:
 
 private:
     void startAfterIsEncryptedIsChecked();
+    void finishPlaceholder(const PlaceholderResult &result);
     void deleteExistingFolder();
 
     qint64 _resumeStart;
@@ -249,6 +274,8 @@ private:
     bool _isEncrypted = false;
     EncryptedFile _encryptedInfo;
     ConflictRecord _conflictRecord;
+    PlaceholderResult _placeholderResult;
+    bool _placeholderChanged = false;
 
     QElapsedTimer _stopwatch;
 
@@ -17,7 +17,7 @@ class PropagateDownloadEncrypted : public QObject {
 public:
   PropagateDownloadEncrypted(OwncloudPropagator *propagator, const QString &localParentPath, SyncFileItemPtr item, QObject *parent = nullptr);
   void start();
-  bool decryptFile(QFile& tmpFile);
+  EncryptedFile encryptedInfo() const { return _encryptedInfo; }
   QString errorString() const;
 
 public slots:
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "propagateremotebatch.h"
+#include "account.h"
+#include "transfergovernor.h"
+#include "common/asserts.h"
+
+#include <QLoggingCategory>
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcPropagateRemoteBatch, "nextcloud.sync.propagator.remotebatch", QtInfoMsg)
+
+bool PropagateRemoteBatch::isBatchable(const SyncFileItem &item)
+{
+    // Directories must be handled in order with their contents, and the
+    // end-to-end encryption jobs need the folder lock one at a time.
+    return item._direction == SyncFileItem::Up
+        && (item._instruction == CSYNC_INSTRUCTION_REMOVE || item._instruction == CSYNC_INSTRUCTION_RENAME)
+        && !item.isDirectory()
+        && !item._isEncrypted
+        && item._encryptedFileName.isEmpty();
+}
+
+PropagatorJob *PropagateRemoteBatch::create(OwncloudPropagator *propagator, const SyncFileItemPtr &item, SyncFileItemVector &tasks)
+{
+    const auto batchesWithItem = [&item](const SyncFileItemPtr &task) {
+        return task->_instruction == item->_instruction && isBatchable(*task);
+    };
+    if (!isBatchable(*item) || std::none_of(tasks.cbegin(), tasks.cend(), batchesWithItem))
+        return propagator->createJob(item);
+
+    SyncFileItemVector items{ item };
+    const auto it = std::stable_partition(tasks.begin(), tasks.end(), [&](const SyncFileItemPtr &task) {
+        return !batchesWithItem(task);
+    });
+    std::copy(it, tasks.end(), std::back_inserter(items));
+    tasks.erase(it, tasks.end());
+
+    qCInfo(lcPropagateRemoteBatch) << "Batching" << items.size() << item->_instruction << "items starting with" << item->_file;
+    return new PropagateRemoteBatch(propagator, std::move(items));
+}
+
+PropagateRemoteBatch::PropagateRemoteBatch(OwncloudPropagator *propagator, SyncFileItemVector &&items)
+    : PropagatorJob(propagator)
+    , _items(std::move(items))
+{
+}
+
+PropagateRemoteBatch::~PropagateRemoteBatch()
+{
+    // Never started, so nobody else knows about it
+    delete _heldJob;
+}
+
+int PropagateRemoteBatch::window()
+{
+    return propagator()->maximumActiveSmallJob();
+}
+
+bool PropagateRemoteBatch::canStartMore()
+{
+    if ((!_heldJob && _nextItem >= _items.size()) || propagator()->_abortRequested)
+        return false;
+    if (_runningJobs.isEmpty())
+        return true;
+    const bool waitingForJob = std::any_of(_runningJobs.cbegin(), _runningJobs.cend(), [](PropagatorJob *job) {
+        return job->parallelism() != FullParallelism;
+    });
+    return !waitingForJob
+        && _runningJobs.size() < window()
+        && TransferGovernor::instance()->freeRequestSlots(propagator()->account()->url()) > 0;
+}
+
+bool PropagateRemoteBatch::scheduleSelfOrChild()
+{
+    if (_state == Finished)
+        return false;
+    _state = Running;
+
+    // At most a window of jobs per call: jobs may finish right away, see slotSubJobFinished()
+    bool started = false;
+    for (int count = 0; count < window() && canStartMore(); ++count) {
+        PropagatorJob *job = std::exchange(_heldJob, nullptr);
+        if (!job) {
+            const auto &item = _items.at(_nextItem++);
+            job = propagator()->createJob(item);
+            if (!job) {
+                qCWarning(lcPropagateRemoteBatch) << "Useless task found for file" << item->destination() << "instruction" << item->_instruction;
+                continue;
+            }
+        }
+
+        // Jobs that don't allow parallelism run on their own
+        if (job->parallelism() != FullParallelism && !_runningJobs.isEmpty()) {
+            _heldJob = job;
+            break;
+        }
+
+        connect(job, &PropagatorJob::finished, this, &PropagateRemoteBatch::slotSubJobFinished);
+        _runningJobs.append(job);
+        started = job->scheduleSelfOrChild() || started;
+    }
+
+    if (_runningJobs.isEmpty() && !_heldJob && _nextItem >= _items.size()) {
+        // Our parent jobs are iterating over their running jobs, see PropagatorCompositeJob
+        QMetaObject::invokeMethod(this, &PropagateRemoteBatch::finalize, Qt::QueuedConnection);
+    }
+    return started;
+}
+
+void PropagateRemoteBatch::slotSubJobFinished(SyncFileItem::Status status)
+{
+    auto *subJob = static_cast<PropagatorJob *>(sender());
+    ASSERT(subJob);
+
+    subJob->deleteLater();
+    const int i = _runningJobs.indexOf(subJob);
+    ENFORCE(i >= 0);
+    _runningJobs.remove(i);
+
+    // The parent directory must not get its etag updated
+    if (PropagatorCompositeJob::isErrorStatus(status)) {
+        _hasError = status;
+    }
+
+    if (_runningJobs.isEmpty() && !_heldJob && _nextItem >= _items.size()) {
+        finalize();
+        return;
+    }
+
+    // Refill the window soon, the propagator only asks for new jobs while it
+    // has free slots of its own. Not right away: some jobs finish within
+    // their start(), e.g. PropagateRemoteMove when nothing needs to be moved,
+    // and would recurse through here for every item of the batch.
+    if (!_refillScheduled) {
+        _refillScheduled = true;
+        QMetaObject::invokeMethod(this, &PropagateRemoteBatch::slotRefill, Qt::QueuedConnection);
+    }
+    propagator()->scheduleNextJob();
+}
+
+void PropagateRemoteBatch::slotRefill()
+{
+    _refillScheduled = false;
+    scheduleSelfOrChild();
+}
+
+void PropagateRemoteBatch::finalize()
+{
+    if (_state == Finished)
+        return;
+
+    _state = Finished;
+    emit finished(_hasError == SyncFileItem::NoStatus ? SyncFileItem::Success : _hasError);
+}
+
+void PropagateRemoteBatch::abort(PropagatorJob::AbortType abortType)
+{
+    // The held job didn't start yet, there is nothing to abort
+    delete std::exchange(_heldJob, nullptr);
+
+    if (!_runningJobs.isEmpty()) {
+        _abortsCount = _runningJobs.size();
+        for (auto *job : qAsConst(_runningJobs)) {
+            if (abortType == AbortType::Asynchronous) {
+                connect(job, &PropagatorJob::abortFinished,
+                    this, &PropagateRemoteBatch::slotSubJobAbortFinished);
+            }
+            job->abort(abortType);
+        }
+    } else if (abortType == AbortType::Asynchronous) {
+        emit abortFinished();
+    }
+}
+
+void PropagateRemoteBatch::slotSubJobAbortFinished()
+{
+    if (--_abortsCount == 0)
+        emit abortFinished();
+}
+
+}
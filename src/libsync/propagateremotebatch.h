@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include "owncloudpropagator.h"
+
+namespace OCC {
+
+/**
+ * @brief Propagates many remote deletes or moves of files in one directory
+ * @ingroup libsync
+ *
+ * Each item is still handled by its own PropagateRemoteDelete or
+ * PropagateRemoteMove job and reported as usual, but the batch keeps
+ * a whole window of their requests in flight instead of competing
+ * with the other jobs for the propagator's few parallel slots. Over
+ * HTTP/2 all of them share the same connection, so the window is
+ * much larger there, see OwncloudPropagator::maximumActiveSmallJob().
+ */
+class OWNCLOUDSYNC_EXPORT PropagateRemoteBatch : public PropagatorJob
+{
+    Q_OBJECT
+public:
+    /** Whether the item could be propagated as part of a batch */
+    static bool isBatchable(const SyncFileItem &item);
+
+    /**
+     * Creates the job for @a item, taking all the tasks that can be batched
+     * with it out of @a tasks.
+     *
+     * Falls back to OwncloudPropagator::createJob() when there is nothing to
+     * batch the item with.
+     */
+    static PropagatorJob *create(OwncloudPropagator *propagator, const SyncFileItemPtr &item, SyncFileItemVector &tasks);
+
+    PropagateRemoteBatch(OwncloudPropagator *propagator, SyncFileItemVector &&items);
+    ~PropagateRemoteBatch() override;
+
+    bool scheduleSelfOrChild() override;
+    void abort(PropagatorJob::AbortType abortType) override;
+
+    /** The number of requests kept in flight */
+    int window();
+
+private slots:
+    void slotSubJobFinished(SyncFileItem::Status status);
+    void slotSubJobAbortFinished();
+    void slotRefill();
+
+private:
+    bool canStartMore();
+    void finalize();
+
+    SyncFileItemVector _items;
+    int _nextItem = 0; // index of the next item to create a job for
+    PropagatorJob *_heldJob = nullptr; // waits for the running jobs, see scheduleSelfOrChild()
+    QVector<PropagatorJob *> _runningJobs;
+    SyncFileItem::Status _hasError = SyncFileItem::NoStatus;
+    int _abortsCount = 0;
+    bool _refillScheduled = false;
+};
+
+}
@@ -13,9 +13,8 @@
  */
 
 #include "propagateremotedeleteencrypted.h"
-#include "clientsideencryptionjobs.h"
+#include "clientsideencryption.h"
 #include "owncloudpropagator.h"
-#include "encryptfolderjob.h"
 #include <QLoggingCategory>
 #include <QFileInfo>
 
@@ -33,55 +32,37 @@ void PropagateRemoteDeleteEncrypted::start()
 {
     Q_ASSERT(!_item->_encryptedFileName.isEmpty());
 
+    // The folder is locked and its metadata sent once for all its items
     const QFileInfo info(_item->_encryptedFileName);
-    startLsColJob(info.path());
+    _session = _propagator->folderMetadataSession(_item->_file, info.path());
+    _session->open(this, [this] { slotFolderMetadataReady(); }, [this] { taskFailed(); });
 }
 
-void PropagateRemoteDeleteEncrypted::slotFolderUnLockedSuccessfully(const QByteArray &folderId)
+void PropagateRemoteDeleteEncrypted::slotFolderMetadataReady()
 {
-    AbstractPropagateRemoteDeleteEncrypted::slotFolderUnLockedSuccessfully(folderId);
-    emit finished(!_isTaskFailed);
-}
-
-void PropagateRemoteDeleteEncrypted::slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode)
-{
-    if (statusCode == 404) {
-        qCDebug(PROPAGATE_REMOVE_ENCRYPTED) << "Metadata not found, but let's proceed with removing the file anyway.";
-        deleteRemoteItem(_item->_encryptedFileName);
+    if (!_session) {
+        taskFailed();
         return;
     }
 
-    FolderMetadata metadata(_propagator->account(), json.toJson(QJsonDocument::Compact), statusCode);
-
     qCDebug(PROPAGATE_REMOVE_ENCRYPTED) << "Metadata Received, preparing it for removal of the file";
 
     const QFileInfo info(_propagator->fullLocalPath(_item->_file));
     const QString fileName = info.fileName();
 
-    // Find existing metadata for this file
-    bool found = false;
-    const QVector<EncryptedFile> files = metadata.files();
+    // Find existing metadata for this file, if it's not found we still need to remove the file
+    auto metadata = _session->metadata();
+    const QVector<EncryptedFile> files = metadata->files();
     for (const EncryptedFile &file : files) {
         if (file.originalFilename == fileName) {
-            metadata.removeEncryptedFile(file);
-            found = true;
+            metadata->removeEncryptedFile(file);
+            _session->setChanged(_item->_file);
             break;
         }
     }
 
-    if (!found) {
-        // file is not found in the metadata, but we still need to remove it
-        deleteRemoteItem(_item->_encryptedFileName);
-        return;
-    }
-
-    qCDebug(PROPAGATE_REMOVE_ENCRYPTED) << "Metadata updated, sending to the server.";
-
-    auto job = new UpdateMetadataApiJob(_propagator->account(), _folderId, metadata.encryptedMetadata(), _folderToken);
-    connect(job, &UpdateMetadataApiJob::success, this, [this](const QByteArray& fileId) {
-        Q_UNUSED(fileId);
-        deleteRemoteItem(_item->_encryptedFileName);
-    });
-    connect(job, &UpdateMetadataApiJob::error, this, &PropagateRemoteDeleteEncrypted::taskFailed);
-    job->start();
+    // The folder stays locked by the session, unlockFolder() just finishes
+    _folderId = _session->folderId();
+    _folderToken = _session->folderToken();
+    deleteRemoteItem(_item->_encryptedFileName);
 }
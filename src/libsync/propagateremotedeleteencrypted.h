@@ -15,6 +15,9 @@
 #pragma once
 
 #include "abstractpropagateremotedeleteencrypted.h"
+#include "foldermetadatasession.h"
+
+#include <QPointer>
 
 namespace OCC {
 
@@ -27,8 +30,9 @@ public:
     void start() override;
 
 private:
-    void slotFolderUnLockedSuccessfully(const QByteArray &folderId) override;
-    void slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode) override;
+    void slotFolderMetadataReady();
+
+    QPointer<FolderMetadataSession> _session;
 };
 
 }
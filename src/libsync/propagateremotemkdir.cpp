@@ -190,8 +190,10 @@ void PropagateRemoteMkdir::slotMkdir()
     _uploadEncryptedHelper = new PropagateUploadEncrypted(propagator(), remoteParentPath, _item, this);
     connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::finalized,
       this, &PropagateRemoteMkdir::slotStartEncryptedMkcolJob);
-    connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::error,
-      []{ qCDebug(lcPropagateRemoteMkdir) << "Error setting up encryption."; });
+    connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::error, this, [this] {
+        qCDebug(lcPropagateRemoteMkdir) << "Error setting up encryption.";
+        done(SyncFileItem::NormalError, tr("Failed to lock the encrypted folder."));
+    });
     _uploadEncryptedHelper->start();
 }
 
@@ -214,15 +216,8 @@ void PropagateRemoteMkdir::slotMkcolJobFinished()
 
     const auto jobPath = _job->path();
 
-    if (_uploadEncryptedHelper && _uploadEncryptedHelper->isFolderLocked() && !_uploadEncryptedHelper->isUnlockRunning()) {
-        // since we are done, we need to unlock a folder in case it was locked
-        connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::folderUnlocked, this, [this, err, jobHttpReasonPhraseString, jobPath]() {
-            finalizeMkColJob(err, jobHttpReasonPhraseString, jobPath);
-        });
-        _uploadEncryptedHelper->unlockFolder();
-    } else {
-        finalizeMkColJob(err, jobHttpReasonPhraseString, jobPath);
-    }
+    // The parent folder is unlocked by its metadata session, see FolderMetadataSession
+    finalizeMkColJob(err, jobHttpReasonPhraseString, jobPath);
 }
 
 void PropagateRemoteMkdir::slotEncryptFolderFinished()
@@ -21,9 +21,11 @@
 #include "common/syncjournaldb.h"
 #include "common/syncjournalfilerecord.h"
 #include "common/utility.h"
+#include "common/syncmetrics.h"
 #include "filesystem.h"
 #include "propagatorjobs.h"
 #include "common/checksums.h"
+#include "common/constants.h"
 #include "syncengine.h"
 #include "deletejob.h"
 #include "common/asserts.h"
@@ -239,7 +241,7 @@ void PropagateUploadFileCommon::start()
             this, &PropagateUploadFileCommon::setupEncryptedFile);
     connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::error, [this] {
         qCDebug(lcPropagateUpload) << "Error setting up encryption.";
-        done(SyncFileItem::FatalError, tr("Failed to upload encrypted file."));
+        done(SyncFileItem::NormalError, tr("Failed to upload encrypted file."));
     });
     _uploadEncryptedHelper->start();
 }
@@ -346,6 +348,12 @@ void PropagateUploadFileCommon::slotComputeTransmissionChecksum(const QByteArray
 {
     _item->_checksumHeader = makeChecksumHeader(contentChecksumType, contentChecksum);
 
+    // Encrypted data only exists while it's being uploaded
+    if (_uploadingEncrypted) {
+        slotStartUpload(QByteArray(), QByteArray());
+        return;
+    }
+
     // Reuse the content checksum as the transmission checksum if possible
     const auto supportedTransmissionChecksums =
         propagator()->account()->capabilities().supportedChecksumTypes();
@@ -400,6 +408,9 @@ void PropagateUploadFileCommon::slotStartUpload(const QByteArray &transmissionCh
     }
 
     _fileToUpload._size = FileSystem::getSize(fullFilePath);
+    if (_uploadingEncrypted) {
+        _fileToUpload._size += Constants::e2EeTagSize;
+    }
     _item->_size = FileSystem::getSize(originalFilePath);
 
     // But skip the file if the mtime is too close to 'now'!
@@ -443,6 +454,15 @@ UploadDevice::UploadDevice(const QString &fileName, qint64 start, qint64 size, B
     _bandwidthManager->registerUploadDevice(this);
 }
 
+UploadDevice::UploadDevice(QIODevice *source, qint64 start, qint64 size, BandwidthManager *bwm)
+    : _source(source)
+    , _start(start)
+    , _size(size)
+    , _bandwidthManager(bwm)
+{
+    _bandwidthManager->registerUploadDevice(this);
+}
+
 
 UploadDevice::~UploadDevice()
 {
@@ -456,6 +476,16 @@ bool UploadDevice::open(QIODevice::OpenMode mode)
     if (mode & QIODevice::WriteOnly)
         return false;
 
+    if (_source) {
+        if (!_source->isOpen() && !_source->open(QIODevice::ReadOnly)) {
+            setErrorString(_source->errorString());
+            return false;
+        }
+        _size = qBound(0ll, _size, _source->size() - _start);
+        _read = 0;
+        return QIODevice::open(mode);
+    }
+
     // Get the file size now: _file.fileName() is no longer reliable
     // on all platforms after openAndSeekFileSharedRead().
     auto fileDiskSize = FileSystem::getSize(_file.fileName());
@@ -474,6 +504,7 @@ bool UploadDevice::open(QIODevice::OpenMode mode)
 
 void UploadDevice::close()
 {
+    // A source is shared, it's closed by its owner
     _file.close();
     QIODevice::close();
 }
@@ -497,21 +528,37 @@ qint64 UploadDevice::readData(char *data, qint64 maxlen)
     if (maxlen <= 0) {
         return 0;
     }
+    static auto throttled = SyncMetrics::instance()->counter(QStringLiteral("bandwidth.upload_throttled"));
     if (isChoked()) {
+        throttled->add();
         return 0;
     }
     if (isBandwidthLimited()) {
         maxlen = qMin(maxlen, _bandwidthQuota);
         if (maxlen <= 0) { // no quota
+            throttled->add();
             return 0;
         }
         _bandwidthQuota -= maxlen;
     }
 
-    auto c = _file.read(data, maxlen);
-    if (c < 0) {
-        setErrorString(_file.errorString());
-        return -1;
+    qint64 c = 0;
+    if (_source) {
+        if (_source->pos() != _start + _read && !_source->seek(_start + _read)) {
+            setErrorString(_source->errorString());
+            return -1;
+        }
+        c = _source->read(data, maxlen);
+        if (c < 0) {
+            setErrorString(_source->errorString());
+            return -1;
+        }
+    } else {
+        c = _file.read(data, maxlen);
+        if (c < 0) {
+            setErrorString(_file.errorString());
+            return -1;
+        }
     }
     _read += c;
     return c;
@@ -555,7 +602,9 @@ bool UploadDevice::seek(qint64 pos)
         return false;
     }
     _read = pos;
-    _file.seek(_start + pos);
+    // A source is positioned when it's read, it may be shared
+    if (!_source)
+        _file.seek(_start + pos);
     return true;
 }
 
@@ -757,8 +806,28 @@ QMap<QByteArray, QByteArray> PropagateUploadFileCommon::headers()
     return headers;
 }
 
+std::unique_ptr<UploadDevice> PropagateUploadFileCommon::makeUploadDevice(qint64 start, qint64 size)
+{
+    if (_uploadingEncrypted) {
+        return std::make_unique<UploadDevice>(_uploadEncryptedHelper->encryptor(), start, size, &propagator()->_bandwidthManager);
+    }
+    return std::make_unique<UploadDevice>(_fileToUpload._path, start, size, &propagator()->_bandwidthManager);
+}
+
+bool PropagateUploadFileCommon::canResumeUpload() const
+{
+    // A new key is generated for every attempt until the metadata is stored
+    return !_uploadingEncrypted || _uploadEncryptedHelper->hasStoredKey();
+}
+
 void PropagateUploadFileCommon::finalize()
 {
+    // The metadata of the encrypted file needs the tag, known now that all was sent
+    if (_uploadingEncrypted && !_uploadEncryptedHelper->storeMetadata()) {
+        slotOnErrorStartFolderUnlock(SyncFileItem::NormalError, tr("Failed to store the metadata of the encrypted file."));
+        return;
+    }
+
     // Update the quota, if known
     auto quotaIt = propagator()->_folderQuota.find(QFileInfo(_item->_file).path());
     if (quotaIt != propagator()->_folderQuota.end())
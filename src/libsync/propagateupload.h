@@ -39,6 +39,8 @@ class UploadDevice : public QIODevice
     Q_OBJECT
 public:
     UploadDevice(const QString &fileName, qint64 start, qint64 size, BandwidthManager *bwm);
+    /** Reads from source instead of a local file, see PropagateUploadFileCommon::makeUploadDevice() */
+    UploadDevice(QIODevice *source, qint64 start, qint64 size, BandwidthManager *bwm);
     ~UploadDevice() override;
 
     bool open(QIODevice::OpenMode mode) override;
@@ -63,6 +65,8 @@ signals:
 private:
     /// The local file to read data from
     QFile _file;
+    /// The device to read data from instead of _file, it may be shared with other devices
+    QPointer<QIODevice> _source;
 
     /// Start of the file data to use
     qint64 _start = 0;
@@ -316,6 +320,19 @@ protected:
 
     /** Bases headers that need to be sent on the PUT, or in the MOVE for chunking-ng */
     QMap<QByteArray, QByteArray> headers();
+
+    /**
+     * Creates the device for sending size bytes of the file starting at start.
+     *
+     * Encrypted files are encrypted while the device is read. All devices of
+     * one upload share the encryptor, which is cheap to read in order only.
+     */
+    std::unique_ptr<UploadDevice> makeUploadDevice(qint64 start, qint64 size);
+
+    /** Whether a partial upload of a previous attempt may be continued */
+    bool canResumeUpload() const;
+
+    bool isUploadingEncrypted() const { return _uploadingEncrypted; }
 private:
   PropagateUploadEncrypted *_uploadEncryptedHelper;
   bool _uploadingEncrypted;
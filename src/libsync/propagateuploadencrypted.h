@@ -12,15 +12,23 @@
 
 #include "owncloudpropagator.h"
 #include "clientsideencryption.h"
+#include "foldermetadatasession.h"
 
 namespace OCC {
-class FolderMetadata;
 
   /* This class is used if the server supports end to end encryption.
  * It will fire for *any* folder, encrypted or not, because when the
  * client starts the upload request we don't know if the folder is
  * encrypted on the server.
  *
+ * The folder is locked and its metadata changed through the
+ * FolderMetadataSession shared by all items of the folder, which sends the
+ * metadata once they are done.
+ *
+ * Files are encrypted while they are uploaded, see encryptor(). Their
+ * metadata can only be added with storeMetadata() once the upload is done
+ * since it needs the authentication tag of the encryption.
+ *
  * emits:
  * finalized() if the encrypted file is ready to be uploaded
  * error() if there was an error with the encryption
@@ -37,22 +45,24 @@ public:
 
     void start();
 
+    /** The folder stays locked until its session is committed, this only emits folderUnlocked() */
     void unlockFolder();
 
-    bool isUnlockRunning() const { return _isUnlockRunning; }
-    bool isFolderLocked() const { return _isFolderLocked; }
-    const QByteArray folderToken() const { return _folderToken; }
-
-private slots:
-    void slotFolderEncryptedIdReceived(const QStringList &list);
-    void slotFolderEncryptedIdError(QNetworkReply *r);
-    void slotFolderLockedSuccessfully(const QByteArray& fileId, const QByteArray& token);
-    void slotFolderLockedError(const QByteArray& fileId, int httpErrorCode);
-    void slotTryLock(const QByteArray& fileId);
-    void slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode);
-    void slotFolderEncryptedMetadataError(const QByteArray& fileId, int httpReturnCode);
-    void slotUpdateMetadataSuccess(const QByteArray& fileId);
-    void slotUpdateMetadataError(const QByteArray& fileId, int httpReturnCode);
+    bool isFolderLocked() const { return _session && _session->isOpen(); }
+    const QByteArray folderToken() const { return _session ? _session->folderToken() : QByteArray(); }
+
+    /** The device encrypting the file while it is read, null for directories */
+    EncryptionHelper::StreamingEncryptor *encryptor() const { return _encryptor; }
+
+    /** Whether the key of the file was already in the metadata of the folder
+     *
+     * Only then the encrypted data is the same as in a previous attempt and
+     * partial uploads can be resumed.
+     */
+    bool hasStoredKey() const { return _hasStoredKey; }
+
+    /** Adds the uploaded file with the encryption tag to the metadata of the folder */
+    bool storeMetadata();
 
 signals:
     // Emmited after the file is encrypted and everythign is setup.
@@ -61,24 +71,17 @@ signals:
     void folderUnlocked(const QByteArray &folderId, int httpStatus);
 
 private:
+  void slotFolderMetadataReady();
+
   OwncloudPropagator *_propagator;
   QString _remoteParentPath;
   SyncFileItemPtr _item;
 
-  QByteArray _folderToken;
-  QByteArray _folderId;
-
-  QElapsedTimer _folderLockFirstTry;
-  bool _currentLockingInProgress = false;
-
-  bool _isUnlockRunning = false;
-  bool _isFolderLocked = false;
+  QPointer<FolderMetadataSession> _session;
+  bool _hasStoredKey = false;
 
-  QByteArray _generatedKey;
-  QByteArray _generatedIv;
-  FolderMetadata *_metadata;
   EncryptedFile _encryptedFile;
-  QString _completeFileName;
+  EncryptionHelper::StreamingEncryptor *_encryptor = nullptr;
 };
 
 
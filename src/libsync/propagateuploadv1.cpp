@@ -43,7 +43,7 @@ void PropagateUploadFileV1::doStartUpload()
 
     const SyncJournalDb::UploadInfo progressInfo = propagator()->_journal->getUploadInfo(_item->_file);
 
-    if (progressInfo._valid && progressInfo.isChunked() && progressInfo._modtime == _item->_modtime && progressInfo._size == _item->_size
+    if (progressInfo._valid && progressInfo.isChunked() && progressInfo._modtime == _item->_modtime && progressInfo._size == _item->_size && canResumeUpload()
         && (progressInfo._contentChecksum == _item->_checksumHeader || progressInfo._contentChecksum.isEmpty() || _item->_checksumHeader.isEmpty())) {
         _startChunk = progressInfo._chunk;
         _transferId = progressInfo._transferid;
@@ -123,8 +123,7 @@ void PropagateUploadFileV1::startNextChunk()
     }
 
     const QString fileName = _fileToUpload._path;
-    auto device = std::make_unique<UploadDevice>(
-            fileName, chunkStart, currentChunkSize, &propagator()->_bandwidthManager);
+    auto device = makeUploadDevice(chunkStart, currentChunkSize);
     if (!device->open(QIODevice::ReadOnly)) {
         qCWarning(lcPropagateUploadV1) << "Could not prepare upload device: " << device->errorString();
 
@@ -157,6 +156,9 @@ void PropagateUploadFileV1::startNextChunk()
     if (propagator()->account()->capabilities().chunkingParallelUploadDisabled()) {
         // Server may also disable parallel chunked upload for any higher version
         parallelChunkUpload = false;
+    } else if (isUploadingEncrypted()) {
+        // The chunks are encrypted in order while they are sent
+        parallelChunkUpload = false;
     } else {
         QByteArray env = qgetenv("OWNCLOUD_PARALLEL_CHUNK");
         if (!env.isEmpty()) {
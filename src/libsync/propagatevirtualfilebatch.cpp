@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "propagatevirtualfilebatch.h"
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+#include "common/vfs.h"
+
+#include <QLoggingCategory>
+#include <qtconcurrentmap.h>
+
+#include <algorithm>
+#include <functional>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcPropagateVirtualFileBatch, "nextcloud.sync.propagator.virtualfilebatch", QtInfoMsg)
+
+bool PropagateVirtualFileBatch::isBatchable(OwncloudPropagator *propagator, const SyncFileItem &item)
+{
+    // Virtual files in end-to-end encrypted folders need the folder's
+    // metadata first, see PropagateDownloadFile::start().
+    return propagator->syncOptions()._vfs->canChangePlaceholdersInParallel()
+        && item._direction == SyncFileItem::Down
+        && (item._instruction == CSYNC_INSTRUCTION_NEW || item._instruction == CSYNC_INSTRUCTION_SYNC)
+        && (item._type == ItemTypeVirtualFile || item._type == ItemTypeVirtualFileDehydration)
+        && !item._isEncrypted
+        && item._encryptedFileName.isEmpty();
+}
+
+PropagatorJob *PropagateVirtualFileBatch::create(OwncloudPropagator *propagator, const SyncFileItemPtr &item, SyncFileItemVector &tasks)
+{
+    const auto batchesWithItem = [propagator](const SyncFileItemPtr &task) {
+        return isBatchable(propagator, *task);
+    };
+    if (!isBatchable(propagator, *item) || std::none_of(tasks.cbegin(), tasks.cend(), batchesWithItem))
+        return nullptr;
+
+    // The tasks are all in the same directory as the item
+    const auto slashPosition = item->_file.lastIndexOf('/');
+    const auto parentPath = slashPosition >= 0 ? item->_file.left(slashPosition) : QString();
+    SyncJournalFileRecord parentRec;
+    propagator->_journal->getFileRecord(parentPath, &parentRec);
+    if (parentRec.isValid() && parentRec._isE2eEncrypted)
+        return nullptr;
+
+    SyncFileItemVector items{ item };
+    SyncFileItemVector remainingTasks;
+    for (const auto &task : qAsConst(tasks)) {
+        if (items.size() < maxBatchSize() && batchesWithItem(task)) {
+            items.append(task);
+        } else {
+            remainingTasks.append(task);
+        }
+    }
+    tasks = std::move(remainingTasks);
+
+    qCInfo(lcPropagateVirtualFileBatch) << "Batching" << items.size() << "placeholders starting with" << item->_file;
+    return new PropagateVirtualFileBatch(propagator, std::move(items));
+}
+
+PropagateVirtualFileBatch::PropagateVirtualFileBatch(OwncloudPropagator *propagator, SyncFileItemVector &&items)
+    : PropagatorJob(propagator)
+    , _items(std::move(items))
+{
+    connect(&_watcher, &QFutureWatcherBase::finished, this, &PropagateVirtualFileBatch::slotPlaceholdersChanged);
+}
+
+PropagateVirtualFileBatch::~PropagateVirtualFileBatch()
+{
+    // The workers use the propagator
+    _watcher.waitForFinished();
+}
+
+bool PropagateVirtualFileBatch::scheduleSelfOrChild()
+{
+    if (_state != NotYetStarted)
+        return false;
+    _state = Running;
+
+    auto propagator = this->propagator();
+    std::function<PropagateDownloadFile::PlaceholderResult(const SyncFileItemPtr &)> changePlaceholder =
+        [propagator](const SyncFileItemPtr &item) {
+            return PropagateDownloadFile::changePlaceholder(propagator, *item);
+        };
+    _watcher.setFuture(QtConcurrent::mapped(_items, changePlaceholder));
+    return true;
+}
+
+void PropagateVirtualFileBatch::slotPlaceholdersChanged()
+{
+    if (_state == Finished)
+        return;
+
+    // Record the items with their usual jobs, in one journal transaction.
+    // When aborted, the items the workers didn't get to have no result and
+    // are left for the next sync.
+    SyncFileItem::Status status = SyncFileItem::Success;
+    const auto future = _watcher.future();
+    for (int i = 0; i < _items.size(); ++i) {
+        if (!future.isResultReadyAt(i)) {
+            status = SyncFileItem::NormalError;
+            continue;
+        }
+        auto job = new PropagateDownloadFile(propagator(), _items.at(i));
+        job->setPlaceholderChanged(_watcher.resultAt(i));
+        // With the placeholder already changed, the job finishes right away
+        job->scheduleSelfOrChild();
+        job->deleteLater();
+        // The parent directory must not get its etag updated
+        if (PropagatorCompositeJob::isErrorStatus(_items.at(i)->_status))
+            status = _items.at(i)->_status;
+    }
+    propagator()->_journal->commit(QStringLiteral("virtual file batch"));
+
+    _state = Finished;
+    if (_abortFinishedPending)
+        emit abortFinished();
+    emit finished(status);
+}
+
+void PropagateVirtualFileBatch::abort(PropagatorJob::AbortType abortType)
+{
+    if (_state != Running || _watcher.isFinished()) {
+        if (abortType == AbortType::Asynchronous)
+            emit abortFinished();
+        return;
+    }
+
+    // Don't start on more placeholders. The ones the workers are changing
+    // get their journal records in slotPlaceholdersChanged() once they are
+    // done, and the destructor waits for them if the propagator goes away.
+    _watcher.cancel();
+    if (abortType == AbortType::Asynchronous)
+        _abortFinishedPending = true;
+}
+
+}
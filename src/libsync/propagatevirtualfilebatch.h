@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include "owncloudpropagator.h"
+#include "propagatedownload.h"
+
+#include <QFutureWatcher>
+
+namespace OCC {
+
+/**
+ * @brief Creates or dehydrates the placeholders of many virtual files in one directory
+ * @ingroup libsync
+ *
+ * Each item is still handled by its own PropagateDownloadFile job and
+ * reported as usual, but the placeholders are created or dehydrated by
+ * PropagateDownloadFile::changePlaceholder() for all of them at once in
+ * worker threads. The journal records are written afterwards on the main
+ * thread and committed once for the batch.
+ *
+ * Only used with vfs plugins that allow it, see
+ * Vfs::canChangePlaceholdersInParallel().
+ */
+class OWNCLOUDSYNC_EXPORT PropagateVirtualFileBatch : public PropagatorJob
+{
+    Q_OBJECT
+public:
+    /** Whether the item could be propagated as part of a batch */
+    static bool isBatchable(OwncloudPropagator *propagator, const SyncFileItem &item);
+
+    /**
+     * Creates the job for @a item, taking up to maxBatchSize() tasks that can
+     * be batched with it out of @a tasks.
+     *
+     * Returns nullptr when there is nothing to batch the item with.
+     */
+    static PropagatorJob *create(OwncloudPropagator *propagator, const SyncFileItemPtr &item, SyncFileItemVector &tasks);
+
+    /** The items of one batch, bounding the work done on the main thread at once */
+    static int maxBatchSize() { return 1000; }
+
+    PropagateVirtualFileBatch(OwncloudPropagator *propagator, SyncFileItemVector &&items);
+    ~PropagateVirtualFileBatch() override;
+
+    bool scheduleSelfOrChild() override;
+    void abort(PropagatorJob::AbortType abortType) override;
+
+private slots:
+    void slotPlaceholdersChanged();
+
+private:
+    SyncFileItemVector _items;
+    QFutureWatcher<PropagateDownloadFile::PlaceholderResult> _watcher;
+    bool _abortFinishedPending = false;
+};
+
+}
@@ -16,9 +16,13 @@
 #include "creds/abstractcredentials.h"
 #include "account.h"
 
+#include <QJsonArray>
+#include <QJsonDocument>
+
 namespace {
 static constexpr int MAX_ALLOWED_FAILED_AUTHENTICATION_ATTEMPTS = 3;
 static constexpr int PING_INTERVAL = 30 * 1000;
+static const QLatin1String NOTIFY_FILE_ID_PREFIX("notify_file_id ");
 }
 
 namespace OCC {
@@ -113,6 +117,8 @@ void PushNotifications::onWebSocketTextMessageReceived(const QString &message)
 
     if (message == "notify_file") {
         handleNotifyFile();
+    } else if (message.startsWith(NOTIFY_FILE_ID_PREFIX)) {
+        handleNotifyFileId(message);
     } else if (message == "notify_activity") {
         handleNotifyActivity();
     } else if (message == "notify_notification") {
@@ -194,6 +200,11 @@ void PushNotifications::handleAuthenticated()
     qCInfo(lcPushNotifications) << "Authenticated successful on websocket";
     _failedAuthenticationAttemptsCount = 0;
     _isReady = true;
+
+    // Ask the server to tell us which files changed. Servers that don't
+    // support this keep sending plain notify_file messages.
+    _webSocket->sendTextMessage(QStringLiteral("listen notify_file_id"));
+
     startPingTimer();
     emit ready();
 
@@ -211,6 +222,38 @@ void PushNotifications::handleNotifyFile()
     emitFilesChanged();
 }
 
+void PushNotifications::handleNotifyFileId(const QString &message)
+{
+    qCInfo(lcPushNotifications) << "File-id push notification arrived";
+
+    QJsonParseError error;
+    const auto json = QJsonDocument::fromJson(message.mid(NOTIFY_FILE_ID_PREFIX.size()).toUtf8(), &error);
+    if (error.error != QJsonParseError::NoError || !json.isArray()) {
+        qCWarning(lcPushNotifications) << "Could not parse file ids, treating as generic file change:" << error.errorString();
+        emitFilesChanged();
+        return;
+    }
+
+    QVector<qint64> fileIds;
+    const auto array = json.array();
+    fileIds.reserve(array.size());
+    for (const auto &value : array) {
+        if (!value.isDouble()) {
+            qCWarning(lcPushNotifications) << "Invalid file id in push notification" << value;
+            emitFilesChanged();
+            return;
+        }
+        fileIds.append(static_cast<qint64>(value.toDouble()));
+    }
+
+    if (fileIds.isEmpty()) {
+        emitFilesChanged();
+        return;
+    }
+
+    emitFileIdsChanged(fileIds);
+}
+
 void PushNotifications::handleInvalidCredentials()
 {
     qCInfo(lcPushNotifications) << "Invalid credentials submitted to websocket";
@@ -285,6 +328,11 @@ void PushNotifications::emitFilesChanged()
     emit filesChanged(_account);
 }
 
+void PushNotifications::emitFileIdsChanged(const QVector<qint64> &fileIds)
+{
+    emit fileIdsChanged(_account, fileIds);
+}
+
 void PushNotifications::emitNotificationsChanged()
 {
     emit notificationsChanged(_account);
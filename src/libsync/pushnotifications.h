@@ -16,6 +16,7 @@
 
 #include <QWebSocket>
 #include <QTimer>
+#include <QVector>
 
 #include "capabilities.h"
 
@@ -74,6 +75,15 @@ signals:
      */
     void filesChanged(Account *account);
 
+    /**
+     * Will be emitted if files on the server changed and the server told us which ones
+     *
+     * The ids are the numeric server file ids, see SyncJournalFileRecord::numericFileId().
+     * If the server does not know the ids (or there were too many changes) filesChanged()
+     * is emitted instead.
+     */
+    void fileIdsChanged(Account *account, const QVector<qint64> &fileIds);
+
     /**
      * Will be emitted if activities have been changed on the server
      */
@@ -120,11 +130,13 @@ private:
 
     void handleAuthenticated();
     void handleNotifyFile();
+    void handleNotifyFileId(const QString &message);
     void handleInvalidCredentials();
     void handleNotifyNotification();
     void handleNotifyActivity();
 
     void emitFilesChanged();
+    void emitFileIdsChanged(const QVector<qint64> &fileIds);
     void emitNotificationsChanged();
     void emitActivitiesChanged();
 
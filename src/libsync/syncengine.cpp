@@ -21,6 +21,7 @@
 #include "discoveryphase.h"
 #include "creds/abstractcredentials.h"
 #include "common/syncfilestatus.h"
+#include "common/syncmetrics.h"
 #include "csync_exclude.h"
 #include "filesystem.h"
 #include "deletejob.h"
@@ -29,6 +30,7 @@
 #include "configfile.h"
 #include "discovery.h"
 #include "common/vfs.h"
+#include "transfergovernor.h"
 
 #ifdef Q_OS_WIN
 #include <windows.h>
@@ -36,6 +38,7 @@
 #include <unistd.h>
 #endif
 
+#include <algorithm>
 #include <climits>
 #include <cassert>
 #include <chrono>
@@ -59,8 +62,6 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcEngine, "nextcloud.sync.engine", QtInfoMsg)
 
-bool SyncEngine::s_anySyncRunning = false;
-
 /** When the client touches a file, block change notifications for this duration (ms)
  *
  * On Linux and Windows the file watcher can't distinguish a change that originates
@@ -84,6 +85,7 @@ SyncEngine::SyncEngine(AccountPtr account, const QString &localPath,
     : _account(account)
     , _needsUpdate(false)
     , _syncRunning(false)
+    , _propagationStarted(false)
     , _localPath(localPath)
     , _remotePath(remotePath)
     , _journal(journal)
@@ -415,9 +417,52 @@ void OCC::SyncEngine::slotItemDiscovered(const OCC::SyncFileItemPtr &item)
 
     if (item->isDirectory()) {
         slotFolderDiscovered(item->_etag.isEmpty(), item->_file);
+        if (_syncOptions._streamingPropagation)
+            propagateSubtreeEarly(item);
     }
 }
 
+void SyncEngine::propagateSubtreeEarly(const SyncFileItemPtr &dirItem)
+{
+    // Only new top level folders from the server: nothing below them is known
+    // locally or in the database, so neither rename detection nor the etag
+    // update of a parent folder can depend on the rest of the discovery.
+    if (dirItem->_file.contains(QLatin1Char('/')) || _syncOptions.fileRegex().isValid())
+        return;
+
+    // The directory item is discovered after its contents, which directly follow it
+    auto begin = std::lower_bound(_syncItems.begin(), _syncItems.end(), dirItem);
+    if (begin == _syncItems.end() || *begin != dirItem)
+        return;
+    const QString prefix = dirItem->_file + QLatin1Char('/');
+    auto end = begin + 1;
+    while (end != _syncItems.end() && (*end)->destination().startsWith(prefix))
+        ++end;
+
+    const bool isNewDownload = std::all_of(begin, end, [this](const SyncFileItemPtr &item) {
+        return item->_instruction == CSYNC_INSTRUCTION_NEW
+            && item->_direction == SyncFileItem::Down
+            && item->_renameTarget.isEmpty()
+            && item->_originalFile == item->_file
+            && !item->_isEncrypted
+            && !_discoveryPhase->mayBeCancelled(item->_originalFile);
+    });
+    if (!isNewDownload)
+        return;
+
+    SyncFileItemVector subtree(begin, end);
+    _syncItems.erase(begin, end);
+    _streamedItems.append(subtree);
+    qCInfo(lcEngine) << "Propagating" << dirItem->_file << "with" << subtree.size() - 1 << "items while the discovery runs";
+
+    if (!_propagator) {
+        setupPropagator();
+        Q_EMIT started();
+    }
+    emit aboutToPropagateSubtree(subtree);
+    _propagator->appendItems(std::move(subtree));
+}
+
 void SyncEngine::startSync()
 {
     if (_journal->exists()) {
@@ -433,13 +478,13 @@ void SyncEngine::startSync()
         }
     }
 
-    if (s_anySyncRunning || _syncRunning) {
+    if (_syncRunning) {
         ASSERT(false)
         return;
     }
 
-    s_anySyncRunning = true;
     _syncRunning = true;
+    _propagationStarted = false;
     _anotherSyncNeeded = NoFollowUpSync;
     _clearTouchedFilesTimer.stop();
 
@@ -582,7 +627,7 @@ void SyncEngine::startSync()
     connect(_discoveryPhase.data(), &DiscoveryPhase::newBigFolder, this, &SyncEngine::newBigFolder);
     connect(_discoveryPhase.data(), &DiscoveryPhase::fatalError, this, [this](const QString &errorString) {
         Q_EMIT syncError(errorString);
-        finalize(false);
+        finalizeAfterError();
     });
     connect(_discoveryPhase.data(), &DiscoveryPhase::finished, this, &SyncEngine::slotDiscoveryFinished);
     connect(_discoveryPhase.data(), &DiscoveryPhase::silentlyExcluded,
@@ -635,13 +680,18 @@ void SyncEngine::slotDiscoveryFinished()
         return;
     }
 
-    qCInfo(lcEngine) << "#### Discovery end #################################################### " << _stopWatch.addLapTime(QLatin1String("Discovery Finished")) << "ms";
+    const auto discoveryTime = _stopWatch.addLapTime(QLatin1String("Discovery Finished"));
+    qCInfo(lcEngine) << "#### Discovery end #################################################### " << discoveryTime << "ms";
+    SyncMetrics::instance()->rate(QStringLiteral("discovery.directories"))->add(_discoveryPhase->_discoveredDirectories, discoveryTime * 1000);
+    SyncMetrics::instance()->rate(QStringLiteral("discovery.entries"))->add(_discoveryPhase->_discoveredEntries, discoveryTime * 1000);
+    SyncMetrics::instance()->rate(QStringLiteral("exclude.matches"))->add(_discoveryPhase->_excludeMatches,
+        std::chrono::duration_cast<std::chrono::microseconds>(_discoveryPhase->_excludeMatchTime).count());
 
     // Sanity check
     if (!_journal->open()) {
         qCWarning(lcEngine) << "Bailing out, DB failure";
         Q_EMIT syncError(tr("Cannot open the sync journal"));
-        finalize(false);
+        finalizeAfterError();
         return;
     } else {
         // Commits a possibly existing (should not though) transaction and starts a new one for the propagate phase
@@ -703,32 +753,24 @@ void SyncEngine::slotDiscoveryFinished()
         // do a database commit
         _journal->commit(QStringLiteral("post treewalk"));
 
-        _propagator = QSharedPointer<OwncloudPropagator>(
-            new OwncloudPropagator(_account, _localPath, _remotePath, _journal));
-        _propagator->setSyncOptions(_syncOptions);
-        connect(_propagator.data(), &OwncloudPropagator::itemCompleted,
-            this, &SyncEngine::slotItemCompleted);
-        connect(_propagator.data(), &OwncloudPropagator::progress,
-            this, &SyncEngine::slotProgress);
-        connect(_propagator.data(), &OwncloudPropagator::finished, this, &SyncEngine::slotPropagationFinished, Qt::QueuedConnection);
-        connect(_propagator.data(), &OwncloudPropagator::seenLockedFile, this, &SyncEngine::seenLockedFile);
-        connect(_propagator.data(), &OwncloudPropagator::touchedFile, this, &SyncEngine::slotAddTouchedFile);
-        connect(_propagator.data(), &OwncloudPropagator::insufficientLocalStorage, this, &SyncEngine::slotInsufficientLocalStorage);
-        connect(_propagator.data(), &OwncloudPropagator::insufficientRemoteStorage, this, &SyncEngine::slotInsufficientRemoteStorage);
-        connect(_propagator.data(), &OwncloudPropagator::newItem, this, &SyncEngine::slotNewItem);
-
-        // apply the network limits to the propagator
-        setNetworkLimits(_uploadLimit, _downloadLimit);
-
-        deleteStaleDownloadInfos(_syncItems);
-        deleteStaleUploadInfos(_syncItems);
-        deleteStaleErrorBlacklistEntries(_syncItems);
+        // With streaming propagation, the propagator may already be running
+        const bool propagationStarted = !_propagator.isNull();
+        if (!propagationStarted)
+            setupPropagator();
+
+        // Items that are already being propagated must keep their download and upload info
+        const auto allItems = _streamedItems.isEmpty() ? _syncItems : _streamedItems + _syncItems;
+        deleteStaleDownloadInfos(allItems);
+        deleteStaleUploadInfos(allItems);
+        deleteStaleErrorBlacklistEntries(allItems);
         _journal->commit(QStringLiteral("post stale entry removal"));
 
         // Emit the started signal only after the propagator has been set up.
-        if (_needsUpdate)
+        if (_needsUpdate && !propagationStarted)
             Q_EMIT started();
 
+        _propagationStarted = true;
+        emit propagationStarted();
         _propagator->start(std::move(_syncItems));
 
         qCInfo(lcEngine) << "#### Post-Reconcile end #################################################### " << _stopWatch.addLapTime(QStringLiteral("Post-Reconcile Finished")) << "ms";
@@ -754,7 +796,7 @@ void SyncEngine::slotDiscoveryFinished()
             guard->deleteLater();
             if (cancel) {
                 qCInfo(lcEngine) << "User aborted sync";
-                finalize(false);
+                finalizeAfterError();
                 return;
             } else {
                 finish();
@@ -766,6 +808,28 @@ void SyncEngine::slotDiscoveryFinished()
     finish();
 }
 
+void SyncEngine::setupPropagator()
+{
+    _propagator = QSharedPointer<OwncloudPropagator>(
+        new OwncloudPropagator(_account, _localPath, _remotePath, _journal));
+    _propagator->setSyncOptions(_syncOptions);
+    connect(_propagator.data(), &OwncloudPropagator::itemCompleted,
+        this, &SyncEngine::slotItemCompleted);
+    connect(_propagator.data(), &OwncloudPropagator::progress,
+        this, &SyncEngine::slotProgress);
+    connect(_propagator.data(), &OwncloudPropagator::finished, this, &SyncEngine::slotPropagationFinished, Qt::QueuedConnection);
+    connect(_propagator.data(), &OwncloudPropagator::seenLockedFile, this, &SyncEngine::seenLockedFile);
+    connect(_propagator.data(), &OwncloudPropagator::touchedFile, this, &SyncEngine::slotAddTouchedFile);
+    connect(_propagator.data(), &OwncloudPropagator::insufficientLocalStorage, this, &SyncEngine::slotInsufficientLocalStorage);
+    connect(_propagator.data(), &OwncloudPropagator::insufficientRemoteStorage, this, &SyncEngine::slotInsufficientRemoteStorage);
+    connect(_propagator.data(), &OwncloudPropagator::newItem, this, &SyncEngine::slotNewItem);
+    connect(TransferGovernor::instance(), &TransferGovernor::requestSlotAvailable,
+        _propagator.data(), &OwncloudPropagator::scheduleNextJob);
+
+    // apply the network limits to the propagator
+    setNetworkLimits(_uploadLimit, _downloadLimit);
+}
+
 void SyncEngine::slotCleanPollsJobAborted(const QString &error)
 {
     syncError(error);
@@ -829,12 +893,13 @@ void SyncEngine::finalize(bool success)
     if (_discoveryPhase) {
         _discoveryPhase.take()->deleteLater();
     }
-    s_anySyncRunning = false;
     _syncRunning = false;
+    _propagationStarted = false;
     emit finished(success);
 
     // Delete the propagator only after emitting the signal.
     _propagator.clear();
+    _streamedItems.clear();
     _seenConflictFiles.clear();
     _uniqueErrors.clear();
     _localDiscoveryPaths.clear();
@@ -843,6 +908,23 @@ void SyncEngine::finalize(bool success)
     _clearTouchedFilesTimer.start();
 }
 
+void SyncEngine::finalizeAfterError()
+{
+    if (!_propagator) {
+        finalize(false);
+        return;
+    }
+
+    // Streamed subtrees are being propagated: the discovery must not hand
+    // out more, and the running jobs must stop before the propagator is
+    // deleted. slotPropagationFinished() finalizes once they did.
+    if (_discoveryPhase) {
+        disconnect(_discoveryPhase.data(), nullptr, this, nullptr);
+        _discoveryPhase.take()->deleteLater();
+    }
+    _propagator->abort();
+}
+
 void SyncEngine::slotProgress(const SyncFileItem &item, qint64 current)
 {
     _progressInfo->setProgressItem(item, current);
@@ -888,40 +970,38 @@ void SyncEngine::slotAddTouchedFile(const QString &fn)
     now.start();
     QString file = QDir::cleanPath(fn);
 
-    // Iterate from the oldest and remove anything older than 15 seconds.
-    while (true) {
-        auto first = _touchedFiles.begin();
-        if (first == _touchedFiles.end())
-            break;
+    // Expire touches from the oldest on, until one is younger than the maximum age.
+    while (!_touchedFilesOrder.isEmpty()) {
+        const auto &oldest = _touchedFilesOrder.head();
         // Compare to our new QElapsedTimer instead of using elapsed().
         // This avoids querying the current time from the OS for every loop.
-        auto elapsed = std::chrono::milliseconds(now.msecsSinceReference() - first.key().msecsSinceReference());
-        if (elapsed <= s_touchedFilesMaxAgeMs) {
-            // We found the first path younger than the maximum age, keep the rest.
+        auto elapsed = std::chrono::milliseconds(now.msecsSinceReference() - oldest.first.msecsSinceReference());
+        if (elapsed <= s_touchedFilesMaxAgeMs)
             break;
-        }
 
-        _touchedFiles.erase(first);
+        // Keep the path if it was touched again since
+        auto it = _touchedFiles.find(oldest.second);
+        if (it != _touchedFiles.end() && it.value() == oldest.first)
+            _touchedFiles.erase(it);
+        _touchedFilesOrder.dequeue();
     }
 
-    // This should be the largest QElapsedTimer yet, use constEnd() as hint.
-    _touchedFiles.insert(_touchedFiles.constEnd(), now, file);
+    _touchedFiles.insert(file, now);
+    _touchedFilesOrder.enqueue(qMakePair(now, file));
 }
 
 void SyncEngine::slotClearTouchedFiles()
 {
     _touchedFiles.clear();
+    _touchedFilesOrder.clear();
 }
 
 bool SyncEngine::wasFileTouched(const QString &fn) const
 {
-    // Start from the end (most recent) and look for our path. Check the time just in case.
-    auto begin = _touchedFiles.constBegin();
-    for (auto it = _touchedFiles.constEnd(); it != begin; --it) {
-        if ((it-1).value() == fn)
-            return std::chrono::milliseconds((it-1).key().elapsed()) <= s_touchedFilesMaxAgeMs;
-    }
-    return false;
+    // Check the time just in case the entry wasn't expired yet
+    auto it = _touchedFiles.constFind(fn);
+    return it != _touchedFiles.constEnd()
+        && std::chrono::milliseconds(it.value().elapsed()) <= s_touchedFilesMaxAgeMs;
 }
 
 AccountPtr SyncEngine::account() const
@@ -1014,12 +1094,31 @@ void SyncEngine::wipeVirtualFiles(const QString &localPath, SyncJournalDb &journ
     // But hydrated placeholders may still be around.
 }
 
+void SyncEngine::setParallelNetworkJobs(int jobs)
+{
+    if (_syncOptions._parallelNetworkJobs == jobs)
+        return;
+
+    qCInfo(lcEngine) << "Parallel network jobs" << _syncOptions._parallelNetworkJobs << "->" << jobs;
+    _syncOptions._parallelNetworkJobs = jobs;
+
+    if (_discoveryPhase)
+        _discoveryPhase->setParallelNetworkJobs(jobs);
+    if (_propagator)
+        _propagator->setParallelNetworkJobs(jobs);
+}
+
 void SyncEngine::abort()
 {
     if (_propagator)
         qCInfo(lcEngine) << "Aborting sync";
 
     if (_propagator) {
+        // A discovery that streams items to the propagator must not continue
+        if (_discoveryPhase) {
+            disconnect(_discoveryPhase.data(), nullptr, this, nullptr);
+            _discoveryPhase.take()->deleteLater();
+        }
         // If we're already in the propagation phase, aborting that is sufficient
         _propagator->abort();
     } else if (_discoveryPhase) {
@@ -22,6 +22,7 @@
 #include <QString>
 #include <QSet>
 #include <QMap>
+#include <QQueue>
 #include <QStringList>
 #include <QSharedPointer>
 #include <set>
@@ -69,6 +70,24 @@ public:
 
     bool isSyncRunning() const { return _syncRunning; }
 
+    /**
+     * Whether the sync is in the propagation phase.
+     *
+     * Only true once the discovery finished and the propagator got all items,
+     * subtrees propagated while the discovery runs don't count.
+     *
+     * Aborting a sync at that point loses little work: completed items are
+     * already in the journal and interrupted transfers can be resumed.
+     */
+    bool isPropagating() const { return _syncRunning && _propagationStarted; }
+
+    /**
+     * Changes the number of parallel network jobs, also for a running sync.
+     *
+     * Lowering the limit does not abort running jobs, it only delays new ones.
+     */
+    void setParallelNetworkJobs(int jobs);
+
     SyncOptions syncOptions() const { return _syncOptions; }
     void setSyncOptions(const SyncOptions &options) { _syncOptions = options; }
     bool ignoreHiddenFiles() const { return _ignore_hidden_files; }
@@ -143,6 +162,10 @@ signals:
     // after the above signals. with the items that actually need propagating
     void aboutToPropagate(SyncFileItemVector &);
 
+    // During update, with a subtree that is propagated before the discovery finished.
+    // See SyncOptions::_streamingPropagation. Its items are not part of aboutToPropagate.
+    void aboutToPropagateSubtree(const SyncFileItemVector &);
+
     // after each item completed by a job (successful or not)
     void itemCompleted(const SyncFileItemPtr &);
 
@@ -156,6 +179,9 @@ signals:
     void finished(bool success);
     void started();
 
+    /// When the propagator got the full list of items, after the discovery finished
+    void propagationStarted();
+
     /**
      * Emited when the sync engine detects that all the files have been removed or change.
      * This usually happen when the server was reset or something.
@@ -224,14 +250,19 @@ private:
     // cleanup and emit the finished signal
     void finalize(bool success);
 
-    static bool s_anySyncRunning; //true when one sync is running somewhere (for debugging)
+    // Like finalize(false), but first stops the propagation of streamed subtrees
+    void finalizeAfterError();
 
     // Must only be acessed during update and reconcile
     QVector<SyncFileItemPtr> _syncItems;
 
+    /** Items that were handed to the propagator while the discovery was still running */
+    SyncFileItemVector _streamedItems;
+
     AccountPtr _account;
     bool _needsUpdate;
     bool _syncRunning;
+    bool _propagationStarted;
     QString _localPath;
     QString _remotePath;
     QByteArray _remoteRootEtag;
@@ -260,6 +291,14 @@ private:
      */
     void restoreOldFiles(SyncFileItemVector &syncItems);
 
+    /** Creates _propagator and connects to it */
+    void setupPropagator();
+
+    /** Propagates the subtree of a discovered folder right away, if the rest
+     * of the discovery can't affect it.
+     */
+    void propagateSubtreeEarly(const SyncFileItemPtr &dirItem);
+
     // true if there is at least one file which was not changed on the server
     bool _hasNoneFiles;
 
@@ -276,8 +315,11 @@ private:
 
     AnotherSyncNeeded _anotherSyncNeeded;
 
-    /** Stores the time since a job touched a file. */
-    QMultiMap<QElapsedTimer, QString> _touchedFiles;
+    /** Stores the time since a job last touched a file, by path. */
+    QHash<QString, QElapsedTimer> _touchedFiles;
+
+    /** The touches in the order they happened, to expire old _touchedFiles entries. */
+    QQueue<QPair<QElapsedTimer, QString>> _touchedFilesOrder;
 
     QElapsedTimer _lastUpdateProgressCallbackCall;
 
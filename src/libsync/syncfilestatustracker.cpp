@@ -26,61 +26,6 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcStatusTracker, "nextcloud.sync.statustracker", QtInfoMsg)
 
-static int pathCompare( const QString& lhs, const QString& rhs )
-{
-    // Should match Utility::fsCasePreserving, we want don't want to pay for the runtime check on every comparison.
-    return lhs.compare(rhs,
-#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
-        Qt::CaseInsensitive
-#else
-        Qt::CaseSensitive
-#endif
-        );
-}
-
-static bool pathStartsWith( const QString& lhs, const QString& rhs )
-{
-    return lhs.startsWith(rhs,
-#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
-        Qt::CaseInsensitive
-#else
-        Qt::CaseSensitive
-#endif
-        );
-}
-
-bool SyncFileStatusTracker::PathComparator::operator()( const QString& lhs, const QString& rhs ) const
-{
-    // This will make sure that the std::map is ordered and queried case-insensitively on macOS and Windows.
-    return pathCompare(lhs, rhs) < 0;
-}
-
-SyncFileStatus::SyncFileStatusTag SyncFileStatusTracker::lookupProblem(const QString &pathToMatch, const SyncFileStatusTracker::ProblemsMap &problemMap)
-{
-    auto lower = problemMap.lower_bound(pathToMatch);
-    for (auto it = lower; it != problemMap.cend(); ++it) {
-        const QString &problemPath = it->first;
-        SyncFileStatus::SyncFileStatusTag severity = it->second;
-
-        if (pathCompare(problemPath, pathToMatch) == 0) {
-            return severity;
-        } else if (severity == SyncFileStatus::StatusError
-            && pathStartsWith(problemPath, pathToMatch)
-            && (pathToMatch.isEmpty() || problemPath.at(pathToMatch.size()) == '/')) {
-            return SyncFileStatus::StatusWarning;
-        } else if (!pathStartsWith(problemPath, pathToMatch)) {
-            // Starting at lower_bound we get the first path that is not smaller,
-            // since: "a/" < "a/aa" < "a/aa/aaa" < "a/ab/aba"
-            // If problemMap keys are ["a/aa/aaa", "a/ab/aba"] and pathToMatch == "a/aa",
-            // lower_bound(pathToMatch) will point to "a/aa/aaa", and the moment that
-            // problemPath.startsWith(pathToMatch) == false, we know that we've looked
-            // at everything that interest us.
-            break;
-        }
-    }
-    return SyncFileStatus::StatusNone;
-}
-
 /**
  * Whether this item should get an ERROR icon through the Socket API.
  *
@@ -115,6 +60,8 @@ SyncFileStatusTracker::SyncFileStatusTracker(SyncEngine *syncEngine)
 {
     connect(syncEngine, &SyncEngine::aboutToPropagate,
         this, &SyncFileStatusTracker::slotAboutToPropagate);
+    connect(syncEngine, &SyncEngine::aboutToPropagateSubtree,
+        this, &SyncFileStatusTracker::slotAboutToPropagateSubtree);
     connect(syncEngine, &SyncEngine::itemCompleted,
         this, &SyncFileStatusTracker::slotItemCompleted);
     connect(syncEngine, &SyncEngine::finished, this, &SyncFileStatusTracker::slotSyncFinished);
@@ -123,6 +70,16 @@ SyncFileStatusTracker::SyncFileStatusTracker(SyncEngine *syncEngine)
 }
 
 SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
+{
+    return resolveFileStatus(relativePath, nullptr);
+}
+
+SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath, const SyncJournalFileRecord &record)
+{
+    return resolveFileStatus(relativePath, &record);
+}
+
+SyncFileStatus SyncFileStatusTracker::resolveFileStatus(const QString &relativePath, const SyncJournalFileRecord *record)
 {
     ASSERT(!relativePath.endsWith(QLatin1Char('/')));
 
@@ -145,17 +102,22 @@ SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
         return SyncFileStatus::StatusExcluded;
     }
 
-    if (_dirtyPaths.contains(relativePath))
+    const auto id = _paths.find(relativePath);
+    if (id != PathStatusTrie::InvalidNode && _paths.node(id).dirty)
         return SyncFileStatus::StatusSync;
 
     // First look it up in the database to know if it's shared
     SyncJournalFileRecord rec;
-    if (_syncEngine->journal()->getFileRecord(relativePath, &rec) && rec.isValid()) {
-        return resolveSyncAndErrorStatus(relativePath, rec._remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared);
+    if (!record) {
+        _syncEngine->journal()->getFileRecord(relativePath, &rec);
+        record = &rec;
+    }
+    if (record->isValid()) {
+        return resolveSyncAndErrorStatus(id, record->_remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared);
     }
 
     // Must be a new file not yet in the database, check if it's syncing or has an error.
-    return resolveSyncAndErrorStatus(relativePath, NotShared, PathUnknown);
+    return resolveSyncAndErrorStatus(id, NotShared, PathUnknown);
 }
 
 void SyncFileStatusTracker::slotPathTouched(const QString &fileName)
@@ -164,76 +126,123 @@ void SyncFileStatusTracker::slotPathTouched(const QString &fileName)
 
     ASSERT(fileName.startsWith(folderPath));
     QString localPath = fileName.mid(folderPath.size());
-    _dirtyPaths.insert(localPath);
+    _paths.setDirty(_paths.findOrInsert(localPath), true);
 
     emit fileStatusChanged(fileName, SyncFileStatus::StatusSync);
 }
 
 void SyncFileStatusTracker::slotAddSilentlyExcluded(const QString &folderPath)
 {
-    _syncProblems[folderPath] = SyncFileStatus::StatusExcluded;
+    _paths.setProblem(_paths.findOrInsert(folderPath), SyncFileStatus::StatusExcluded);
     emit fileStatusChanged(getSystemDestination(folderPath), resolveSyncAndErrorStatus(folderPath, NotShared));
 }
 
-void SyncFileStatusTracker::incSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedFlag)
+// The path of the parent, for paths built by PathStatusTrie::path()
+static QString parentPath(const QString &path)
 {
-    // Will return 0 (and increase to 1) if the path wasn't in the map yet
-    int count = _syncCount[relativePath]++;
-    if (!count) {
+    const int slash = path.lastIndexOf(QLatin1Char('/'));
+    return slash == -1 ? QString() : path.left(slash);
+}
+
+void SyncFileStatusTracker::incSyncCountAndEmitStatusChanged(PathStatusTrie::NodeId id, const QString &relativePath, SharedFlag sharedFlag)
+{
+    QString path = relativePath;
+    bool isTriePath = false;
+
+    // Will return 1 if the path wasn't being synced yet
+    while (_paths.addSyncCount(id, 1) == 1) {
         SyncFileStatus status = sharedFlag == UnknownShared
-            ? fileStatus(relativePath)
-            : resolveSyncAndErrorStatus(relativePath, sharedFlag);
-        emit fileStatusChanged(getSystemDestination(relativePath), status);
+            ? fileStatus(path)
+            : resolveSyncAndErrorStatus(id, sharedFlag);
+        emit fileStatusChanged(getSystemDestination(path), status);
 
         // We passed from OK to SYNC, increment the parent to keep it marked as
         // SYNC while we propagate ourselves and our own children.
-        ASSERT(!relativePath.endsWith('/'));
-        int lastSlashIndex = relativePath.lastIndexOf('/');
-        if (lastSlashIndex != -1)
-            incSyncCountAndEmitStatusChanged(relativePath.left(lastSlashIndex), UnknownShared);
-        else if (!relativePath.isEmpty())
-            incSyncCountAndEmitStatusChanged(QString(), UnknownShared);
+        id = _paths.parent(id);
+        if (id == PathStatusTrie::InvalidNode)
+            break;
+        // The trie builds the first parent's path, the others are prefixes of it
+        path = isTriePath ? parentPath(path) : _paths.path(id);
+        isTriePath = true;
+        sharedFlag = UnknownShared;
     }
 }
 
-void SyncFileStatusTracker::decSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedFlag)
+void SyncFileStatusTracker::decSyncCountAndEmitStatusChanged(PathStatusTrie::NodeId id, const QString &relativePath, SharedFlag sharedFlag)
 {
-    int count = --_syncCount[relativePath];
-    if (!count) {
-        // Remove from the map, same as 0
-        _syncCount.remove(relativePath);
+    const auto firstId = id;
+    QString path = relativePath;
+    bool isTriePath = false;
 
+    while (_paths.addSyncCount(id, -1) == 0) {
         SyncFileStatus status = sharedFlag == UnknownShared
-            ? fileStatus(relativePath)
-            : resolveSyncAndErrorStatus(relativePath, sharedFlag);
-        emit fileStatusChanged(getSystemDestination(relativePath), status);
+            ? fileStatus(path)
+            : resolveSyncAndErrorStatus(id, sharedFlag);
+        emit fileStatusChanged(getSystemDestination(path), status);
 
         // We passed from SYNC to OK, decrement our parent.
-        ASSERT(!relativePath.endsWith('/'));
-        int lastSlashIndex = relativePath.lastIndexOf('/');
-        if (lastSlashIndex != -1)
-            decSyncCountAndEmitStatusChanged(relativePath.left(lastSlashIndex), UnknownShared);
-        else if (!relativePath.isEmpty())
-            decSyncCountAndEmitStatusChanged(QString(), UnknownShared);
+        id = _paths.parent(id);
+        if (id == PathStatusTrie::InvalidNode)
+            break;
+        path = isTriePath ? parentPath(path) : _paths.path(id);
+        isTriePath = true;
+        sharedFlag = UnknownShared;
     }
+
+    // Drop the nodes unless they're still synced, have a problem or are dirty
+    _paths.prune(firstId);
 }
 
-void SyncFileStatusTracker::slotAboutToPropagate(SyncFileItemVector &items)
+void SyncFileStatusTracker::setProblem(const QString &relativePath, SyncFileStatus::SyncFileStatusTag problem)
 {
-    ASSERT(_syncCount.isEmpty());
+    if (problem == SyncFileStatus::StatusNone) {
+        const auto id = _paths.find(relativePath);
+        if (id != PathStatusTrie::InvalidNode) {
+            _paths.setProblem(id, problem);
+            _paths.prune(id);
+        }
+        return;
+    }
+
+    const auto id = _paths.findOrInsert(relativePath);
+    _paths.setProblem(id, problem);
+    if (problem == SyncFileStatus::StatusError)
+        invalidateParentPaths(id);
+}
 
-    ProblemsMap oldProblems;
-    std::swap(_syncProblems, oldProblems);
+void SyncFileStatusTracker::beginPropagation()
+{
+    if (_propagationBegun)
+        return;
+    _propagationBegun = true;
+
+    ASSERT(_paths.nodes([](const PathStatusTrie::Node &node) { return node.syncCount != 0; }).isEmpty());
+
+    // Start over with the problems of this sync, remember the old ones
+    // to update their status in slotAboutToPropagate().
+    _oldProblems.clear();
+    const auto problemNodes = _paths.nodes([](const PathStatusTrie::Node &node) {
+        return node.problem != SyncFileStatus::StatusNone;
+    });
+    for (const auto id : problemNodes) {
+        _oldProblems.append({ _paths.path(id), _paths.node(id).problem });
+        _paths.setProblem(id, SyncFileStatus::StatusNone);
+    }
+}
 
-    foreach (const SyncFileItemPtr &item, items) {
+void SyncFileStatusTracker::markItemsAboutToPropagate(const SyncFileItemVector &items)
+{
+    for (const auto &item : items) {
         qCDebug(lcStatusTracker) << "Investigating" << item->destination() << item->_status << item->_instruction;
-        _dirtyPaths.remove(item->destination());
+        const QString destination = item->destination();
+        auto id = _paths.find(destination);
+        if (id != PathStatusTrie::InvalidNode)
+            _paths.setDirty(id, false);
 
         if (hasErrorStatus(*item)) {
-            _syncProblems[item->destination()] = SyncFileStatus::StatusError;
-            invalidateParentPaths(item->destination());
+            setProblem(destination, SyncFileStatus::StatusError);
         } else if (hasExcludedStatus(*item)) {
-            _syncProblems[item->destination()] = SyncFileStatus::StatusExcluded;
+            setProblem(destination, SyncFileStatus::StatusExcluded);
         }
 
         SharedFlag sharedFlag = item->_remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared;
@@ -242,30 +251,61 @@ void SyncFileStatusTracker::slotAboutToPropagate(SyncFileItemVector &items)
             && item->_instruction != CSYNC_INSTRUCTION_IGNORE
             && item->_instruction != CSYNC_INSTRUCTION_ERROR) {
             // Mark this path as syncing for instructions that will result in propagation.
-            incSyncCountAndEmitStatusChanged(item->destination(), sharedFlag);
+            incSyncCountAndEmitStatusChanged(_paths.findOrInsert(destination), destination, sharedFlag);
         } else {
-            emit fileStatusChanged(getSystemDestination(item->destination()), resolveSyncAndErrorStatus(item->destination(), sharedFlag));
+            emit fileStatusChanged(getSystemDestination(destination), resolveSyncAndErrorStatus(destination, sharedFlag));
+            id = _paths.find(destination);
+            if (id != PathStatusTrie::InvalidNode)
+                _paths.prune(id);
         }
     }
+}
+
+void SyncFileStatusTracker::slotAboutToPropagateSubtree(const SyncFileItemVector &items)
+{
+    beginPropagation();
+    markItemsAboutToPropagate(items);
+}
+
+void SyncFileStatusTracker::slotAboutToPropagate(SyncFileItemVector &items)
+{
+    beginPropagation();
+    markItemsAboutToPropagate(items);
+    _propagationBegun = false;
+    const auto oldProblems = std::move(_oldProblems);
+    _oldProblems.clear();
 
     // Some metadata status won't trigger files to be synced, make sure that we
     // push the OK status for dirty files that don't need to be propagated.
-    // Swap into a copy since fileStatus() reads _dirtyPaths to determine the status
-    QSet<QString> oldDirtyPaths;
-    std::swap(_dirtyPaths, oldDirtyPaths);
+    // Clear all dirty flags first since fileStatus() reads them to determine the status
+    QStringList oldDirtyPaths;
+    const auto dirtyNodes = _paths.nodes([](const PathStatusTrie::Node &node) { return node.dirty; });
+    for (const auto id : dirtyNodes) {
+        oldDirtyPaths.append(_paths.path(id));
+        _paths.setDirty(id, false);
+    }
+    for (const auto id : dirtyNodes)
+        _paths.prune(id);
     for (const auto &oldDirtyPath : qAsConst(oldDirtyPaths))
         emit fileStatusChanged(getSystemDestination(oldDirtyPath), fileStatus(oldDirtyPath));
 
     // Make sure to push any status that might have been resolved indirectly since the last sync
     // (like an error file being deleted from disk)
-    for (const auto &syncProblem : _syncProblems)
-        oldProblems.erase(syncProblem.first);
-    for (const auto &oldProblem : oldProblems) {
+    for (const auto &oldProblem : qAsConst(oldProblems)) {
         const QString &path = oldProblem.first;
+        auto id = _paths.find(path);
+        if (id != PathStatusTrie::InvalidNode && _paths.node(id).problem != SyncFileStatus::StatusNone)
+            continue;
+
         SyncFileStatus::SyncFileStatusTag severity = oldProblem.second;
-        if (severity == SyncFileStatus::StatusError)
-            invalidateParentPaths(path);
+        if (severity == SyncFileStatus::StatusError) {
+            // The parents are walked from the path's node
+            id = _paths.findOrInsert(path);
+            invalidateParentPaths(id);
+        }
         emit fileStatusChanged(getSystemDestination(path), fileStatus(path));
+        if (id != PathStatusTrie::InvalidNode)
+            _paths.prune(id);
     }
 }
 
@@ -273,13 +313,13 @@ void SyncFileStatusTracker::slotItemCompleted(const SyncFileItemPtr &item)
 {
     qCDebug(lcStatusTracker) << "Item completed" << item->destination() << item->_status << item->_instruction;
 
+    const QString destination = item->destination();
     if (hasErrorStatus(*item)) {
-        _syncProblems[item->destination()] = SyncFileStatus::StatusError;
-        invalidateParentPaths(item->destination());
+        setProblem(destination, SyncFileStatus::StatusError);
     } else if (hasExcludedStatus(*item)) {
-        _syncProblems[item->destination()] = SyncFileStatus::StatusExcluded;
+        setProblem(destination, SyncFileStatus::StatusExcluded);
     } else {
-        _syncProblems.erase(item->destination());
+        setProblem(destination, SyncFileStatus::StatusNone);
     }
 
     SharedFlag sharedFlag = item->_remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared;
@@ -288,24 +328,30 @@ void SyncFileStatusTracker::slotItemCompleted(const SyncFileItemPtr &item)
         && item->_instruction != CSYNC_INSTRUCTION_IGNORE
         && item->_instruction != CSYNC_INSTRUCTION_ERROR) {
         // decSyncCount calls *must* be symetric with incSyncCount calls in slotAboutToPropagate
-        decSyncCountAndEmitStatusChanged(item->destination(), sharedFlag);
+        decSyncCountAndEmitStatusChanged(_paths.findOrInsert(destination), destination, sharedFlag);
     } else {
-        emit fileStatusChanged(getSystemDestination(item->destination()), resolveSyncAndErrorStatus(item->destination(), sharedFlag));
+        emit fileStatusChanged(getSystemDestination(destination), resolveSyncAndErrorStatus(destination, sharedFlag));
     }
 }
 
 void SyncFileStatusTracker::slotSyncFinished()
 {
+    // A sync that ended before announcing all its items doesn't need the old problems
+    _propagationBegun = false;
+    _oldProblems.clear();
+
     // Clear the sync counts to reduce the impact of unsymetrical inc/dec calls (e.g. when directory job abort)
-    QHash<QString, int> oldSyncCount;
-    std::swap(_syncCount, oldSyncCount);
-    for (auto it = oldSyncCount.begin(); it != oldSyncCount.end(); ++it) {
-        // Don't announce folders, fileStatus expect only paths without '/', otherwise it asserts
-        if (it.key().endsWith('/')) {
-            continue;
-        }
+    const auto syncingNodes = _paths.nodes([](const PathStatusTrie::Node &node) { return node.syncCount != 0; });
+    QStringList syncingPaths;
+    for (const auto id : syncingNodes) {
+        syncingPaths.append(_paths.path(id));
+        _paths.addSyncCount(id, -_paths.node(id).syncCount);
+    }
+    for (const auto id : syncingNodes)
+        _paths.prune(id);
 
-        emit fileStatusChanged(getSystemDestination(it.key()), fileStatus(it.key()));
+    for (const auto &path : qAsConst(syncingPaths)) {
+        emit fileStatusChanged(getSystemDestination(path), fileStatus(path));
     }
 }
 
@@ -315,18 +361,25 @@ void SyncFileStatusTracker::slotSyncEngineRunningChanged()
 }
 
 SyncFileStatus SyncFileStatusTracker::resolveSyncAndErrorStatus(const QString &relativePath, SharedFlag sharedFlag, PathKnownFlag isPathKnown)
+{
+    return resolveSyncAndErrorStatus(_paths.find(relativePath), sharedFlag, isPathKnown);
+}
+
+SyncFileStatus SyncFileStatusTracker::resolveSyncAndErrorStatus(PathStatusTrie::NodeId id, SharedFlag sharedFlag, PathKnownFlag isPathKnown)
 {
     // If it's a new file and that we're not syncing it yet,
     // don't show any icon and wait for the filesystem watcher to trigger a sync.
     SyncFileStatus status(isPathKnown ? SyncFileStatus::StatusUpToDate : SyncFileStatus::StatusNone);
-    if (_syncCount.value(relativePath)) {
-        status.set(SyncFileStatus::StatusSync);
-    } else {
-        // After a sync finished, we need to show the users issues from that last sync like the activity list does.
-        // Also used for parent directories showing a warning for an error child.
-        SyncFileStatus::SyncFileStatusTag problemStatus = lookupProblem(relativePath, _syncProblems);
-        if (problemStatus != SyncFileStatus::StatusNone)
-            status.set(problemStatus);
+    if (id != PathStatusTrie::InvalidNode) {
+        if (_paths.node(id).syncCount) {
+            status.set(SyncFileStatus::StatusSync);
+        } else {
+            // After a sync finished, we need to show the users issues from that last sync like the activity list does.
+            // Also used for parent directories showing a warning for an error child.
+            SyncFileStatus::SyncFileStatusTag problemStatus = _paths.problemStatus(id);
+            if (problemStatus != SyncFileStatus::StatusNone)
+                status.set(problemStatus);
+        }
     }
 
     ASSERT(sharedFlag != UnknownShared,
@@ -337,13 +390,20 @@ SyncFileStatus SyncFileStatusTracker::resolveSyncAndErrorStatus(const QString &r
     return status;
 }
 
-void SyncFileStatusTracker::invalidateParentPaths(const QString &path)
+void SyncFileStatusTracker::invalidateParentPaths(PathStatusTrie::NodeId id)
 {
-    QStringList splitPath = path.split('/', Qt::SkipEmptyParts);
-    for (int i = 0; i < splitPath.size(); ++i) {
-        QString parentPath = QStringList(splitPath.mid(0, i)).join(QLatin1String("/"));
+    if (id == PathStatusTrie::RootNode)
+        return;
+
+    // The parents' paths are the prefixes of the path up to each slash.
+    // From the root down, like before.
+    const QString path = _paths.path(id);
+    int end = 0;
+    do {
+        const QString parentPath = path.left(end);
         emit fileStatusChanged(getSystemDestination(parentPath), fileStatus(parentPath));
-    }
+        end = path.indexOf(QLatin1Char('/'), end + 1);
+    } while (end != -1);
 }
 
 QString SyncFileStatusTracker::getSystemDestination(const QString &relativePath)
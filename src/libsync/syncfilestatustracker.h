@@ -19,12 +19,12 @@
 // #include "ownsql.h"
 #include "syncfileitem.h"
 #include "common/syncfilestatus.h"
-#include <map>
-#include <QSet>
+#include "pathstatustrie.h"
 
 namespace OCC {
 
 class SyncEngine;
+class SyncJournalFileRecord;
 
 /**
  * @brief Takes care of tracking the status of individual files as they
@@ -37,6 +37,14 @@ class OWNCLOUDSYNC_EXPORT SyncFileStatusTracker : public QObject
 public:
     explicit SyncFileStatusTracker(SyncEngine *syncEngine);
     SyncFileStatus fileStatus(const QString &relativePath);
+    /**
+     * Like fileStatus(), but uses the given journal record of the path
+     * instead of looking it up. Pass an invalid record for paths that
+     * aren't in the journal.
+     *
+     * Allows looking up the records in bulk or in another thread.
+     */
+    SyncFileStatus fileStatus(const QString &relativePath, const SyncJournalFileRecord &record);
 
 public slots:
     void slotPathTouched(const QString &fileName);
@@ -48,37 +56,47 @@ signals:
 
 private slots:
     void slotAboutToPropagate(SyncFileItemVector &items);
+    void slotAboutToPropagateSubtree(const SyncFileItemVector &items);
     void slotItemCompleted(const SyncFileItemPtr &item);
     void slotSyncFinished();
     void slotSyncEngineRunningChanged();
 
 private:
-    struct PathComparator {
-        bool operator()( const QString& lhs, const QString& rhs ) const;
-    };
-    using ProblemsMap = std::map<QString, SyncFileStatus::SyncFileStatusTag, PathComparator>;
-    SyncFileStatus::SyncFileStatusTag lookupProblem(const QString &pathToMatch, const ProblemsMap &problemMap);
-
     enum SharedFlag { UnknownShared,
         NotShared,
         Shared };
     enum PathKnownFlag { PathUnknown = 0,
         PathKnown };
+    // Looks up the journal record unless one is passed in
+    SyncFileStatus resolveFileStatus(const QString &relativePath, const SyncJournalFileRecord *record);
     SyncFileStatus resolveSyncAndErrorStatus(const QString &relativePath, SharedFlag sharedState, PathKnownFlag isPathKnown = PathKnown);
+    SyncFileStatus resolveSyncAndErrorStatus(PathStatusTrie::NodeId id, SharedFlag sharedState, PathKnownFlag isPathKnown = PathKnown);
+
+    /** Starts the status tracking for a sync, unless it was already started */
+    void beginPropagation();
+    void markItemsAboutToPropagate(const SyncFileItemVector &items);
 
-    void invalidateParentPaths(const QString &path);
+    void invalidateParentPaths(PathStatusTrie::NodeId id);
+    void setProblem(const QString &relativePath, SyncFileStatus::SyncFileStatusTag problem);
     QString getSystemDestination(const QString &relativePath);
-    void incSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedState);
-    void decSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedState);
+    void incSyncCountAndEmitStatusChanged(PathStatusTrie::NodeId id, const QString &relativePath, SharedFlag sharedState);
+    void decSyncCountAndEmitStatusChanged(PathStatusTrie::NodeId id, const QString &relativePath, SharedFlag sharedState);
 
     SyncEngine *_syncEngine;
 
-    ProblemsMap _syncProblems;
-    QSet<QString> _dirtyPaths;
-    // Counts the number direct children currently being synced (has unfinished propagation jobs).
-    // We'll show a file/directory as SYNC as long as its sync count is > 0.
-    // A directory that starts/ends propagation will in turn increase/decrease its own parent by 1.
-    QHash<QString, int> _syncCount;
+    // The sync counts, problems and dirty flags of all paths that have any.
+    //
+    // The sync count of a path is the number of its direct children currently
+    // being synced (has unfinished propagation jobs), plus one while the path
+    // itself is. We'll show a file/directory as SYNC as long as its sync count
+    // is > 0. A directory that starts/ends propagation will in turn
+    // increase/decrease its own parent by 1.
+    PathStatusTrie _paths;
+
+    // Whether items of the current sync were announced already, and the
+    // problems of the previous sync, see beginPropagation().
+    bool _propagationBegun = false;
+    QVector<QPair<QString, SyncFileStatus::SyncFileStatusTag>> _oldProblems;
 };
 }
 
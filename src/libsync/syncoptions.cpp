@@ -47,6 +47,23 @@ void SyncOptions::fillFromEnvironmentVariables()
     int maxParallel = qgetenv("OWNCLOUD_MAX_PARALLEL").toInt();
     if (maxParallel > 0)
         _parallelNetworkJobs = maxParallel;
+
+    int maxMultiplexed = qgetenv("OWNCLOUD_MAX_PARALLEL_MULTIPLEXED").toInt();
+    if (maxMultiplexed > 0)
+        _maxMultiplexedNetworkJobs = maxMultiplexed;
+
+    QByteArray streamingPropagationEnv = qgetenv("OWNCLOUD_STREAMING_PROPAGATION");
+    if (!streamingPropagationEnv.isEmpty())
+        _streamingPropagation = streamingPropagationEnv != "0";
+}
+
+int SyncOptions::parallelSmallRequests(bool multiplexed) const
+{
+    // A single job means no parallelism was asked for, e.g. OWNCLOUD_MAX_PARALLEL=1
+    if (!multiplexed || _parallelNetworkJobs <= 1)
+        return qMax(1, _parallelNetworkJobs);
+    // Scale with _parallelNetworkJobs, it is the sync's share when several folders sync
+    return qMax(_parallelNetworkJobs, qMin(3 * _parallelNetworkJobs, _maxMultiplexedNetworkJobs));
 }
 
 void SyncOptions::verifyChunkSizes()
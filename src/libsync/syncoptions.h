@@ -72,13 +72,31 @@ public:
     /** The maximum number of active jobs in parallel  */
     int _parallelNetworkJobs = 6;
 
+    /** Upper limit for parallel small requests over HTTP/2, see parallelSmallRequests() */
+    int _maxMultiplexedNetworkJobs = 64;
+
+    /** Whether to propagate new top level folders from the server while the
+     * discovery still runs, instead of waiting for the whole discovery.
+     */
+    bool _streamingPropagation = false;
+
     /** Reads settings from env vars where available.
      *
      * Currently reads _initialChunkSize, _minChunkSize, _maxChunkSize,
-     * _targetChunkUploadDuration, _parallelNetworkJobs.
+     * _targetChunkUploadDuration, _parallelNetworkJobs, _maxMultiplexedNetworkJobs,
+     * _streamingPropagation.
      */
     void fillFromEnvironmentVariables();
 
+    /** The number of small requests to keep in flight.
+     *
+     * Small requests, like listings, folder creations, deletes or small
+     * uploads, mostly wait for the server. When they are multiplexed over a
+     * single HTTP/2 connection, several times _parallelNetworkJobs of them
+     * may run at once.
+     */
+    int parallelSmallRequests(bool multiplexed) const;
+
     /** Ensure min <= initial <= max
      *
      * Previously min/max chunk size values didn't exist, so users might
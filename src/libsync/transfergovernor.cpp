@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "transfergovernor.h"
+#include "common/syncmetrics.h"
+
+#include <QLoggingCategory>
+
+#include <limits>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcTransferGovernor, "nextcloud.sync.transfergovernor", QtInfoMsg)
+
+TransferGovernor *TransferGovernor::_instance = nullptr;
+
+TransferGovernor *TransferGovernor::instance()
+{
+    if (!_instance) {
+        _instance = new TransferGovernor();
+    }
+    return _instance;
+}
+
+TransferGovernor::TransferGovernor(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void TransferGovernor::setMaxRequestsPerHost(int max)
+{
+    if (max == _maxRequestsPerHost)
+        return;
+
+    qCInfo(lcTransferGovernor) << "Maximum requests per host" << _maxRequestsPerHost << "->" << max;
+    const bool raised = max <= 0 || (_maxRequestsPerHost > 0 && max > _maxRequestsPerHost);
+    _maxRequestsPerHost = qMax(0, max);
+    if (raised)
+        emit requestSlotAvailable();
+}
+
+void TransferGovernor::setThroughputLimits(qint64 upload, qint64 download)
+{
+    if (upload != _uploadLimit || download != _downloadLimit) {
+        qCInfo(lcTransferGovernor) << "Global bandwidth limits (up/down)" << upload << download;
+    }
+    _uploadLimit = qMax<qint64>(0, upload);
+    _downloadLimit = qMax<qint64>(0, download);
+}
+
+int TransferGovernor::freeRequestSlots(const QUrl &url) const
+{
+    if (_maxRequestsPerHost <= 0)
+        return std::numeric_limits<int>::max();
+    return qMax(0, _maxRequestsPerHost - activeRequests(url));
+}
+
+int TransferGovernor::activeRequests(const QUrl &url) const
+{
+    return _hosts.value(url.host()).activeRequests;
+}
+
+QVector<TransferGovernor::HostAllocation> TransferGovernor::allocation() const
+{
+    QVector<HostAllocation> result;
+    result.reserve(_hosts.size());
+    for (const auto &host : _hosts) {
+        result.append(host);
+    }
+    return result;
+}
+
+qint64 TransferGovernor::effectiveLimit(qint64 ownLimit, qint64 globalLimit, int managerCount)
+{
+    if (globalLimit <= 0)
+        return ownLimit;
+
+    const qint64 share = qMax<qint64>(1, globalLimit / qMax(1, managerCount));
+    // An absolute global limit takes precedence over relative and missing limits
+    if (ownLimit <= 0)
+        return share;
+    return qMin(ownLimit, share);
+}
+
+qint64 TransferGovernor::effectiveUploadLimit(qint64 ownLimit) const
+{
+    return effectiveLimit(ownLimit, _uploadLimit, _bandwidthManagers.size());
+}
+
+qint64 TransferGovernor::effectiveDownloadLimit(qint64 ownLimit) const
+{
+    return effectiveLimit(ownLimit, _downloadLimit, _bandwidthManagers.size());
+}
+
+void TransferGovernor::registerRequest(AbstractNetworkJob *job, const QUrl &url)
+{
+    // Redirects and resends register the same job again
+    unregisterRequest(job);
+
+    const auto hostName = url.host();
+    _requestHosts.insert(job, hostName);
+
+    auto &host = _hosts[hostName];
+    host.host = hostName;
+    host.activeRequests++;
+    host.startedRequests++;
+    host.peakRequests = qMax(host.peakRequests, host.activeRequests);
+    updateInFlightMetric();
+    qCDebug(lcTransferGovernor) << "Requests to" << hostName << ":" << host.activeRequests;
+}
+
+void TransferGovernor::unregisterRequest(AbstractNetworkJob *job)
+{
+    const auto it = _requestHosts.find(job);
+    if (it == _requestHosts.end())
+        return;
+
+    auto &host = _hosts[it.value()];
+    _requestHosts.erase(it);
+    host.activeRequests--;
+    updateInFlightMetric();
+    if (_maxRequestsPerHost > 0 && host.activeRequests == _maxRequestsPerHost - 1) {
+        emit requestSlotAvailable();
+    }
+}
+
+void TransferGovernor::updateInFlightMetric()
+{
+    static auto inFlight = SyncMetrics::instance()->counter(QStringLiteral("http.in_flight"));
+    inFlight->set(_requestHosts.size());
+}
+
+void TransferGovernor::registerBandwidthManager(BandwidthManager *manager)
+{
+    _bandwidthManagers.insert(manager);
+}
+
+void TransferGovernor::unregisterBandwidthManager(BandwidthManager *manager)
+{
+    _bandwidthManagers.remove(manager);
+}
+
+} // namespace OCC
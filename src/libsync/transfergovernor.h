@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QUrl>
+#include <QVector>
+
+namespace OCC {
+
+class AbstractNetworkJob;
+class BandwidthManager;
+
+/**
+ * @brief Process-wide limits for network requests and bandwidth
+ * @ingroup libsync
+ *
+ * Every folder sync has its own propagator and bandwidth manager, so
+ * without coordination the number of requests and the bandwidth used add
+ * up with every concurrently syncing folder and account.
+ *
+ * All AbstractNetworkJobs register their requests here. The discovery and
+ * the propagator don't start new jobs while the server's host has no
+ * free request slot, apart from always keeping one job of their own going
+ * so that no sync can starve. Jobs started outside of a sync are counted
+ * but never delayed.
+ *
+ * BandwidthManagers register as well and split the global throughput
+ * limits evenly between them.
+ */
+class OWNCLOUDSYNC_EXPORT TransferGovernor : public QObject
+{
+    Q_OBJECT
+public:
+    static TransferGovernor *instance();
+
+    /** The state of one host, for monitoring */
+    struct HostAllocation
+    {
+        QString host;
+        int activeRequests = 0;
+        int peakRequests = 0;
+        qint64 startedRequests = 0;
+    };
+
+    /// 0 means no limit
+    int maxRequestsPerHost() const { return _maxRequestsPerHost; }
+    void setMaxRequestsPerHost(int max);
+
+    /**
+     * Sets the global bandwidth limits in bytes per second, 0 means no limit
+     *
+     * Relative limits (percentages) stay per sync, see Folder::setDirtyNetworkLimits().
+     */
+    void setThroughputLimits(qint64 upload, qint64 download);
+    qint64 uploadLimit() const { return _uploadLimit; }
+    qint64 downloadLimit() const { return _downloadLimit; }
+
+    /** Number of requests to the url's host that may still be started */
+    int freeRequestSlots(const QUrl &url) const;
+    int activeRequests(const QUrl &url) const;
+
+    /** Current per-host request counts */
+    QVector<HostAllocation> allocation() const;
+    int bandwidthManagerCount() const { return _bandwidthManagers.size(); }
+
+    /**
+     * The absolute limit a single bandwidth manager should apply.
+     *
+     * Combines the sync's own limit (positive: absolute, negative: relative,
+     * 0: none) with its share of the global limit.
+     */
+    static qint64 effectiveLimit(qint64 ownLimit, qint64 globalLimit, int managerCount);
+    qint64 effectiveUploadLimit(qint64 ownLimit) const;
+    qint64 effectiveDownloadLimit(qint64 ownLimit) const;
+
+    void registerRequest(AbstractNetworkJob *job, const QUrl &url);
+    void unregisterRequest(AbstractNetworkJob *job);
+
+    void registerBandwidthManager(BandwidthManager *manager);
+    void unregisterBandwidthManager(BandwidthManager *manager);
+
+signals:
+    /** A host that was at its request limit has a free slot again */
+    void requestSlotAvailable();
+
+private:
+    explicit TransferGovernor(QObject *parent = nullptr);
+    void updateInFlightMetric();
+
+    int _maxRequestsPerHost = 0;
+    qint64 _uploadLimit = 0;
+    qint64 _downloadLimit = 0;
+
+    QHash<AbstractNetworkJob *, QString> _requestHosts;
+    QHash<QString, HostAllocation> _hosts;
+    QSet<BandwidthManager *> _bandwidthManagers;
+
+    static TransferGovernor *_instance;
+};
+
+} // namespace OCC
@@ -0,0 +1,118 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "account.h"
+#include "clientsideencryption.h"
+#include "propagatedownload.h"
+
+using namespace OCC;
+
+/*
+ * Receives an end-to-end encrypted file of 2 GB in the pieces GETFileJob
+ * reads from the network, once written to a temporary file and decrypted
+ * from there in a second pass, as downloads used to do, and once decrypted
+ * on the fly by GETEncryptedFileJob.
+ *
+ * Needs about 6 GB of free space in the temporary directory.
+ *
+ * Usage: EncryptedDownloadBench
+ */
+
+static const qint64 fileSize = 2ll * 1024 * 1024 * 1024;
+static const qint64 networkReadSize = 8 * 1024;
+
+class StreamingDecryptionJob : public GETEncryptedFileJob
+{
+public:
+    StreamingDecryptionJob(QIODevice *device, qint64 contentLength, const EncryptedFile &encryptedInfo)
+        : GETEncryptedFileJob(Account::create(), QString(), device, {}, {}, 0, encryptedInfo)
+    {
+        _contentLength = contentLength;
+    }
+
+    using GETEncryptedFileJob::writeToDevice;
+};
+
+class BenchEncryptedDownload : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir _dir;
+    QString _encryptedPath;
+    EncryptedFile _encryptedInfo;
+
+    // Hands the encrypted file to write in the pieces a network reply would
+    template <typename Write>
+    bool receive(Write write)
+    {
+        QFile encrypted(_encryptedPath);
+        if (!encrypted.open(QIODevice::ReadOnly))
+            return false;
+        QByteArray buffer(networkReadSize, Qt::Uninitialized);
+        while (!encrypted.atEnd()) {
+            const auto read = encrypted.read(buffer.data(), buffer.size());
+            if (read <= 0 || write(QByteArray::fromRawData(buffer.constData(), read)) != read)
+                return false;
+        }
+        return true;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(_dir.isValid());
+        _encryptedInfo.encryptionKey = EncryptionHelper::generateRandom(16);
+        _encryptedInfo.initializationVector = EncryptionHelper::generateRandom(16);
+
+        QFile plain(_dir.filePath(QStringLiteral("plain")));
+        QVERIFY(plain.open(QIODevice::WriteOnly));
+        const auto block = EncryptionHelper::generateRandom(1024 * 1024);
+        for (qint64 written = 0; written < fileSize; written += block.size())
+            QCOMPARE(plain.write(block), qint64(block.size()));
+        plain.close();
+
+        _encryptedPath = _dir.filePath(QStringLiteral("encrypted"));
+        QFile encrypted(_encryptedPath);
+        QVERIFY(EncryptionHelper::fileEncryption(_encryptedInfo.encryptionKey, _encryptedInfo.initializationVector, &plain, &encrypted, _encryptedInfo.authenticationTag));
+        QVERIFY(plain.remove());
+    }
+
+    void benchTwoPasses()
+    {
+        QFile tmpFile(_dir.filePath(QStringLiteral("download")));
+        QFile output(_dir.filePath(QStringLiteral("decrypted")));
+        QBENCHMARK_ONCE {
+            QVERIFY(tmpFile.open(QIODevice::WriteOnly | QIODevice::Unbuffered));
+            QVERIFY(receive([&](const QByteArray &data) { return tmpFile.write(data); }));
+            tmpFile.close();
+            QVERIFY(EncryptionHelper::fileDecryption(_encryptedInfo.encryptionKey, _encryptedInfo.initializationVector, &tmpFile, &output));
+        }
+        QCOMPARE(output.size(), fileSize);
+        QVERIFY(tmpFile.remove());
+        QVERIFY(output.remove());
+    }
+
+    void benchStreaming()
+    {
+        QFile output(_dir.filePath(QStringLiteral("decrypted")));
+        QVERIFY(output.open(QIODevice::WriteOnly | QIODevice::Unbuffered));
+        StreamingDecryptionJob job(&output, QFileInfo(_encryptedPath).size(), _encryptedInfo);
+        QBENCHMARK_ONCE {
+            QVERIFY(receive([&](const QByteArray &data) { return job.writeToDevice(data); }));
+        }
+        output.close();
+        QVERIFY(job.isDecryptionFinished());
+        QCOMPARE(output.size(), fileSize);
+        QVERIFY(output.remove());
+    }
+};
+
+QTEST_GUILESS_MAIN(BenchEncryptedDownload)
+#include "benchencrypteddownload.moc"
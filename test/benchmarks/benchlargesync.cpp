@@ -8,42 +8,254 @@
 #include "syncenginetestutils.h"
 #include <syncengine.h>
 
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QTemporaryDir>
+
+#include <iostream>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
 using namespace OCC;
 
-int numDirs = 0;
-int numFiles = 0;
+/*
+ * Syncs trees of different shapes through a series of scenarios and reports
+ * the time spent in each sync phase as JSON.
+ *
+ * Usage: LargeSyncBench [--shape <name>]... [--scale <factor>] [--json <file>]
+ *
+ * The log goes to stdout, so the results are written to largesync.json
+ * unless another file is given.
+ *
+ * Each shape runs in its own process: peakRssKb is the high-water mark of
+ * the resident memory of that process, so it covers all scenarios of the
+ * shape and nothing else.
+ */
+
+struct TreeShape
+{
+    QString name;
+    int filesPerDir;
+    int dirsPerDir;
+    int maxDepth;
+    qint64 fileSize;
+};
+
+static const QVector<TreeShape> &treeShapes()
+{
+    static const QVector<TreeShape> shapes = {
+        { QStringLiteral("default"), 10, 8, 4, 64 },
+        { QStringLiteral("wide"), 2000, 10, 1, 64 },
+        { QStringLiteral("deep"), 20, 1, 40, 64 },
+        { QStringLiteral("tiny"), 100, 10, 2, 1 },
+        { QStringLiteral("huge"), 4, 2, 1, 16 * 1024 * 1024 },
+    };
+    return shapes;
+}
 
-template<int filesPerDir, int dirPerDir, int maxDepth>
-void addBunchOfFiles(int depth, const QString &path, FileModifier &fi) {
-    for (int fileNum = 1; fileNum <= filesPerDir; ++fileNum) {
+struct Tree
+{
+    QStringList files;
+    QStringList topLevel;
+    int dirs = 0;
+};
+
+static void addBunchOfFiles(const TreeShape &shape, int depth, const QString &path, FileModifier &fi, Tree &tree)
+{
+    for (int fileNum = 1; fileNum <= shape.filesPerDir; ++fileNum) {
         QString name = QStringLiteral("file") + QString::number(fileNum);
-        fi.insert(path.isEmpty() ? name : path + "/" + name);
-        numFiles++;
+        const QString filePath = path.isEmpty() ? name : path + "/" + name;
+        fi.insert(filePath, shape.fileSize);
+        tree.files.append(filePath);
+        if (path.isEmpty())
+            tree.topLevel.append(filePath);
     }
-    if (depth >= maxDepth)
+    if (depth >= shape.maxDepth)
         return;
-    for (int dirNum = 1; dirNum <= dirPerDir; ++dirNum) {
+    for (int dirNum = 1; dirNum <= shape.dirsPerDir; ++dirNum) {
         QString name = QStringLiteral("dir") + QString::number(dirNum);
         QString subPath = path.isEmpty() ? name : path + "/" + name;
         fi.mkdir(subPath);
-        numDirs++;
-        addBunchOfFiles<filesPerDir, dirPerDir, maxDepth>(depth + 1, subPath, fi);
+        tree.dirs++;
+        if (path.isEmpty())
+            tree.topLevel.append(subPath);
+        addBunchOfFiles(shape, depth + 1, subPath, fi, tree);
     }
 }
 
-int main(int argc, char *argv[])
+static qint64 peakRssKb()
 {
-    QCoreApplication app(argc, argv);
-    FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
-    addBunchOfFiles<10, 8, 4>(0, "", fakeFolder.localModifier());
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize / 1024;
+    return -1;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#ifdef Q_OS_MAC
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
 
-    qDebug() << "NUMFILES" << numFiles;
-    qDebug() << "NUMDIRS" << numDirs;
+/// Runs one sync and times its phases by following the progress status
+static QJsonObject timedSync(FakeFolder &fakeFolder, const QString &scenario)
+{
     QElapsedTimer timer;
+    qint64 discoveryEnd = -1;
+    qint64 reconcileEnd = -1;
+    auto connection = QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::transmissionProgress,
+        [&](const ProgressInfo &progress) {
+            if (progress.status() == ProgressInfo::Reconcile && discoveryEnd < 0)
+                discoveryEnd = timer.nsecsElapsed();
+            if (progress.status() == ProgressInfo::Propagation && reconcileEnd < 0)
+                reconcileEnd = timer.nsecsElapsed();
+        });
+
     timer.start();
-    bool result1 = fakeFolder.syncOnce();
-    qDebug() << "FIRST SYNC: " << result1 << timer.restart();
-    bool result2 = fakeFolder.syncOnce();
-    qDebug() << "SECOND SYNC: " << result2 << timer.restart();
-    return (result1 && result2) ? 0 : -1;
+    const bool success = fakeFolder.syncOnce();
+    const qint64 total = timer.nsecsElapsed();
+    QObject::disconnect(connection);
+
+    // A sync without changes never gets to the propagation phase
+    if (discoveryEnd < 0)
+        discoveryEnd = total;
+    if (reconcileEnd < 0)
+        reconcileEnd = total;
+
+    auto ms = [](qint64 nsecs) { return nsecs / 1e6; };
+    QJsonObject result {
+        { QStringLiteral("scenario"), scenario },
+        { QStringLiteral("success"), success },
+        { QStringLiteral("discoveryMs"), ms(discoveryEnd) },
+        { QStringLiteral("reconcileMs"), ms(reconcileEnd - discoveryEnd) },
+        { QStringLiteral("propagationMs"), ms(total - reconcileEnd) },
+        { QStringLiteral("totalMs"), ms(total) },
+    };
+    qDebug() << scenario << result;
+    return result;
+}
+
+static QJsonObject runShape(TreeShape shape, double scale, bool *ok)
+{
+    shape.filesPerDir = qMax(1, qRound(shape.filesPerDir * scale));
+
+    FakeFolder fakeFolder{ FileInfo{} };
+    Tree tree;
+    addBunchOfFiles(shape, 0, QString(), fakeFolder.localModifier(), tree);
+    qDebug() << "SHAPE" << shape.name << "NUMFILES" << tree.files.size() << "NUMDIRS" << tree.dirs;
+
+    QJsonArray scenarios;
+    auto run = [&](const QString &scenario) {
+        const auto result = timedSync(fakeFolder, scenario);
+        *ok = *ok && result.value(QStringLiteral("success")).toBool();
+        scenarios.append(result);
+    };
+
+    run(QStringLiteral("initial"));
+    run(QStringLiteral("noop"));
+
+    for (int i = 0; i < tree.files.size(); i += 100)
+        fakeFolder.localModifier().appendByte(tree.files.at(i));
+    run(QStringLiteral("changed1pct"));
+
+    QStringList renamed;
+    for (const auto &path : qAsConst(tree.topLevel)) {
+        renamed.append(QStringLiteral("renamed_") + path);
+        fakeFolder.localModifier().rename(path, renamed.last());
+    }
+    run(QStringLiteral("rename"));
+
+    for (const auto &path : qAsConst(renamed))
+        fakeFolder.localModifier().remove(path);
+    run(QStringLiteral("delete"));
+
+    return QJsonObject{
+        { QStringLiteral("shape"), shape.name },
+        { QStringLiteral("files"), tree.files.size() },
+        { QStringLiteral("dirs"), tree.dirs },
+        { QStringLiteral("fileSize"), double(shape.fileSize) },
+        { QStringLiteral("peakRssKb"), double(peakRssKb()) },
+        { QStringLiteral("scenarios"), scenarios },
+    };
+}
+
+/// Runs a single shape in a child process, to get the peak memory of that shape alone
+static QJsonArray runShapeProcess(const QString &name, double scale, bool *ok)
+{
+    QTemporaryDir dir;
+    const QString jsonFile = dir.filePath(QStringLiteral("shape.json"));
+    QProcess process;
+    process.setProcessChannelMode(QProcess::ForwardedChannels);
+    process.start(QCoreApplication::applicationFilePath(), { QStringLiteral("--shape"), name,
+        QStringLiteral("--scale"), QString::number(scale), QStringLiteral("--json"), jsonFile });
+    process.waitForFinished(-1);
+    *ok = *ok && process.exitStatus() == QProcess::NormalExit && process.exitCode() == 0;
+
+    QFile file(jsonFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::cerr << "No results for shape " << qPrintable(name) << std::endl;
+        *ok = false;
+        return {};
+    }
+    return QJsonDocument::fromJson(file.readAll()).object().value(QStringLiteral("benchmarks")).toArray();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList shapeNames;
+    QString jsonFile = QStringLiteral("largesync.json");
+    double scale = 1;
+    const auto args = app.arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        if (args[i] == QLatin1String("--shape") && i + 1 < args.size()) {
+            shapeNames.append(args[++i]);
+        } else if (args[i] == QLatin1String("--scale") && i + 1 < args.size()) {
+            scale = args[++i].toDouble();
+        } else if (args[i] == QLatin1String("--json") && i + 1 < args.size()) {
+            jsonFile = args[++i];
+        } else {
+            std::cerr << "Usage: " << qPrintable(args[0]) << " [--shape <name>]... [--scale <factor>] [--json <file>]" << std::endl;
+            std::cerr << "Shapes:";
+            for (const auto &shape : treeShapes())
+                std::cerr << " " << qPrintable(shape.name);
+            std::cerr << std::endl;
+            return -1;
+        }
+    }
+
+    bool ok = true;
+    QJsonArray results;
+    for (const auto &shape : treeShapes()) {
+        if (!shapeNames.isEmpty() && !shapeNames.contains(shape.name))
+            continue;
+        if (shapeNames.size() == 1) {
+            results.append(runShape(shape, scale, &ok));
+        } else {
+            for (const auto &result : runShapeProcess(shape.name, scale, &ok))
+                results.append(result);
+        }
+    }
+
+    const auto json = QJsonDocument(QJsonObject{ { QStringLiteral("benchmarks"), results } }).toJson();
+    QFile file(jsonFile);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+        std::cerr << "Could not write " << qPrintable(jsonFile) << std::endl;
+        return -1;
+    }
+    std::cerr << "Results written to " << qPrintable(QFileInfo(file).absoluteFilePath()) << std::endl;
+    return ok ? 0 : -1;
 }
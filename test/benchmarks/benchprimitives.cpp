@@ -0,0 +1,268 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include "csync_exclude.h"
+#include "common/checksums.h"
+#include "common/remotepermissions.h"
+#include "common/syncjournaldb.h"
+#include "common/utility.h"
+#include "networkjobs.h"
+#include "syncfilestatustracker.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+/*
+ * Micro-benchmarks for the primitives that run once per file or per
+ * directory during a sync. Run with the usual QtTest benchmark options,
+ * for example: PrimitivesBench -iterations 1000 or -callgrind.
+ */
+
+#define EXCLUDE_LIST_FILE SOURCEDIR "/../../sync-exclude.lst"
+
+static const int journalRecords = 10000;
+
+static QByteArray propfindReply(const QString &folder, int entries)
+{
+    QByteArray xml = "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+                     "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">";
+    auto response = [&](const QString &path, bool isDir) {
+        xml += "<d:response><d:href>" + path.toUtf8() + "</d:href>"
+               "<d:propstat><d:prop>"
+               "<oc:id>00004213ocobzus5kn6s</oc:id>"
+               "<oc:permissions>RDNVCK</oc:permissions>"
+               "<d:getetag>\"5a3ff2f4a3b1e\"</d:getetag>"
+               "<d:getlastmodified>Fri, 06 Feb 2015 13:49:55 GMT</d:getlastmodified>";
+        if (isDir) {
+            xml += "<d:resourcetype><d:collection/></d:resourcetype><oc:size>121780</oc:size>";
+        } else {
+            xml += "<d:resourcetype/><d:getcontentlength>33</d:getcontentlength>";
+        }
+        xml += "</d:prop><d:status>HTTP/1.1 200 OK</d:status></d:propstat>"
+               "<d:propstat><d:prop><oc:downloadURL/><oc:dDC/></d:prop>"
+               "<d:status>HTTP/1.1 404 Not Found</d:status></d:propstat>"
+               "</d:response>";
+    };
+    response(folder, true);
+    for (int i = 0; i < entries; ++i) {
+        const bool isDir = i % 10 == 0;
+        response(folder + (isDir ? QStringLiteral("subdir%1/") : QStringLiteral("file%1.txt")).arg(i), isDir);
+    }
+    xml += "</d:multistatus>";
+    return xml;
+}
+
+static SyncJournalFileRecord journalRecord(int i)
+{
+    SyncJournalFileRecord record;
+    record._path = QByteArray("dir") + QByteArray::number(i / 100) + "/file" + QByteArray::number(i) + ".txt";
+    record._inode = 1000 + i;
+    record._modtime = 1600000000 + i;
+    record._type = ItemTypeFile;
+    record._etag = QByteArray::number(i, 16).rightJustified(13, '0');
+    record._fileId = QByteArray::number(i).rightJustified(8, '0') + "ocobzus5kn6s";
+    record._remotePerm = RemotePermissions::fromDbValue("RDNVW");
+    record._fileSize = 4096 + i;
+    record._checksumHeader = "SHA1:" + QByteArray(40, 'a');
+    return record;
+}
+
+class BenchPrimitives : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir _tempDir;
+    QScopedPointer<SyncJournalDb> _journal;
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(_tempDir.isValid());
+        _journal.reset(new SyncJournalDb(_tempDir.path() + QStringLiteral("/sync.db")));
+        for (int i = 0; i < journalRecords; ++i)
+            QVERIFY(_journal->setFileRecord(journalRecord(i)));
+        _journal->commit(QStringLiteral("benchmark setup"));
+    }
+
+    void cleanupTestCase()
+    {
+        _journal->close();
+    }
+
+    void benchTraversalPatternMatch_data()
+    {
+        QTest::addColumn<QString>("path");
+        QTest::addColumn<bool>("isDirectory");
+
+        QTest::newRow("plain file") << QStringLiteral("Documents/Projects/report final.odt") << false;
+        QTest::newRow("excluded file") << QStringLiteral("Documents/Projects/.report final.odt.swp") << false;
+        QTest::newRow("plain directory") << QStringLiteral("Documents/Projects/2020") << true;
+        QTest::newRow("excluded directory") << QStringLiteral("Documents/Projects/.git") << true;
+        QTest::newRow("deep file") << QStringLiteral("a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p/q/r/s/t/file.txt") << false;
+    }
+
+    void benchTraversalPatternMatch()
+    {
+        QFETCH(QString, path);
+        QFETCH(bool, isDirectory);
+
+        ExcludedFiles excludedFiles;
+        excludedFiles.addExcludeFilePath(EXCLUDE_LIST_FILE);
+        excludedFiles.reloadExcludeFiles();
+        excludedFiles.setWildcardsMatchSlash(false);
+        const auto type = isDirectory ? ItemTypeDirectory : ItemTypeFile;
+
+        QBENCHMARK {
+            excludedFiles.traversalPatternMatch(path, type);
+        }
+    }
+
+    void benchLsColParse_data()
+    {
+        QTest::addColumn<int>("entries");
+
+        QTest::newRow("10 entries") << 10;
+        QTest::newRow("1000 entries") << 1000;
+    }
+
+    void benchLsColParse()
+    {
+        QFETCH(int, entries);
+
+        const QString folder = QStringLiteral("/oc/remote.php/dav/files/admin/Documents/");
+        const auto xml = propfindReply(folder, entries);
+
+        QBENCHMARK {
+            LsColXMLParser parser;
+            QHash<QString, ExtraFolderInfo> sizes;
+            QVERIFY(parser.parse(xml, &sizes, folder));
+        }
+    }
+
+    void benchGetFileRecord()
+    {
+        int i = 0;
+        QBENCHMARK {
+            SyncJournalFileRecord record;
+            _journal->getFileRecord(journalRecord(i * 7919 % journalRecords)._path, &record);
+            ++i;
+        }
+    }
+
+    void benchGetFileRecordMissing()
+    {
+        QBENCHMARK {
+            SyncJournalFileRecord record;
+            _journal->getFileRecord(QByteArrayLiteral("does/not/exist.txt"), &record);
+        }
+    }
+
+    void benchSetFileRecord()
+    {
+        int i = 0;
+        QBENCHMARK {
+            auto record = journalRecord(i % journalRecords);
+            record._etag = QByteArray::number(i);
+            _journal->setFileRecord(record);
+            ++i;
+        }
+        _journal->commit(QStringLiteral("benchmark"));
+    }
+
+    void benchChecksum_data()
+    {
+        QTest::addColumn<QByteArray>("type");
+        QTest::addColumn<int>("size");
+
+        QTest::newRow("SHA1 4KB") << checkSumSHA1C << 4 * 1024;
+        QTest::newRow("SHA1 4MB") << checkSumSHA1C << 4 * 1024 * 1024;
+#ifdef ZLIB_FOUND
+        QTest::newRow("Adler32 4KB") << checkSumAdlerC << 4 * 1024;
+        QTest::newRow("Adler32 4MB") << checkSumAdlerC << 4 * 1024 * 1024;
+#endif
+    }
+
+    void benchChecksum()
+    {
+        QFETCH(QByteArray, type);
+        QFETCH(int, size);
+
+        QByteArray data(size, Qt::Uninitialized);
+        for (int i = 0; i < size; ++i)
+            data[i] = char(i * 31 + i / 7);
+        QBuffer buffer(&data);
+        QVERIFY(buffer.open(QIODevice::ReadOnly));
+
+        auto calc = &calcSha1;
+#ifdef ZLIB_FOUND
+        if (type == checkSumAdlerC)
+            calc = &calcAdler32;
+#endif
+
+        QBENCHMARK {
+            buffer.seek(0);
+            calc(&buffer);
+        }
+    }
+
+    void benchFileStatus()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        for (int i = 0; i < 100; ++i)
+            fakeFolder.remoteModifier().insert(QStringLiteral("A/file%1").arg(i));
+        QVERIFY(fakeFolder.syncOnce());
+        auto &tracker = fakeFolder.syncEngine().syncFileStatusTracker();
+
+        int i = 0;
+        QBENCHMARK {
+            tracker.fileStatus(QStringLiteral("A/file%1").arg(i % 100));
+            tracker.fileStatus(QStringLiteral("B"));
+            ++i;
+        }
+    }
+
+    void benchRemotePermissions_data()
+    {
+        QTest::addColumn<QString>("permissions");
+
+        QTest::newRow("file") << QStringLiteral("RDNVW");
+        QTest::newRow("directory") << QStringLiteral("RDNVCK");
+        QTest::newRow("shared mount") << QStringLiteral("SRMGDNVCK");
+    }
+
+    void benchRemotePermissions()
+    {
+        QFETCH(QString, permissions);
+
+        QBENCHMARK {
+            RemotePermissions::fromServerString(permissions);
+        }
+    }
+
+    void benchNormalizeEtag_data()
+    {
+        QTest::addColumn<QByteArray>("etag");
+
+        QTest::newRow("quoted") << QByteArray("\"5a3ff2f4a3b1e\"");
+        QTest::newRow("weak gzip") << QByteArray("W/\"5a3ff2f4a3b1e-gzip\"");
+        QTest::newRow("plain") << QByteArray("5a3ff2f4a3b1e");
+    }
+
+    void benchNormalizeEtag()
+    {
+        QFETCH(QByteArray, etag);
+
+        QBENCHMARK {
+            Utility::normalizeEtag(etag);
+        }
+    }
+};
+
+QTEST_GUILESS_MAIN(BenchPrimitives)
+#include "benchprimitives.moc"
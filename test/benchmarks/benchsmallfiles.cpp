@@ -0,0 +1,74 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+/*
+ * Uploads many small files to a stand-in server that answers every upload
+ * after a fixed round trip time, once as HTTP/1.1 server and once as HTTP/2
+ * server. Both use the same _parallelNetworkJobs, so the difference is only
+ * that of SyncOptions::parallelSmallRequests().
+ *
+ * Usage: SmallFilesBench [-iterations <n>]
+ */
+
+static const int fileCount = 500;
+static const int roundTripMs = 20;
+
+class BenchSmallFiles : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void benchUpload_data()
+    {
+        QTest::addColumn<bool>("http2");
+
+        QTest::newRow("HTTP/1.1") << false;
+        QTest::newRow("HTTP/2") << true;
+    }
+
+    void benchUpload()
+    {
+        QFETCH(bool, http2);
+
+        FakeFolder fakeFolder{ FileInfo{} };
+        fakeFolder.account()->setHttp2Supported(http2);
+        auto options = fakeFolder.syncEngine().syncOptions();
+        options._parallelNetworkJobs = 6;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        int inFlight = 0;
+        int maxInFlight = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::PutOperation)
+                return nullptr;
+            auto reply = new DelayedReply<FakePutReply>(roundTripMs, fakeFolder.remoteModifier(), op, request, outgoingData->readAll(), this);
+            maxInFlight = qMax(maxInFlight, ++inFlight);
+            connect(reply, &QNetworkReply::finished, [&] { --inFlight; });
+            return reply;
+        });
+
+        int round = 0;
+        QBENCHMARK {
+            fakeFolder.localModifier().mkdir(QStringLiteral("round%1").arg(round));
+            for (int i = 0; i < fileCount; ++i)
+                fakeFolder.localModifier().insert(QStringLiteral("round%1/file%2").arg(round).arg(i), 100);
+            QVERIFY(fakeFolder.syncOnce());
+            ++round;
+        }
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        qInfo() << QTest::currentDataTag() << "uploads in flight:" << maxInFlight;
+    }
+};
+
+QTEST_GUILESS_MAIN(BenchSmallFiles)
+#include "benchsmallfiles.moc"
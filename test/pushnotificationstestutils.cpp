@@ -1,3 +1,5 @@
+#include <QJsonArray>
+#include <QJsonDocument>
 #include <QLoggingCategory>
 #include <QSignalSpy>
 #include <QTest>
@@ -80,6 +82,15 @@ void FakeWebSocketServer::close()
 void FakeWebSocketServer::processTextMessageInternal(const QString &message)
 {
     auto client = qobject_cast<QWebSocket *>(sender());
+
+    // Subscriptions are not part of the authentication handshake the tests
+    // look at, so keep them out of the text message list
+    const QString listenPrefix = QStringLiteral("listen ");
+    if (message.startsWith(listenPrefix)) {
+        _listenedEvents.append(message.mid(listenPrefix.size()));
+        return;
+    }
+
     emit processTextMessage(client, message);
 }
 
@@ -134,6 +145,20 @@ void FakeWebSocketServer::clearTextMessages()
     _processTextMessageSpy->clear();
 }
 
+QStringList FakeWebSocketServer::listenedEvents() const
+{
+    return _listenedEvents;
+}
+
+void FakeWebSocketServer::sendNotifyFileIds(QWebSocket *socket, const QVector<qint64> &fileIds)
+{
+    QJsonArray array;
+    for (const auto fileId : fileIds) {
+        array.append(fileId);
+    }
+    socket->sendTextMessage(QStringLiteral("notify_file_id ") + QString::fromUtf8(QJsonDocument(array).toJson(QJsonDocument::Compact)));
+}
+
 OCC::AccountPtr FakeWebSocketServer::createAccount(const QString &username, const QString &password)
 {
     auto account = OCC::Account::create();
@@ -46,6 +46,12 @@ public:
 
     void clearTextMessages();
 
+    /// Events the client subscribed to with "listen <event>" after authentication
+    QStringList listenedEvents() const;
+
+    /// Sends a notify_file_id message, like the server does for clients listening to it
+    static void sendNotifyFileIds(QWebSocket *socket, const QVector<qint64> &fileIds);
+
     static OCC::AccountPtr createAccount(const QString &username = "user", const QString &password = "password");
 
 signals:
@@ -60,6 +66,7 @@ private slots:
 private:
     QWebSocketServer *_webSocketServer;
     QList<QWebSocket *> _clients;
+    QStringList _listenedEvents;
 
     std::unique_ptr<QSignalSpy> _processTextMessageSpy;
 };
@@ -14,6 +14,7 @@
 #include "account.h"
 #include "accountstate.h"
 #include "configfile.h"
+#include "accessmanager.h"
 #include "testhelper.h"
 
 using namespace OCC;
@@ -28,6 +29,21 @@ private slots:
         AccountPtr account = Account::create();
         account->davPath();
     }
+
+    void testHttp2Enabled()
+    {
+        AccountPtr account = Account::create();
+        QCOMPARE(account->isHttp2Enabled(), AccessManager::isHttp2Allowed());
+
+        account->setHttp2Enabled(true);
+        account->setHttp2Supported(true);
+        QVERIFY(account->isHttp2Enabled());
+
+        // The syncs don't count on HTTP/2 once it's turned off
+        account->setHttp2Enabled(false);
+        QVERIFY(!account->isHttp2Enabled());
+        QVERIFY(!account->isHttp2Supported());
+    }
 };
 
 QTEST_APPLESS_MAIN(TestAccount)
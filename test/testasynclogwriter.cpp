@@ -0,0 +1,120 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "asynclogwriter.h"
+
+#include <mutex>
+#include <thread>
+
+using namespace OCC;
+
+class TestAsyncLogWriter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testOrderAcrossThreads()
+    {
+        std::mutex mutex;
+        QVector<QString> written;
+        {
+            AsyncLogWriter writer([&](const QVector<QString> &messages) {
+                std::lock_guard<std::mutex> lock(mutex);
+                written += messages;
+            });
+
+            std::vector<std::thread> threads;
+            for (int t = 0; t < 4; ++t) {
+                threads.emplace_back([&writer, t] {
+                    for (int i = 0; i < 1000; ++i)
+                        writer.post(QStringLiteral("%1 %2").arg(t).arg(i));
+                });
+            }
+            for (auto &thread : threads)
+                thread.join();
+            writer.sync();
+            QCOMPARE(writer.overflowedMessages(), quint64(0));
+        }
+        QCOMPARE(written.size(), 4000);
+
+        // Each thread's messages are in the order they were posted
+        QVector<int> last(4, -1);
+        for (const auto &message : qAsConst(written)) {
+            const auto parts = message.split(QLatin1Char(' '));
+            const int t = parts[0].toInt();
+            const int i = parts[1].toInt();
+            QVERIFY(i > last[t]);
+            last[t] = i;
+        }
+    }
+
+    void testTasksInOrder()
+    {
+        QVector<QString> written;
+        AsyncLogWriter writer([&](const QVector<QString> &messages) { written += messages; });
+
+        bool taskOnWriterThread = false;
+        writer.post(QStringLiteral("before"));
+        writer.runOnWriterThread([&] {
+            taskOnWriterThread = writer.isWriterThread();
+            written.append(QStringLiteral("task"));
+        });
+        writer.post(QStringLiteral("after"));
+        writer.sync();
+
+        QCOMPARE(written, QVector<QString>({ "before", "task", "after" }));
+        QVERIFY(taskOnWriterThread);
+        QVERIFY(!writer.isWriterThread());
+    }
+
+    void testOverflowWhenFull()
+    {
+        std::mutex blocker;
+        QVector<QString> written;
+        QSemaphore writing;
+        AsyncLogWriter writer([&](const QVector<QString> &messages) {
+            writing.release();
+            std::lock_guard<std::mutex> lock(blocker);
+            written += messages;
+        });
+
+        {
+            // Keep the writer thread busy while the ring fills up
+            std::unique_lock<std::mutex> lock(blocker);
+            writer.post(QStringLiteral("first"));
+            writing.acquire();
+            for (int i = 0; i < AsyncLogWriter::RingCapacity + 10; ++i)
+                writer.post(QString::number(i));
+            QCOMPARE(writer.overflowedMessages(), quint64(10));
+        }
+        writer.sync();
+
+        // Nothing is lost and the order is kept
+        QCOMPARE(written.size(), AsyncLogWriter::RingCapacity + 11);
+        QCOMPARE(written.first(), QStringLiteral("first"));
+        for (int i = 0; i < AsyncLogWriter::RingCapacity + 10; ++i)
+            QCOMPARE(written.at(i + 1), QString::number(i));
+    }
+
+    void testWaitWhenFull()
+    {
+        QVector<QString> written;
+        AsyncLogWriter writer([&](const QVector<QString> &messages) { written += messages; });
+
+        // The writer thread keeps up when it isn't blocked
+        for (int i = 0; i < 10 * AsyncLogWriter::RingCapacity; ++i)
+            writer.post(QString::number(i));
+        writer.sync();
+
+        QCOMPARE(written.size(), 10 * AsyncLogWriter::RingCapacity);
+        QCOMPARE(written.last(), QString::number(10 * AsyncLogWriter::RingCapacity - 1));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestAsyncLogWriter)
+#include "testasynclogwriter.moc"
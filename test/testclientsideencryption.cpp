@@ -247,6 +247,56 @@ private slots:
         QCOMPARE(generateHash(chunkedOutputDecrypted.readAll()), originalFileHash);
         chunkedOutputDecrypted.close();
     }
+
+    void testStreamingEncryptor_data()
+    {
+        QTest::addColumn<int>("totalBytes");
+        QTest::addColumn<int>("bytesToRead");
+
+        QTest::newRow("empty") << 0 << 16;
+        QTest::newRow("data1") << 64 << 2;
+        QTest::newRow("data2") << 76 << 64;
+        QTest::newRow("data3") << 5000 << 1000;
+    }
+
+    void testStreamingEncryptor()
+    {
+        QFETCH(int, totalBytes);
+        QFETCH(int, bytesToRead);
+
+        QTemporaryFile dummyInputFile;
+        QVERIFY(dummyInputFile.open());
+        QCOMPARE(dummyInputFile.write(EncryptionHelper::generateRandom(totalBytes)), qint64(totalBytes));
+        dummyInputFile.close();
+
+        const auto encryptionKey = EncryptionHelper::generateRandom(16);
+        const auto initializationVector = EncryptionHelper::generateRandom(16);
+
+        QTemporaryFile dummyEncryptionOutputFile;
+        QByteArray tag;
+        QVERIFY(EncryptionHelper::fileEncryption(encryptionKey, initializationVector, &dummyInputFile, &dummyEncryptionOutputFile, tag));
+        QVERIFY(dummyEncryptionOutputFile.open());
+        const auto encrypted = dummyEncryptionOutputFile.readAll();
+
+        EncryptionHelper::StreamingEncryptor streamingEncryptor(dummyInputFile.fileName(), encryptionKey, initializationVector);
+        QCOMPARE(streamingEncryptor.size(), qint64(encrypted.size()));
+        QVERIFY(streamingEncryptor.open(QIODevice::ReadOnly));
+
+        QByteArray streamed;
+        while (!streamingEncryptor.atEnd()) {
+            const auto chunk = streamingEncryptor.read(bytesToRead);
+            QVERIFY(!chunk.isEmpty());
+            streamed += chunk;
+        }
+        QCOMPARE(streamed, encrypted);
+        QCOMPARE(streamingEncryptor.tag(), tag);
+
+        // Resending a chunk needs going back
+        const auto middle = encrypted.size() / 2;
+        QVERIFY(streamingEncryptor.seek(middle));
+        QCOMPARE(streamingEncryptor.readAll(), encrypted.mid(middle));
+        QCOMPARE(streamingEncryptor.tag(), tag);
+    }
 };
 
 QTEST_APPLESS_MAIN(TestClientSideEncryption)
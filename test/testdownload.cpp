@@ -9,6 +9,8 @@
 #include "syncenginetestutils.h"
 #include <syncengine.h>
 #include <owncloudpropagator.h>
+#include <propagatedownload.h>
+#include <clientsideencryption.h>
 
 using namespace OCC;
 
@@ -39,6 +41,70 @@ public:
     }
 };
 
+/* A GET reply that makes its payload available in pieces of the given sizes,
+ * one readyRead per piece. The ContentLength is given separately so that the
+ * payload can be cut short. */
+class ChunkedFakeGetReply : public FakeReply
+{
+    Q_OBJECT
+public:
+    QByteArray payload;
+    qint64 contentLength;
+    QVector<int> chunkSizes;
+    int available = 0;
+    int offset = 0;
+
+    ChunkedFakeGetReply(const QByteArray &payload, qint64 contentLength, const QVector<int> &chunkSizes,
+        QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+        : FakeReply(parent)
+        , payload(payload)
+        , contentLength(contentLength)
+        , chunkSizes(chunkSizes)
+    {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+    }
+
+    Q_INVOKABLE void respond()
+    {
+        setHeader(QNetworkRequest::ContentLengthHeader, contentLength);
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        setRawHeader("ETag", "\"etag\"");
+        emit metaDataChanged();
+        QMetaObject::invokeMethod(this, "sendChunk", Qt::QueuedConnection);
+    }
+
+    Q_INVOKABLE void sendChunk()
+    {
+        if (!chunkSizes.isEmpty() && available < payload.size()) {
+            available = qMin(available + chunkSizes.takeFirst(), payload.size());
+            emit readyRead();
+            QMetaObject::invokeMethod(this, "sendChunk", Qt::QueuedConnection);
+            return;
+        }
+        setFinished(true);
+        emit finished();
+    }
+
+    void abort() override {}
+
+    qint64 bytesAvailable() const override
+    {
+        return available - offset + QIODevice::bytesAvailable();
+    }
+
+    qint64 readData(char *data, qint64 maxlen) override
+    {
+        const auto len = qMin(qint64(available - offset), maxlen);
+        std::copy_n(payload.constData() + offset, len, data);
+        offset += len;
+        return len;
+    }
+};
+
 
 SyncFileItemPtr getItem(const QSignalSpy &spy, const QString &path)
 {
@@ -242,6 +308,78 @@ private slots:
         QCOMPARE(getItem(completeSpy, "A/resendme")->_status, SyncFileItem::NormalError);
         QVERIFY(getItem(completeSpy, "A/resendme")->_errorString.contains(serverMessage));
     }
+
+    void testEncryptedChunks_data()
+    {
+        QTest::addColumn<QVector<int>>("chunkSizes");
+        QTest::addColumn<int>("truncateBy");
+
+        // The file has 1000 bytes, followed by the 16 bytes of the e2EeTag
+        QTest::newRow("whole") << QVector<int>{ 1016 } << 0;
+        QTest::newRow("tag with the last bytes") << QVector<int>{ 3, 333, 680 } << 0;
+        QTest::newRow("tag alone") << QVector<int>{ 1, 999, 16 } << 0;
+        QTest::newRow("tag split") << QVector<int>{ 1, 999, 7, 9 } << 0;
+        QTest::newRow("tag split with the last bytes") << QVector<int>{ 501, 504, 11 } << 0;
+        QTest::newRow("tag byte by byte") << (QVector<int>{ 1000 } + QVector<int>(16, 1)) << 0;
+        QTest::newRow("truncated in the tag") << QVector<int>{ 500, 510 } << 6;
+        QTest::newRow("truncated before the tag") << QVector<int>{ 333, 333, 333 } << 17;
+    }
+
+    void testEncryptedChunks()
+    {
+        QFETCH(QVector<int>, chunkSizes);
+        QFETCH(int, truncateBy);
+
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const auto plainData = EncryptionHelper::generateRandom(1000);
+        QFile plain(dir.filePath("plain"));
+        QVERIFY(plain.open(QIODevice::WriteOnly));
+        plain.write(plainData);
+        plain.close();
+        EncryptedFile encryptedInfo;
+        encryptedInfo.encryptionKey = EncryptionHelper::generateRandom(16);
+        encryptedInfo.initializationVector = EncryptionHelper::generateRandom(16);
+        QFile encrypted(dir.filePath("encrypted"));
+        QVERIFY(EncryptionHelper::fileEncryption(encryptedInfo.encryptionKey, encryptedInfo.initializationVector,
+            &plain, &encrypted, encryptedInfo.authenticationTag));
+        QVERIFY(encrypted.open(QIODevice::ReadOnly));
+        const auto encryptedData = encrypted.readAll();
+        QCOMPARE(encryptedData.size(), 1016);
+
+        FakeFolder fakeFolder{ FileInfo{} };
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::GetOperation)
+                return nullptr;
+            return new ChunkedFakeGetReply(encryptedData.left(encryptedData.size() - truncateBy), encryptedData.size(),
+                chunkSizes, op, request, this);
+        });
+
+        QBuffer output;
+        QVERIFY(output.open(QIODevice::WriteOnly));
+        auto job = new GETEncryptedFileJob(fakeFolder.account(), QStringLiteral("encrypted"), &output, {}, {}, 0, encryptedInfo);
+        QNetworkReply::NetworkError replyError = QNetworkReply::UnknownNetworkError;
+        bool decryptionFinished = false;
+        connect(job, &GETFileJob::finishedSignal, this, [&] {
+            replyError = job->reply()->error();
+            decryptionFinished = job->isDecryptionFinished();
+        });
+        QSignalSpy finishedSpy(job, &GETFileJob::finishedSignal);
+        job->start();
+        QVERIFY(finishedSpy.wait());
+        QCOMPARE(replyError, QNetworkReply::NoError);
+
+        if (truncateBy == 0) {
+            QVERIFY(decryptionFinished);
+            QCOMPARE(output.data(), plainData);
+        } else {
+            // Only what was received is decrypted, and there is no complete
+            // tag to verify: PropagateDownloadFile fails the download then
+            QVERIFY(!decryptionFinished);
+            QVERIFY(plainData.startsWith(output.data()));
+            QVERIFY(output.data().size() <= qMin(1000, 1016 - truncateBy));
+        }
+    }
 };
 
 QTEST_GUILESS_MAIN(TestDownload)
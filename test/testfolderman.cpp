@@ -208,6 +208,167 @@ private slots:
         QCOMPARE(folderman->findGoodPathForNewSyncFolder(dirPath + "/ownCloud2", url),
             QString(dirPath + "/ownCloud22"));
     }
+
+    void testFileIdsPushNotificationSchedulesRemoteDiscovery()
+    {
+        QTemporaryDir dir;
+        ConfigFile::setConfDir(dir.path()); // we don't want to pollute the user's config file
+        QVERIFY(dir.isValid());
+        QDir dir2(dir.path());
+        QVERIFY(dir2.mkpath("push"));
+        QString dirPath = dir2.canonicalPath();
+
+        AccountPtr account = Account::create();
+        account->setCredentials(new HttpCredentialsTest("testuser", "secret"));
+        account->setUrl(QUrl("http://example.de"));
+        AccountStatePtr newAccountState(new AccountState(account));
+        auto folder = _fm.addFolder(newAccountState.data(), folderDefinition(dirPath + "/push"));
+        QVERIFY(folder);
+
+        auto makeEntry = [&](const QByteArray &path, ItemType type, const QByteArray &fileId) {
+            SyncJournalFileRecord record;
+            record._path = path;
+            record._type = type;
+            record._etag = "etag";
+            record._fileId = fileId;
+            record._remotePerm = RemotePermissions::fromDbValue("RW");
+            QVERIFY(folder->journalDb()->setFileRecord(record));
+        };
+        auto etagOf = [&](const QByteArray &path) {
+            SyncJournalFileRecord record;
+            folder->journalDb()->getFileRecord(path, &record);
+            return record._etag;
+        };
+        makeEntry("A", ItemTypeDirectory, "00000001ocid");
+        makeEntry("A/sub", ItemTypeDirectory, "00000002ocid");
+        makeEntry("A/sub/file", ItemTypeFile, "00000003ocid");
+        makeEntry("B", ItemTypeDirectory, "00000004ocid");
+        makeEntry("C", ItemTypeDirectory, "00000005ocid");
+
+        // A changed file schedules its parent directories, a changed directory itself
+        _fm.slotProcessFileIdsPushNotification(account.data(), { 3, 5 });
+        QCOMPARE(etagOf("A"), QByteArray("_invalid_"));
+        QCOMPARE(etagOf("A/sub"), QByteArray("_invalid_"));
+        QCOMPARE(etagOf("A/sub/file"), QByteArray("etag"));
+        QCOMPARE(etagOf("B"), QByteArray("etag"));
+        QCOMPARE(etagOf("C"), QByteArray("_invalid_"));
+
+        _fm.removeFolder(folder);
+    }
+
+    void testSyncSchedulingScore()
+    {
+        using namespace std::chrono;
+        const auto noLocalChange = milliseconds::max();
+
+        // A folder that synced quickly goes before one that took long
+        QVERIFY(FolderMan::syncSchedulingScore(seconds(5), minutes(1), noLocalChange)
+            < FolderMan::syncSchedulingScore(minutes(20), minutes(1), noLocalChange));
+
+        // Waiting makes up for a long last sync
+        QVERIFY(FolderMan::syncSchedulingScore(minutes(20), hours(1), noLocalChange)
+            < FolderMan::syncSchedulingScore(seconds(5), minutes(1), noLocalChange));
+
+        // A recent local change boosts the folder, the more recent the more
+        const auto changedNow = FolderMan::syncSchedulingScore(minutes(5), minutes(1), seconds(1));
+        const auto changedEarlier = FolderMan::syncSchedulingScore(minutes(5), minutes(1), minutes(8));
+        const auto unchanged = FolderMan::syncSchedulingScore(minutes(5), minutes(1), noLocalChange);
+        QVERIFY(changedNow < changedEarlier);
+        QVERIFY(changedEarlier < unchanged);
+
+        // Old local changes don't matter anymore
+        QCOMPARE(FolderMan::syncSchedulingScore(minutes(5), minutes(1), hours(1)), unchanged);
+    }
+
+    void testNextFolderToSync()
+    {
+        using namespace std::chrono;
+        QTemporaryDir dir;
+        ConfigFile::setConfDir(dir.path()); // we don't want to pollute the user's config file
+        QVERIFY(dir.isValid());
+        QDir dir2(dir.path());
+        QVERIFY(dir2.mkpath("small"));
+        QVERIFY(dir2.mkpath("big"));
+        QVERIFY(dir2.mkpath("changed"));
+        QString dirPath = dir2.canonicalPath();
+
+        AccountPtr account = Account::create();
+        account->setCredentials(new HttpCredentialsTest("testuser", "secret"));
+        account->setUrl(QUrl("http://example.de"));
+        AccountStatePtr newAccountState(new AccountState(account));
+        auto small = _fm.addFolder(newAccountState.data(), folderDefinition(dirPath + "/small"));
+        auto big = _fm.addFolder(newAccountState.data(), folderDefinition(dirPath + "/big"));
+        auto changed = _fm.addFolder(newAccountState.data(), folderDefinition(dirPath + "/changed"));
+        QVERIFY(small && big && changed);
+        small->_lastSyncDuration = seconds(5);
+        big->_lastSyncDuration = minutes(20);
+        changed->_lastSyncDuration = minutes(8);
+
+        // Nothing scheduled
+        QVERIFY(!_fm.nextFolderToSync());
+
+        // The quick folder goes first, whatever the queue order
+        _fm._scheduledFolders.append(big);
+        _fm._scheduledFolders.append(changed);
+        _fm._scheduledFolders.append(small);
+        QCOMPARE(_fm.nextFolderToSync(), small);
+
+        // A local change the user waits for beats the quick folder
+        changed->_timeSinceLastLocalChange.start();
+        QCOMPARE(_fm.nextFolderToSync(), changed);
+
+        // Running folders are skipped
+        _fm._currentSyncFolders = { changed };
+        QCOMPARE(_fm.nextFolderToSync(), small);
+        _fm._currentSyncFolders.clear();
+
+        // A folder scheduled to go next overrides the priorities
+        _fm._nextSyncFolder = big;
+        QCOMPARE(_fm.nextFolderToSync(), big);
+        _fm._nextSyncFolder = nullptr;
+
+        _fm._scheduledFolders.clear();
+        _fm.removeFolder(small);
+        _fm.removeFolder(big);
+        _fm.removeFolder(changed);
+    }
+
+    void testSyncPreemptionDue()
+    {
+        using namespace std::chrono;
+        const auto timeout = minutes(5);
+
+        // Discovery doesn't count: a sync that is still discovering hasn't propagated yet
+        QVERIFY(!FolderMan::isSyncPreemptionDue(milliseconds(0), 0, timeout));
+        QVERIFY(!FolderMan::isSyncPreemptionDue(minutes(4), 0, timeout));
+        QVERIFY(FolderMan::isSyncPreemptionDue(minutes(5), 0, timeout));
+        QVERIFY(FolderMan::isSyncPreemptionDue(minutes(30), 1, timeout));
+
+        // A folder isn't preempted over and over again
+        QVERIFY(!FolderMan::isSyncPreemptionDue(minutes(30), FolderMan::maxConsecutiveSyncPreemptions(), timeout));
+
+        // Disabled
+        QVERIFY(!FolderMan::isSyncPreemptionDue(hours(1), 0, milliseconds(0)));
+    }
+
+    void testConnectionWarmUpDelay()
+    {
+        using namespace std::chrono;
+        const auto lead = FolderMan::connectionWarmUpLead();
+        QVERIFY(lead > milliseconds(0));
+
+        // The connections are opened ahead of the next scheduled sync, but not long before
+        const milliseconds syncDelays[] = { lead + milliseconds(1), seconds(12), minutes(1) };
+        for (const auto syncDelay : syncDelays) {
+            const auto warmUpDelay = FolderMan::connectionWarmUpDelay(syncDelay);
+            QVERIFY(warmUpDelay < syncDelay);
+            QCOMPARE(warmUpDelay, syncDelay - lead);
+        }
+
+        // A sync that starts soon gets its connections right away
+        QCOMPARE(FolderMan::connectionWarmUpDelay(milliseconds(100)), milliseconds(0));
+        QCOMPARE(FolderMan::connectionWarmUpDelay(lead), milliseconds(0));
+    }
 };
 
 QTEST_APPLESS_MAIN(TestFolderMan)
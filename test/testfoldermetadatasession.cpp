@@ -0,0 +1,370 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include "foldermetadatasession.h"
+#include "clientsideencryption.h"
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+
+using namespace OCC;
+
+/* Answers the end-to-end encryption API for one folder, with a lock, metadata and counters */
+class FakeE2eeServer
+{
+public:
+    int lockErrors = 0; // number of lock requests answered with "423 Locked"
+    int metadataError = 0; // answer to storing or updating the metadata, 0 for success
+    bool hasMetadata = true; // otherwise the metadata is not found and has to be stored
+    QByteArray metadata;
+
+    int lockCount = 0;
+    int unlockCount = 0;
+    int storeCount = 0;
+    int updateCount = 0;
+    QByteArray lastUpdateToken;
+    bool locked = false;
+
+    QNetworkReply *reply(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    {
+        const auto path = request.url().path();
+        if (!path.contains(QLatin1String("/end_to_end_encryption/api/v1/")))
+            return nullptr;
+
+        if (path.endsWith(QLatin1String("/lock/a-id")) && op == QNetworkAccessManager::PostOperation) {
+            ++lockCount;
+            if (lockErrors > 0 || locked) {
+                lockErrors = qMax(0, lockErrors - 1);
+                return new FakeErrorReply(op, request, parent, 423);
+            }
+            locked = true;
+            const auto token = QByteArray("token") + QByteArray::number(lockCount);
+            return new FakePayloadReply(op, request, "{\"ocs\":{\"data\":{\"e2e-token\":\"" + token + "\"}}}", parent);
+        }
+        if (path.endsWith(QLatin1String("/lock/a-id")) && op == QNetworkAccessManager::DeleteOperation) {
+            ++unlockCount;
+            locked = false;
+            return new FakePayloadReply(op, request, "{}", parent);
+        }
+        if (path.endsWith(QLatin1String("/meta-data/a-id")) && op == QNetworkAccessManager::GetOperation) {
+            if (!hasMetadata)
+                return new FakeErrorReply(op, request, parent, 404);
+            const QJsonObject json{ { "ocs", QJsonObject{ { "data", QJsonObject{ { "meta-data", QString::fromUtf8(metadata) } } } } } };
+            return new FakePayloadReply(op, request, QJsonDocument(json).toJson(), parent);
+        }
+        if (path.endsWith(QLatin1String("/meta-data/a-id"))
+            && (op == QNetworkAccessManager::PostOperation || op == QNetworkAccessManager::PutOperation)) {
+            if (op == QNetworkAccessManager::PostOperation) {
+                ++storeCount;
+            } else {
+                ++updateCount;
+                lastUpdateToken = QUrlQuery(request.url()).queryItemValue(QStringLiteral("e2e-token")).toUtf8();
+            }
+            if (metadataError)
+                return new FakeErrorReply(op, request, parent, metadataError);
+            hasMetadata = true;
+            return new FakePayloadReply(op, request, "{}", parent);
+        }
+        return nullptr;
+    }
+};
+
+class TestFolderMetadataSession : public QObject
+{
+    Q_OBJECT
+
+    QByteArray _privateKey;
+    QSslKey _publicKey;
+
+    void setupFolder(FakeFolder &fakeFolder, FakeE2eeServer &server)
+    {
+        auto e2e = fakeFolder.account()->e2e();
+        e2e->_privateKey = _privateKey;
+        e2e->_publicKey = _publicKey;
+        server.metadata = FolderMetadata(fakeFolder.account()).encryptedMetadata();
+
+        fakeFolder.remoteModifier().find("A")->extraDavProperties = "<oc:fileid>a-id</oc:fileid>";
+        fakeFolder.setServerOverride([this, &server](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) {
+            return server.reply(op, request, this);
+        });
+    }
+
+    static bool hasRecord(FakeFolder &fakeFolder, const QString &path)
+    {
+        SyncJournalFileRecord record;
+        return fakeFolder.syncJournal().getFileRecord(path, &record) && record.isValid();
+    }
+
+private slots:
+    void initTestCase()
+    {
+        // The metadata keys are encrypted for the account's key pair
+        auto ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+        QVERIFY(EVP_PKEY_keygen_init(ctx) > 0);
+        QVERIFY(EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048) > 0);
+        EVP_PKEY *keyPair = nullptr;
+        QVERIFY(EVP_PKEY_keygen(ctx, &keyPair) > 0);
+        EVP_PKEY_CTX_free(ctx);
+
+        auto pem = [](EVP_PKEY *key, bool privateKey) {
+            auto bio = BIO_new(BIO_s_mem());
+            if (privateKey) {
+                PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+            } else {
+                PEM_write_bio_PUBKEY(bio, key);
+            }
+            char *data = nullptr;
+            const auto size = BIO_get_mem_data(bio, &data);
+            QByteArray result(data, static_cast<int>(size));
+            BIO_free(bio);
+            return result;
+        };
+        _privateKey = pem(keyPair, true);
+        _publicKey = QSslKey(pem(keyPair, false), QSsl::Rsa, QSsl::Pem, QSsl::PublicKey);
+        EVP_PKEY_free(keyPair);
+        QVERIFY(!_publicKey.isNull());
+
+        FolderMetadataSession::lockRetryInterval = std::chrono::milliseconds(10);
+    }
+
+    void init()
+    {
+        FolderMetadataSession::maxItemsPerLock = 100;
+        FolderMetadataSession::maxLockDuration = std::chrono::minutes(5);
+    }
+
+    void testLockRetry()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        FakeE2eeServer server;
+        setupFolder(fakeFolder, server);
+        server.lockErrors = 2;
+
+        auto session = new FolderMetadataSession(fakeFolder.account(), &fakeFolder.syncJournal(), "A", "A");
+        QSignalSpy committedSpy(session, &FolderMetadataSession::committed);
+        QObject item;
+        bool ready = false;
+        session->open(&item, [&] { ready = true; }, [] { QFAIL("opening failed"); });
+        QTRY_VERIFY(ready);
+        QCOMPARE(server.lockCount, 3);
+        QVERIFY(session->isOpen());
+        QCOMPARE(session->folderId(), QByteArray("a-id"));
+        QCOMPARE(session->folderToken(), QByteArray("token3"));
+
+        // Nothing changed: only unlocked
+        session->commit();
+        QTRY_COMPARE(committedSpy.count(), 1);
+        QCOMPARE(committedSpy.first().first().toBool(), true);
+        QCOMPARE(server.unlockCount, 1);
+        QCOMPARE(server.updateCount + server.storeCount, 0);
+    }
+
+    void testCommit()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        QVERIFY(fakeFolder.syncOnce());
+        FakeE2eeServer server;
+        setupFolder(fakeFolder, server);
+
+        auto session = new FolderMetadataSession(fakeFolder.account(), &fakeFolder.syncJournal(), "A", "A");
+        QSignalSpy committedSpy(session, &FolderMetadataSession::committed);
+        QObject item1;
+        QObject item2;
+        int ready = 0;
+        session->open(&item1, [&] { ++ready; }, [] { QFAIL("opening failed"); });
+        session->open(&item2, [&] { ++ready; }, [] { QFAIL("opening failed"); });
+        QTRY_COMPARE(ready, 2);
+
+        // Both items share one lock and one metadata update
+        session->setChanged("A/a1");
+        session->setChanged("A/a2");
+        session->commit();
+        QTRY_COMPARE(committedSpy.count(), 1);
+        QCOMPARE(committedSpy.first().first().toBool(), true);
+        QCOMPARE(server.lockCount, 1);
+        QCOMPARE(server.updateCount, 1);
+        QCOMPARE(server.storeCount, 0);
+        QCOMPARE(server.lastUpdateToken, QByteArray("token1"));
+        QCOMPARE(server.unlockCount, 1);
+        QVERIFY(hasRecord(fakeFolder, "A/a1"));
+        QVERIFY(hasRecord(fakeFolder, "A/a2"));
+    }
+
+    void testStoreNewMetadata()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        FakeE2eeServer server;
+        setupFolder(fakeFolder, server);
+        server.hasMetadata = false;
+
+        auto session = new FolderMetadataSession(fakeFolder.account(), &fakeFolder.syncJournal(), "A", "A");
+        QSignalSpy committedSpy(session, &FolderMetadataSession::committed);
+        QObject item;
+        bool ready = false;
+        session->open(&item, [&] { ready = true; }, [] { QFAIL("opening failed"); });
+        QTRY_VERIFY(ready);
+
+        session->setChanged("A/a1");
+        session->commit();
+        QTRY_COMPARE(committedSpy.count(), 1);
+        QCOMPARE(committedSpy.first().first().toBool(), true);
+        QCOMPARE(server.storeCount, 1);
+        QCOMPARE(server.updateCount, 0);
+        QCOMPARE(server.unlockCount, 1);
+    }
+
+    void testCommitFailure()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        QVERIFY(fakeFolder.syncOnce());
+        FakeE2eeServer server;
+        setupFolder(fakeFolder, server);
+        server.metadataError = 500;
+
+        auto session = new FolderMetadataSession(fakeFolder.account(), &fakeFolder.syncJournal(), "A", "A");
+        QSignalSpy committedSpy(session, &FolderMetadataSession::committed);
+        QObject item;
+        bool ready = false;
+        session->open(&item, [&] { ready = true; }, [] { QFAIL("opening failed"); });
+        QTRY_VERIFY(ready);
+
+        session->setChanged("A/a1");
+        session->commit();
+        QTRY_COMPARE(committedSpy.count(), 1);
+        QCOMPARE(committedSpy.first().first().toBool(), false);
+        QCOMPARE(server.updateCount, 1);
+
+        // Still unlocked, the changed item is propagated again by the next sync
+        QCOMPARE(server.unlockCount, 1);
+        QVERIFY(!server.locked);
+        QVERIFY(!hasRecord(fakeFolder, "A/a1"));
+        QVERIFY(hasRecord(fakeFolder, "A/a2"));
+    }
+
+    void testAbortUnlocks()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        FakeE2eeServer server;
+        setupFolder(fakeFolder, server);
+
+        // Aborted while locking: unlocked as soon as the lock is known
+        auto session = new FolderMetadataSession(fakeFolder.account(), &fakeFolder.syncJournal(), "A", "A");
+        QSignalSpy committedSpy(session, &FolderMetadataSession::committed);
+        QObject item;
+        session->open(&item, [] {}, [] {});
+        session->commit();
+        QTRY_COMPARE(committedSpy.count(), 1);
+        QCOMPARE(server.lockCount, 1);
+        QCOMPARE(server.unlockCount, 1);
+        QVERIFY(!server.locked);
+
+        // Aborted while an item uses the lock: the changes so far are sent and the folder unlocked
+        session = new FolderMetadataSession(fakeFolder.account(), &fakeFolder.syncJournal(), "A", "A");
+        QSignalSpy committedSpy2(session, &FolderMetadataSession::committed);
+        bool ready = false;
+        session->open(&item, [&] { ready = true; }, [] { QFAIL("opening failed"); });
+        QTRY_VERIFY(ready);
+        session->setChanged("A/a1");
+        session->commit();
+        QTRY_COMPARE(committedSpy2.count(), 1);
+        QCOMPARE(server.updateCount, 1);
+        QCOMPARE(server.unlockCount, 2);
+        QVERIFY(!server.locked);
+    }
+
+    void testLockAgainAfterMaxItems()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.remoteModifier().insert("A/a3");
+        QVERIFY(fakeFolder.syncOnce());
+        FakeE2eeServer server;
+        setupFolder(fakeFolder, server);
+        FolderMetadataSession::maxItemsPerLock = 2;
+
+        auto session = new FolderMetadataSession(fakeFolder.account(), &fakeFolder.syncJournal(), "A", "A");
+        QSignalSpy committedSpy(session, &FolderMetadataSession::committed);
+        auto item1 = new QObject;
+        auto item2 = new QObject;
+        QObject item3;
+        int ready = 0;
+        bool item3Ready = false;
+        session->open(item1, [&] { ++ready; }, [] { QFAIL("opening failed"); });
+        session->open(item2, [&] { ++ready; }, [] { QFAIL("opening failed"); });
+        session->open(&item3, [&] { item3Ready = true; }, [] { QFAIL("opening failed"); });
+        QTRY_COMPARE(ready, 2);
+        session->setChanged("A/a1");
+        session->setChanged("A/a2");
+
+        // The third item waits until the others are done with the lock
+        QTest::qWait(50);
+        QVERIFY(!item3Ready);
+        delete item1;
+        QTest::qWait(50);
+        QVERIFY(!item3Ready);
+        QCOMPARE(server.updateCount, 0);
+        delete item2;
+
+        // Their changes are sent and the folder locked again for it
+        QTRY_VERIFY(item3Ready);
+        QCOMPARE(server.updateCount, 1);
+        QCOMPARE(server.unlockCount, 1);
+        QCOMPARE(server.lockCount, 2);
+        QCOMPARE(session->folderToken(), QByteArray("token2"));
+        QCOMPARE(committedSpy.count(), 0);
+
+        // A failure only concerns the items changed since
+        server.metadataError = 500;
+        session->setChanged("A/a3");
+        session->commit();
+        QTRY_COMPARE(committedSpy.count(), 1);
+        QCOMPARE(committedSpy.first().first().toBool(), false);
+        QCOMPARE(server.updateCount, 2);
+        QCOMPARE(server.unlockCount, 2);
+        QVERIFY(hasRecord(fakeFolder, "A/a1"));
+        QVERIFY(hasRecord(fakeFolder, "A/a2"));
+        QVERIFY(!hasRecord(fakeFolder, "A/a3"));
+    }
+
+    void testLockAgainAfterMaxDuration()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        FakeE2eeServer server;
+        setupFolder(fakeFolder, server);
+        FolderMetadataSession::maxLockDuration = std::chrono::milliseconds(100);
+
+        auto session = new FolderMetadataSession(fakeFolder.account(), &fakeFolder.syncJournal(), "A", "A");
+        QSignalSpy committedSpy(session, &FolderMetadataSession::committed);
+        auto item1 = new QObject;
+        QObject item2;
+        bool ready = false;
+        session->open(item1, [&] { ready = true; }, [] { QFAIL("opening failed"); });
+        QTRY_VERIFY(ready);
+
+        // Items that come late don't extend the lock
+        QTest::qWait(150);
+        ready = false;
+        session->open(&item2, [&] { ready = true; }, [] { QFAIL("opening failed"); });
+        QTest::qWait(50);
+        QVERIFY(!ready);
+        delete item1;
+        QTRY_VERIFY(ready);
+        QCOMPARE(server.lockCount, 2);
+        QCOMPARE(server.unlockCount, 1);
+
+        session->commit();
+        QTRY_COMPARE(committedSpy.count(), 1);
+        QCOMPARE(committedSpy.first().first().toBool(), true);
+        QCOMPARE(server.unlockCount, 2);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestFolderMetadataSession)
+#include "testfoldermetadatasession.moc"
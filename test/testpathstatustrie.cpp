@@ -0,0 +1,104 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "pathstatustrie.h"
+
+using namespace OCC;
+
+class TestPathStatusTrie : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testInsertAndFind()
+    {
+        PathStatusTrie trie;
+        QCOMPARE(trie.find(QString()), PathStatusTrie::RootNode);
+        QCOMPARE(trie.find("A/a1"), PathStatusTrie::InvalidNode);
+
+        const auto a1 = trie.findOrInsert("A/a1");
+        const auto a2 = trie.findOrInsert("A/a2");
+        QVERIFY(a1 != a2);
+        QCOMPARE(trie.find("A/a1"), a1);
+        QCOMPARE(trie.findOrInsert("A/a1"), a1);
+        QCOMPARE(trie.parent(a1), trie.find("A"));
+        QCOMPARE(trie.parent(a1), trie.parent(a2));
+        QCOMPARE(trie.parent(trie.find("A")), PathStatusTrie::RootNode);
+        QCOMPARE(trie.path(a2), QStringLiteral("A/a2"));
+        QCOMPARE(trie.path(PathStatusTrie::RootNode), QString());
+        // The root and "A" are shared
+        QCOMPARE(trie.nodeCount(), 4);
+
+#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
+        QCOMPARE(trie.find("a/A1"), a1);
+#else
+        QCOMPARE(trie.find("a/A1"), PathStatusTrie::InvalidNode);
+#endif
+    }
+
+    void testProblemStatus()
+    {
+        PathStatusTrie trie;
+        const auto error = trie.findOrInsert("A/B/error");
+        const auto excluded = trie.findOrInsert("A/excluded");
+        trie.setProblem(error, SyncFileStatus::StatusError);
+        trie.setProblem(excluded, SyncFileStatus::StatusExcluded);
+
+        QCOMPARE(trie.problemStatus(error), SyncFileStatus::StatusError);
+        QCOMPARE(trie.problemStatus(excluded), SyncFileStatus::StatusExcluded);
+        // Errors show up as warnings on all parents
+        QCOMPARE(trie.problemStatus(trie.find("A/B")), SyncFileStatus::StatusWarning);
+        QCOMPARE(trie.problemStatus(trie.find("A")), SyncFileStatus::StatusWarning);
+        QCOMPARE(trie.problemStatus(PathStatusTrie::RootNode), SyncFileStatus::StatusWarning);
+
+        // The problem of the path itself wins
+        trie.setProblem(trie.find("A"), SyncFileStatus::StatusExcluded);
+        QCOMPARE(trie.problemStatus(trie.find("A")), SyncFileStatus::StatusExcluded);
+        trie.setProblem(trie.find("A"), SyncFileStatus::StatusNone);
+
+        trie.setProblem(error, SyncFileStatus::StatusNone);
+        QCOMPARE(trie.problemStatus(trie.find("A/B")), SyncFileStatus::StatusNone);
+        QCOMPARE(trie.problemStatus(PathStatusTrie::RootNode), SyncFileStatus::StatusNone);
+        QCOMPARE(trie.node(PathStatusTrie::RootNode).errorDescendants, 0);
+    }
+
+    void testPrune()
+    {
+        PathStatusTrie trie;
+        const auto file = trie.findOrInsert("A/B/file");
+        const auto other = trie.findOrInsert("A/other");
+        const QVector<PathStatusTrie::NodeId> ids = { file, other, trie.find("A"), trie.find("A/B") };
+        trie.setDirty(file, true);
+        trie.addSyncCount(other, 1);
+
+        // Nodes with state stay
+        trie.prune(file);
+        QCOMPARE(trie.find("A/B/file"), file);
+
+        // Unused nodes go away with their unused parents
+        trie.setDirty(file, false);
+        trie.prune(file);
+        QCOMPARE(trie.find("A/B/file"), PathStatusTrie::InvalidNode);
+        QCOMPARE(trie.find("A/B"), PathStatusTrie::InvalidNode);
+        QVERIFY(trie.find("A") != PathStatusTrie::InvalidNode);
+        QCOMPARE(trie.nodeCount(), 3);
+
+        trie.addSyncCount(other, -1);
+        trie.prune(other);
+        QCOMPARE(trie.nodeCount(), 1);
+        QVERIFY(trie.nodes([](const PathStatusTrie::Node &) { return true; }) == QVector<PathStatusTrie::NodeId>{ PathStatusTrie::RootNode });
+
+        // Freed nodes get reused
+        const auto reused = trie.findOrInsert("C");
+        QVERIFY(ids.contains(reused));
+        QCOMPARE(trie.path(reused), QStringLiteral("C"));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestPathStatusTrie)
+#include "testpathstatustrie.moc"
@@ -115,6 +115,52 @@ private slots:
         QVERIFY(verifyCalledOnceWithAccount(filesChangedSpy, account));
     }
 
+    void testSetup_authenticated_listenToFileIds()
+    {
+        FakeWebSocketServer fakeServer;
+        auto account = FakeWebSocketServer::createAccount();
+        QVERIFY(fakeServer.authenticateAccount(account));
+
+        QTRY_VERIFY(fakeServer.listenedEvents().contains("notify_file_id"));
+    }
+
+    void testOnWebSocketTextMessageReceived_notifyFileIdMessage_emitFileIdsChanged()
+    {
+        FakeWebSocketServer fakeServer;
+        auto account = FakeWebSocketServer::createAccount();
+        const auto socket = fakeServer.authenticateAccount(account);
+        QVERIFY(socket);
+        QSignalSpy filesChangedSpy(account->pushNotifications(), &OCC::PushNotifications::filesChanged);
+        QSignalSpy fileIdsChangedSpy(account->pushNotifications(), &OCC::PushNotifications::fileIdsChanged);
+
+        const QVector<qint64> fileIds { 1, 42, 1234567890123 };
+        FakeWebSocketServer::sendNotifyFileIds(socket, fileIds);
+
+        // Only the more specific signal should be emitted
+        QVERIFY(fileIdsChangedSpy.wait());
+        QCOMPARE(fileIdsChangedSpy.count(), 1);
+        QCOMPARE(fileIdsChangedSpy.at(0).at(0).value<OCC::Account *>(), account.data());
+        QCOMPARE(fileIdsChangedSpy.at(0).at(1).value<QVector<qint64>>(), fileIds);
+        QCOMPARE(filesChangedSpy.count(), 0);
+    }
+
+    void testOnWebSocketTextMessageReceived_invalidNotifyFileIdMessage_emitFilesChanged()
+    {
+        FakeWebSocketServer fakeServer;
+        auto account = FakeWebSocketServer::createAccount();
+        const auto socket = fakeServer.authenticateAccount(account);
+        QVERIFY(socket);
+        QSignalSpy filesChangedSpy(account->pushNotifications(), &OCC::PushNotifications::filesChanged);
+        QSignalSpy fileIdsChangedSpy(account->pushNotifications(), &OCC::PushNotifications::fileIdsChanged);
+
+        socket->sendTextMessage("notify_file_id {\"not\": \"an array\"}");
+
+        // Fall back to the generic signal
+        QVERIFY(filesChangedSpy.wait());
+        QVERIFY(verifyCalledOnceWithAccount(filesChangedSpy, account));
+        QCOMPARE(fileIdsChangedSpy.count(), 0);
+    }
+
     void testOnWebSocketTextMessageReceived_notifyActivityMessage_emitNotification()
     {
         FakeWebSocketServer fakeServer;
@@ -171,6 +171,52 @@ private slots:
         QVERIFY(completeSpy.findItem("nofileid")->_errorString.contains("file id"));
         QVERIFY(completeSpy.findItem("nopermissions/A")->_errorString.contains("permissions"));
     }
+
+    void testRefreshListing()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        QStringList fullListings;
+        QStringList refreshListings;
+        QMap<QString, QByteArray> detailQueries; // path -> depth
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &req, QIODevice *outgoingData)
+                -> QNetworkReply *{
+            if (req.attribute(QNetworkRequest::CustomVerbAttribute) != "PROPFIND" || !outgoingData)
+                return nullptr;
+            // The fake server sends all properties, whatever is asked for
+            const auto body = outgoingData->peek(outgoingData->bytesAvailable());
+            const auto path = getFilePathFromUrl(req.url());
+            if (!body.contains("checksums"))
+                refreshListings.append(path);
+            else if (!body.contains("permissions"))
+                detailQueries.insert(path, req.rawHeader("Depth"));
+            else
+                fullListings.append(path);
+            return nullptr;
+        });
+
+        // The root only lists changed directories. A has two changed files
+        // that are queried one by one, B has more new files than known ones
+        // and gets a listing with the details.
+        fakeFolder.remoteModifier().appendByte("A/a1");
+        fakeFolder.remoteModifier().insert("A/new");
+        fakeFolder.remoteModifier().mkdir("A/newdir");
+        fakeFolder.remoteModifier().insert("B/new1");
+        fakeFolder.remoteModifier().insert("B/new2");
+        fakeFolder.remoteModifier().insert("B/new3");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        refreshListings.sort();
+        QCOMPARE(refreshListings, QStringList({ "", "A", "B" }));
+        QCOMPARE(detailQueries.keys(), QStringList({ "A/a1", "A/new", "B" }));
+        QCOMPARE(detailQueries.value("A/a1"), QByteArray("0"));
+        QCOMPARE(detailQueries.value("A/new"), QByteArray("0"));
+        QCOMPARE(detailQueries.value("B"), QByteArray("1"));
+        // New directories have nothing to refresh
+        QCOMPARE(fullListings, QStringList({ "A/newdir" }));
+    }
 };
 
 QTEST_GUILESS_MAIN(TestRemoteDiscovery)
@@ -0,0 +1,97 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QLocalSocket>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include "common/utility.h"
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+#include "folderman.h"
+#include "account.h"
+#include "accountstate.h"
+#include "configfile.h"
+#include "theme.h"
+#include "testhelper.h"
+
+using namespace OCC;
+
+class TestSocketApi : public QObject
+{
+    Q_OBJECT
+
+    FolderMan _fm;
+
+private slots:
+    void testRetrieveFileStatusMulti()
+    {
+        if (!Utility::isLinux())
+            QSKIP("The socket path is only known on Linux");
+
+        QTemporaryDir dir;
+        ConfigFile::setConfDir(dir.path()); // we don't want to pollute the user's config file
+        QVERIFY(dir.isValid());
+        QDir dir2(dir.path());
+        QVERIFY(dir2.mkpath("sync"));
+        const QString folderPath = dir2.canonicalPath() + "/sync";
+
+        AccountPtr account = Account::create();
+        account->setCredentials(new HttpCredentialsTest("testuser", "secret"));
+        account->setUrl(QUrl("http://example.de"));
+        AccountStatePtr accountState(new AccountState(account));
+        Folder *folder = FolderMan::instance()->addFolder(accountState.data(), folderDefinition(folderPath));
+        QVERIFY(folder);
+
+        SyncJournalFileRecord record;
+        record._path = "known.txt";
+        record._type = ItemTypeFile;
+        record._etag = "etag";
+        record._fileId = "abcd";
+        record._remotePerm = RemotePermissions::fromDbValue("RW");
+        QVERIFY(folder->journalDb()->setFileRecord(record));
+        folder->journalDb()->commit("test");
+        // The lookups are done by a worker thread with its own connection
+        QVERIFY(folder->journalDb()->allowsReadOnlyConnections());
+
+        QLocalSocket socket;
+        QStringList lines;
+        connect(&socket, &QIODevice::readyRead, this, [&] {
+            while (socket.canReadLine())
+                lines.append(QString::fromUtf8(socket.readLine()).trimmed());
+        });
+        socket.connectToServer(QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation)
+            + "/" + Theme::instance()->appName() + "/socket");
+        QVERIFY(socket.waitForConnected());
+
+        const QStringList files = {
+            folderPath + "/known.txt",
+            folderPath + "/unknown.txt",
+            dir2.canonicalPath() + "/outside.txt",
+        };
+        socket.write("RETRIEVE_FILE_STATUS_MULTI:" + files.join(QChar(0x1e)).toUtf8() + "\n");
+        QTRY_VERIFY(lines.contains("RETRIEVE_FILE_STATUS_MULTI:END"));
+
+        // One status per file, in the order they were asked for, before the end
+        const auto statusLines = lines.mid(lines.indexOf(QRegularExpression("^STATUS:.*")));
+        QCOMPARE(statusLines, QStringList({
+            "STATUS:OK:" + QDir::toNativeSeparators(files.at(0)),
+            "STATUS:NOP:" + QDir::toNativeSeparators(files.at(1)),
+            "STATUS:NOP:" + QDir::toNativeSeparators(files.at(2)),
+            "RETRIEVE_FILE_STATUS_MULTI:END",
+        }));
+
+        // The same as asking for each file
+        lines.clear();
+        socket.write("RETRIEVE_FILE_STATUS:" + files.at(0).toUtf8() + "\n");
+        QTRY_COMPARE(lines, QStringList({ "STATUS:OK:" + QDir::toNativeSeparators(files.at(0)) }));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSocketApi)
+#include "testsocketapi.moc"
@@ -57,6 +57,64 @@ private slots:
         QVERIFY(fakeFolder.currentRemoteState().find("B/b1"));
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
+
+    void testBatchedDelete_data()
+    {
+        QTest::addColumn<bool>("http2");
+
+        QTest::newRow("HTTP/1") << false;
+        QTest::newRow("HTTP/2") << true;
+    }
+
+    void testBatchedDelete()
+    {
+        QFETCH(bool, http2);
+
+        FakeFolder fakeFolder{ FileInfo{} };
+        fakeFolder.account()->setHttp2Supported(http2);
+        fakeFolder.localModifier().mkdir("flat");
+        for (int i = 0; i < 200; ++i)
+            fakeFolder.localModifier().insert(QStringLiteral("flat/file%1").arg(i));
+        QVERIFY(fakeFolder.syncOnce());
+
+        int inFlight = 0;
+        int maxInFlight = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::DeleteOperation)
+                return nullptr;
+            QNetworkReply *reply = nullptr;
+            if (getFilePathFromUrl(request.url()) == QLatin1String("flat/file7"))
+                reply = new FakeErrorReply(op, request, this, 403);
+            else
+                reply = new FakeDeleteReply(fakeFolder.remoteModifier(), op, request, this);
+            maxInFlight = qMax(maxInFlight, ++inFlight);
+            connect(reply, &QNetworkReply::finished, [&] { --inFlight; });
+            return reply;
+        });
+
+        for (int i = 0; i < 200; ++i)
+            fakeFolder.localModifier().remove(QStringLiteral("flat/file%1").arg(i));
+        ItemCompletedSpy completeSpy(fakeFolder);
+        QVERIFY(!fakeFolder.syncOnce());
+
+        // Every item is still reported on its own
+        QCOMPARE(completeSpy.findItem("flat/file7")->_status, SyncFileItem::NormalError);
+        QVERIFY(fakeFolder.currentRemoteState().find("flat/file7"));
+        for (int i = 0; i < 200; ++i) {
+            if (i == 7)
+                continue;
+            const auto path = QStringLiteral("flat/file%1").arg(i);
+            QCOMPARE(completeSpy.findItem(path)->_status, SyncFileItem::Success);
+            QVERIFY(!fakeFolder.currentRemoteState().find(path));
+        }
+
+        const int parallelJobs = fakeFolder.syncEngine().syncOptions()._parallelNetworkJobs;
+        if (http2) {
+            QVERIFY(maxInFlight > parallelJobs);
+        } else {
+            QVERIFY(maxInFlight <= parallelJobs);
+        }
+    }
 };
 
 QTEST_GUILESS_MAIN(TestSyncDelete)
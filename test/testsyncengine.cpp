@@ -745,6 +745,202 @@ private slots:
 
         QCOMPARE(QFileInfo(fakeFolder.localPath() + "foo").lastModified(), datetime);
     }
+
+    // Check that our own writes are recognized so the watcher can ignore them
+    void testWasFileTouched()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        auto &engine = fakeFolder.syncEngine();
+        const auto newFile = QDir::cleanPath(fakeFolder.localPath() + "A/new");
+        const auto renamed = QDir::cleanPath(fakeFolder.localPath() + "B/renamed");
+
+        fakeFolder.remoteModifier().insert("A/new");
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(engine.wasFileTouched(newFile));
+        QVERIFY(!engine.wasFileTouched(QDir::cleanPath(fakeFolder.localPath() + "A/a1")));
+
+        // Touching another file keeps the first one
+        fakeFolder.remoteModifier().rename("B/b1", "B/renamed");
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(engine.wasFileTouched(renamed));
+        QVERIFY(engine.wasFileTouched(newFile));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testStreamingPropagation()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        auto options = fakeFolder.syncEngine().syncOptions();
+        options._streamingPropagation = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        QStringList streamed;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagateSubtree, [&](const SyncFileItemVector &items) {
+            // Streamed subtrees don't start the propagation phase
+            QVERIFY(!fakeFolder.syncEngine().isPropagating());
+            for (const auto &item : items)
+                streamed.append(item->_file);
+        });
+        QSignalSpy propagationStartedSpy(&fakeFolder.syncEngine(), &SyncEngine::propagationStarted);
+
+        fakeFolder.remoteModifier().mkdir("N1");
+        fakeFolder.remoteModifier().insert("N1/x");
+        fakeFolder.remoteModifier().mkdir("N1/sub");
+        fakeFolder.remoteModifier().insert("N1/sub/y");
+        fakeFolder.remoteModifier().mkdir("N2");
+        fakeFolder.remoteModifier().insert("N2/z");
+        fakeFolder.remoteModifier().mkdir("A/newdir");
+        fakeFolder.remoteModifier().insert("A/newdir/f");
+        fakeFolder.remoteModifier().rename("B/b1", "B/b1_renamed");
+        fakeFolder.localModifier().remove("C/c1");
+        ItemCompletedSpy completeSpy(fakeFolder);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        streamed.sort();
+        QCOMPARE(streamed, QStringList({ "N1", "N1/sub", "N1/sub/y", "N1/x", "N2", "N2/z" }));
+        QCOMPARE(propagationStartedSpy.count(), 1);
+        QVERIFY(itemInstruction(completeSpy, "A/newdir/f", CSYNC_INSTRUCTION_NEW));
+        QVERIFY(itemDidCompleteSuccessfully(completeSpy, "N1/sub/y"));
+
+        // The streamed folders are in the database like any other
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("N1/sub/y"), &record));
+        QVERIFY(record.isValid());
+
+        // Nothing left to do
+        streamed.clear();
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(streamed.isEmpty());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testStreamingPropagationDiscoveryError()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        auto options = fakeFolder.syncEngine().syncOptions();
+        options._streamingPropagation = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        int streamedCount = 0;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagateSubtree, [&](const SyncFileItemVector &) {
+            ++streamedCount;
+        });
+
+        // The download of the streamed folder is still running when the
+        // discovery of B fails
+        int getCount = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            const auto path = request.url().path();
+            if (op == QNetworkAccessManager::GetOperation && path.contains("/N1/")) {
+                ++getCount;
+                return new FakeHangingReply(op, request, this);
+            }
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND" && path.endsWith("dav/files/admin/B"))
+                return new DelayedReply<FakeErrorReply>(200, op, request, this, 400);
+            return nullptr;
+        });
+
+        fakeFolder.remoteModifier().mkdir("N1");
+        fakeFolder.remoteModifier().insert("N1/x");
+        QSignalSpy errorSpy(&fakeFolder.syncEngine(), &SyncEngine::syncError);
+        QSignalSpy finishedSpy(&fakeFolder.syncEngine(), &SyncEngine::finished);
+        QVERIFY(!fakeFolder.syncOnce());
+
+        QCOMPARE(streamedCount, 1);
+        QCOMPARE(getCount, 1);
+        QCOMPARE(finishedSpy.count(), 1);
+        QVERIFY(!errorSpy.isEmpty());
+        QVERIFY(errorSpy[0][0].toString().contains("\"B\""));
+
+        // The next sync gets it right
+        fakeFolder.setServerOverride(nullptr);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // Two folders of different accounts sync at the same time
+    void testConcurrentFolderSyncs()
+    {
+        FakeFolder fakeFolderA{ FileInfo::A12_B12_C12_S12() };
+        FakeFolder fakeFolderB{ FileInfo::A12_B12_C12_S12() };
+
+        // Slow uploads, one at a time, so that both propagations overlap
+        for (auto fakeFolder : { &fakeFolderA, &fakeFolderB }) {
+            fakeFolder->setServerOverride([fakeFolder, this](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+                if (op != QNetworkAccessManager::PutOperation)
+                    return nullptr;
+                return new DelayedReply<FakePutReply>(50, fakeFolder->remoteModifier(), op, request, outgoingData->readAll(), this);
+            });
+            fakeFolder->syncEngine().setParallelNetworkJobs(1);
+            fakeFolder->localModifier().insert("A/new1");
+            fakeFolder->localModifier().insert("A/new2");
+            fakeFolder->localModifier().insert("B/new3");
+        }
+        fakeFolderA.remoteModifier().insert("C/onlyA");
+        fakeFolderB.localModifier().remove("S/s1");
+
+        bool bothPropagating = false;
+        connect(&fakeFolderA.syncEngine(), &SyncEngine::itemCompleted, [&](const SyncFileItemPtr &) {
+            if (fakeFolderB.syncEngine().isPropagating())
+                bothPropagating = true;
+        });
+
+        QSignalSpy finishedA(&fakeFolderA.syncEngine(), &SyncEngine::finished);
+        QSignalSpy finishedB(&fakeFolderB.syncEngine(), &SyncEngine::finished);
+        fakeFolderA.scheduleSync();
+        fakeFolderB.scheduleSync();
+        QTRY_VERIFY_WITH_TIMEOUT(finishedA.count() == 1 && finishedB.count() == 1, 10000);
+
+        QVERIFY(finishedA[0][0].toBool());
+        QVERIFY(finishedB[0][0].toBool());
+        QVERIFY(bothPropagating);
+        QCOMPARE(fakeFolderA.currentLocalState(), fakeFolderA.currentRemoteState());
+        QCOMPARE(fakeFolderB.currentLocalState(), fakeFolderB.currentRemoteState());
+        QVERIFY(fakeFolderA.currentLocalState().find("C/onlyA"));
+        QVERIFY(!fakeFolderB.currentRemoteState().find("S/s1"));
+    }
+
+    void testSmallRequestConcurrency_data()
+    {
+        QTest::addColumn<bool>("http2");
+
+        QTest::newRow("HTTP/1") << false;
+        QTest::newRow("HTTP/2") << true;
+    }
+
+    // Multiplexed small uploads are not limited to the parallel network jobs
+    void testSmallRequestConcurrency()
+    {
+        QFETCH(bool, http2);
+
+        FakeFolder fakeFolder{ FileInfo{} };
+        fakeFolder.account()->setHttp2Supported(http2);
+        const auto options = fakeFolder.syncEngine().syncOptions();
+
+        int inFlight = 0;
+        int maxInFlight = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::PutOperation)
+                return nullptr;
+            auto reply = new DelayedReply<FakePutReply>(50, fakeFolder.remoteModifier(), op, request, outgoingData->readAll(), this);
+            maxInFlight = qMax(maxInFlight, ++inFlight);
+            connect(reply, &QNetworkReply::finished, [&] { --inFlight; });
+            return reply;
+        });
+
+        for (int i = 0; i < 100; ++i)
+            fakeFolder.localModifier().insert(QStringLiteral("small%1").arg(i), 10);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        QCOMPARE(options.parallelSmallRequests(false), options._parallelNetworkJobs);
+        QVERIFY(maxInFlight <= options.parallelSmallRequests(http2));
+        if (http2) {
+            QVERIFY(options.parallelSmallRequests(true) > options._parallelNetworkJobs);
+            QVERIFY(maxInFlight > options._parallelNetworkJobs);
+        }
+    }
 };
 
 QTEST_GUILESS_MAIN(TestSyncEngine)
@@ -24,6 +24,7 @@ public:
         : _db((_tempDir.path() + "/sync.db"))
     {
         QVERIFY(_tempDir.isValid());
+        _db.enableReadOnlyConnections();
     }
 
     qint64 dropMsecs(QDateTime time)
@@ -128,6 +129,81 @@ private slots:
         }
     }
 
+    void testHexFieldsStayText_data()
+    {
+        QTest::addColumn<QByteArray>("etag");
+        QTest::addColumn<QByteArray>("checksumHeader");
+
+        QTest::newRow("hex") << QByteArray("5f3a9c0b12e4") << QByteArray("SHA1:00a1b2c3d4e5f60718293a4b5c6d7e8f90a1b2c3");
+        QTest::newRow("odd length") << QByteArray("5f3a9c0b12e") << QByteArray("Adler32:0a1b2c3");
+        QTest::newRow("not hex") << QByteArray("\"abc-123\"") << QByteArray("MD5:mychecksum");
+    }
+
+    void testHexFieldsStayText()
+    {
+        QFETCH(QByteArray, etag);
+        QFETCH(QByteArray, checksumHeader);
+
+        SyncJournalFileRecord record;
+        record._path = "hextext/file";
+        record._etag = etag;
+        record._checksumHeader = checksumHeader;
+        record._remotePerm = RemotePermissions::fromDbValue("RW");
+        QVERIFY(_db.setFileRecord(record));
+        _db.close();
+
+        // Older clients open the same journal, they read these columns as text
+        {
+            SqlDatabase db;
+            QVERIFY(db.openOrCreateReadWrite(_db.databaseFilePath()));
+            SqlQuery query(db);
+            query.prepare("SELECT typeof(md5), typeof(contentChecksum) FROM metadata WHERE path = 'hextext/file';");
+            QVERIFY(query.exec());
+            QVERIFY(query.next().hasData);
+            QCOMPARE(query.stringValue(0), QStringLiteral("text"));
+            QCOMPARE(query.stringValue(1), QStringLiteral("text"));
+            db.close();
+        }
+
+        SyncJournalFileRecord storedRecord;
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("hextext/file"), &storedRecord));
+        QCOMPARE(storedRecord._etag, etag);
+        QCOMPARE(storedRecord._checksumHeader, checksumHeader);
+
+        _db.deleteFileRecord("hextext", true);
+    }
+
+    void testParentBackfill()
+    {
+        SyncJournalFileRecord record;
+        record._path = "olderclient/file";
+        record._etag = "5f3a9c0b12e4";
+        record._remotePerm = RemotePermissions::fromDbValue("RW");
+        QVERIFY(_db.setFileRecord(record));
+        _db.close();
+
+        // Like a client that doesn't know the parent column wrote the row
+        {
+            SqlDatabase db;
+            QVERIFY(db.openOrCreateReadWrite(_db.databaseFilePath()));
+            SqlQuery query(db);
+            query.prepare("UPDATE metadata SET parent = NULL WHERE path = 'olderclient/file';");
+            QVERIFY(query.exec());
+            db.close();
+        }
+
+        // Reopening the journal fills the column in again
+        int children = 0;
+        QVERIFY(_db.listFilesInPath("olderclient", [&](const SyncJournalFileRecord &rec) {
+            QCOMPARE(rec._path, record._path);
+            QCOMPARE(rec._etag, record._etag);
+            ++children;
+        }));
+        QCOMPARE(children, 1);
+
+        _db.deleteFileRecord("olderclient", true);
+    }
+
     void testDownloadInfo()
     {
         using Info = SyncJournalDb::DownloadInfo;
@@ -183,6 +259,174 @@ private slots:
         QCOMPARE(record.numericFileId(), QByteArray("123456789"));
     }
 
+    void testFileRecordsByNumericFileId()
+    {
+        auto makeEntry = [&](const QByteArray &path, const QByteArray &fileId) {
+            SyncJournalFileRecord record;
+            record._path = path;
+            record._type = ItemTypeFile;
+            record._etag = "etag";
+            record._fileId = fileId;
+            record._remotePerm = RemotePermissions::fromDbValue("RW");
+            QVERIFY(_db.setFileRecord(record));
+        };
+        auto pathsForId = [&](qint64 numericFileId) {
+            QByteArrayList paths;
+            _db.getFileRecordsByNumericFileId(numericFileId, [&](const SyncJournalFileRecord &record) {
+                paths.append(record._path);
+            });
+            paths.sort();
+            return paths;
+        };
+
+        makeEntry("numericid/a", "00000042ocidbla");
+        makeEntry("numericid/b", "00000420ocidbla");
+        makeEntry("numericid/c", "123456789ocidbla");
+        makeEntry("numericid/d", "1234567890ocidbla");
+
+        QCOMPARE(pathsForId(42), QByteArrayList({ "numericid/a" }));
+        QCOMPARE(pathsForId(420), QByteArrayList({ "numericid/b" }));
+        QCOMPARE(pathsForId(123456789), QByteArrayList({ "numericid/c" }));
+        QCOMPARE(pathsForId(1234567890), QByteArrayList({ "numericid/d" }));
+        QCOMPARE(pathsForId(4), QByteArrayList());
+
+        _db.deleteFileRecord("numericid", true);
+    }
+
+    void testReadOnlyConnection()
+    {
+        if (!_db.allowsReadOnlyConnections())
+            QSKIP("The journal does not allow read-only connections");
+
+        SyncJournalFileRecord record;
+        record._path = "readonly/file";
+        record._type = ItemTypeFile;
+        record._etag = "etag";
+        record._fileId = "abcd";
+        record._remotePerm = RemotePermissions::fromDbValue("RW");
+        QVERIFY(_db.setFileRecord(record));
+        _db.commit("test");
+
+        SyncJournalReader reader(_db.databaseFilePath());
+        SyncJournalFileRecord storedRecord;
+        QVERIFY(reader.getFileRecord(QByteArrayLiteral("readonly/file"), &storedRecord));
+        QVERIFY(storedRecord == record);
+        QVERIFY(reader.getFileRecord(QByteArrayLiteral("readonly/missing"), &storedRecord));
+        QVERIFY(!storedRecord.isValid());
+
+        // Committed changes are visible to the open reader
+        record._etag = "changed";
+        QVERIFY(_db.setFileRecord(record));
+        _db.commit("test");
+        QVERIFY(reader.getFileRecord(QByteArrayLiteral("readonly/file"), &storedRecord));
+        QCOMPARE(storedRecord._etag, QByteArray("changed"));
+
+        // Readers never create a journal
+        const QString missingDb = _tempDir.path() + "/missing.db";
+        SyncJournalReader missingReader(missingDb);
+        QVERIFY(!missingReader.getFileRecord(QByteArrayLiteral("readonly/file"), &storedRecord));
+        QVERIFY(!QFile::exists(missingDb));
+
+        _db.deleteFileRecord("readonly", true);
+    }
+
+    void testPooledReads()
+    {
+        SyncJournalFileRecord record;
+        record._path = "pooled/file";
+        record._type = ItemTypeFile;
+        record._etag = "etag";
+        record._fileId = "efgh";
+        record._inode = 4242;
+        record._remotePerm = RemotePermissions::fromDbValue("RW");
+        QVERIFY(_db.setFileRecord(record));
+        _db.commit("test");
+
+        SyncJournalFileRecord storedRecord;
+        QVERIFY(_db.getFileRecordByInode(4242, &storedRecord));
+        QVERIFY(storedRecord == record);
+
+        // Uncommitted changes are visible to the reads, too
+        record._etag = "uncommitted";
+        QVERIFY(_db.setFileRecord(record));
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("pooled/file"), &storedRecord));
+        QCOMPARE(storedRecord._etag, QByteArray("uncommitted"));
+
+        SyncJournalFileRecord newRecord = record;
+        newRecord._path = "pooled/new";
+        newRecord._fileId = "ijkl";
+        newRecord._inode = 4243;
+        QVERIFY(_db.setFileRecord(newRecord));
+        QStringList listed;
+        QVERIFY(_db.listFilesInPath("pooled", [&](const SyncJournalFileRecord &rec) { listed.append(rec.path()); }));
+        QCOMPARE(listed, QStringList({ "pooled/file", "pooled/new" }));
+
+        _db.commit("test");
+        QStringList below;
+        QVERIFY(_db.getFilesBelowPath("pooled", [&](const SyncJournalFileRecord &rec) { below.append(rec.path()); }));
+        QCOMPARE(below, listed);
+
+        _db.deleteFileRecord("pooled", true);
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("pooled/new"), &storedRecord));
+        QVERIFY(!storedRecord.isValid());
+        _db.commit("test");
+    }
+
+    void testMaintenance()
+    {
+        // Journals end up with incremental vacuum
+        auto stats = _db.performMaintenance();
+        QVERIFY(stats.incrementalVacuum);
+        QVERIFY(stats.pageSize > 0);
+
+        for (int i = 0; i < 2000; ++i) {
+            SyncJournalFileRecord record;
+            record._path = "maintenance/file" + QByteArray::number(i);
+            record._etag = QByteArray(64, 'x');
+            record._remotePerm = RemotePermissions::fromDbValue("RW");
+            QVERIFY(_db.setFileRecord(record));
+        }
+        _db.commit("test");
+        const auto filledStats = _db.databaseStats();
+        QVERIFY(filledStats.pageCount > stats.pageCount);
+
+        _db.deleteFileRecord("maintenance", true);
+        _db.commit("test");
+        QVERIFY(_db.databaseStats().freePages > 0);
+
+        stats = _db.performMaintenance();
+        QVERIFY(stats.pageCount < filledStats.pageCount);
+        QCOMPARE(stats.freePages, qint64(0));
+
+        // The journal stays usable
+        SyncJournalFileRecord record;
+        record._path = "maintenance/after";
+        record._remotePerm = RemotePermissions::fromDbValue("RW");
+        QVERIFY(_db.setFileRecord(record));
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("maintenance/after"), &record));
+        QVERIFY(record.isValid());
+        _db.deleteFileRecord("maintenance", true);
+    }
+
+    void testMaintenanceConvertsOldJournal()
+    {
+        // A journal of a client that didn't enable incremental vacuum
+        const auto dbFile = _tempDir.path() + "/old.db";
+        sqlite3 *oldDb = nullptr;
+        QCOMPARE(sqlite3_open(dbFile.toUtf8().constData(), &oldDb), SQLITE_OK);
+        QCOMPARE(sqlite3_exec(oldDb, "CREATE TABLE old(x);", nullptr, nullptr, nullptr), SQLITE_OK);
+        QCOMPARE(sqlite3_close(oldDb), SQLITE_OK);
+
+        SyncJournalDb journal(dbFile);
+        QVERIFY(!journal.databaseStats().incrementalVacuum);
+
+        // Converted right away, however little of it is unused
+        const auto stats = journal.performMaintenance();
+        QVERIFY(stats.incrementalVacuum);
+        QCOMPARE(stats.freePages, qint64(0));
+        journal.close();
+    }
+
     void testConflictRecord()
     {
         ConflictRecord record;
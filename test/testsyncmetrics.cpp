@@ -0,0 +1,84 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include "common/syncmetrics.h"
+
+using namespace OCC;
+
+class TestSyncMetrics : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testHistogram()
+    {
+        SyncMetrics::Histogram histogram;
+        QCOMPARE(histogram.quantile(0.5), qint64(0));
+
+        for (int i = 1; i <= 100; ++i)
+            histogram.record(i);
+        histogram.record(-5);
+        QCOMPARE(histogram.count(), quint64(101));
+        QCOMPARE(histogram.sum(), qint64(5050));
+        QCOMPARE(histogram.max(), qint64(100));
+        // Power of two buckets: the median 50 is in [32, 64)
+        QCOMPARE(histogram.quantile(0.5), qint64(63));
+        QCOMPARE(histogram.quantile(0.99), qint64(100));
+        QCOMPARE(histogram.quantile(0), qint64(0));
+    }
+
+    void testRegistry()
+    {
+        auto metrics = SyncMetrics::instance();
+        auto counter = metrics->counter(QStringLiteral("test.counter"));
+        QCOMPARE(metrics->counter(QStringLiteral("test.counter")), counter);
+        counter->add();
+        counter->add(2);
+
+        auto rate = metrics->rate(QStringLiteral("test.bytes"));
+        rate->add(1000, 500000);
+        rate->add(1000, 500000);
+        QCOMPARE(rate->perSecond(), 2000.0);
+
+        const auto json = metrics->toJson();
+        QCOMPARE(json["counters"].toObject()["test.counter"].toInt(), 3);
+        QCOMPARE(json["rates"].toObject()["test.bytes"].toObject()["perSecond"].toDouble(), 2000.0);
+
+        QTemporaryDir dir;
+        const auto fileName = dir.path() + QStringLiteral("/metrics.json");
+        QVERIFY(metrics->writeToFile(fileName));
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE(QJsonDocument::fromJson(file.readAll()).object(), metrics->toJson());
+    }
+
+    void testSyncRecordsMetrics()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        auto metrics = SyncMetrics::instance();
+        const auto journalQueries = metrics->histogram(QStringLiteral("journal.query_us"))->count();
+        const auto propfinds = metrics->histogram(QStringLiteral("http.latency_ms.PROPFIND"))->count();
+        const auto directories = metrics->rate(QStringLiteral("discovery.directories"))->amount();
+
+        fakeFolder.remoteModifier().insert("A/new");
+        fakeFolder.remoteModifier().mkdir("D");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        QVERIFY(metrics->histogram(QStringLiteral("journal.query_us"))->count() > journalQueries);
+        QVERIFY(metrics->histogram(QStringLiteral("http.latency_ms.PROPFIND"))->count() > propfinds);
+        QVERIFY(metrics->histogram(QStringLiteral("http.latency_ms.GET"))->count() > 0);
+        // At least the root and the new D
+        QVERIFY(metrics->rate(QStringLiteral("discovery.directories"))->amount() >= directories + 2);
+        QCOMPARE(metrics->counter(QStringLiteral("http.in_flight"))->value(), qint64(0));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSyncMetrics)
+#include "testsyncmetrics.moc"
@@ -969,6 +969,48 @@ private slots:
         QVERIFY(!fakeFolder.currentRemoteState().find(dest));
     }
 
+    // Many moves in one folder are pipelined instead of using the propagator's few slots
+    void testBatchedMove()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        fakeFolder.account()->setHttp2Supported(true);
+        fakeFolder.localModifier().mkdir("flat");
+        fakeFolder.localModifier().mkdir("dest");
+        for (int i = 0; i < 200; ++i)
+            fakeFolder.localModifier().insert(QStringLiteral("flat/file%1").arg(i));
+        QVERIFY(fakeFolder.syncOnce());
+
+        int inFlight = 0;
+        int maxInFlight = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) != "MOVE")
+                return nullptr;
+            auto reply = new FakeMoveReply(fakeFolder.remoteModifier(), op, request, this);
+            maxInFlight = qMax(maxInFlight, ++inFlight);
+            connect(reply, &QNetworkReply::finished, [&] { --inFlight; });
+            return reply;
+        });
+
+        // Renames within the folder and moves to another one
+        for (int i = 0; i < 200; ++i) {
+            const auto source = QStringLiteral("flat/file%1").arg(i);
+            fakeFolder.localModifier().rename(source, i % 2 ? QStringLiteral("flat/renamed%1").arg(i) : QStringLiteral("dest/file%1").arg(i));
+        }
+        ItemCompletedSpy completeSpy(fakeFolder);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        for (int i = 0; i < 200; ++i)
+            QVERIFY(itemSuccessfulMove(completeSpy, i % 2 ? QStringLiteral("flat/renamed%1").arg(i) : QStringLiteral("dest/file%1").arg(i)));
+        QVERIFY(maxInFlight > fakeFolder.syncEngine().syncOptions()._parallelNetworkJobs);
+
+        // The moved files keep their records
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("dest/file0"), &record));
+        QVERIFY(record.isValid());
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("flat/file0"), &record));
+        QVERIFY(!record.isValid());
+    }
 };
 
 QTEST_GUILESS_MAIN(TestSyncMove)
@@ -0,0 +1,104 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "common/synctrace.h"
+
+using namespace OCC;
+
+class TestSyncTrace : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testRoundTrip()
+    {
+        QTemporaryDir dir;
+        const auto fileName = dir.path() + QStringLiteral("/sync.trace");
+
+        QVERIFY(!SyncTrace::isEnabled());
+        QVERIFY(SyncTrace::start(fileName));
+        QVERIFY(SyncTrace::isEnabled());
+        // Names of any length, repeated names refer to the same definition
+        const QString longName = QStringLiteral("A/").repeated(40) + QStringLiteral("file ü");
+        SyncTrace::begin(SyncTrace::Discovery, QStringLiteral("A"), 1);
+        SyncTrace::begin(SyncTrace::Propagation, longName, 2, 1234);
+        SyncTrace::end(SyncTrace::Propagation, 2, 1234);
+        {
+            SyncTrace::Scope scope(SyncTrace::Journal, "getFileRecord");
+        }
+        SyncTrace::end(SyncTrace::Discovery, 1);
+        SyncTrace::begin(SyncTrace::Discovery, QStringLiteral("A"), 3);
+        SyncTrace::stop();
+        QVERIFY(!SyncTrace::isEnabled());
+
+        // Nothing is recorded after stopping
+        SyncTrace::end(SyncTrace::Discovery, 3);
+
+        SyncTraceReader reader;
+        QVERIFY(reader.open(fileName));
+        QVERIFY(qAbs(reader.startTime() - QDateTime::currentMSecsSinceEpoch()) < 60 * 1000);
+
+        QVector<SyncTraceReader::Event> events;
+        SyncTraceReader::Event event;
+        while (reader.next(&event))
+            events.append(event);
+        QVERIFY(reader.errorString().isEmpty());
+        QCOMPARE(events.size(), 6);
+
+        QCOMPARE(events[0].category, SyncTrace::Discovery);
+        QCOMPARE(events[0].phase, SyncTrace::Begin);
+        QCOMPARE(events[0].name, QStringLiteral("A"));
+        QCOMPARE(events[0].span, quint64(1));
+
+        QCOMPARE(events[1].name, longName);
+        QCOMPARE(events[1].value, qint64(1234));
+        QCOMPARE(events[2].phase, SyncTrace::End);
+        QCOMPARE(events[2].span, quint64(2));
+        QVERIFY(events[2].name.isEmpty());
+
+        QCOMPARE(events[3].category, SyncTrace::Journal);
+        QCOMPARE(events[3].phase, SyncTrace::Complete);
+        QCOMPARE(events[3].name, QStringLiteral("getFileRecord"));
+        QVERIFY(events[3].value >= 0);
+
+        QCOMPARE(events[5].name, QStringLiteral("A"));
+        for (int i = 1; i < events.size(); ++i)
+            QVERIFY(events[i].timestamp >= events[i - 1].timestamp);
+        QCOMPARE(events[0].thread, events[5].thread);
+    }
+
+    void testDamagedTrace()
+    {
+        QTemporaryDir dir;
+        const auto fileName = dir.path() + QStringLiteral("/sync.trace");
+
+        QVERIFY(SyncTrace::start(fileName));
+        SyncTrace::begin(SyncTrace::Http, QStringLiteral("GET /"), 1);
+        SyncTrace::stop();
+
+        SyncTraceReader reader;
+        {
+            QFile file(fileName);
+            QVERIFY(file.resize(file.size() - 1));
+        }
+        QVERIFY(reader.open(fileName));
+        SyncTraceReader::Event event;
+        QVERIFY(!reader.next(&event));
+        QVERIFY(!reader.errorString().isEmpty());
+
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write("not a trace");
+        file.close();
+        SyncTraceReader other;
+        QVERIFY(!other.open(fileName));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSyncTrace)
+#include "testsynctrace.moc"
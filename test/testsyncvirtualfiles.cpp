@@ -10,6 +10,7 @@
 #include "common/vfs.h"
 #include "config.h"
 #include <syncengine.h>
+#include "propagatevirtualfilebatch.h"
 
 using namespace OCC;
 
@@ -856,6 +857,54 @@ private slots:
         QCOMPARE(fakeFolder.currentRemoteState(), expectedRemoteState);
     }
 
+    // Placeholders of many files in a directory are changed in batches, see PropagateVirtualFileBatch
+    void testManyPlaceholders()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        setupVfs(fakeFolder);
+
+        auto setPin = [&] (const QByteArray &path, PinState state) {
+            fakeFolder.syncJournal().internalPinStates().setForPath(path, state);
+        };
+
+        // More than fit in one batch
+        const int fileCount = PropagateVirtualFileBatch::maxBatchSize() + 10;
+        fakeFolder.remoteModifier().mkdir("many");
+        for (int i = 0; i < fileCount; ++i)
+            fakeFolder.remoteModifier().insert(QStringLiteral("many/file%1").arg(i), 10);
+
+        ItemCompletedSpy completeSpy(fakeFolder);
+        QVERIFY(fakeFolder.syncOnce());
+        for (int i = 0; i < fileCount; ++i) {
+            const auto placeholder = QStringLiteral("many/file%1" DVSUFFIX).arg(i);
+            QVERIFY(fakeFolder.currentLocalState().find(placeholder));
+            QCOMPARE(dbRecord(fakeFolder, placeholder)._type, ItemTypeVirtualFile);
+            QCOMPARE(completeSpy.findItem(placeholder)->_status, SyncFileItem::Success);
+        }
+
+        // Hydrate them all, then dehydrate them all because of their pin state
+        setPin("many", PinState::AlwaysLocal);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        completeSpy.clear();
+        setPin("many", PinState::OnlineOnly);
+        QVERIFY(fakeFolder.syncOnce());
+        for (int i = 0; i < fileCount; ++i) {
+            const auto file = QStringLiteral("many/file%1").arg(i);
+            const auto placeholder = file + DVSUFFIX;
+            QVERIFY(!fakeFolder.currentLocalState().find(file));
+            QVERIFY(fakeFolder.currentLocalState().find(placeholder));
+            QVERIFY(!dbRecord(fakeFolder, file).isValid());
+            QCOMPARE(dbRecord(fakeFolder, placeholder)._type, ItemTypeVirtualFile);
+            QCOMPARE(completeSpy.findItem(placeholder)->_type, ItemTypeVirtualFileDehydration);
+        }
+
+        auto expectedLocalState = fakeFolder.currentLocalState();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), expectedLocalState);
+    }
+
     void testWipeVirtualSuffixFiles()
     {
         FakeFolder fakeFolder{ FileInfo{} };
@@ -0,0 +1,104 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+#include <transfergovernor.h>
+
+using namespace OCC;
+
+/* Syncs many new files and returns the highest number of requests that were
+ * already running when another one was sent */
+static int maxRequestsSeenDuringSync()
+{
+    FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+    for (int i = 0; i < 20; ++i) {
+        fakeFolder.remoteModifier().insert(QStringLiteral("A/remote%1").arg(i));
+        fakeFolder.localModifier().insert(QStringLiteral("B/local%1").arg(i));
+    }
+
+    int maxSeen = 0;
+    const auto url = fakeFolder.account()->url();
+    fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &, QIODevice *) -> QNetworkReply * {
+        maxSeen = qMax(maxSeen, TransferGovernor::instance()->activeRequests(url));
+        return nullptr;
+    });
+
+    if (!fakeFolder.syncOnce())
+        return -1;
+    if (fakeFolder.currentLocalState() != fakeFolder.currentRemoteState())
+        return -1;
+    return maxSeen;
+}
+
+class TestTransferGovernor : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanup()
+    {
+        TransferGovernor::instance()->setMaxRequestsPerHost(0);
+        TransferGovernor::instance()->setThroughputLimits(0, 0);
+    }
+
+    void testEffectiveLimit()
+    {
+        // Without a global limit the sync's own limit applies
+        QCOMPARE(TransferGovernor::effectiveLimit(0, 0, 3), qint64(0));
+        QCOMPARE(TransferGovernor::effectiveLimit(1000, 0, 3), qint64(1000));
+        QCOMPARE(TransferGovernor::effectiveLimit(-75, 0, 3), qint64(-75));
+
+        // The global limit is shared evenly
+        QCOMPARE(TransferGovernor::effectiveLimit(0, 3000, 3), qint64(1000));
+        QCOMPARE(TransferGovernor::effectiveLimit(-75, 3000, 3), qint64(1000));
+        QCOMPARE(TransferGovernor::effectiveLimit(0, 3000, 0), qint64(3000));
+
+        // The lower of both wins
+        QCOMPARE(TransferGovernor::effectiveLimit(500, 3000, 3), qint64(500));
+        QCOMPARE(TransferGovernor::effectiveLimit(2000, 3000, 3), qint64(1000));
+    }
+
+    void testRequestAccounting()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        const auto url = fakeFolder.account()->url();
+        QCOMPARE(TransferGovernor::instance()->freeRequestSlots(url), std::numeric_limits<int>::max());
+
+        fakeFolder.remoteModifier().insert("A/new");
+        QVERIFY(fakeFolder.syncOnce());
+
+        // All requests are done and the host shows up in the allocation
+        QCOMPARE(TransferGovernor::instance()->activeRequests(url), 0);
+        const auto allocation = TransferGovernor::instance()->allocation();
+        auto host = std::find_if(allocation.begin(), allocation.end(), [&](const TransferGovernor::HostAllocation &a) {
+            return a.host == url.host();
+        });
+        QVERIFY(host != allocation.end());
+        QVERIFY(host->startedRequests > 0);
+        QVERIFY(host->peakRequests > 0);
+
+        TransferGovernor::instance()->setMaxRequestsPerHost(4);
+        QCOMPARE(TransferGovernor::instance()->freeRequestSlots(url), 4);
+    }
+
+    void testMaxRequestsPerHost()
+    {
+        const int unlimited = maxRequestsSeenDuringSync();
+        QVERIFY(unlimited > 2);
+
+        TransferGovernor::instance()->setMaxRequestsPerHost(2);
+        const int limited = maxRequestsSeenDuringSync();
+        QVERIFY(limited >= 0);
+        // A sync may always keep one request of its own going on top
+        QVERIFY(limited <= 2);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestTransferGovernor)
+#include "testtransfergovernor.moc"